@@ -0,0 +1,656 @@
+#include "kernel.h"
+#include "linux_bridge.h"
+#include "windows_bridge.h"
+#include "kcl_interpreter.h"
+#include "kcl_aot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define bench_mkdir(path) _mkdir(path)
+#else
+#include <unistd.h>
+#define bench_mkdir(path) mkdir(path, 0755)
+#endif
+
+#define BENCH_START(name) printf("Benchmark %s\n", name)
+
+#ifdef _WIN32
+#define BENCH_LINUX_ROOT "C:\\tmp\\kurono_bench_linux"
+#define BENCH_KCL_CACHE "C:\\tmp\\kurono_bench_kcl"
+#else
+#define BENCH_LINUX_ROOT "/tmp/kurono_bench_linux"
+#define BENCH_KCL_CACHE "/tmp/kurono_bench_kcl"
+#endif
+
+static void bench_populate_linux_root(const char* root) {
+    char path[512];
+    
+    bench_mkdir(root);
+    snprintf(path, sizeof(path), "%s/bin", root);
+    bench_mkdir(path);
+    snprintf(path, sizeof(path), "%s/usr", root);
+    bench_mkdir(path);
+    snprintf(path, sizeof(path), "%s/usr/bin", root);
+    bench_mkdir(path);
+    
+    size_t command_count = 0;
+    const char* const* commands = linux_bridge_common_commands(&command_count);
+    for (size_t i = 0; i < command_count; i++) {
+        snprintf(path, sizeof(path), "%s/usr/bin/%s", root, commands[i]);
+        FILE* file = fopen(path, "w");
+        if (file) fclose(file);
+    }
+}
+
+static CommandRegistry* bench_build_full_registry(void) {
+    CommandRegistry* registry = command_registry_create();
+    if (!registry) return NULL;
+    
+    bench_populate_linux_root(BENCH_LINUX_ROOT);
+    LinuxBridge* linux_bridge = linux_bridge_create(BENCH_LINUX_ROOT);
+    if (linux_bridge) {
+        linux_bridge_register_commands(linux_bridge, registry);
+        linux_bridge_destroy(linux_bridge);
+    }
+    
+    WindowsBridge* windows_bridge = windows_bridge_create("C:\\kurono\\windows");
+    if (windows_bridge) {
+        windows_bridge_register_commands(windows_bridge, registry);
+        windows_bridge_destroy(windows_bridge);
+    }
+    
+    KernelContext kernel = { false, ENV_KURONO, NULL, NULL };
+    KCLContext* kcl = kcl_context_create(&kernel);
+    if (kcl) {
+        kcl_register_commands(kcl, registry);
+        kcl_context_destroy(kcl);
+    }
+    
+    return registry;
+}
+
+// Approximate glibc chunk size for a malloc of n bytes on a 64-bit target
+static size_t bench_malloc_chunk(size_t n) {
+    size_t chunk = (n + sizeof(size_t) + 15) & ~(size_t)15;
+    return chunk < 32 ? 32 : chunk;
+}
+
+static void bench_report_registry_memory(const char* label, CommandRegistry* registry) {
+    // Model the previous layout: one realloc'd CommandEntry array starting at
+    // 100 slots, plus three strdup'd strings per entry
+    struct LegacyEntry { char* name; char* path; EnvironmentType env; char* description; };
+    size_t legacy_capacity = 100;
+    while (legacy_capacity < registry->count) legacy_capacity *= 2;
+    size_t legacy_bytes = bench_malloc_chunk(sizeof(CommandRegistry)) +
+                          bench_malloc_chunk(sizeof(struct LegacyEntry) * legacy_capacity);
+    size_t legacy_blocks = 2;
+    
+    for (size_t g = 0; g < registry->group_count; g++) {
+        CommandView group = command_group_view(&registry->groups[g]);
+        for (size_t i = 0; i < group.count; i++) {
+            char description[512];
+            size_t description_len = command_entry_format_description(group.entries[i], description, sizeof(description));
+            legacy_bytes += bench_malloc_chunk(strlen(group.entries[i]->name) + 1);
+            legacy_bytes += bench_malloc_chunk(strlen(group.entries[i]->path) + 1);
+            legacy_bytes += bench_malloc_chunk(description_len + 1);
+            legacy_blocks += 3;
+        }
+    }
+    
+    CommandRegistryMemory usage;
+    command_registry_memory_usage(registry, &usage);
+    
+    printf("  %s\n", label);
+    printf("  entries:            %zu (%zu names, %zu unique strings)\n", usage.entry_count, usage.group_count, usage.string_count);
+    printf("  legacy layout:      %zu bytes in %zu heap blocks\n", legacy_bytes, legacy_blocks);
+    printf("  arena layout:       %zu bytes in %zu heap blocks\n", usage.total_bytes, usage.heap_blocks);
+    printf("    arena used:       %zu of %zu bytes reserved\n", usage.arena_used, usage.arena_reserved);
+    printf("    hash indexes:     %zu bytes\n", usage.index_bytes);
+}
+
+void bench_registry_memory(void) {
+    BENCH_START("Registry memory footprint");
+    
+    CommandRegistry* registry = bench_build_full_registry();
+    if (!registry) {
+        printf("  failed to build registry\n");
+        return;
+    }
+    
+    bench_report_registry_memory("Bridge registration set:", registry);
+    
+    // A session with a few thousand package commands on top of the bridges
+    char name[64];
+    char path[128];
+    for (int i = 0; i < 3000; i++) {
+        snprintf(name, sizeof(name), "pkg-tool-%d", i);
+        snprintf(path, sizeof(path), "/kurono/packages/bin/pkg-tool-%d", i);
+        command_registry_add_template(registry, name, path, ENV_KURONO, "Package command: %s");
+    }
+    printf("\n");
+    bench_report_registry_memory("Bridges plus 3000 package commands:", registry);
+    
+    command_registry_destroy(registry);
+}
+
+static double bench_seconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void bench_output_capture(void) {
+    BENCH_START("Output capture");
+    
+    // Feed the same stream through the old fgets/strcat loop and through an
+    // OutputBuffer, the way the bridges drain a popen'd pipe
+    const size_t sizes[] = { 256 * 1024, 1024 * 1024, 2 * 1024 * 1024 };
+    char line[128];
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        FILE* file = tmpfile();
+        if (!file) {
+            printf("  failed to create temporary file\n");
+            return;
+        }
+        size_t written = 0;
+        for (int i = 0; written < sizes[s]; i++) {
+            int n = snprintf(line, sizeof(line), "/usr/share/kurono/packages/file-%08d.txt\n", i);
+            fwrite(line, 1, (size_t)n, file);
+            written += (size_t)n;
+        }
+        
+        rewind(file);
+        clock_t start = clock();
+        char buffer[1024];
+        char* legacy = (char*)malloc(1);
+        legacy[0] = '\0';
+        while (fgets(buffer, sizeof(buffer), file) != NULL) {
+            legacy = (char*)realloc(legacy, strlen(legacy) + strlen(buffer) + 1);
+            strcat(legacy, buffer);
+        }
+        double legacy_time = bench_seconds(start);
+        
+        rewind(file);
+        start = clock();
+        OutputBuffer output;
+        output_buffer_init(&output);
+        output_buffer_read_file(&output, file);
+        double buffer_time = bench_seconds(start);
+        
+        printf("  %5zu KiB: fgets/strcat %8.3f ms, OutputBuffer %8.3f ms%s\n",
+               written / 1024, legacy_time * 1000.0, buffer_time * 1000.0,
+               strcmp(legacy, output.data) == 0 ? "" : " (MISMATCH)");
+        
+        free(legacy);
+        output_buffer_free(&output);
+        fclose(file);
+    }
+}
+
+void bench_path_resolution(void) {
+    BENCH_START("Linux path resolution");
+    
+    bench_populate_linux_root(BENCH_LINUX_ROOT);
+    LinuxBridge* bridge = linux_bridge_create(BENCH_LINUX_ROOT);
+    if (!bridge) {
+        printf("  failed to create bridge\n");
+        return;
+    }
+    
+    size_t command_count = 0;
+    const char* const* commands = linux_bridge_common_commands(&command_count);
+    const char* missing[] = { "kurono-missing-a", "kurono-missing-b", "kurono-missing-c", NULL };
+    const int rounds = 2000;
+    size_t lookups = 0;
+    
+    // The previous implementation: format and stat bin, then usr/bin
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < command_count; i++) {
+            char path[512];
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%s", bridge->bin_path, commands[i]);
+            if (stat(path, &st) != 0) {
+                snprintf(path, sizeof(path), "%s/%s", bridge->usr_bin_path, commands[i]);
+                stat(path, &st);
+            }
+            lookups++;
+        }
+    }
+    double stat_time = bench_seconds(start);
+    
+    start = clock();
+    size_t cached_lookups = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < command_count; i++, cached_lookups++) {
+            linux_bridge_is_command_available(bridge, commands[i]);
+        }
+        for (int i = 0; missing[i] != NULL; i++, cached_lookups++) {
+            linux_bridge_is_command_available(bridge, missing[i]);
+        }
+    }
+    double cached_time = bench_seconds(start);
+    
+    printf("  stat per lookup:    %8.3f ms for %zu lookups (%.0f ns/lookup)\n",
+           stat_time * 1000.0, lookups, stat_time * 1e9 / lookups);
+    printf("  bridge resolution:  %8.3f ms for %zu lookups (%.0f ns/lookup, misses included)\n",
+           cached_time * 1000.0, cached_lookups, cached_time * 1e9 / cached_lookups);
+    
+    linux_bridge_destroy(bridge);
+}
+
+void bench_command_sets(void) {
+    BENCH_START("Static command set membership");
+    
+    size_t command_count = 0;
+    const char* const* commands = linux_bridge_common_commands(&command_count);
+    
+    // Every listed command plus as many names that are not listed
+    const char* probes[256];
+    char missing[128][32];
+    size_t probe_count = 0;
+    for (size_t i = 0; i < command_count && probe_count < 128; i++) probes[probe_count++] = commands[i];
+    for (size_t i = 0; i < command_count && i < 128; i++) {
+        snprintf(missing[i], sizeof(missing[i]), "%s-x", commands[i]);
+        probes[probe_count++] = missing[i];
+    }
+    
+    const int rounds = 20000;
+    volatile size_t hits = 0;
+    
+    // The previous implementation: strcmp down the list until a match
+    clock_t start = clock();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t p = 0; p < probe_count; p++) {
+            for (size_t i = 0; i < command_count; i++) {
+                if (strcmp(commands[i], probes[p]) == 0) {
+                    hits = hits + 1;
+                    break;
+                }
+            }
+        }
+    }
+    double linear_time = bench_seconds(start);
+    size_t linear_hits = hits;
+    
+    hits = 0;
+    start = clock();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t p = 0; p < probe_count; p++) {
+            if (linux_bridge_is_known_command(probes[p])) hits = hits + 1;
+        }
+    }
+    double hashed_time = bench_seconds(start);
+    
+    size_t lookups = (size_t)rounds * probe_count;
+    printf("  linear scan:        %8.3f ms for %zu lookups (%.1f ns/lookup, %zu hits)\n",
+           linear_time * 1000.0, lookups, linear_time * 1e9 / lookups, linear_hits);
+    printf("  perfect hash:       %8.3f ms for %zu lookups (%.1f ns/lookup, %zu hits)\n",
+           hashed_time * 1000.0, lookups, hashed_time * 1e9 / lookups, (size_t)hits);
+}
+
+#ifdef _WIN32
+#define BENCH_DISCOVERY_ROOT "C:\\tmp\\kurono_bench_discovery"
+#else
+#define BENCH_DISCOVERY_ROOT "/tmp/kurono_bench_discovery"
+#endif
+
+void bench_command_discovery(void) {
+    BENCH_START("Linux command discovery");
+    
+    // A root shaped like a desktop install: a few hundred tools in bin and
+    // a few thousand in usr/bin
+    bench_populate_linux_root(BENCH_DISCOVERY_ROOT);
+    char path[512];
+    for (int i = 0; i < 3000; i++) {
+        snprintf(path, sizeof(path), "%s/%s/tool-%04d", BENCH_DISCOVERY_ROOT, i < 300 ? "bin" : "usr/bin", i);
+        FILE* file = fopen(path, "w");
+        if (file) fclose(file);
+    }
+    
+    LinuxBridge* bridge = linux_bridge_create(BENCH_DISCOVERY_ROOT);
+    if (!bridge) {
+        printf("  failed to create bridge\n");
+        return;
+    }
+    
+    const int rounds = 20;
+    clock_t start = clock();
+    size_t listed = 0;
+    for (int r = 0; r < rounds; r++) {
+        CommandRegistry* registry = command_registry_create();
+        linux_bridge_register_commands(bridge, registry);
+        listed = registry->count;
+        command_registry_destroy(registry);
+    }
+    double list_time = bench_seconds(start) / rounds;
+    
+    start = clock();
+    size_t discovered = 0;
+    for (int r = 0; r < rounds; r++) {
+        CommandRegistry* registry = command_registry_create();
+        linux_bridge_discover_commands(bridge, registry);
+        discovered = registry->count;
+        command_registry_destroy(registry);
+    }
+    double discover_time = bench_seconds(start) / rounds;
+    
+    printf("  common list probe:  %8.3f ms, %zu commands\n", list_time * 1000.0, listed);
+    printf("  full discovery:     %8.3f ms, %zu commands\n", discover_time * 1000.0, discovered);
+    linux_bridge_destroy(bridge);
+    
+    #ifndef _WIN32
+    // The host's own /bin and /usr/bin, for a real-world mix of entry types
+    bridge = linux_bridge_create("");
+    if (bridge) {
+        start = clock();
+        CommandRegistry* registry = command_registry_create();
+        linux_bridge_discover_commands(bridge, registry);
+        printf("  host root:          %8.3f ms, %zu commands\n", bench_seconds(start) * 1000.0, registry->count);
+        command_registry_destroy(registry);
+        linux_bridge_destroy(bridge);
+    }
+    #endif
+}
+
+#ifndef _WIN32
+static double bench_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int bench_compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_report_latency(const char* label, double* samples, int count) {
+    qsort(samples, (size_t)count, sizeof(double), bench_compare_double);
+    printf("  %-20s p50 %8.1f us   p99 %8.1f us\n", label, samples[count / 2], samples[count * 99 / 100]);
+}
+#endif
+
+void bench_launch_latency(void) {
+    BENCH_START("Linux command launch latency");
+    
+    #ifdef _WIN32
+    printf("  not available on this platform\n");
+    #else
+    const int runs = 1000;
+    double* samples = (double*)malloc(sizeof(double) * runs);
+    LinuxBridge* bridge = linux_bridge_create(BENCH_LINUX_ROOT);
+    if (!samples || !bridge) {
+        printf("  setup failed\n");
+        free(samples);
+        linux_bridge_destroy(bridge);
+        return;
+    }
+    
+    // Fork the helper first, while this process is still small
+    bool zygote = linux_bridge_start_zygote(bridge);
+    
+    for (int i = 0; i < runs; i++) {
+        double start = bench_now_us();
+        int rc = system("/bin/true");
+        (void)rc;
+        samples[i] = bench_now_us() - start;
+    }
+    bench_report_latency("system():", samples, runs);
+    
+    LinuxBridge* direct = linux_bridge_create(BENCH_LINUX_ROOT);
+    for (int i = 0; direct && i < runs; i++) {
+        double start = bench_now_us();
+        execution_result_destroy(linux_bridge_run(direct, "/bin/true", NULL));
+        samples[i] = bench_now_us() - start;
+    }
+    bench_report_latency("posix_spawn:", samples, runs);
+    linux_bridge_destroy(direct);
+    
+    if (zygote) {
+        for (int i = 0; i < runs; i++) {
+            double start = bench_now_us();
+            execution_result_destroy(linux_bridge_run(bridge, "/bin/true", NULL));
+            samples[i] = bench_now_us() - start;
+        }
+        bench_report_latency("zygote:", samples, runs);
+    } else {
+        printf("  zygote:              not available on this platform\n");
+    }
+    
+    linux_bridge_destroy(bridge);
+    free(samples);
+    #endif
+}
+
+static ExecutionResult* bench_nop_executor(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    ExecutionResult* result = execution_result_create();
+    result->result = CMD_SUCCESS;
+    result->exit_code = 0;
+    return result;
+}
+
+static bool bench_discard_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    return true;
+}
+
+static bool bench_add_nop_command(CommandRegistry* registry, void* userdata) {
+    command_registry_add(registry, "knop", "knop", ENV_KURONO, "Benchmark command");
+    return true;
+}
+
+void bench_kcl_aot(void) {
+    BENCH_START("KCL script, interpreted vs. compiled ahead of time");
+    
+    #ifdef _WIN32
+    printf("  not available on this platform\n");
+    #else
+    // Dispatch to an in-process command, so the loop itself dominates
+    const char* script_text =
+        "kcl-set label run\n"
+        "kcl-for i from 1 to 100000\n"
+        "    kcl-if $i -ge 50000\n"
+        "        knop $label $i\n"
+        "    kcl-else\n"
+        "        knop $i\n"
+        "    kcl-end\n"
+        "    kcl-set last $i\n"
+        "kcl-end\n";
+    
+    KernelContext* kernel = kernel_init();
+    KCLContext* ctx = kcl_context_create(kernel);
+    KernelEnvironmentHandlers previous = *kernel_get_handlers(ENV_KURONO);
+    kernel_register_executor(ENV_KURONO, bench_nop_executor, NULL);
+    kernel_update_registry(bench_add_nop_command, NULL);
+    OutputSink discard = { bench_discard_write, NULL, -1 };
+    
+    KCLScript* script = kcl_parse(script_text);
+    double start = bench_now_us();
+    int status = kcl_execute_streaming(ctx, script, &discard);
+    double interpreted = (bench_now_us() - start) / 1e6;
+    kcl_script_destroy(script);
+    printf("  interpreted:         %8.3f s (status %d)\n", interpreted, status);
+    
+    const char* cache_dir = BENCH_KCL_CACHE;
+    char* error = NULL;
+    start = bench_now_us();
+    KCLNativeScript* native = kcl_aot_compile(script_text, cache_dir, &error);
+    double compile = (bench_now_us() - start) / 1e6;
+    
+    if (native) {
+        start = bench_now_us();
+        status = kcl_aot_run(native, ctx, &discard);
+        double compiled = (bench_now_us() - start) / 1e6;
+        printf("  compiled:            %8.3f s (status %d, %.1fx)\n", compiled, status, compiled > 0 ? interpreted / compiled : 0.0);
+        printf("  compile step:        %8.3f s (once per script version, not counted above)\n", compile);
+        kcl_aot_unload(native);
+    
+        char* path = kcl_aot_cache_path(script_text, cache_dir);
+        if (path) remove(path);
+        free(path);
+        rmdir(cache_dir);
+    } else {
+        printf("  compiled:            not available (%s)\n", error ? error : "no compiler");
+    }
+    
+    free(error);
+    kernel_register_executor(ENV_KURONO, previous.executor, previous.executor_userdata);
+    kcl_context_destroy(ctx);
+    kernel_shutdown(kernel);
+    #endif
+}
+
+// A provisioning-style script of about target bytes covering every token
+// kind: commands, pipes, redirects, variables, strings, numbers, operators
+static char* bench_generate_kcl_script(size_t target, size_t* length) {
+    static const char* block =
+        "# provision host $i\n"
+        "kcl-set host node-$i.cluster.local\n"
+        "kcl-for port in 22 80 443 8080\n"
+        "    kcl-if $port -lt 1024\n"
+        "        echo \"privileged ${port} on $host\" >> /var/log/provision.log\n"
+        "    kcl-else\n"
+        "        check-port --host $host --port $port --timeout 30 | grep -v 'closed port' > /tmp/ports.txt\n"
+        "    kcl-end\n"
+        "kcl-end\n"
+        "kcl-if $host != 'localhost'; deploy --target=$host --retries 3; kcl-end\n";
+    
+    OutputBuffer text;
+    output_buffer_init(&text);
+    size_t block_length = strlen(block);
+    while (text.length < target && output_buffer_append(&text, block, block_length)) {
+    }
+    *length = text.length;
+    return output_buffer_take(&text);
+}
+
+void bench_kcl_lexer(void) {
+    BENCH_START("KCL lexer throughput");
+    
+    size_t length = 0;
+    char* script_text = bench_generate_kcl_script(32 * 1024 * 1024, &length);
+    if (!script_text) return;
+    double megabytes = (double)length / (1024.0 * 1024.0);
+    const int rounds = 5;
+    
+    // Best of several rounds, so page faults on the first pass do not count
+    double lex_best = 0.0;
+    size_t tokens = 0;
+    for (int r = 0; r < rounds; r++) {
+        double start = bench_now_us();
+        KCLLexer* lexer = kcl_lexer_create(script_text);
+        double elapsed = (bench_now_us() - start) / 1e6;
+        if (lexer) tokens = lexer->count;
+        kcl_lexer_destroy(lexer);
+        if (r == 0 || elapsed < lex_best) lex_best = elapsed;
+    }
+    
+    // What the tokens used to cost: a heap copy of every token's text
+    double copy_best = 0.0;
+    for (int r = 0; r < rounds; r++) {
+        double start = bench_now_us();
+        KCLLexer* lexer = kcl_lexer_create(script_text);
+        char** values = lexer ? (char**)malloc(sizeof(char*) * lexer->count) : NULL;
+        for (size_t i = 0; values && i < lexer->count; i++) {
+            values[i] = (char*)malloc(lexer->tokens[i].length + 1);
+            if (values[i]) {
+                memcpy(values[i], kcl_token_text(lexer, &lexer->tokens[i]), lexer->tokens[i].length);
+                values[i][lexer->tokens[i].length] = '\0';
+            }
+        }
+        for (size_t i = 0; values && i < lexer->count; i++) free(values[i]);
+        double elapsed = (bench_now_us() - start) / 1e6;
+        free(values);
+        kcl_lexer_destroy(lexer);
+        if (r == 0 || elapsed < copy_best) copy_best = elapsed;
+    }
+    
+    double start = bench_now_us();
+    KCLScript* script = kcl_parse(script_text);
+    double parse = (bench_now_us() - start) / 1e6;
+    bool parsed = script && !script->has_error;
+    kcl_script_destroy(script);
+    
+    printf("  script:              %8.1f MB, %zu tokens\n", megabytes, tokens);
+    printf("  lexer (token views): %8.1f MB/s (%.1f ns/token)\n", megabytes / lex_best, lex_best * 1e9 / (tokens ? tokens : 1));
+    printf("  lexer + token copies:%8.1f MB/s (one heap string per token)\n", megabytes / copy_best);
+    printf("  lex + parse:         %8.1f MB/s%s\n", megabytes / parse, parsed ? "" : " (parse failed)");
+    
+    free(script_text);
+}
+
+void run_all_benchmarks(void) {
+    printf("\n");
+    printf("╔══════════════════════════════════════════════════════════════════════════════╗\n");
+    printf("║                        KURONO OS BENCHMARKS                                  ║\n");
+    printf("╚══════════════════════════════════════════════════════════════════════════════╝\n");
+    printf("\n");
+    
+    bench_registry_memory();
+    printf("\n");
+    bench_output_capture();
+    printf("\n");
+    bench_path_resolution();
+    printf("\n");
+    bench_command_discovery();
+    printf("\n");
+    bench_command_sets();
+    printf("\n");
+    bench_launch_latency();
+    printf("\n");
+    bench_kcl_aot();
+    printf("\n");
+    bench_kcl_lexer();
+    
+    printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        run_all_benchmarks();
+        return 0;
+    }
+    
+    if (argc > 1) {
+        if (strcmp(argv[1], "--bench-registry-memory") == 0) {
+            bench_registry_memory();
+        } else if (strcmp(argv[1], "--bench-output-capture") == 0) {
+            bench_output_capture();
+        } else if (strcmp(argv[1], "--bench-path-resolution") == 0) {
+            bench_path_resolution();
+        } else if (strcmp(argv[1], "--bench-command-discovery") == 0) {
+            bench_command_discovery();
+        } else if (strcmp(argv[1], "--bench-command-sets") == 0) {
+            bench_command_sets();
+        } else if (strcmp(argv[1], "--bench-launch-latency") == 0) {
+            bench_launch_latency();
+        } else if (strcmp(argv[1], "--bench-kcl-aot") == 0) {
+            bench_kcl_aot();
+        } else if (strcmp(argv[1], "--bench-kcl-lexer") == 0) {
+            bench_kcl_lexer();
+        } else {
+            printf("Unknown benchmark flag: %s\n", argv[1]);
+            return 1;
+        }
+        return 0;
+    }
+    
+    printf("Kurono OS Benchmarks\n");
+    printf("Usage: %s --bench [specific-benchmark]\n", argv[0]);
+    printf("Available benchmarks:\n");
+    printf("  --bench                   Run all benchmarks\n");
+    printf("  --bench-registry-memory   Registry memory footprint, arena vs. legacy layout\n");
+    printf("  --bench-output-capture    Command output capture, fgets/strcat vs. OutputBuffer\n");
+    printf("  --bench-path-resolution   Linux command lookup, stat per call vs. cached resolution\n");
+    printf("  --bench-command-discovery Linux registration, common list vs. full directory scan\n");
+    printf("  --bench-command-sets      Static command list membership, linear scan vs. perfect hash\n");
+    printf("  --bench-launch-latency    Command launch p50/p99: system(), posix_spawn, zygote\n");
+    printf("  --bench-kcl-aot           KCL loop script, interpreter vs. native compiled code\n");
+    printf("  --bench-kcl-lexer         KCL lexer MB/s on a large generated script\n");
+    
+    return 0;
+}
@@ -19,13 +19,22 @@ if (!(Test-Path $BuildDir)) { New-Item -ItemType Directory -Path $BuildDir | Out
 
 $Sources = @(
     "kernel.cpp",
+    "kernel_args.cpp",
+    "kernel_pipeline.cpp",
+    "kernel_jobs.cpp",
+    "kurono_daemon.cpp",
+    "kurono_batch.cpp",
     "linux_sync.c",
     "linux_bridge.c",
     "windows_bridge.c",
     "kcl_interpreter.c",
+    "kcl_aot.cpp",
+    "kcl_vm.cpp",
+    "kcl_variables.cpp",
     "conflict_resolver.c",
     "security_supr_engine.c",
     "package_manager.c",
+    "registry_snapshot.cpp",
     "kurono_os.c"
 )
 
@@ -0,0 +1,770 @@
+#include "kcl_aot.h"
+#include "kcl_vm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+// Part of the cache key: bump whenever the generated code changes meaning
+#define KCL_AOT_GENERATOR_VERSION "1"
+
+typedef int (*KCLNativeMain)(const KCLNativeApi* api);
+
+struct KCLNativeScript {
+    void* handle;
+    KCLNativeMain main;
+};
+
+// Variables whose every assignment is an integer literal, another integer
+// variable or a kcl-for range become a long plus a set flag; all others are
+// std::string. An unset variable reads as "" either way, and one the script
+// never assigns starts out with the context's value.
+typedef struct {
+    std::string name;
+    bool assigned;
+    bool is_int;
+} AotVariable;
+
+typedef struct {
+    size_t target;
+    size_t source;
+} AotCopy;
+
+typedef struct {
+    std::vector<AotVariable> variables;
+    std::vector<AotCopy> copies;
+    std::vector<std::string> commands;
+    std::string out;
+    int indent;
+    int next_local;
+} AotGenerator;
+
+static size_t aot_variable(AotGenerator* gen, const char* name) {
+    for (size_t i = 0; i < gen->variables.size(); i++) {
+        if (gen->variables[i].name == name) return i;
+    }
+    gen->variables.push_back({ name, false, true });
+    return gen->variables.size() - 1;
+}
+
+static bool aot_parse_int(const char* text, long* value) {
+    if (!*text) return false;
+    char* end;
+    errno = 0;
+    *value = strtol(text, &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+// Integers that print back unchanged, so a long holds them without loss
+static bool aot_canonical_int(const KCLNode* node, long* value) {
+    if (node->type != KCL_NODE_LITERAL || !aot_parse_int(node->value, value)) return false;
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%ld", *value);
+    return strcmp(buffer, node->value) == 0;
+}
+
+static void aot_collect(AotGenerator* gen, const KCLNode* node) {
+    if (node->type == KCL_NODE_VARIABLE) {
+        aot_variable(gen, node->value);
+    } else if (node->type == KCL_NODE_ASSIGNMENT) {
+        size_t index = aot_variable(gen, node->value);
+        gen->variables[index].assigned = true;
+        long value;
+        if (node->child_count == 1 && node->children[0]->type == KCL_NODE_VARIABLE) {
+            gen->copies.push_back({ index, aot_variable(gen, node->children[0]->value) });
+        } else if (node->child_count != 1 || !aot_canonical_int(node->children[0], &value)) {
+            gen->variables[index].is_int = false;
+        }
+    } else if (node->type == KCL_NODE_FOR) {
+        size_t index = aot_variable(gen, node->value);
+        gen->variables[index].assigned = true;
+        if (node->children[0]->type != KCL_NODE_RANGE) gen->variables[index].is_int = false;
+    }
+    
+    for (size_t i = 0; i < node->child_count; i++) {
+        aot_collect(gen, node->children[i]);
+    }
+}
+
+static void aot_infer_types(AotGenerator* gen) {
+    for (AotVariable& variable : gen->variables) {
+        if (!variable.assigned) variable.is_int = false;
+    }
+    
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const AotCopy& copy : gen->copies) {
+            if (gen->variables[copy.target].is_int && !gen->variables[copy.source].is_int) {
+                gen->variables[copy.target].is_int = false;
+                changed = true;
+            }
+        }
+    }
+}
+
+static void aot_line(AotGenerator* gen, const std::string& code) {
+    gen->out.append((size_t)gen->indent * 4, ' ');
+    gen->out += code;
+    gen->out += '\n';
+}
+
+static std::string aot_quote(const char* text, size_t length) {
+    std::string quoted = "\"";
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += (char)c;
+        } else if (c < 0x20 || c >= 0x7f) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\%03o", c);
+            quoted += escape;
+        } else {
+            quoted += (char)c;
+        }
+    }
+    return quoted + "\"";
+}
+
+static std::string aot_local(AotGenerator* gen, const char* prefix) {
+    return prefix + std::to_string(gen->next_local++);
+}
+
+static std::string aot_var(size_t index) {
+    return "v" + std::to_string(index);
+}
+
+static std::string aot_set(size_t index) {
+    return "s" + std::to_string(index);
+}
+
+static void aot_fail(AotGenerator* gen, const std::string& message) {
+    aot_line(gen, "api->fail(api->session, " + aot_quote(message.c_str(), message.size()) + ");");
+    aot_line(gen, "goto kcl_fail;");
+}
+
+static void aot_append_word(AotGenerator* gen, const std::string& buffer, const KCLNode* word) {
+    if (word->type == KCL_NODE_LITERAL) {
+        size_t length = strlen(word->value);
+        if (length) aot_line(gen, buffer + ".append(" + aot_quote(word->value, length) + ", " + std::to_string(length) + ");");
+    } else if (word->type == KCL_NODE_VARIABLE) {
+        size_t index = aot_variable(gen, word->value);
+        const AotVariable& variable = gen->variables[index];
+        if (variable.is_int) {
+            aot_line(gen, "kcl_append_int(" + buffer + ", " + aot_set(index) + ", " + aot_var(index) + ");");
+        } else {
+            aot_line(gen, buffer + ".append(" + aot_var(index) + ");");
+        }
+    } else {
+        for (size_t i = 0; i < word->child_count; i++) {
+            aot_append_word(gen, buffer, word->children[i]);
+        }
+    }
+}
+
+// Appends a command's words to line and its redirection target to target;
+// returns the redirection operator or NULL
+static const char* aot_command_words(AotGenerator* gen, const KCLNode* command, size_t first_word) {
+    const char* redirect = NULL;
+    bool first = true;
+    for (size_t i = first_word; i < command->child_count; i++) {
+        const KCLNode* child = command->children[i];
+        if (child->type == KCL_NODE_REDIRECTION) {
+            aot_line(gen, "target.clear();");
+            aot_append_word(gen, "target", child->children[0]);
+            redirect = child->value;
+            continue;
+        }
+        if (!first) aot_line(gen, "line += ' ';");
+        aot_append_word(gen, "line", child);
+        first = false;
+    }
+    return redirect;
+}
+
+static std::string aot_redirect_args(const char* redirect) {
+    if (!redirect) return "nullptr, 0";
+    return std::string("target.c_str(), ") + (redirect[1] == '>' ? "1" : "0");
+}
+
+static size_t aot_command_slot(AotGenerator* gen, const char* name) {
+    for (size_t i = 0; i < gen->commands.size(); i++) {
+        if (gen->commands[i] == name) return i;
+    }
+    gen->commands.push_back(name);
+    return gen->commands.size() - 1;
+}
+
+static void aot_emit_command(AotGenerator* gen, const KCLNode* node) {
+    aot_line(gen, "line.clear();");
+    
+    if (node->type == KCL_NODE_PIPELINE) {
+        const char* redirect = NULL;
+        for (size_t i = 0; i < node->child_count; i++) {
+            if (i > 0) aot_line(gen, "line.append(\" | \", 3);");
+            const char* stage_redirect = aot_command_words(gen, node->children[i], 0);
+            if (stage_redirect) redirect = stage_redirect;
+        }
+        aot_line(gen, "status = api->run(api->session, nullptr, line.c_str(), 1, " + aot_redirect_args(redirect) + ");");
+        return;
+    }
+    
+    const KCLNode* name = node->children[0];
+    if (name->type == KCL_NODE_LITERAL && strcmp(name->value, "echo") == 0) {
+        const char* redirect = aot_command_words(gen, node, 1);
+        aot_line(gen, "status = api->echo(api->session, line.data(), line.size(), " + aot_redirect_args(redirect) + ");");
+        return;
+    }
+    
+    // A literal name is looked up once, when the script starts
+    std::string entry = "nullptr";
+    if (name->type == KCL_NODE_LITERAL && name->value[0] && !strchr(name->value, ' ')) {
+        entry = "cmd_" + std::to_string(aot_command_slot(gen, name->value));
+    }
+    const char* redirect = aot_command_words(gen, node, 0);
+    aot_line(gen, "status = api->run(api->session, " + entry + ", line.c_str(), 0, " + aot_redirect_args(redirect) + ");");
+}
+
+// Leaves the value of an integer operand in a new local, failing the script
+// like the interpreter when the operand is not an integer
+static std::string aot_int_operand(AotGenerator* gen, const KCLNode* word, const std::string& buffer, const std::string& message) {
+    std::string local = aot_local(gen, "n");
+    long value;
+    if (word->type == KCL_NODE_LITERAL) {
+        if (!aot_parse_int(word->value, &value)) {
+            aot_fail(gen, message);
+            value = 0;
+        }
+        aot_line(gen, "long " + local + " = " + std::to_string(value) + "L;");
+    } else if (word->type == KCL_NODE_VARIABLE && gen->variables[aot_variable(gen, word->value)].is_int) {
+        size_t index = aot_variable(gen, word->value);
+        aot_line(gen, "if (!" + aot_set(index) + ") {");
+        gen->indent++;
+        aot_fail(gen, message);
+        gen->indent--;
+        aot_line(gen, "}");
+        aot_line(gen, "long " + local + " = " + aot_var(index) + ";");
+    } else {
+        aot_line(gen, buffer + ".clear();");
+        aot_append_word(gen, buffer, word);
+        aot_line(gen, "long " + local + ";");
+        aot_line(gen, "if (!kcl_to_int(" + buffer + ", &" + local + ")) {");
+        gen->indent++;
+        aot_fail(gen, message);
+        gen->indent--;
+        aot_line(gen, "}");
+    }
+    return local;
+}
+
+static bool aot_int_variable(AotGenerator* gen, const KCLNode* word, size_t* index) {
+    if (word->type != KCL_NODE_VARIABLE) return false;
+    *index = aot_variable(gen, word->value);
+    return gen->variables[*index].is_int;
+}
+
+// Emits the statements that evaluate a condition and returns the expression
+// to test; the caller opens a scope for the locals it declares
+static std::string aot_condition(AotGenerator* gen, const KCLNode* node) {
+    const char* op = node->value;
+    const KCLNode* lhs = node->children[0];
+    const KCLNode* rhs = node->children[1];
+    
+    if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0) {
+        std::string negate = op[0] == '!' ? "!" : "";
+        size_t a, b;
+        long value;
+        if (aot_int_variable(gen, rhs, &b) && !aot_int_variable(gen, lhs, &a)) {
+            const KCLNode* swap = lhs;
+            lhs = rhs;
+            rhs = swap;
+        }
+        if (aot_int_variable(gen, lhs, &a)) {
+            if (aot_int_variable(gen, rhs, &b)) {
+                return negate + "(" + aot_set(a) + " == " + aot_set(b) + " && (!" + aot_set(a) + " || " + aot_var(a) + " == " + aot_var(b) + "))";
+            }
+            if (aot_canonical_int(rhs, &value)) {
+                return negate + "(" + aot_set(a) + " && " + aot_var(a) + " == " + std::to_string(value) + "L)";
+            }
+        }
+        aot_line(gen, "kcl_lhs.clear();");
+        aot_append_word(gen, "kcl_lhs", lhs);
+        aot_line(gen, "kcl_rhs.clear();");
+        aot_append_word(gen, "kcl_rhs", rhs);
+        return negate + "(kcl_lhs == kcl_rhs)";
+    }
+    
+    std::string message = std::string(op) + " expects integers";
+    std::string a = aot_int_operand(gen, lhs, "kcl_lhs", message);
+    std::string b = aot_int_operand(gen, rhs, "kcl_rhs", message);
+    const char* cmp = strcmp(op, "-eq") == 0 ? "==" : strcmp(op, "-ne") == 0 ? "!=" :
+                      strcmp(op, "-lt") == 0 ? "<" : strcmp(op, "-le") == 0 ? "<=" :
+                      strcmp(op, "-gt") == 0 ? ">" : ">=";
+    return "(" + a + " " + cmp + " " + b + ")";
+}
+
+static void aot_emit_block(AotGenerator* gen, const KCLNode* block);
+
+static void aot_emit_statement(AotGenerator* gen, const KCLNode* node) {
+    switch (node->type) {
+        case KCL_NODE_COMMAND:
+        case KCL_NODE_PIPELINE:
+            aot_emit_command(gen, node);
+            break;
+        case KCL_NODE_ASSIGNMENT: {
+            size_t index = aot_variable(gen, node->value);
+            long value;
+            size_t source;
+            if (!gen->variables[index].is_int) {
+                // Built aside first: the value may mention the variable itself
+                aot_line(gen, "kcl_value.clear();");
+                for (size_t i = 0; i < node->child_count; i++) {
+                    if (i > 0) aot_line(gen, "kcl_value += ' ';");
+                    aot_append_word(gen, "kcl_value", node->children[i]);
+                }
+                aot_line(gen, aot_var(index) + ".swap(kcl_value);");
+            } else if (aot_int_variable(gen, node->children[0], &source)) {
+                aot_line(gen, aot_var(index) + " = " + aot_var(source) + ";");
+                aot_line(gen, aot_set(index) + " = " + aot_set(source) + ";");
+            } else {
+                aot_canonical_int(node->children[0], &value);
+                aot_line(gen, aot_var(index) + " = " + std::to_string(value) + "L;");
+                aot_line(gen, aot_set(index) + " = true;");
+            }
+            aot_line(gen, "status = 0;");
+            break;
+        }
+        case KCL_NODE_IF: {
+            aot_line(gen, "{");
+            gen->indent++;
+            aot_line(gen, "if (" + aot_condition(gen, node) + ") {");
+            aot_emit_block(gen, node->children[2]);
+            if (node->child_count > 3) {
+                aot_line(gen, "} else {");
+                aot_emit_block(gen, node->children[3]);
+            }
+            aot_line(gen, "}");
+            gen->indent--;
+            aot_line(gen, "}");
+            break;
+        }
+        case KCL_NODE_WHILE: {
+            aot_line(gen, "for (;;) {");
+            gen->indent++;
+            aot_line(gen, "if (!" + aot_condition(gen, node) + ") break;");
+            gen->indent--;
+            aot_emit_block(gen, node->children[2]);
+            aot_line(gen, "}");
+            break;
+        }
+        case KCL_NODE_FOR: {
+            size_t index = aot_variable(gen, node->value);
+            const KCLNode* body = node->children[node->child_count - 1];
+            std::string counter = aot_local(gen, "i");
+            aot_line(gen, "{");
+            gen->indent++;
+            if (node->children[0]->type == KCL_NODE_RANGE) {
+                // Bounds are evaluated once, before the first iteration
+                std::string message = std::string("kcl-for ") + node->value + " expects integer bounds";
+                const KCLNode* range = node->children[0];
+                std::string from = aot_int_operand(gen, range->children[0], "kcl_lhs", message);
+                std::string to = aot_int_operand(gen, range->children[1], "kcl_rhs", message);
+                aot_line(gen, "for (long " + counter + " = " + from + "; " + counter + " <= " + to + "; " + counter + "++) {");
+                gen->indent++;
+                if (gen->variables[index].is_int) {
+                    aot_line(gen, aot_var(index) + " = " + counter + ";");
+                    aot_line(gen, aot_set(index) + " = true;");
+                } else {
+                    aot_line(gen, aot_var(index) + ".clear();");
+                    aot_line(gen, "kcl_append_int(" + aot_var(index) + ", true, " + counter + ");");
+                }
+                gen->indent--;
+                aot_emit_block(gen, body);
+                aot_line(gen, "}");
+            } else if (node->child_count > 1) {
+                // Items are expanded up front so the body cannot change them
+                size_t item_count = node->child_count - 1;
+                std::string items = aot_local(gen, "items");
+                aot_line(gen, "std::string " + items + "[" + std::to_string(item_count) + "];");
+                for (size_t i = 0; i < item_count; i++) {
+                    aot_append_word(gen, items + "[" + std::to_string(i) + "]", node->children[i]);
+                }
+                aot_line(gen, "for (size_t " + counter + " = 0; " + counter + " < " + std::to_string(item_count) + "; " + counter + "++) {");
+                gen->indent++;
+                aot_line(gen, aot_var(index) + " = " + items + "[" + counter + "];");
+                gen->indent--;
+                aot_emit_block(gen, body);
+                aot_line(gen, "}");
+            }
+            gen->indent--;
+            aot_line(gen, "}");
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void aot_emit_block(AotGenerator* gen, const KCLNode* block) {
+    gen->indent++;
+    for (size_t i = 0; i < block->child_count; i++) {
+        aot_emit_statement(gen, block->children[i]);
+    }
+    gen->indent--;
+}
+
+// Runtime support copied into every generated file; the API struct must stay
+// layout-identical to KCLNativeApi
+static const char* aot_prelude =
+    "#include <string>\n"
+    "#include <cerrno>\n"
+    "#include <cstddef>\n"
+    "#include <cstdint>\n"
+    "#include <cstdio>\n"
+    "#include <cstdlib>\n"
+    "\n"
+    "struct KCLNativeApi {\n"
+    "    uint32_t abi_version;\n"
+    "    void* session;\n"
+    "    const void* (*resolve)(void* session, const char* name);\n"
+    "    int (*run)(void* session, const void* entry, const char* command_line, int pipeline, const char* redirect, int append);\n"
+    "    int (*echo)(void* session, const char* text, size_t length, const char* redirect, int append);\n"
+    "    void (*fail)(void* session, const char* message);\n"
+    "    const char* (*variable)(void* session, const char* name);\n"
+    "};\n"
+    "\n"
+    "static void kcl_append_int(std::string& s, bool set, long value) {\n"
+    "    if (!set) return;\n"
+    "    char buffer[32];\n"
+    "    s.append(buffer, (size_t)snprintf(buffer, sizeof(buffer), \"%ld\", value));\n"
+    "}\n"
+    "\n"
+    "static bool kcl_to_int(const std::string& s, long* value) {\n"
+    "    if (s.empty()) return false;\n"
+    "    char* end;\n"
+    "    errno = 0;\n"
+    "    *value = strtol(s.c_str(), &end, 10);\n"
+    "    return *end == '\\0' && errno == 0;\n"
+    "}\n"
+    "\n";
+
+char* kcl_aot_generate(const KCLScript* script) {
+    if (!script || script->has_error || !script->root) return NULL;
+    
+    AotGenerator gen;
+    gen.indent = 0;
+    gen.next_local = 0;
+    aot_collect(&gen, script->root);
+    aot_infer_types(&gen);
+    
+    // The body is generated first since it decides which commands to resolve
+    gen.indent = 1;
+    aot_emit_block(&gen, script->root);
+    std::string body;
+    body.swap(gen.out);
+    
+    gen.out = aot_prelude;
+    gen.out += "extern \"C\" const uint32_t kcl_native_abi = " + std::to_string(KCL_NATIVE_ABI_VERSION) + ";\n\n";
+    gen.out += "extern \"C\" int kcl_native_main(const KCLNativeApi* api) {\n";
+    gen.indent = 1;
+    aot_line(&gen, "if (api->abi_version != kcl_native_abi) return -1;");
+    for (size_t i = 0; i < gen.commands.size(); i++) {
+        const std::string& name = gen.commands[i];
+        aot_line(&gen, "const void* cmd_" + std::to_string(i) + " = api->resolve(api->session, " + aot_quote(name.c_str(), name.size()) + ");");
+    }
+    for (size_t i = 0; i < gen.variables.size(); i++) {
+        if (!gen.variables[i].assigned) {
+            const std::string& name = gen.variables[i].name;
+            aot_line(&gen, "std::string " + aot_var(i) + ";");
+            aot_line(&gen, "if (const char* value = api->variable(api->session, " + aot_quote(name.c_str(), name.size()) + ")) " + aot_var(i) + " = value;");
+        } else if (gen.variables[i].is_int) {
+            aot_line(&gen, "long " + aot_var(i) + " = 0;");
+            aot_line(&gen, "bool " + aot_set(i) + " = false;");
+        } else {
+            aot_line(&gen, "std::string " + aot_var(i) + ";");
+        }
+    }
+    aot_line(&gen, "std::string line, target, kcl_lhs, kcl_rhs, kcl_value;");
+    aot_line(&gen, "int status = 0;");
+    gen.out += "    {\n";
+    gen.out += body;
+    gen.out += "    }\n";
+    aot_line(&gen, "return status;");
+    gen.out += "kcl_fail:\n";
+    aot_line(&gen, "return status == 0 ? 1 : status;");
+    gen.out += "}\n";
+    
+    return strdup(gen.out.c_str());
+}
+
+static uint64_t aot_hash(uint64_t hash, const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+char* kcl_aot_cache_path(const char* source_text, const char* cache_dir) {
+    if (!source_text || !cache_dir) return NULL;
+    
+    char version[32];
+    int version_length = snprintf(version, sizeof(version), "%d:%s", KCL_NATIVE_ABI_VERSION, KCL_AOT_GENERATOR_VERSION);
+    uint64_t hash = aot_hash(14695981039346656037ULL, version, (size_t)version_length + 1);
+    hash = aot_hash(hash, source_text, strlen(source_text));
+    
+    size_t length = strlen(cache_dir) + 32;
+    char* path = (char*)malloc(length);
+    if (path) snprintf(path, length, "%s/kcl-%016llx.so", cache_dir, (unsigned long long)hash);
+    return path;
+}
+
+#ifndef _WIN32
+
+static bool aot_make_directory(const char* path) {
+    std::string partial;
+    for (const char* cursor = path; *cursor; cursor++) {
+        partial += *cursor;
+        if ((cursor[1] == '/' || cursor[1] == '\0') && mkdir(partial.c_str(), 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool aot_write_file(const char* path, const char* text) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    
+    size_t length = strlen(text);
+    bool ok = fwrite(text, 1, length, file) == length;
+    return (fclose(file) == 0) && ok;
+}
+
+static char* aot_read_log(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return strdup("compiler failed");
+    
+    OutputBuffer log;
+    output_buffer_init(&log);
+    output_buffer_read_file(&log, file);
+    fclose(file);
+    if (log.length == 0 && !output_buffer_append(&log, "compiler failed", 15)) {
+        output_buffer_free(&log);
+        return NULL;
+    }
+    return output_buffer_take(&log);
+}
+
+// Runs the compiler with its output sent to log_path; true on exit status 0
+static bool aot_run_compiler(const char* source_path, const char* output_path, const char* log_path) {
+    const char* compiler = getenv("KCL_CXX");
+    if (!compiler || !*compiler) compiler = getenv("CXX");
+    if (!compiler || !*compiler) compiler = "c++";
+    
+    const char* argv[] = {
+        compiler, "-std=c++17", "-O2", "-shared", "-fPIC", "-o", output_path, source_path, NULL
+    };
+    
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    
+    pid_t pid;
+    int rc = posix_spawnp(&pid, compiler, &actions, NULL, (char* const*)argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) return false;
+    
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Loads the cached artifact; on failure *reason (when given) says why
+static KCLNativeScript* aot_load(const char* source_text, const char* cache_dir, const char** reason) {
+    const char* failure = "cannot load the compiled script";
+    char* path = kcl_aot_cache_path(source_text, cache_dir);
+    if (!path) {
+        if (reason) *reason = failure;
+        return NULL;
+    }
+    
+    // Only an artifact no one else could have written is loaded; with its
+    // directory checked it cannot be swapped before dlopen
+    void* handle = NULL;
+    int fd = kcl_cache_open(cache_dir, path);
+    if (fd >= 0) {
+        handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        const char* message = handle ? NULL : dlerror();
+        if (message) failure = message;
+        close(fd);
+    } else if (errno == EPERM) {
+        failure = "the KCL cache or its artifact is writable by other users";
+    }
+    free(path);
+    
+    const uint32_t* abi = handle ? (const uint32_t*)dlsym(handle, "kcl_native_abi") : NULL;
+    KCLNativeMain main = handle ? (KCLNativeMain)dlsym(handle, "kcl_native_main") : NULL;
+    KCLNativeScript* native = (abi && *abi == KCL_NATIVE_ABI_VERSION && main) ? (KCLNativeScript*)malloc(sizeof(KCLNativeScript)) : NULL;
+    if (!native) {
+        if (handle) {
+            if (!abi || !main || *abi != KCL_NATIVE_ABI_VERSION) failure = "the compiled script does not match this KCL version";
+            dlclose(handle);
+        }
+        if (reason) *reason = failure;
+        return NULL;
+    }
+    
+    native->handle = handle;
+    native->main = main;
+    return native;
+}
+
+static std::atomic<unsigned> g_aot_build_counter{0};
+
+KCLNativeScript* kcl_aot_compile(const char* source_text, const char* cache_dir, char** error) {
+    if (error) *error = NULL;
+    if (!source_text || !cache_dir) return NULL;
+    
+    KCLNativeScript* native = kcl_aot_load(source_text, cache_dir);
+    if (native) return native;
+    
+    KCLScript* script = kcl_parse(source_text);
+    char* code = kcl_aot_generate(script);
+    if (!code) {
+        if (error) *error = strdup(script && script->error_message ? script->error_message : "invalid script");
+        kcl_script_destroy(script);
+        return NULL;
+    }
+    kcl_script_destroy(script);
+    
+    char* path = kcl_aot_cache_path(source_text, cache_dir);
+    if (!path || !aot_make_directory(cache_dir)) {
+        if (error) *error = strdup("cannot create the KCL cache directory");
+        free(code);
+        free(path);
+        return NULL;
+    }
+    
+    // Concurrent builds of the same script each use their own scratch files;
+    // the artifact appears under its final name in one rename
+    std::string scratch = std::string(path) + "." + std::to_string((long)getpid()) + "." + std::to_string(g_aot_build_counter++);
+    std::string source_path = scratch + ".cpp";
+    std::string output_path = scratch + ".tmp";
+    std::string log_path = scratch + ".log";
+    
+    bool built = aot_write_file(source_path.c_str(), code) &&
+                 aot_run_compiler(source_path.c_str(), output_path.c_str(), log_path.c_str()) &&
+                 chmod(output_path.c_str(), 0700) == 0 &&
+                 rename(output_path.c_str(), path) == 0;
+    if (!built && error) *error = aot_read_log(log_path.c_str());
+    
+    remove(source_path.c_str());
+    remove(output_path.c_str());
+    remove(log_path.c_str());
+    free(code);
+    free(path);
+    
+    if (!built) return NULL;
+    
+    const char* reason = NULL;
+    native = aot_load(source_text, cache_dir, &reason);
+    if (!native && error) *error = strdup(reason);
+    return native;
+}
+
+KCLNativeScript* kcl_aot_load(const char* source_text, const char* cache_dir) {
+    return aot_load(source_text, cache_dir, NULL);
+}
+
+void kcl_aot_unload(KCLNativeScript* native) {
+    if (!native) return;
+    
+    dlclose(native->handle);
+    free(native);
+}
+
+#else
+
+KCLNativeScript* kcl_aot_compile(const char* source_text, const char* cache_dir, char** error) {
+    if (error) *error = strdup("ahead-of-time compilation is not supported on this platform");
+    return NULL;
+}
+
+KCLNativeScript* kcl_aot_load(const char* source_text, const char* cache_dir) {
+    return NULL;
+}
+
+void kcl_aot_unload(KCLNativeScript* native) {
+}
+
+#endif
+
+typedef struct {
+    KCLContext* ctx;
+    OutputSink* sink;
+    CommandRegistry* registry;
+} KCLNativeSession;
+
+static const void* native_resolve(void* session, const char* name) {
+    KCLNativeSession* native = (KCLNativeSession*)session;
+    if (!native->registry) return NULL;
+    
+    return command_registry_resolve(native->registry, name, NULL);
+}
+
+static int native_run(void* session, const void* entry, const char* command_line, int pipeline, const char* redirect, int append) {
+    KCLNativeSession* native = (KCLNativeSession*)session;
+    return kcl_run_line(native->ctx, (const CommandEntry*)entry, command_line, pipeline != 0, redirect, append != 0, native->sink);
+}
+
+static int native_echo(void* session, const char* text, size_t length, const char* redirect, int append) {
+    KCLNativeSession* native = (KCLNativeSession*)session;
+    return kcl_run_echo(text, length, redirect, append != 0, native->sink);
+}
+
+static const char* native_variable(void* session, const char* name) {
+    KCLContext* ctx = ((KCLNativeSession*)session)->ctx;
+    const KCLVariable* variable = kcl_variables_find(&ctx->variables, name, strlen(name));
+    return variable ? kcl_value_data(&variable->value) : NULL;
+}
+
+static void native_fail(void* session, const char* message) {
+    OutputSink* sink = ((KCLNativeSession*)session)->sink;
+    sink->write(sink, OUTPUT_STREAM_STDERR, "kcl: ", 5);
+    sink->write(sink, OUTPUT_STREAM_STDERR, message, strlen(message));
+    sink->write(sink, OUTPUT_STREAM_STDERR, "\n", 1);
+}
+
+int kcl_aot_run(KCLNativeScript* native, KCLContext* ctx, OutputSink* sink) {
+    if (!native || !ctx || !sink) return -1;
+    
+    // Resolved entries belong to the pinned version, so it stays pinned for
+    // the whole run
+    KCLNativeSession session = { ctx, sink, NULL };
+    KernelRegistryGuard guard;
+    session.registry = kernel_registry_acquire(&guard);
+    
+    KCLNativeApi api = { KCL_NATIVE_ABI_VERSION, &session, native_resolve, native_run, native_echo, native_fail, native_variable };
+    int status = native->main(&api);
+    
+    kernel_registry_release(&guard);
+    return status;
+}
@@ -0,0 +1,46 @@
+#ifndef KCL_AOT_H
+#define KCL_AOT_H
+
+#include "kcl_interpreter.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KCL_AOT_DEFAULT_CACHE "/kurono/cache/kcl"
+#define KCL_NATIVE_ABI_VERSION 2
+
+/* Scripts compiled ahead of time become shared objects exporting
+ * kcl_native_main, which runs the script against this table and returns its
+ * exit status, and kcl_native_abi, the KCL_NATIVE_ABI_VERSION it was built
+ * for. Command names are resolved once when the script starts; resolve
+ * returns NULL for names that are missing or ambiguous, and run then resolves
+ * the command line itself so the script reports them as the interpreter
+ * does. variable returns the context's value for a name the script reads
+ * but never assigns, or NULL when it is unset. */
+typedef struct {
+    uint32_t abi_version;
+    void* session;
+    const void* (*resolve)(void* session, const char* name);
+    int (*run)(void* session, const void* entry, const char* command_line, int pipeline, const char* redirect, int append);
+    int (*echo)(void* session, const char* text, size_t length, const char* redirect, int append);
+    void (*fail)(void* session, const char* message);
+    const char* (*variable)(void* session, const char* name);
+} KCLNativeApi;
+
+typedef struct KCLNativeScript KCLNativeScript;
+
+/* C++ source for a parsed script, or NULL if the script has errors. */
+char* kcl_aot_generate(const KCLScript* script);
+
+/* Artifacts are cached as <cache_dir>/kcl-<hash>.so, keyed by the script
+ * text together with the ABI and code generator versions, so an edited
+ * script simply misses the cache. kcl_aot_compile runs $KCL_CXX (or $CXX, or
+ * c++) and loads the result; kcl_aot_load only loads an existing artifact,
+ * and only if both it and cache_dir are owned by the current user and are
+ * not group- or world-writable. Created directories and artifacts are 0700. */
+char* kcl_aot_cache_path(const char* source_text, const char* cache_dir);
+KCLNativeScript* kcl_aot_compile(const char* source_text, const char* cache_dir, char** error);
+KCLNativeScript* kcl_aot_load(const char* source_text, const char* cache_dir);
+int kcl_aot_run(KCLNativeScript* native, KCLContext* ctx, OutputSink* sink);
+void kcl_aot_unload(KCLNativeScript* native);
+
+#endif
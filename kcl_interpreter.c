@@ -1,65 +1,709 @@
 #include "kcl_interpreter.h"
+#include "kcl_aot.h"
+#include "kcl_vm.h"
+#include "perfect_hash.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <ctype.h>
+#include <stdarg.h>
 
+#define KCL_LEXER_INITIAL_TOKENS 100
+#define KCL_ARENA_MIN_CHUNK 4096
+#define KCL_ARENA_BYTES_PER_SOURCE_BYTE 8
+#define KCL_SOURCE_BYTES_PER_TOKEN 8
+
+// Character classes, so the lexer decides what to do with each byte through a
+// single table lookup
+#define KCL_CHAR_END 0x001
+#define KCL_CHAR_SPACE 0x002
+#define KCL_CHAR_BREAK 0x004
+#define KCL_CHAR_PIPE 0x008
+#define KCL_CHAR_REDIRECT 0x010
+#define KCL_CHAR_QUOTE 0x020
+#define KCL_CHAR_ESCAPE 0x040
+#define KCL_CHAR_COMMENT 0x080
+#define KCL_CHAR_NAME 0x100
+#define KCL_CHAR_DIGIT 0x200
+#define KCL_CHAR_WORD_END (KCL_CHAR_END | KCL_CHAR_SPACE | KCL_CHAR_BREAK | KCL_CHAR_PIPE | KCL_CHAR_REDIRECT)
+
+typedef struct {
+    uint16_t classes[256];
+} KCLCharTable;
+
+static constexpr KCLCharTable kcl_build_char_table(void) {
+    KCLCharTable table = {};
+    table.classes[(unsigned char)'\0'] = KCL_CHAR_END;
+    table.classes[(unsigned char)' '] = KCL_CHAR_SPACE;
+    table.classes[(unsigned char)'\t'] = KCL_CHAR_SPACE;
+    table.classes[(unsigned char)'\r'] = KCL_CHAR_SPACE;
+    table.classes[(unsigned char)'\n'] = KCL_CHAR_BREAK;
+    table.classes[(unsigned char)';'] = KCL_CHAR_BREAK;
+    table.classes[(unsigned char)'|'] = KCL_CHAR_PIPE;
+    table.classes[(unsigned char)'<'] = KCL_CHAR_REDIRECT;
+    table.classes[(unsigned char)'>'] = KCL_CHAR_REDIRECT;
+    table.classes[(unsigned char)'\''] = KCL_CHAR_QUOTE;
+    table.classes[(unsigned char)'"'] = KCL_CHAR_QUOTE;
+    table.classes[(unsigned char)'\\'] = KCL_CHAR_ESCAPE;
+    table.classes[(unsigned char)'#'] = KCL_CHAR_COMMENT;
+    table.classes[(unsigned char)'_'] = KCL_CHAR_NAME;
+    for (int c = 'a'; c <= 'z'; c++) table.classes[c] = KCL_CHAR_NAME;
+    for (int c = 'A'; c <= 'Z'; c++) table.classes[c] = KCL_CHAR_NAME;
+    for (int c = '0'; c <= '9'; c++) table.classes[c] = KCL_CHAR_NAME | KCL_CHAR_DIGIT;
+    return table;
+}
+
+static constexpr KCLCharTable kcl_char_table = kcl_build_char_table();
+
+static inline uint16_t kcl_char_class(char c) {
+    return kcl_char_table.classes[(unsigned char)c];
+}
+
+static bool kcl_is_name_char(char c) {
+    return (kcl_char_class(c) & KCL_CHAR_NAME) != 0;
+}
+
+static bool kcl_lexer_push(KCLLexer* lexer, KCLTokenType type, const char* start, size_t length, int line, int column) {
+    size_t offset = (size_t)(start - lexer->source);
+    if (offset > UINT32_MAX || length > UINT32_MAX) return false;
+    
+    if (lexer->count >= lexer->capacity) {
+        size_t capacity = lexer->capacity * 2;
+        KCLToken* tokens = (KCLToken*)realloc(lexer->tokens, sizeof(KCLToken) * capacity);
+        if (!tokens) return false;
+        lexer->tokens = tokens;
+        lexer->capacity = capacity;
+    }
+    
+    KCLToken* token = &lexer->tokens[lexer->count++];
+    token->type = type;
+    token->offset = (uint32_t)offset;
+    token->length = (uint32_t)length;
+    token->line = line;
+    token->column = column;
+    return true;
+}
+
+static bool kcl_lexer_at_separator(const KCLLexer* lexer) {
+    return lexer->count > 0 && lexer->tokens[lexer->count - 1].type == KCL_TOKEN_OPERATOR &&
+           lexer->tokens[lexer->count - 1].length == 1;
+}
+
+typedef struct {
+    const char* cursor;
+    const char* line_start;
+    int line;
+} KCLScan;
+
+// Scans one word and classifies it on the way, so no byte is looked at twice:
+// a lone $NAME or ${NAME} is a variable, a single quoted run a string, digits
+// a number and == or != an operator; the first word of a statement is its
+// command. Newlines inside quotes advance the line
+static KCLTokenType kcl_scan_word(KCLScan* scan, bool at_command) {
+    const char* start = scan->cursor;
+    const char* p = start;
+    const char* closed = NULL;
+    char quote = '\0';
+    size_t quote_runs = 0;
+    size_t escapes = 0;
+    size_t non_name = 0;
+    size_t non_digit = 0;
+    
+    for (;; p++) {
+        char c = *p;
+        uint16_t cls = kcl_char_class(c);
+        if (quote) {
+            if (cls & KCL_CHAR_END) break;
+            if (c == quote) {
+                quote = '\0';
+                closed = p;
+            } else if (quote == '"' && (cls & KCL_CHAR_ESCAPE) && p[1]) {
+                p++;
+                escapes++;
+            } else if (c == '\n') {
+                scan->line++;
+                scan->line_start = p + 1;
+            }
+        } else if (cls & KCL_CHAR_WORD_END) {
+            break;
+        } else if (cls & KCL_CHAR_QUOTE) {
+            quote = c;
+            quote_runs++;
+        } else if ((cls & KCL_CHAR_ESCAPE) && p[1]) {
+            p++;
+            escapes++;
+        }
+        if (p > start) {
+            non_name += !(cls & KCL_CHAR_NAME);
+            non_digit += !(cls & KCL_CHAR_DIGIT);
+        }
+    }
+    scan->cursor = p;
+    
+    if (quote) return KCL_TOKEN_UNKNOWN;
+    if (at_command) return KCL_TOKEN_COMMAND;
+    
+    size_t length = (size_t)(p - start);
+    char first = start[0];
+    if (first == '$' && length > 1 && escapes == 0) {
+        if (non_name == 0) return KCL_TOKEN_VARIABLE;
+        if (start[1] == '{' && start[length - 1] == '}' && length > 3 && non_name == 2) return KCL_TOKEN_VARIABLE;
+    }
+    if ((kcl_char_class(first) & KCL_CHAR_QUOTE) && quote_runs == 1 && closed == p - 1 && (first == '\'' || escapes == 0)) {
+        return KCL_TOKEN_STRING;
+    }
+    if (((kcl_char_class(first) & KCL_CHAR_DIGIT) || (first == '-' && length > 1)) && non_digit == 0 && escapes == 0) {
+        return KCL_TOKEN_NUMBER;
+    }
+    if (length == 2 && start[1] == '=' && (first == '=' || first == '!')) return KCL_TOKEN_OPERATOR;
+    return KCL_TOKEN_ARGUMENT;
+}
+
+// One forward pass over the input. Tokens keep the raw source text of each
+// word, quotes included; the parser decides what the quoting means
 KCLLexer* kcl_lexer_create(const char* input) {
     if (!input) return NULL;
     
     KCLLexer* lexer = (KCLLexer*)malloc(sizeof(KCLLexer));
     if (!lexer) return NULL;
     
-    lexer->tokens = (KCLToken*)malloc(sizeof(KCLToken) * 100);
+    // Sized from the input so large scripts rarely regrow the array
+    size_t capacity = strlen(input) / KCL_SOURCE_BYTES_PER_TOKEN;
+    if (capacity < KCL_LEXER_INITIAL_TOKENS) capacity = KCL_LEXER_INITIAL_TOKENS;
+    
+    lexer->source = input;
+    lexer->tokens = (KCLToken*)malloc(sizeof(KCLToken) * capacity);
     lexer->count = 0;
-    lexer->capacity = 100;
+    lexer->capacity = capacity;
     lexer->current = 0;
+    if (!lexer->tokens) {
+        free(lexer);
+        return NULL;
+    }
+    
+    KCLScan scan = { input, input, 1 };
+    bool at_command = true;
+    bool ok = true;
+    
+    while (ok) {
+        const char* cursor = scan.cursor;
+        uint16_t cls = kcl_char_class(*cursor);
+        int column = (int)(cursor - scan.line_start) + 1;
+        
+        if (cls & KCL_CHAR_END) {
+            break;
+        } else if (cls & KCL_CHAR_SPACE) {
+            scan.cursor++;
+        } else if (cls & KCL_CHAR_COMMENT) {
+            const char* end = strchr(cursor, '\n');
+            scan.cursor = end ? end : cursor + strlen(cursor);
+        } else if (cls & KCL_CHAR_BREAK) {
+            // Statement separators; consecutive ones collapse into one token
+            if (!kcl_lexer_at_separator(lexer)) {
+                ok = kcl_lexer_push(lexer, KCL_TOKEN_OPERATOR, cursor, 1, scan.line, column);
+            }
+            if (*cursor == '\n') {
+                scan.line++;
+                scan.line_start = cursor + 1;
+            }
+            scan.cursor++;
+            at_command = true;
+        } else if (cls & KCL_CHAR_PIPE) {
+            ok = kcl_lexer_push(lexer, KCL_TOKEN_PIPE, cursor, 1, scan.line, column);
+            scan.cursor++;
+            at_command = true;
+        } else if (cls & KCL_CHAR_REDIRECT) {
+            size_t length = (*cursor == '>' && cursor[1] == '>') ? 2 : 1;
+            ok = kcl_lexer_push(lexer, KCL_TOKEN_REDIRECT, cursor, length, scan.line, column);
+            scan.cursor += length;
+        } else {
+            int line = scan.line;
+            KCLTokenType type = kcl_scan_word(&scan, at_command);
+            ok = kcl_lexer_push(lexer, type, cursor, (size_t)(scan.cursor - cursor), line, column);
+            at_command = false;
+        }
+    }
     
+    if (!ok) {
+        kcl_lexer_destroy(lexer);
+        return NULL;
+    }
     return lexer;
 }
 
 void kcl_lexer_destroy(KCLLexer* lexer) {
     if (!lexer) return;
     
-    for (size_t i = 0; i < lexer->count; i++) {
-        free(lexer->tokens[i].value);
-    }
-    
     free(lexer->tokens);
     free(lexer);
 }
 
 KCLToken kcl_lexer_next_token(KCLLexer* lexer) {
+    if (lexer && lexer->current < lexer->count) {
+        return lexer->tokens[lexer->current++];
+    }
+    
     KCLToken token;
     token.type = KCL_TOKEN_EOF;
-    token.value = NULL;
-    token.line = 1;
+    token.offset = lexer ? (uint32_t)strlen(lexer->source) : 0;
+    token.length = 0;
+    token.line = (lexer && lexer->count) ? lexer->tokens[lexer->count - 1].line : 1;
     token.column = 0;
     
     return token;
 }
 
+// The token's text is not NUL-terminated; it runs for token->length bytes
+const char* kcl_token_text(const KCLLexer* lexer, const KCLToken* token) {
+    if (!lexer || !token) return NULL;
+    return lexer->source + token->offset;
+}
+
+// Nodes, their values and their child spans all live in the script's arena.
+// While a node is being parsed its children collect on the parser's stack;
+// closing the node copies them into one exactly sized span, so a script costs
+// a handful of heap allocations however many nodes it has
+typedef struct {
+    KCLLexer* lexer;
+    KCLScript* script;
+    KCLNode** stack;
+    size_t stack_count;
+    size_t stack_capacity;
+    OutputBuffer literal;
+} KCLParser;
+
+static KCLNode* kcl_node_create(KCLParser* parser, KCLNodeType type, const char* value, size_t length) {
+    KCLNode* node = (KCLNode*)arena_alloc(&parser->script->arena, sizeof(KCLNode), 0);
+    if (!node) return NULL;
+    
+    node->type = type;
+    node->value = NULL;
+    node->children = NULL;
+    node->child_count = 0;
+    if (value && !(node->value = arena_strndup(&parser->script->arena, value, length))) return NULL;
+    return node;
+}
+
+static bool kcl_push_child(KCLParser* parser, KCLNode* child) {
+    if (!child) return false;
+    
+    if (parser->stack_count >= parser->stack_capacity) {
+        size_t capacity = parser->stack_capacity ? parser->stack_capacity * 2 : 64;
+        KCLNode** stack = (KCLNode**)realloc(parser->stack, sizeof(KCLNode*) * capacity);
+        if (!stack) return false;
+        parser->stack = stack;
+        parser->stack_capacity = capacity;
+    }
+    
+    parser->stack[parser->stack_count++] = child;
+    return true;
+}
+
+// Moves the children pushed since base into the node
+static bool kcl_close_node(KCLParser* parser, KCLNode* node, size_t base) {
+    size_t count = parser->stack_count - base;
+    parser->stack_count = base;
+    if (count == 0) return true;
+    
+    KCLNode** children = (KCLNode**)arena_alloc(&parser->script->arena, sizeof(KCLNode*) * count, 0);
+    if (!children) return false;
+    memcpy(children, parser->stack + base, sizeof(KCLNode*) * count);
+    node->children = children;
+    node->child_count = count;
+    return true;
+}
+
+static KCLToken* kcl_peek(KCLParser* parser) {
+    KCLLexer* lexer = parser->lexer;
+    return lexer->current < lexer->count ? &lexer->tokens[lexer->current] : NULL;
+}
+
+static bool kcl_parse_error(KCLParser* parser, const KCLToken* token, const char* message) {
+    if (parser->script->has_error) return false;
+    
+    char buffer[256];
+    int line = token ? token->line : kcl_lexer_next_token(parser->lexer).line;
+    snprintf(buffer, sizeof(buffer), "line %d: %s", line, message);
+    parser->script->error_message = strdup(buffer);
+    parser->script->has_error = true;
+    return false;
+}
+
+static const char* kcl_text(KCLParser* parser, const KCLToken* token) {
+    return kcl_token_text(parser->lexer, token);
+}
+
+static bool kcl_is_separator(const KCLToken* token) {
+    return token && token->type == KCL_TOKEN_OPERATOR && token->length == 1;
+}
+
+static bool kcl_is_word_token(const KCLToken* token) {
+    return token && (token->type == KCL_TOKEN_COMMAND || token->type == KCL_TOKEN_ARGUMENT ||
+                     token->type == KCL_TOKEN_VARIABLE || token->type == KCL_TOKEN_STRING ||
+                     token->type == KCL_TOKEN_NUMBER || token->type == KCL_TOKEN_OPERATOR) &&
+           !kcl_is_separator(token);
+}
+
+static bool kcl_flush_literal(KCLParser* parser) {
+    OutputBuffer* literal = &parser->literal;
+    if (literal->length == 0) return true;
+    bool added = kcl_push_child(parser, kcl_node_create(parser, KCL_NODE_LITERAL, literal->data, literal->length));
+    literal->length = 0;
+    return added;
+}
+
+// Decodes quoting and escapes and splits out $NAME expansions. Words made of a
+// single part collapse into that LITERAL or VARIABLE node
+static KCLNode* kcl_parse_word_text(KCLParser* parser, const char* raw, size_t length) {
+    OutputBuffer* literal = &parser->literal;
+    literal->length = 0;
+    size_t base = parser->stack_count;
+    bool ok = true;
+    bool quoted = false;
+    char quote = '\0';
+    
+    const char* end = raw + length;
+    for (const char* cursor = raw; ok && cursor < end; cursor++) {
+        char c = *cursor;
+        if (quote == '\'') {
+            if (c == '\'') quote = '\0';
+            else ok = output_buffer_append(literal, cursor, 1);
+        } else if (c == '\'' || c == '"') {
+            if (quote == c) {
+                quote = '\0';
+            } else if (!quote) {
+                quote = c;
+                quoted = true;
+            } else {
+                ok = output_buffer_append(literal, cursor, 1);
+            }
+        } else if (c == '\\' && cursor + 1 < end) {
+            // Inside double quotes only the characters that mean something
+            // there can be escaped
+            char next = cursor[1];
+            if (quote == '"' && next != '"' && next != '\\' && next != '$') {
+                ok = output_buffer_append(literal, cursor, 1);
+            } else {
+                ok = output_buffer_append(literal, cursor + 1, 1);
+                cursor++;
+            }
+        } else if (c == '$' && cursor + 1 < end && (kcl_is_name_char(cursor[1]) ||
+                                                     (cursor[1] == '{' && memchr(cursor, '}', (size_t)(end - cursor))))) {
+            bool braced = cursor[1] == '{';
+            const char* name = cursor + (braced ? 2 : 1);
+            const char* name_end = name;
+            while (name_end < end && kcl_is_name_char(*name_end)) name_end++;
+            if (braced && (name_end == end || *name_end != '}')) {
+                ok = output_buffer_append(literal, cursor, 1);
+                continue;
+            }
+            ok = kcl_flush_literal(parser) &&
+                 kcl_push_child(parser, kcl_node_create(parser, KCL_NODE_VARIABLE, name, (size_t)(name_end - name)));
+            cursor = braced ? name_end : name_end - 1;
+        } else {
+            ok = output_buffer_append(literal, cursor, 1);
+        }
+    }
+    
+    // A quoted empty string is still one (empty) word
+    if (ok && (literal->length > 0 || (quoted && parser->stack_count == base))) {
+        ok = kcl_push_child(parser, kcl_node_create(parser, KCL_NODE_LITERAL, literal->data ? literal->data : "", literal->length));
+    }
+    if (!ok) return NULL;
+    
+    if (parser->stack_count - base == 1) return parser->stack[--parser->stack_count];
+    
+    KCLNode* word = kcl_node_create(parser, KCL_NODE_WORD, NULL, 0);
+    if (!word || !kcl_close_node(parser, word, base)) return NULL;
+    return word;
+}
+
+static KCLNode* kcl_parse_word(KCLParser* parser) {
+    KCLToken* token = kcl_peek(parser);
+    if (!kcl_is_word_token(token)) {
+        kcl_parse_error(parser, token, "expected a word");
+        return NULL;
+    }
+    parser->lexer->current++;
+    
+    KCLNode* word = kcl_parse_word_text(parser, kcl_text(parser, token), token->length);
+    if (!word) kcl_parse_error(parser, token, "out of memory");
+    return word;
+}
+
+static bool kcl_expect_separator(KCLParser* parser) {
+    KCLToken* token = kcl_peek(parser);
+    if (!token) return true;
+    if (!kcl_is_separator(token)) return kcl_parse_error(parser, token, "expected end of statement");
+    parser->lexer->current++;
+    return true;
+}
+
+static bool kcl_text_is(const char* text, size_t length, const char* word) {
+    return strncmp(text, word, length) == 0 && word[length] == '\0';
+}
+
+static bool kcl_token_is(KCLParser* parser, const KCLToken* token, const char* text) {
+    return kcl_is_word_token(token) && kcl_text_is(kcl_text(parser, token), token->length, text);
+}
+
+static bool kcl_is_comparison(const char* op, size_t length) {
+    static const char* operators[] = { "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL };
+    for (int i = 0; operators[i]; i++) {
+        if (kcl_text_is(op, length, operators[i])) return true;
+    }
+    return false;
+}
+
+static KCLNode* kcl_parse_block(KCLParser* parser, const char* const* terminators);
+
+static bool kcl_is_name(const char* text, size_t length) {
+    if (length == 0 || (kcl_char_class(*text) & KCL_CHAR_DIGIT)) return false;
+    for (size_t i = 0; i < length; i++) {
+        if (!kcl_is_name_char(text[i])) return false;
+    }
+    return true;
+}
+
+static const char* kcl_end_only[] = { "kcl-end", NULL };
+static const char* kcl_else_or_end[] = { "kcl-else", "kcl-end", NULL };
+
+// WORD OP WORD, stored as the node's value and its first two children
+static bool kcl_parse_condition(KCLParser* parser, KCLNode* node) {
+    if (!kcl_push_child(parser, kcl_parse_word(parser))) return false;
+    
+    KCLToken* op = kcl_peek(parser);
+    if (!kcl_is_word_token(op) || !kcl_is_comparison(kcl_text(parser, op), op->length)) {
+        return kcl_parse_error(parser, op, "expected a comparison operator");
+    }
+    parser->lexer->current++;
+    node->value = arena_strndup(&parser->script->arena, kcl_text(parser, op), op->length);
+    
+    return node->value && kcl_push_child(parser, kcl_parse_word(parser)) && kcl_expect_separator(parser);
+}
+
+static KCLNode* kcl_parse_control(KCLParser* parser, KCLToken* keyword) {
+    KCLNode* node = NULL;
+    size_t base = parser->stack_count;
+    bool ok = false;
+    
+    if (kcl_token_is(parser, keyword, "kcl-if")) {
+        node = kcl_node_create(parser, KCL_NODE_IF, NULL, 0);
+        ok = node && kcl_parse_condition(parser, node) &&
+             kcl_push_child(parser, kcl_parse_block(parser, kcl_else_or_end));
+        if (ok && kcl_token_is(parser, kcl_peek(parser), "kcl-else")) {
+            parser->lexer->current++;
+            ok = kcl_expect_separator(parser) && kcl_push_child(parser, kcl_parse_block(parser, kcl_end_only));
+        }
+    } else if (kcl_token_is(parser, keyword, "kcl-while")) {
+        node = kcl_node_create(parser, KCL_NODE_WHILE, NULL, 0);
+        ok = node && kcl_parse_condition(parser, node) &&
+             kcl_push_child(parser, kcl_parse_block(parser, kcl_end_only));
+    } else {
+        KCLToken* name = kcl_peek(parser);
+        if (!kcl_is_word_token(name) || !kcl_is_name(kcl_text(parser, name), name->length)) {
+            kcl_parse_error(parser, name, "kcl-for expects a variable name");
+            return NULL;
+        }
+        parser->lexer->current++;
+        node = kcl_node_create(parser, KCL_NODE_FOR, kcl_text(parser, name), name->length);
+    
+        KCLToken* form = kcl_peek(parser);
+        if (node && kcl_token_is(parser, form, "in")) {
+            parser->lexer->current++;
+            ok = true;
+            while (ok && kcl_is_word_token(kcl_peek(parser))) {
+                ok = kcl_push_child(parser, kcl_parse_word(parser));
+            }
+        } else if (node && kcl_token_is(parser, form, "from")) {
+            parser->lexer->current++;
+            KCLNode* range = kcl_node_create(parser, KCL_NODE_RANGE, NULL, 0);
+            size_t range_base = parser->stack_count;
+            ok = range && kcl_push_child(parser, kcl_parse_word(parser));
+            if (ok && !kcl_token_is(parser, kcl_peek(parser), "to")) {
+                ok = kcl_parse_error(parser, kcl_peek(parser), "kcl-for expects 'to'");
+            } else if (ok) {
+                parser->lexer->current++;
+                ok = kcl_push_child(parser, kcl_parse_word(parser));
+            }
+            ok = ok && kcl_close_node(parser, range, range_base) && kcl_push_child(parser, range);
+        } else if (node) {
+            kcl_parse_error(parser, form, "kcl-for expects 'in' or 'from'");
+        }
+        ok = ok && kcl_expect_separator(parser) && kcl_push_child(parser, kcl_parse_block(parser, kcl_end_only));
+    }
+    
+    // The block parser stops at its terminator; consume the closing kcl-end
+    if (ok && kcl_token_is(parser, kcl_peek(parser), "kcl-end")) {
+        parser->lexer->current++;
+        ok = kcl_expect_separator(parser);
+    } else if (ok) {
+        ok = kcl_parse_error(parser, keyword, "missing kcl-end");
+    }
+    
+    if (!ok || !kcl_close_node(parser, node, base)) return NULL;
+    return node;
+}
+
+static KCLNode* kcl_parse_command(KCLParser* parser, bool* redirected) {
+    KCLNode* command = kcl_node_create(parser, KCL_NODE_COMMAND, NULL, 0);
+    if (!command) return NULL;
+    size_t base = parser->stack_count;
+    
+    bool ok = kcl_push_child(parser, kcl_parse_word(parser));
+    for (KCLToken* token = kcl_peek(parser); ok && token && !kcl_is_separator(token) && token->type != KCL_TOKEN_PIPE; token = kcl_peek(parser)) {
+        if (token->type == KCL_TOKEN_REDIRECT) {
+            if (kcl_text(parser, token)[0] == '<') {
+                ok = kcl_parse_error(parser, token, "input redirection is not supported");
+                break;
+            }
+            parser->lexer->current++;
+            KCLNode* redirect = kcl_node_create(parser, KCL_NODE_REDIRECTION, kcl_text(parser, token), token->length);
+            size_t redirect_base = parser->stack_count;
+            ok = redirect && kcl_push_child(parser, kcl_parse_word(parser)) &&
+                 kcl_close_node(parser, redirect, redirect_base) && kcl_push_child(parser, redirect);
+            *redirected = true;
+        } else if (*redirected) {
+            ok = kcl_parse_error(parser, token, "words must come before the redirection");
+        } else if (token->type == KCL_TOKEN_UNKNOWN) {
+            ok = kcl_parse_error(parser, token, "unterminated quote");
+        } else {
+            ok = kcl_push_child(parser, kcl_parse_word(parser));
+        }
+    }
+    
+    if (!ok || !kcl_close_node(parser, command, base)) return NULL;
+    return command;
+}
+
+static KCLNode* kcl_parse_statement(KCLParser* parser) {
+    KCLToken* token = kcl_peek(parser);
+    if (token->type == KCL_TOKEN_UNKNOWN) {
+        kcl_parse_error(parser, token, "unterminated quote");
+        return NULL;
+    }
+    
+    if (kcl_token_is(parser, token, "kcl-if") || kcl_token_is(parser, token, "kcl-while") || kcl_token_is(parser, token, "kcl-for")) {
+        parser->lexer->current++;
+        return kcl_parse_control(parser, token);
+    }
+    
+    if (kcl_token_is(parser, token, "kcl-set")) {
+        parser->lexer->current++;
+        KCLToken* name = kcl_peek(parser);
+        if (!kcl_is_word_token(name) || !kcl_is_name(kcl_text(parser, name), name->length)) {
+            kcl_parse_error(parser, name, "kcl-set expects a variable name");
+            return NULL;
+        }
+        parser->lexer->current++;
+    
+        KCLNode* assignment = kcl_node_create(parser, KCL_NODE_ASSIGNMENT, kcl_text(parser, name), name->length);
+        size_t base = parser->stack_count;
+        bool ok = assignment != NULL;
+        while (ok && kcl_is_word_token(kcl_peek(parser))) {
+            ok = kcl_push_child(parser, kcl_parse_word(parser));
+        }
+        if (!ok || !kcl_expect_separator(parser) || !kcl_close_node(parser, assignment, base)) return NULL;
+        return assignment;
+    }
+    
+    // Only the last command of a pipeline may redirect its output
+    bool redirected = false;
+    KCLNode* command = kcl_parse_command(parser, &redirected);
+    if (!command) return NULL;
+    if (kcl_peek(parser) && kcl_peek(parser)->type != KCL_TOKEN_PIPE) {
+        if (!kcl_expect_separator(parser)) return NULL;
+        return command;
+    }
+    if (!kcl_peek(parser)) return command;
+    
+    KCLNode* pipeline = kcl_node_create(parser, KCL_NODE_PIPELINE, NULL, 0);
+    size_t base = parser->stack_count;
+    bool ok = pipeline && kcl_push_child(parser, command);
+    while (ok && kcl_peek(parser) && kcl_peek(parser)->type == KCL_TOKEN_PIPE) {
+        if (redirected) {
+            ok = kcl_parse_error(parser, kcl_peek(parser), "only the last pipeline stage may redirect");
+            break;
+        }
+        parser->lexer->current++;
+        ok = kcl_push_child(parser, kcl_parse_command(parser, &redirected));
+    }
+    
+    if (!ok || !kcl_expect_separator(parser) || !kcl_close_node(parser, pipeline, base)) return NULL;
+    return pipeline;
+}
+
+static KCLNode* kcl_parse_block(KCLParser* parser, const char* const* terminators) {
+    KCLNode* block = kcl_node_create(parser, KCL_NODE_BLOCK, NULL, 0);
+    if (!block) return NULL;
+    size_t base = parser->stack_count;
+    
+    for (KCLToken* token = kcl_peek(parser); token; token = kcl_peek(parser)) {
+        if (kcl_is_separator(token)) {
+            parser->lexer->current++;
+            continue;
+        }
+    
+        bool terminated = false;
+        for (int i = 0; terminators && terminators[i]; i++) {
+            if (token->type == KCL_TOKEN_COMMAND && kcl_token_is(parser, token, terminators[i])) terminated = true;
+        }
+        if (terminated) break;
+    
+        if (token->type == KCL_TOKEN_COMMAND && (kcl_token_is(parser, token, "kcl-end") || kcl_token_is(parser, token, "kcl-else"))) {
+            kcl_parse_error(parser, token, "unexpected block terminator");
+        }
+        if (parser->script->has_error || !kcl_push_child(parser, kcl_parse_statement(parser))) {
+            kcl_parse_error(parser, token, "invalid statement");
+            return NULL;
+        }
+    }
+    
+    if (!kcl_close_node(parser, block, base)) return NULL;
+    return block;
+}
+
 KCLScript* kcl_parse(const char* input) {
     if (!input) return NULL;
     
     KCLScript* script = (KCLScript*)malloc(sizeof(KCLScript));
     if (!script) return NULL;
     
+    // A parsed script takes about six arena bytes per source byte, so a single
+    // chunk usually holds the whole tree; pages it never touches cost nothing
+    size_t chunk_size = strlen(input) * KCL_ARENA_BYTES_PER_SOURCE_BYTE;
+    arena_init(&script->arena, chunk_size > KCL_ARENA_MIN_CHUNK ? chunk_size : KCL_ARENA_MIN_CHUNK);
     script->root = NULL;
     script->script_path = NULL;
     script->error_message = NULL;
     script->has_error = false;
     
+    KCLParser parser;
+    parser.lexer = kcl_lexer_create(input);
+    parser.script = script;
+    parser.stack = NULL;
+    parser.stack_count = 0;
+    parser.stack_capacity = 0;
+    output_buffer_init(&parser.literal);
+    if (!parser.lexer) {
+        kcl_parse_error(&parser, NULL, "out of memory");
+        return script;
+    }
+    
+    script->root = kcl_parse_block(&parser, NULL);
+    if (!script->root && !script->has_error) {
+        kcl_parse_error(&parser, NULL, "out of memory");
+    }
+    
+    free(parser.stack);
+    output_buffer_free(&parser.literal);
+    kcl_lexer_destroy(parser.lexer);
     return script;
 }
 
 void kcl_script_destroy(KCLScript* script) {
     if (!script) return;
     
-    if (script->root) {
-        // TODO: Implement proper AST destruction
-    }
-    
+    arena_release(&script->arena);
     free(script->script_path);
     free(script->error_message);
     free(script);
@@ -71,10 +715,12 @@ KCLContext* kcl_context_create(KernelContext* kernel_ctx) {
     KCLContext* ctx = (KCLContext*)malloc(sizeof(KCLContext));
     if (!ctx) return NULL;
     
-    ctx->variables = (char*)malloc(1024);
-    ctx->var_count = 0;
-    ctx->var_capacity = 1024;
+    kcl_variables_init(&ctx->variables);
+    ctx->frame = NULL;
     ctx->kernel_ctx = kernel_ctx;
+    ctx->native_cache_dir = NULL;
+    ctx->bytecode_cache_dir = NULL;
+    ctx->programs = kcl_program_cache_create(KCL_PROGRAM_CACHE_ENTRIES);
     
     return ctx;
 }
@@ -82,101 +728,335 @@ KCLContext* kcl_context_create(KernelContext* kernel_ctx) {
 void kcl_context_destroy(KCLContext* ctx) {
     if (!ctx) return;
     
-    free(ctx->variables);
+    kcl_program_cache_destroy(ctx->programs);
+    kcl_variables_free(&ctx->variables);
+    free(ctx->native_cache_dir);
+    free(ctx->bytecode_cache_dir);
     free(ctx);
 }
 
+bool kcl_context_set_native_cache(KCLContext* ctx, const char* cache_dir) {
+    if (!ctx) return false;
+    
+    char* copy = NULL;
+    if (cache_dir && !(copy = strdup(cache_dir))) return false;
+    free(ctx->native_cache_dir);
+    ctx->native_cache_dir = copy;
+    return true;
+}
+
+bool kcl_context_set_bytecode_cache(KCLContext* ctx, const char* cache_dir) {
+    if (!ctx) return false;
+    
+    char* copy = NULL;
+    if (cache_dir && !(copy = strdup(cache_dir))) return false;
+    free(ctx->bytecode_cache_dir);
+    ctx->bytecode_cache_dir = copy;
+    return true;
+}
+
+typedef struct {
+    FILE* file;
+    OutputSink* outer;
+} KCLFileSink;
+
+// Redirected stdout goes to the file; stderr still reaches the caller
+static bool kcl_file_sink_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    KCLFileSink* target = (KCLFileSink*)sink->userdata;
+    if (stream == OUTPUT_STREAM_STDERR) {
+        return target->outer->write(target->outer, stream, data, length);
+    }
+    return fwrite(data, 1, length, target->file) == length;
+}
+
+static bool kcl_sink_printf(OutputSink* sink, OutputStream stream, const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return false;
+    return sink->write(sink, stream, buffer, (size_t)length < sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1);
+}
+
+static FILE* kcl_open_redirect(const char* redirect, bool append, OutputSink* sink) {
+    FILE* file = fopen(redirect, append ? "ab" : "wb");
+    if (!file) kcl_sink_printf(sink, OUTPUT_STREAM_STDERR, "kcl: cannot open %s\n", redirect);
+    return file;
+}
+
+static int kcl_result_status(ExecutionResult* result, OutputSink* sink) {
+    if (!result) return 1;
+    
+    int status;
+    if (result->result == CMD_NOT_FOUND) {
+        status = 127;
+    } else if (result->exit_code >= 0) {
+        status = result->exit_code;
+    } else {
+        status = result->result == CMD_SUCCESS ? 0 : 1;
+    }
+    
+    // Executors that stream leave output NULL; placeholders report through it
+    if (result->output) {
+        sink->write(sink, OUTPUT_STREAM_STDOUT, result->output, strlen(result->output));
+        sink->write(sink, OUTPUT_STREAM_STDOUT, "\n", 1);
+    }
+    if (result->error) {
+        kcl_sink_printf(sink, OUTPUT_STREAM_STDERR, "kcl: %s\n", result->error);
+    }
+    
+    execution_result_destroy(result);
+    return status;
+}
+
+static int kcl_pipeline_status(PipelineResult* pipeline, OutputSink* sink) {
+    if (!pipeline) return 1;
+    
+    int status = 1;
+    if (pipeline->error) {
+        kcl_sink_printf(sink, OUTPUT_STREAM_STDERR, "kcl: %s\n", pipeline->error);
+    } else if (pipeline->stage_count > 0) {
+        const PipelineStage* last = &pipeline->stages[pipeline->stage_count - 1];
+        status = last->result == CMD_NOT_FOUND ? 127 : last->exit_code >= 0 ? last->exit_code : 1;
+    }
+    
+    pipeline_result_destroy(pipeline);
+    return status;
+}
+
+int kcl_run_line(KCLContext* ctx, const CommandEntry* entry, const char* command_line, bool pipeline, const char* redirect, bool append, OutputSink* sink) {
+    if (!ctx || !command_line || !sink) return 1;
+    
+    KCLFileSink target = { NULL, sink };
+    OutputSink file_sink = { kcl_file_sink_write, &target, -1 };
+    if (redirect) {
+        if (!(target.file = kcl_open_redirect(redirect, append, sink))) return 1;
+        sink = &file_sink;
+    }
+    
+    int status;
+    if (pipeline) {
+        status = kcl_pipeline_status(kernel_execute_pipeline(ctx->kernel_ctx, command_line, sink), target.outer);
+    } else if (entry) {
+        status = kcl_result_status(kernel_execute_entry(ctx->kernel_ctx, entry, command_line, sink), sink);
+    } else {
+        ExecutionResult* result = kernel_execute_command_streaming(ctx->kernel_ctx, command_line, sink);
+        if (result && result->result == CMD_NOT_FOUND) {
+            kcl_sink_printf(target.outer, OUTPUT_STREAM_STDERR, "kcl: command not found: %.*s\n", (int)strcspn(command_line, " "), command_line);
+            execution_result_set_static_error(result, NULL);
+        }
+        status = kcl_result_status(result, sink);
+    }
+    
+    if (target.file) fclose(target.file);
+    return status;
+}
+
+int kcl_run_echo(const char* text, size_t length, const char* redirect, bool append, OutputSink* sink) {
+    if (!text || !sink) return 1;
+    
+    if (redirect) {
+        FILE* file = kcl_open_redirect(redirect, append, sink);
+        if (!file) return 1;
+        bool written = fwrite(text, 1, length, file) == length && fputc('\n', file) != EOF;
+        return (fclose(file) == 0 && written) ? 0 : 1;
+    }
+    
+    return (sink->write(sink, OUTPUT_STREAM_STDOUT, text, length) &&
+            sink->write(sink, OUTPUT_STREAM_STDOUT, "\n", 1)) ? 0 : 1;
+}
+
+int kcl_execute_streaming(KCLContext* ctx, KCLScript* script, OutputSink* sink) {
+    if (!ctx || !script || !sink) return -1;
+    
+    char* error = NULL;
+    KCLProgram* program = kcl_program_compile(script, &error);
+    if (!program) {
+        kcl_sink_printf(sink, OUTPUT_STREAM_STDERR, "kcl: %s\n", error ? error : "out of memory");
+        free(error);
+        return -1;
+    }
+    
+    int status = kcl_program_run(program, ctx, sink);
+    kcl_program_destroy(program);
+    return status;
+}
+
 ExecutionResult* kcl_execute(KCLContext* ctx, KCLScript* script) {
     if (!ctx || !script) return NULL;
     
-    ExecutionResult* result = (ExecutionResult*)malloc(sizeof(ExecutionResult));
+    ExecutionResult* result = execution_result_create();
     if (!result) return NULL;
     
-    result->result = CMD_SUCCESS;
-    result->output = strdup("KCL script executed successfully");
-    result->error = NULL;
-    result->exit_code = 0;
+    OutputCapture capture;
+    output_capture_init(&capture);
+    
+    int status = kcl_execute_streaming(ctx, script, &capture.sink);
+    result->result = status == 0 ? CMD_SUCCESS : CMD_EXECUTION_FAILED;
+    result->exit_code = status;
     
+    output_capture_finish(&capture, result);
     return result;
 }
 
+// Runs a compiled program with its output captured into a result
+static ExecutionResult* kcl_execute_program(KCLContext* ctx, const KCLProgram* program) {
+    ExecutionResult* result = execution_result_create();
+    if (!result) return NULL;
+    
+    OutputCapture capture;
+    output_capture_init(&capture);
+    
+    int status = kcl_program_run(program, ctx, &capture.sink);
+    result->result = status == 0 ? CMD_SUCCESS : CMD_EXECUTION_FAILED;
+    result->exit_code = status;
+    
+    output_capture_finish(&capture, result);
+    return result;
+}
+
+char* kcl_read_script(const char* filename) {
+    if (!filename) return NULL;
+    
+    FILE* file = fopen(filename, "rb");
+    if (!file) return NULL;
+    
+    OutputBuffer text;
+    output_buffer_init(&text);
+    output_buffer_read_file(&text, file);
+    fclose(file);
+    
+    if (!output_buffer_append(&text, "", 0)) {
+        output_buffer_free(&text);
+        return NULL;
+    }
+    return output_buffer_take(&text);
+}
+
+int kcl_execute_file_streaming(KCLContext* ctx, const char* filename, OutputSink* sink) {
+    if (!ctx || !filename || !sink) return -1;
+    
+    // Stamped before anything is read, so an edit made meanwhile can only
+    // make the stamp look stale, never the artifact look current
+    KCLSourceStamp stamp;
+    bool cached = ctx->bytecode_cache_dir && kcl_source_stamp(filename, &stamp);
+    
+    // A script compiled ahead of time for this exact text runs natively; only
+    // that lookup needs the text before the bytecode cache is consulted
+    char* script_text = NULL;
+    if (ctx->native_cache_dir) {
+        if (!(script_text = kcl_read_script(filename))) {
+            kcl_sink_printf(sink, OUTPUT_STREAM_STDERR, "kcl: cannot read %s\n", filename);
+            return -1;
+        }
+        KCLNativeScript* native = kcl_aot_load(script_text, ctx->native_cache_dir);
+        if (native) {
+            int status = kcl_aot_run(native, ctx, sink);
+            kcl_aot_unload(native);
+            free(script_text);
+            return status;
+        }
+    }
+    
+    KCLProgram* program = cached ? kcl_bytecode_load(ctx->bytecode_cache_dir, filename, &stamp, script_text) : NULL;
+    if (!program) {
+        if (!script_text && !(script_text = kcl_read_script(filename))) {
+            kcl_sink_printf(sink, OUTPUT_STREAM_STDERR, "kcl: cannot read %s\n", filename);
+            return -1;
+        }
+        KCLScript* script = kcl_parse(script_text);
+        char* error = NULL;
+        program = script ? kcl_program_compile(script, &error) : NULL;
+        kcl_script_destroy(script);
+        if (!program) {
+            kcl_sink_printf(sink, OUTPUT_STREAM_STDERR, "kcl: %s\n", error ? error : "out of memory");
+            free(error);
+            free(script_text);
+            return -1;
+        }
+        if (cached) kcl_bytecode_store(ctx->bytecode_cache_dir, filename, &stamp, script_text, program);
+    }
+    
+    int status = kcl_program_run(program, ctx, sink);
+    kcl_program_destroy(program);
+    free(script_text);
+    return status;
+}
+
 ExecutionResult* kcl_execute_file(KCLContext* ctx, const char* filename) {
     if (!ctx || !filename) return NULL;
     
+    ExecutionResult* result = execution_result_create();
+    if (!result) return NULL;
+    
     FILE* file = fopen(filename, "r");
     if (!file) {
-        ExecutionResult* result = (ExecutionResult*)malloc(sizeof(ExecutionResult));
-        result->result = CMD_EXECUTION_FAILED;
-        result->output = NULL;
-        result->error = strdup("Failed to open KCL script file");
-        result->exit_code = -1;
+        execution_result_set_static_error(result, "Failed to open KCL script file");
         return result;
     }
-    
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    char* script_text = (char*)malloc(file_size + 1);
-    fread(script_text, 1, file_size, file);
-    script_text[file_size] = '\0';
-    
     fclose(file);
     
-    ExecutionResult* result = kcl_execute_string(ctx, script_text);
-    free(script_text);
+    OutputCapture capture;
+    output_capture_init(&capture);
+    
+    int status = kcl_execute_file_streaming(ctx, filename, &capture.sink);
+    result->result = status == 0 ? CMD_SUCCESS : CMD_EXECUTION_FAILED;
+    result->exit_code = status;
     
+    output_capture_finish(&capture, result);
     return result;
 }
 
 ExecutionResult* kcl_execute_string(KCLContext* ctx, const char* script_text) {
     if (!ctx || !script_text) return NULL;
     
-    KCLScript* script = kcl_parse(script_text);
-    if (!script) {
-        ExecutionResult* result = (ExecutionResult*)malloc(sizeof(ExecutionResult));
-        result->result = CMD_EXECUTION_FAILED;
-        result->output = NULL;
-        result->error = strdup("Failed to parse KCL script");
-        result->exit_code = -1;
-        return result;
-    }
+    // Lines run again, as at a REPL, skip lexing and parsing
+    KCLProgram* program = kcl_program_cache_take(ctx->programs, script_text);
+    if (!program) {
+        KCLScript* script = kcl_parse(script_text);
+        if (!script) {
+            ExecutionResult* result = execution_result_create();
+            if (result) execution_result_set_static_error(result, "Failed to parse KCL script");
+            return result;
+        }
     
-    ExecutionResult* result = kcl_execute(ctx, script);
-    kcl_script_destroy(script);
+        program = kcl_program_compile(script, NULL);
+        if (!program) {
+            // Reports the parse error as the script's output
+            ExecutionResult* result = kcl_execute(ctx, script);
+            kcl_script_destroy(script);
+            return result;
+        }
+        kcl_script_destroy(script);
+    }
     
+    ExecutionResult* result = kcl_execute_program(ctx, program);
+    kcl_program_cache_put(ctx->programs, script_text, program);
     return result;
 }
 
+static constexpr const char* kcl_commands[] = {
+    "kcl", "kurono", "supr", "kcl-run", "kcl-install", "kcl-remove",
+    "kcl-help", "kcl-version", "kcl-list", "kcl-env", "kcl-set",
+    "kcl-get", "kcl-if", "kcl-for", "kcl-while",
+};
+
+#define KCL_COMMAND_COUNT (sizeof(kcl_commands) / sizeof(kcl_commands[0]))
+
+static constexpr auto kcl_command_index = perfect_hash_build<PERFECT_HASH_SLOTS(kcl_commands)>(kcl_commands);
+static_assert(kcl_command_index.complete, "KCL command names must be unique");
+
+bool kcl_is_known_command(const char* name) {
+    return perfect_hash_contains(kcl_command_index, kcl_commands, name);
+}
+
 bool kcl_register_commands(KCLContext* ctx, CommandRegistry* registry) {
     if (!ctx || !registry) return false;
     
-    const char* kcl_commands[] = {
-        "kcl", "kurono", "supr", "kcl-run", "kcl-install", "kcl-remove",
-        "kcl-help", "kcl-version", "kcl-list", "kcl-env", "kcl-set",
-        "kcl-get", "kcl-if", "kcl-for", "kcl-while", "kcl-function",
-        NULL
-    };
-    
-    for (int i = 0; kcl_commands[i] != NULL; i++) {
-        char description[256];
-        snprintf(description, sizeof(description), "KCL command: %s", kcl_commands[i]);
-        command_registry_add(registry, kcl_commands[i], kcl_commands[i], ENV_KURONO, description);
+    for (size_t i = 0; i < KCL_COMMAND_COUNT; i++) {
+        command_registry_add_template(registry, kcl_commands[i], kcl_commands[i], ENV_KURONO, "KCL command: %s");
     }
     
     return true;
 }
-
-char* kcl_get_variable(KCLContext* ctx, const char* name) {
-    if (!ctx || !name) return NULL;
-    
-    // TODO: Implement variable storage and retrieval
-    return NULL;
-}
-
-bool kcl_set_variable(KCLContext* ctx, const char* name, const char* value) {
-    if (!ctx || !name || !value) return false;
-    
-    // TODO: Implement variable storage
-    return true;
-}
\ No newline at end of file
@@ -17,53 +17,128 @@ typedef enum {
     KCL_TOKEN_UNKNOWN
 } KCLTokenType;
 
+/* Tokens are views into the source the lexer was created from, which must
+ * outlive it; words keep their quotes, and statement separators (';' or a
+ * newline) are one-byte OPERATOR tokens. line and column count from 1, the
+ * column in bytes. */
 typedef struct {
     KCLTokenType type;
-    char* value;
+    uint32_t offset;
+    uint32_t length;
     int line;
     int column;
 } KCLToken;
 
 typedef struct {
+    const char* source;
     KCLToken* tokens;
     size_t count;
     size_t capacity;
     size_t current;
 } KCLLexer;
 
+/* Scripts are statements separated by newlines or ';':
+ *   command words... [| command words...] [> file | >> file]
+ *   kcl-set NAME words...
+ *   kcl-if WORD OP WORD ... [kcl-else ...] kcl-end
+ *   kcl-while WORD OP WORD ... kcl-end
+ *   kcl-for NAME in words... ... kcl-end
+ *   kcl-for NAME from WORD to WORD ... kcl-end
+ * OP is == or != (strings) or -eq -ne -lt -le -gt -ge (integers). Words
+ * expand $NAME and ${NAME} outside single quotes; echo is built in. */
 typedef enum {
     KCL_NODE_COMMAND,
     KCL_NODE_PIPELINE,
     KCL_NODE_REDIRECTION,
     KCL_NODE_VARIABLE,
-    KCL_NODE_LITERAL
+    KCL_NODE_LITERAL,
+    KCL_NODE_WORD,
+    KCL_NODE_BLOCK,
+    KCL_NODE_ASSIGNMENT,
+    KCL_NODE_IF,
+    KCL_NODE_WHILE,
+    KCL_NODE_FOR,
+    KCL_NODE_RANGE
 } KCLNodeType;
 
+/* Nodes, values and child arrays are allocated from the script's arena and
+ * released together by kcl_script_destroy; children is one contiguous span. */
 typedef struct KCLNode {
     KCLNodeType type;
     char* value;
     struct KCLNode** children;
     size_t child_count;
-    size_t child_capacity;
 } KCLNode;
 
 typedef struct {
+    Arena arena;
     KCLNode* root;
     char* script_path;
     char* error_message;
     bool has_error;
 } KCLScript;
 
+#define KCL_VALUE_INLINE 23
+
+/* A variable's value: strings up to KCL_VALUE_INLINE bytes are kept inside
+ * the struct and longer ones on the heap (capacity is 0 while inline). The
+ * data is always NUL-terminated. */
 typedef struct {
-    char* variables;
-    size_t var_count;
-    size_t var_capacity;
+    union {
+        char* heap;
+        char inline_data[KCL_VALUE_INLINE + 1];
+    } data;
+    uint32_t length;
+    uint32_t capacity;
+} KCLValue;
+
+/* Context variables live in an open-addressing table with linear probing.
+ * Names are interned in the store's arena when first set and never move, so
+ * an entry stays put across lookups; unsetting only clears its value. */
+typedef struct {
+    const char* name;
+    uint32_t name_length;
+    uint32_t hash;
+    bool set;
+    KCLValue value;
+} KCLVariable;
+
+typedef struct {
+    KCLVariable* slots;
+    size_t capacity;
+    size_t count;
+    Arena names;
+} KCLVariableStore;
+
+struct KCLProgram;
+
+/* A running script keeps its variables in slots numbered when it was
+ * compiled, so $NAME is an array index. For the length of the run it links
+ * a frame from its own stack into the context, through which
+ * kcl_get_variable and kcl_set_variable reach the script's variables by
+ * name. Names a script only reads are filled in from the context store when
+ * it starts. */
+typedef struct KCLFrame {
+    const struct KCLProgram* program;
+    OutputBuffer* slots;
+    struct KCLFrame* parent;
+} KCLFrame;
+
+typedef struct KCLProgramCache KCLProgramCache;
+
+typedef struct {
+    KCLVariableStore variables;
+    KCLFrame* frame;
     KernelContext* kernel_ctx;
+    char* native_cache_dir;
+    char* bytecode_cache_dir;
+    KCLProgramCache* programs;
 } KCLContext;
 
 KCLLexer* kcl_lexer_create(const char* input);
 void kcl_lexer_destroy(KCLLexer* lexer);
 KCLToken kcl_lexer_next_token(KCLLexer* lexer);
+const char* kcl_token_text(const KCLLexer* lexer, const KCLToken* token);
 
 KCLScript* kcl_parse(const char* input);
 void kcl_script_destroy(KCLScript* script);
@@ -75,9 +150,40 @@ ExecutionResult* kcl_execute(KCLContext* ctx, KCLScript* script);
 ExecutionResult* kcl_execute_file(KCLContext* ctx, const char* filename);
 ExecutionResult* kcl_execute_string(KCLContext* ctx, const char* script_text);
 
+/* Streaming forms return the script's exit status (that of the last command
+ * run) or -1 when the script cannot be read or parsed. */
+int kcl_execute_streaming(KCLContext* ctx, KCLScript* script, OutputSink* sink);
+int kcl_execute_file_streaming(KCLContext* ctx, const char* filename, OutputSink* sink);
+char* kcl_read_script(const char* filename);
+
+/* When set, kcl_execute_file runs scripts compiled ahead of time by
+ * kcl_aot_compile from this directory and interprets everything else. */
+bool kcl_context_set_native_cache(KCLContext* ctx, const char* cache_dir);
+/* When set, kcl_execute_file keeps the bytecode of every script it runs in
+ * this directory, so unchanged scripts are not parsed again. */
+bool kcl_context_set_bytecode_cache(KCLContext* ctx, const char* cache_dir);
+
+/* Statement primitives shared by the interpreter and compiled scripts. The
+ * entry may be NULL to resolve the command name at run time. */
+int kcl_run_line(KCLContext* ctx, const CommandEntry* entry, const char* command_line, bool pipeline, const char* redirect, bool append, OutputSink* sink);
+int kcl_run_echo(const char* text, size_t length, const char* redirect, bool append, OutputSink* sink);
+
+/* Whether name is one of the KCL commands kcl_register_commands adds. */
+bool kcl_is_known_command(const char* name);
 bool kcl_register_commands(KCLContext* ctx, CommandRegistry* registry);
 
-char* kcl_get_variable(KCLContext* ctx, const char* name);
+void kcl_variables_init(KCLVariableStore* store);
+void kcl_variables_free(KCLVariableStore* store);
+/* NULL when name has never been set. */
+const KCLVariable* kcl_variables_find(const KCLVariableStore* store, const char* name, size_t length);
+/* A NULL value unsets the variable. */
+bool kcl_variables_set(KCLVariableStore* store, const char* name, size_t length, const char* value, size_t value_length);
+const char* kcl_value_data(const KCLValue* value);
+
+/* Variables of the innermost running script first, then the context's.
+ * The returned string belongs to the context and stays valid until the
+ * variable changes; NULL means unset. Setting NULL unsets. */
+const char* kcl_get_variable(KCLContext* ctx, const char* name);
 bool kcl_set_variable(KCLContext* ctx, const char* name, const char* value);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+#include "kcl_vm.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define KCL_VARIABLES_INITIAL 16
+#define KCL_VARIABLES_NAME_CHUNK 1024
+
+static uint32_t variables_hash(const char* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void kcl_variables_init(KCLVariableStore* store) {
+    if (!store) return;
+    
+    store->slots = NULL;
+    store->capacity = 0;
+    store->count = 0;
+    arena_init(&store->names, KCL_VARIABLES_NAME_CHUNK);
+}
+
+void kcl_variables_free(KCLVariableStore* store) {
+    if (!store) return;
+    
+    for (size_t i = 0; i < store->capacity; i++) {
+        if (store->slots[i].name && store->slots[i].value.capacity) free(store->slots[i].value.data.heap);
+    }
+    free(store->slots);
+    arena_release(&store->names);
+    store->slots = NULL;
+    store->capacity = 0;
+    store->count = 0;
+}
+
+// The slot holding name, or the empty slot where it belongs; capacity is a
+// power of two and the table is never full
+static KCLVariable* variables_probe(const KCLVariableStore* store, const char* name, size_t length, uint32_t hash) {
+    size_t mask = store->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        KCLVariable* slot = &store->slots[i];
+        if (!slot->name) return slot;
+        if (slot->hash == hash && slot->name_length == length && memcmp(slot->name, name, length) == 0) return slot;
+    }
+}
+
+static bool variables_grow(KCLVariableStore* store) {
+    size_t capacity = store->capacity ? store->capacity * 2 : KCL_VARIABLES_INITIAL;
+    KCLVariable* slots = (KCLVariable*)calloc(capacity, sizeof(KCLVariable));
+    if (!slots) return false;
+    
+    KCLVariableStore grown = *store;
+    grown.slots = slots;
+    grown.capacity = capacity;
+    for (size_t i = 0; i < store->capacity; i++) {
+        const KCLVariable* old = &store->slots[i];
+        if (old->name) *variables_probe(&grown, old->name, old->name_length, old->hash) = *old;
+    }
+    free(store->slots);
+    store->slots = slots;
+    store->capacity = capacity;
+    return true;
+}
+
+const KCLVariable* kcl_variables_find(const KCLVariableStore* store, const char* name, size_t length) {
+    if (!store || !name || store->count == 0) return NULL;
+    
+    const KCLVariable* slot = variables_probe(store, name, length, variables_hash(name, length));
+    return slot->name && slot->set ? slot : NULL;
+}
+
+static bool kcl_value_assign(KCLValue* value, const char* data, size_t length) {
+    if (length > UINT32_MAX - 1) return false;
+    
+    if (length <= KCL_VALUE_INLINE) {
+        if (value->capacity) free(value->data.heap);
+        memcpy(value->data.inline_data, data, length);
+        value->data.inline_data[length] = '\0';
+        value->capacity = 0;
+    } else {
+        // Heap storage is kept for later values that fit in it
+        if (length + 1 > value->capacity) {
+            char* heap = (char*)malloc(length + 1);
+            if (!heap) return false;
+            if (value->capacity) free(value->data.heap);
+            value->data.heap = heap;
+            value->capacity = (uint32_t)(length + 1);
+        }
+        memcpy(value->data.heap, data, length);
+        value->data.heap[length] = '\0';
+    }
+    value->length = (uint32_t)length;
+    return true;
+}
+
+bool kcl_variables_set(KCLVariableStore* store, const char* name, size_t length, const char* value, size_t value_length) {
+    if (!store || !name || length == 0 || length > UINT32_MAX) return false;
+    
+    uint32_t hash = variables_hash(name, length);
+    KCLVariable* slot = store->capacity ? variables_probe(store, name, length, hash) : NULL;
+    if (!slot || !slot->name) {
+        if (!value) return true;
+    
+        // Kept at most three quarters full so probes stay short
+        if ((store->count + 1) * 4 > store->capacity * 3) {
+            if (!variables_grow(store)) return false;
+            slot = variables_probe(store, name, length, hash);
+        }
+        const char* interned = arena_strndup(&store->names, name, length);
+        if (!interned) return false;
+        slot->name = interned;
+        slot->name_length = (uint32_t)length;
+        slot->hash = hash;
+        slot->set = false;
+        slot->value.length = 0;
+        slot->value.capacity = 0;
+        slot->value.data.inline_data[0] = '\0';
+        store->count++;
+    }
+    
+    if (!value) {
+        slot->set = false;
+        return kcl_value_assign(&slot->value, "", 0);
+    }
+    if (!kcl_value_assign(&slot->value, value, value_length)) return false;
+    slot->set = true;
+    return true;
+}
+
+const char* kcl_value_data(const KCLValue* value) {
+    if (!value) return NULL;
+    return value->capacity ? value->data.heap : value->data.inline_data;
+}
+
+// A script's own variables are found in its frame; names it only reads were
+// copied from the context when it started and are looked up there instead
+static OutputBuffer* variables_frame_slot(const KCLFrame* frame, const char* name) {
+    if (!frame) return NULL;
+    
+    const KCLProgram* program = frame->program;
+    for (size_t i = 0; i < program->variable_count; i++) {
+        if (strcmp(kcl_program_constant(program, program->variables[i]), name) != 0) continue;
+        for (size_t j = 0; j < program->import_count; j++) {
+            if (program->imports[j] == i) return NULL;
+        }
+        return &frame->slots[i];
+    }
+    return NULL;
+}
+
+const char* kcl_get_variable(KCLContext* ctx, const char* name) {
+    if (!ctx || !name) return NULL;
+    
+    const OutputBuffer* slot = variables_frame_slot(ctx->frame, name);
+    if (slot) return slot->data;
+    
+    const KCLVariable* variable = kcl_variables_find(&ctx->variables, name, strlen(name));
+    return variable ? kcl_value_data(&variable->value) : NULL;
+}
+
+bool kcl_set_variable(KCLContext* ctx, const char* name, const char* value) {
+    if (!ctx || !name) return false;
+    
+    OutputBuffer* slot = variables_frame_slot(ctx->frame, name);
+    if (slot) {
+        if (!value) {
+            output_buffer_free(slot);
+            return true;
+        }
+        slot->length = 0;
+        return output_buffer_append(slot, value, strlen(value));
+    }
+    
+    return kcl_variables_set(&ctx->variables, name, strlen(name), value, value ? strlen(value) : 0);
+}
@@ -0,0 +1,1332 @@
+#include "kcl_vm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// Labels as values let every handler jump straight to the next one instead
+// of returning to a shared switch
+#if defined(__GNUC__) || defined(__clang__)
+#define KCL_VM_COMPUTED_GOTO 1
+#else
+#define KCL_VM_COMPUTED_GOTO 0
+#endif
+
+static const char* const vm_compare_names[] = { "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+
+typedef struct {
+    std::vector<uint32_t> code;
+    std::string pool;
+    std::vector<KCLConstant> constants;
+    std::unordered_map<std::string, uint32_t> constant_index;
+    std::vector<uint32_t> variables;
+    std::unordered_map<std::string, uint32_t> variable_slots;
+    std::vector<bool> assigned;
+    std::vector<uint32_t> commands;
+    std::unordered_map<std::string, uint32_t> command_slots;
+    std::string literal;
+    uint32_t loop_count;
+    uint32_t depth;
+    uint32_t max_depth;
+    const char* error;
+} VmCompiler;
+
+static void vm_error(VmCompiler* c, const char* message) {
+    if (!c->error) c->error = message;
+}
+
+static uint32_t vm_constant(VmCompiler* c, const char* text, size_t length) {
+    std::string key(text, length);
+    auto found = c->constant_index.find(key);
+    if (found != c->constant_index.end()) return found->second;
+    
+    if (c->constants.size() > KCL_OPERAND_MAX || c->pool.size() + length + 1 > UINT32_MAX) {
+        vm_error(c, "script is too large to compile");
+        return 0;
+    }
+    uint32_t index = (uint32_t)c->constants.size();
+    c->constants.push_back({ (uint32_t)c->pool.size(), (uint32_t)length });
+    c->pool.append(text, length);
+    c->pool += '\0';
+    c->constant_index.emplace(std::move(key), index);
+    return index;
+}
+
+static uint32_t vm_slot(VmCompiler* c, std::unordered_map<std::string, uint32_t>& slots, std::vector<uint32_t>& names, const char* name) {
+    auto found = slots.find(name);
+    if (found != slots.end()) return found->second;
+    
+    uint32_t slot = (uint32_t)names.size();
+    names.push_back(vm_constant(c, name, strlen(name)));
+    slots.emplace(name, slot);
+    return slot;
+}
+
+static uint32_t vm_variable(VmCompiler* c, const char* name) {
+    uint32_t slot = vm_slot(c, c->variable_slots, c->variables, name);
+    if (slot >= c->assigned.size()) c->assigned.resize(slot + 1, false);
+    return slot;
+}
+
+static uint32_t vm_assign(VmCompiler* c, const char* name) {
+    uint32_t slot = vm_variable(c, name);
+    c->assigned[slot] = true;
+    return slot;
+}
+
+// Literal text is gathered until an instruction needs the top string, so
+// adjacent literals and separators become a single CONST
+static void vm_flush(VmCompiler* c) {
+    if (c->literal.empty()) return;
+    
+    uint32_t index = vm_constant(c, c->literal.data(), c->literal.size());
+    c->code.push_back(KCL_INSTRUCTION(KCL_OP_CONST, index));
+    c->literal.clear();
+}
+
+static size_t vm_emit(VmCompiler* c, KCLOpcode op, size_t a) {
+    vm_flush(c);
+    if (a > KCL_OPERAND_MAX) {
+        vm_error(c, "script is too large to compile");
+        a = 0;
+    }
+    c->code.push_back(KCL_INSTRUCTION(op, a));
+    return c->code.size() - 1;
+}
+
+// Operand words that follow an instruction
+static size_t vm_operand(VmCompiler* c, uint32_t value) {
+    c->code.push_back(value);
+    return c->code.size() - 1;
+}
+
+static size_t vm_here(VmCompiler* c) {
+    vm_flush(c);
+    if (c->code.size() > KCL_OPERAND_MAX) vm_error(c, "script is too large to compile");
+    return c->code.size();
+}
+
+static void vm_push(VmCompiler* c) {
+    vm_emit(c, KCL_OP_PUSH, 0);
+    if (++c->depth > c->max_depth) c->max_depth = c->depth;
+}
+
+static void vm_pop(VmCompiler* c, KCLOpcode op, size_t a) {
+    vm_emit(c, op, a);
+    c->depth--;
+}
+
+static void vm_word(VmCompiler* c, const KCLNode* word) {
+    switch (word->type) {
+        case KCL_NODE_LITERAL:
+            c->literal += word->value;
+            break;
+        case KCL_NODE_VARIABLE:
+            vm_emit(c, KCL_OP_LOAD, vm_variable(c, word->value));
+            break;
+        case KCL_NODE_WORD:
+            for (size_t i = 0; i < word->child_count; i++) {
+                vm_word(c, word->children[i]);
+            }
+            break;
+        default:
+            vm_error(c, "invalid word");
+            break;
+    }
+}
+
+// Appends a command's words, space separated, to the top string; a
+// redirection is evaluated where it appears and applies to the next command
+static void vm_command_words(VmCompiler* c, const KCLNode* command, size_t first_word) {
+    bool first = true;
+    for (size_t i = first_word; i < command->child_count; i++) {
+        const KCLNode* child = command->children[i];
+        if (child->type == KCL_NODE_REDIRECTION) {
+            vm_push(c);
+            vm_word(c, child->children[0]);
+            vm_pop(c, KCL_OP_REDIRECT, child->value[1] == '>' ? 1 : 0);
+            continue;
+        }
+        if (!first) c->literal += ' ';
+        vm_word(c, child);
+        first = false;
+    }
+}
+
+// A name with no quoting or spaces reaches the registry exactly as written,
+// so it can be looked up before the line is built
+static size_t vm_command_slot(VmCompiler* c, const KCLNode* name) {
+    if (name->type != KCL_NODE_LITERAL || !name->value[0] || strpbrk(name->value, " \t'\"\\")) return 0;
+    return vm_slot(c, c->command_slots, c->commands, name->value) + 1;
+}
+
+static void vm_command(VmCompiler* c, const KCLNode* node) {
+    vm_push(c);
+    
+    if (node->type == KCL_NODE_PIPELINE) {
+        for (size_t i = 0; i < node->child_count; i++) {
+            if (i > 0) c->literal += " | ";
+            vm_command_words(c, node->children[i], 0);
+        }
+        vm_pop(c, KCL_OP_PIPELINE, 0);
+        return;
+    }
+    
+    const KCLNode* name = node->children[0];
+    if (name->type == KCL_NODE_LITERAL && strcmp(name->value, "echo") == 0) {
+        vm_command_words(c, node, 1);
+        vm_pop(c, KCL_OP_ECHO, 0);
+        return;
+    }
+    
+    size_t slot = vm_command_slot(c, name);
+    vm_command_words(c, node, 0);
+    vm_pop(c, KCL_OP_RUN, slot);
+}
+
+// Emits the test of a condition and returns the word to patch with the
+// target taken when it fails
+static size_t vm_condition(VmCompiler* c, const KCLNode* node) {
+    size_t compare = 0;
+    while (compare < sizeof(vm_compare_names) / sizeof(vm_compare_names[0]) && strcmp(vm_compare_names[compare], node->value) != 0) {
+        compare++;
+    }
+    if (compare == sizeof(vm_compare_names) / sizeof(vm_compare_names[0])) vm_error(c, "invalid comparison");
+    
+    vm_push(c);
+    vm_word(c, node->children[0]);
+    vm_push(c);
+    vm_word(c, node->children[1]);
+    vm_emit(c, KCL_OP_TEST, compare);
+    c->depth -= 2;
+    return vm_operand(c, 0);
+}
+
+static void vm_patch(VmCompiler* c, size_t at, size_t target) {
+    c->code[at] = (uint32_t)target;
+}
+
+static void vm_patch_jump(VmCompiler* c, size_t at, size_t target) {
+    c->code[at] = KCL_INSTRUCTION(KCL_OP_JUMP, target & KCL_OPERAND_MAX);
+}
+
+static void vm_block(VmCompiler* c, const KCLNode* block);
+
+static void vm_statement(VmCompiler* c, const KCLNode* node) {
+    switch (node->type) {
+        case KCL_NODE_COMMAND:
+        case KCL_NODE_PIPELINE:
+            vm_command(c, node);
+            break;
+        case KCL_NODE_ASSIGNMENT:
+            // Built on the stack first: the value may mention the variable itself
+            vm_push(c);
+            for (size_t i = 0; i < node->child_count; i++) {
+                if (i > 0) c->literal += ' ';
+                vm_word(c, node->children[i]);
+            }
+            vm_pop(c, KCL_OP_STORE, vm_assign(c, node->value));
+            break;
+        case KCL_NODE_IF: {
+            size_t skip = vm_condition(c, node);
+            vm_block(c, node->children[2]);
+            if (node->child_count > 3) {
+                size_t jump = vm_emit(c, KCL_OP_JUMP, 0);
+                vm_patch(c, skip, vm_here(c));
+                vm_block(c, node->children[3]);
+                vm_patch_jump(c, jump, vm_here(c));
+            } else {
+                vm_patch(c, skip, vm_here(c));
+            }
+            break;
+        }
+        case KCL_NODE_WHILE: {
+            size_t top = vm_here(c);
+            size_t exit = vm_condition(c, node);
+            vm_block(c, node->children[2]);
+            vm_emit(c, KCL_OP_JUMP, top);
+            vm_patch(c, exit, vm_here(c));
+            break;
+        }
+        case KCL_NODE_FOR: {
+            uint32_t variable = vm_assign(c, node->value);
+            uint32_t loop = c->loop_count++;
+            const KCLNode* body = node->children[node->child_count - 1];
+            KCLOpcode next;
+            uint32_t item_count = 0;
+            if (node->children[0]->type == KCL_NODE_RANGE) {
+                // Bounds are evaluated once, before the first iteration
+                const KCLNode* range = node->children[0];
+                vm_push(c);
+                vm_word(c, range->children[0]);
+                vm_push(c);
+                vm_word(c, range->children[1]);
+                vm_emit(c, KCL_OP_RANGE, loop);
+                vm_operand(c, variable);
+                c->depth -= 2;
+                next = KCL_OP_RANGE_NEXT;
+            } else {
+                // Items are expanded up front and stay on the stack while the
+                // body runs, so the body cannot change them
+                item_count = (uint32_t)(node->child_count - 1);
+                for (size_t i = 0; i < item_count; i++) {
+                    vm_push(c);
+                    vm_word(c, node->children[i]);
+                }
+                vm_emit(c, KCL_OP_ITEMS, loop);
+                vm_operand(c, item_count);
+                next = KCL_OP_ITEM_NEXT;
+            }
+            size_t top = vm_here(c);
+            vm_emit(c, next, loop);
+            vm_operand(c, variable);
+            size_t exit = vm_operand(c, 0);
+            vm_block(c, body);
+            vm_emit(c, KCL_OP_JUMP, top);
+            vm_patch(c, exit, vm_here(c));
+            c->depth -= item_count;
+            break;
+        }
+        case KCL_NODE_BLOCK:
+            vm_block(c, node);
+            break;
+        default:
+            vm_error(c, "invalid statement");
+            break;
+    }
+}
+
+static void vm_block(VmCompiler* c, const KCLNode* block) {
+    for (size_t i = 0; i < block->child_count; i++) {
+        vm_statement(c, block->children[i]);
+    }
+}
+
+template <typename T>
+static T* vm_copy(const std::vector<T>& items) {
+    T* copy = (T*)malloc(sizeof(T) * (items.empty() ? 1 : items.size()));
+    if (copy && !items.empty()) memcpy(copy, items.data(), sizeof(T) * items.size());
+    return copy;
+}
+
+KCLProgram* kcl_program_compile(const KCLScript* script, char** error) {
+    if (error) *error = NULL;
+    if (!script || script->has_error || !script->root) {
+        if (error) *error = strdup(script && script->error_message ? script->error_message : "invalid script");
+        return NULL;
+    }
+    
+    VmCompiler c;
+    c.loop_count = 0;
+    c.depth = 0;
+    c.max_depth = 0;
+    c.error = NULL;
+    vm_block(&c, script->root);
+    vm_emit(&c, KCL_OP_HALT, 0);
+    if (c.loop_count > KCL_OPERAND_MAX) vm_error(&c, "script is too large to compile");
+    if (c.error) {
+        if (error) *error = strdup(c.error);
+        return NULL;
+    }
+    
+    std::vector<uint32_t> imports;
+    for (uint32_t slot = 0; slot < c.variables.size(); slot++) {
+        if (!c.assigned[slot]) imports.push_back(slot);
+    }
+    
+    KCLProgram* program = (KCLProgram*)calloc(1, sizeof(KCLProgram));
+    if (!program) return NULL;
+    program->code = vm_copy(c.code);
+    program->code_length = c.code.size();
+    program->pool = (char*)malloc(c.pool.size() + 1);
+    if (program->pool) memcpy(program->pool, c.pool.c_str(), c.pool.size() + 1);
+    program->pool_length = c.pool.size();
+    program->constants = vm_copy(c.constants);
+    program->constant_count = c.constants.size();
+    program->variables = vm_copy(c.variables);
+    program->variable_count = c.variables.size();
+    program->imports = vm_copy(imports);
+    program->import_count = imports.size();
+    program->commands = vm_copy(c.commands);
+    program->command_count = c.commands.size();
+    program->loop_count = c.loop_count;
+    program->stack_depth = c.max_depth;
+    
+    if (!program->code || !program->pool || !program->constants || !program->variables || !program->imports || !program->commands) {
+        kcl_program_destroy(program);
+        if (error) *error = strdup("out of memory");
+        return NULL;
+    }
+    return program;
+}
+
+static void vm_release(const void* data, size_t size);
+
+void kcl_program_destroy(KCLProgram* program) {
+    if (!program) return;
+    
+    if (program->mapping) {
+        vm_release(program->mapping, program->mapping_size);
+        free(program);
+        return;
+    }
+    free(program->code);
+    free(program->pool);
+    free(program->constants);
+    free(program->variables);
+    free(program->imports);
+    free(program->commands);
+    free(program);
+}
+
+const char* kcl_program_constant(const KCLProgram* program, uint32_t index) {
+    if (!program || index >= program->constant_count) return NULL;
+    return program->pool + program->constants[index].offset;
+}
+
+static void vm_report(OutputSink* sink, const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return;
+    sink->write(sink, OUTPUT_STREAM_STDERR, buffer, (size_t)length < sizeof(buffer) ? (size_t)length : sizeof(buffer) - 1);
+}
+
+static bool vm_parse_int(const OutputBuffer* text, long* value) {
+    if (text->length == 0) return false;
+    char* end;
+    errno = 0;
+    *value = strtol(text->data, &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+// Compares two strings as the test op says; false in *valid when an integer
+// test gets something else
+static bool vm_compare(uint32_t op, const OutputBuffer* lhs, const OutputBuffer* rhs, bool* valid) {
+    *valid = true;
+    bool same = lhs->length == rhs->length && memcmp(lhs->data, rhs->data, lhs->length) == 0;
+    if (op == KCL_COMPARE_EQUAL) return same;
+    if (op == KCL_COMPARE_NOT_EQUAL) return !same;
+    
+    long a, b;
+    if (!vm_parse_int(lhs, &a) || !vm_parse_int(rhs, &b)) {
+        *valid = false;
+        return false;
+    }
+    switch (op) {
+        case KCL_COMPARE_EQ: return a == b;
+        case KCL_COMPARE_NE: return a != b;
+        case KCL_COMPARE_LT: return a < b;
+        case KCL_COMPARE_LE: return a <= b;
+        case KCL_COMPARE_GT: return a > b;
+        default: return a >= b;
+    }
+}
+
+static void vm_swap(OutputBuffer* a, OutputBuffer* b) {
+    OutputBuffer swap = *a;
+    *a = *b;
+    *b = swap;
+}
+
+typedef struct {
+    long next;
+    long last;
+    size_t base;
+    bool active;
+} VmLoop;
+
+int kcl_program_run(const KCLProgram* program, KCLContext* ctx, OutputSink* sink) {
+    if (!program || !ctx || !sink) return -1;
+    
+    // Everything a run needs is sized by the compiler, so the loop itself only
+    // grows string buffers it then keeps for later iterations
+    size_t buffer_count = program->stack_depth + program->variable_count + 1;
+    OutputBuffer* buffers = (OutputBuffer*)calloc(buffer_count, sizeof(OutputBuffer));
+    VmLoop* loops = (VmLoop*)calloc(program->loop_count ? program->loop_count : 1, sizeof(VmLoop));
+    const CommandEntry** entries = (const CommandEntry**)calloc(program->command_count ? program->command_count : 1, sizeof(CommandEntry*));
+    if (!buffers || !loops || !entries) {
+        free(buffers);
+        free(loops);
+        free(entries);
+        vm_report(sink, "kcl: out of memory\n");
+        return -1;
+    }
+    for (size_t i = 0; i < buffer_count; i++) output_buffer_init(&buffers[i]);
+    OutputBuffer* stack = buffers;
+    OutputBuffer* variables = buffers + program->stack_depth;
+    OutputBuffer* target = variables + program->variable_count;
+    
+    // Names the script only reads are looked up once, here; from then on
+    // every $NAME is a slot index
+    for (size_t i = 0; i < program->import_count; i++) {
+        uint32_t slot = program->imports[i];
+        const KCLConstant* name = &program->constants[program->variables[slot]];
+        const KCLVariable* value = kcl_variables_find(&ctx->variables, program->pool + name->offset, name->length);
+        if (value && !output_buffer_append(&variables[slot], kcl_value_data(&value->value), value->value.length)) {
+            for (size_t j = 0; j < buffer_count; j++) output_buffer_free(&buffers[j]);
+            free(buffers);
+            free(loops);
+            free(entries);
+            vm_report(sink, "kcl: out of memory\n");
+            return -1;
+        }
+    }
+    KCLFrame frame = { program, variables, ctx->frame };
+    ctx->frame = &frame;
+    
+    // Commands are bound here, once per run, and not when the program is
+    // compiled: cached bytecode, in memory or on disk, outlives the registry
+    // version it was built against, and a CommandEntry pointer baked into it
+    // would dangle once that version is retired, or still name a command that
+    // has since been removed. The program keeps only names. Resolved entries
+    // belong to the pinned version, so it stays pinned for the whole run;
+    // names missing or ambiguous there are left to RUN
+    KernelRegistryGuard guard;
+    CommandRegistry* registry = kernel_registry_acquire(&guard);
+    for (size_t i = 0; registry && i < program->command_count; i++) {
+        entries[i] = command_registry_resolve(registry, kcl_program_constant(program, program->commands[i]), NULL);
+    }
+    
+    const uint32_t* code = program->code;
+    const char* pool = program->pool;
+    size_t pc = 0;
+    size_t sp = 0;
+    uint32_t word;
+    int status = 0;
+    bool failed = false;
+    bool redirected = false;
+    bool append = false;
+    
+#define VM_A (word >> 8)
+#define VM_REDIRECT (redirected ? target->data : NULL)
+    
+#if KCL_VM_COMPUTED_GOTO
+    static const void* const handlers[] = {
+        &&vm_HALT, &&vm_PUSH, &&vm_CONST, &&vm_LOAD, &&vm_STORE, &&vm_REDIRECT, &&vm_RUN, &&vm_PIPELINE,
+        &&vm_ECHO, &&vm_JUMP, &&vm_TEST, &&vm_RANGE, &&vm_RANGE_NEXT, &&vm_ITEMS, &&vm_ITEM_NEXT
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == KCL_OP_COUNT, "Every opcode needs a handler");
+#define VM_OP(name) vm_##name:
+#define VM_NEXT() do { word = code[pc++]; goto *handlers[word & 0xFF]; } while (0)
+    VM_NEXT();
+#else
+#define VM_OP(name) case KCL_OP_##name:
+#define VM_NEXT() continue
+    for (;;) {
+        word = code[pc++];
+        switch (word & 0xFF) {
+#endif
+    
+    VM_OP(HALT) {
+        goto vm_done;
+    }
+    VM_OP(PUSH) {
+        // Appending nothing leaves the string NUL-terminated for the commands
+        stack[sp].length = 0;
+        if (!output_buffer_append(&stack[sp++], "", 0)) goto vm_fail;
+        VM_NEXT();
+    }
+    VM_OP(CONST) {
+        const KCLConstant* constant = &program->constants[VM_A];
+        if (!output_buffer_append(&stack[sp - 1], pool + constant->offset, constant->length)) goto vm_fail;
+        VM_NEXT();
+    }
+    VM_OP(LOAD) {
+        const OutputBuffer* value = &variables[VM_A];
+        if (value->length && !output_buffer_append(&stack[sp - 1], value->data, value->length)) goto vm_fail;
+        VM_NEXT();
+    }
+    VM_OP(STORE) {
+        vm_swap(&stack[--sp], &variables[VM_A]);
+        status = 0;
+        VM_NEXT();
+    }
+    VM_OP(REDIRECT) {
+        vm_swap(&stack[--sp], target);
+        redirected = true;
+        append = VM_A != 0;
+        VM_NEXT();
+    }
+    VM_OP(RUN) {
+        const CommandEntry* entry = VM_A ? entries[VM_A - 1] : NULL;
+        status = kcl_run_line(ctx, entry, stack[--sp].data, false, VM_REDIRECT, append, sink);
+        redirected = false;
+        VM_NEXT();
+    }
+    VM_OP(PIPELINE) {
+        status = kcl_run_line(ctx, NULL, stack[--sp].data, true, VM_REDIRECT, append, sink);
+        redirected = false;
+        VM_NEXT();
+    }
+    VM_OP(ECHO) {
+        sp--;
+        status = kcl_run_echo(stack[sp].data, stack[sp].length, VM_REDIRECT, append, sink);
+        redirected = false;
+        VM_NEXT();
+    }
+    VM_OP(JUMP) {
+        pc = VM_A;
+        VM_NEXT();
+    }
+    VM_OP(TEST) {
+        sp -= 2;
+        bool valid;
+        bool holds = vm_compare(VM_A, &stack[sp], &stack[sp + 1], &valid);
+        if (!valid) {
+            vm_report(sink, "kcl: %s expects integers\n", vm_compare_names[VM_A]);
+            goto vm_fail;
+        }
+        pc = holds ? pc + 1 : code[pc];
+        VM_NEXT();
+    }
+    VM_OP(RANGE) {
+        sp -= 2;
+        VmLoop* loop = &loops[VM_A];
+        uint32_t variable = code[pc++];
+        if (!vm_parse_int(&stack[sp], &loop->next) || !vm_parse_int(&stack[sp + 1], &loop->last)) {
+            vm_report(sink, "kcl: kcl-for %s expects integer bounds\n", kcl_program_constant(program, program->variables[variable]));
+            goto vm_fail;
+        }
+        loop->active = loop->next <= loop->last;
+        VM_NEXT();
+    }
+    VM_OP(RANGE_NEXT) {
+        VmLoop* loop = &loops[VM_A];
+        if (!loop->active) {
+            pc = code[pc + 1];
+            VM_NEXT();
+        }
+        OutputBuffer* value = &variables[code[pc]];
+        char number[32];
+        int length = snprintf(number, sizeof(number), "%ld", loop->next);
+        value->length = 0;
+        if (!output_buffer_append(value, number, (size_t)length)) goto vm_fail;
+        // Stopping at last instead of passing it keeps LONG_MAX from overflowing
+        if (loop->next == loop->last) loop->active = false;
+        else loop->next++;
+        pc += 2;
+        VM_NEXT();
+    }
+    VM_OP(ITEMS) {
+        VmLoop* loop = &loops[VM_A];
+        size_t count = code[pc++];
+        loop->base = sp - count;
+        loop->next = 0;
+        loop->last = (long)count;
+        loop->active = true;
+        VM_NEXT();
+    }
+    VM_OP(ITEM_NEXT) {
+        // Only entered between its ITEMS and the end of the loop; a program
+        // that jumps here from anywhere else would drop the stack to a base
+        // that was never set
+        VmLoop* loop = &loops[VM_A];
+        if (!loop->active) goto vm_fail;
+        if (loop->next == loop->last) {
+            sp = loop->base;
+            loop->active = false;
+            pc = code[pc + 1];
+            VM_NEXT();
+        }
+        // Each item is used once, so it is handed over rather than copied
+        vm_swap(&stack[loop->base + (size_t)loop->next++], &variables[code[pc]]);
+        pc += 2;
+        VM_NEXT();
+    }
+    
+#if !KCL_VM_COMPUTED_GOTO
+            default:
+                goto vm_fail;
+        }
+    }
+#endif
+    
+#undef VM_A
+#undef VM_REDIRECT
+#undef VM_OP
+#undef VM_NEXT
+    
+vm_fail:
+    failed = true;
+vm_done:
+    ctx->frame = frame.parent;
+    kernel_registry_release(&guard);
+    for (size_t i = 0; i < buffer_count; i++) output_buffer_free(&buffers[i]);
+    free(buffers);
+    free(loops);
+    free(entries);
+    
+    // A script stopped by an error fails even when its last command succeeded
+    return (failed && status == 0) ? 1 : status;
+}
+
+#define KCL_BYTECODE_MAGIC "KCLBYTE"
+#define KCL_BYTECODE_ALIGN 8
+
+// On-disk layout, native endianness:
+//   header | code | constants | variables | imports | commands | pool
+// Every section starts on an 8-byte boundary. The header describes the
+// source the program was compiled from, so a changed script is noticed.
+typedef struct {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t loop_count;
+    uint64_t source_size;
+    uint64_t source_mtime;
+    uint64_t source_hash;
+    uint64_t total_size;
+    uint64_t code_offset;
+    uint64_t code_length;
+    uint64_t constants_offset;
+    uint64_t constant_count;
+    uint64_t variables_offset;
+    uint64_t variable_count;
+    uint64_t imports_offset;
+    uint64_t import_count;
+    uint64_t commands_offset;
+    uint64_t command_count;
+    uint64_t pool_offset;
+    uint64_t pool_length;
+    uint32_t stack_depth;
+    uint32_t reserved;
+} VmArtifactHeader;
+
+static std::atomic<unsigned> g_vm_store_counter{0};
+
+static uint64_t vm_stat_mtime(const struct stat* st) {
+#if defined(__linux__)
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ull + (uint64_t)st->st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    return (uint64_t)st->st_mtimespec.tv_sec * 1000000000ull + (uint64_t)st->st_mtimespec.tv_nsec;
+#else
+    return (uint64_t)st->st_mtime * 1000000000ull;
+#endif
+}
+
+bool kcl_source_stamp(const char* path, KCLSourceStamp* stamp) {
+    struct stat st;
+    if (!path || !stamp || stat(path, &st) != 0) return false;
+    
+    stamp->size = (uint64_t)st.st_size;
+    stamp->mtime = vm_stat_mtime(&st);
+    return true;
+}
+
+static uint64_t vm_hash(uint64_t hash, const char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// The interpreter version is part of the content key, so a new bytecode
+// format never accepts an artifact written by an older one
+static uint64_t vm_source_hash(const char* source_text) {
+    char version[32];
+    int version_length = snprintf(version, sizeof(version), "kcl-bytecode:%d", KCL_BYTECODE_VERSION);
+    uint64_t hash = vm_hash(14695981039346656037ULL, version, (size_t)version_length + 1);
+    return vm_hash(hash, source_text, strlen(source_text));
+}
+
+char* kcl_bytecode_cache_path(const char* cache_dir, const char* path) {
+    if (!cache_dir || !path) return NULL;
+    
+    // The same script reached through different relative paths shares one
+    // artifact
+#ifdef _WIN32
+    char* resolved = _fullpath(NULL, path, 0);
+#else
+    char* resolved = realpath(path, NULL);
+#endif
+    const char* key = resolved ? resolved : path;
+    uint64_t hash = vm_hash(14695981039346656037ULL, key, strlen(key));
+    free(resolved);
+    
+    size_t length = strlen(cache_dir) + 32;
+    char* artifact = (char*)malloc(length);
+    if (artifact) snprintf(artifact, length, "%s/kcl-%016llx.kbc", cache_dir, (unsigned long long)hash);
+    return artifact;
+}
+
+static size_t vm_align(size_t offset) {
+    return (offset + KCL_BYTECODE_ALIGN - 1) & ~(size_t)(KCL_BYTECODE_ALIGN - 1);
+}
+
+static char* vm_serialize(const KCLProgram* program, const KCLSourceStamp* stamp, uint64_t source_hash, size_t* out_size) {
+    VmArtifactHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KCL_BYTECODE_MAGIC, sizeof(KCL_BYTECODE_MAGIC));
+    header.format_version = KCL_BYTECODE_VERSION;
+    header.loop_count = program->loop_count;
+    header.stack_depth = program->stack_depth;
+    header.source_size = stamp->size;
+    header.source_mtime = stamp->mtime;
+    header.source_hash = source_hash;
+    header.code_length = program->code_length;
+    header.constant_count = program->constant_count;
+    header.variable_count = program->variable_count;
+    header.import_count = program->import_count;
+    header.command_count = program->command_count;
+    header.pool_length = program->pool_length;
+    header.code_offset = vm_align(sizeof(VmArtifactHeader));
+    header.constants_offset = vm_align(header.code_offset + sizeof(uint32_t) * header.code_length);
+    header.variables_offset = vm_align(header.constants_offset + sizeof(KCLConstant) * header.constant_count);
+    header.imports_offset = vm_align(header.variables_offset + sizeof(uint32_t) * header.variable_count);
+    header.commands_offset = vm_align(header.imports_offset + sizeof(uint32_t) * header.import_count);
+    header.pool_offset = vm_align(header.commands_offset + sizeof(uint32_t) * header.command_count);
+    header.total_size = header.pool_offset + header.pool_length + 1;
+    
+    char* buffer = (char*)calloc(1, header.total_size);
+    if (!buffer) return NULL;
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + header.code_offset, program->code, sizeof(uint32_t) * header.code_length);
+    memcpy(buffer + header.constants_offset, program->constants, sizeof(KCLConstant) * header.constant_count);
+    memcpy(buffer + header.variables_offset, program->variables, sizeof(uint32_t) * header.variable_count);
+    memcpy(buffer + header.imports_offset, program->imports, sizeof(uint32_t) * header.import_count);
+    memcpy(buffer + header.commands_offset, program->commands, sizeof(uint32_t) * header.command_count);
+    memcpy(buffer + header.pool_offset, program->pool, header.pool_length);
+    *out_size = header.total_size;
+    return buffer;
+}
+
+static bool vm_make_directory(const char* path) {
+    std::string partial;
+    for (const char* cursor = path; *cursor; cursor++) {
+        partial += *cursor;
+        if (cursor[1] != '/' && cursor[1] != '\0') continue;
+#ifdef _WIN32
+        if (_mkdir(partial.c_str()) != 0 && errno != EEXIST) return false;
+#else
+        if (mkdir(partial.c_str(), 0700) != 0 && errno != EEXIST) return false;
+#endif
+    }
+    return true;
+}
+
+bool kcl_bytecode_store(const char* cache_dir, const char* path, const KCLSourceStamp* stamp, const char* source_text, const KCLProgram* program) {
+    if (!cache_dir || !path || !stamp || !source_text || !program) return false;
+    
+    size_t size = 0;
+    char* buffer = vm_serialize(program, stamp, vm_source_hash(source_text), &size);
+    char* artifact = kcl_bytecode_cache_path(cache_dir, path);
+    if (!buffer || !artifact || !vm_make_directory(cache_dir)) {
+        free(buffer);
+        free(artifact);
+        return false;
+    }
+    
+    // Concurrent runs of the same script each write their own scratch file;
+    // readers only ever see a complete artifact, which appears in one rename
+#ifdef _WIN32
+    long pid = (long)_getpid();
+#else
+    long pid = (long)getpid();
+#endif
+    std::string scratch = std::string(artifact) + "." + std::to_string(pid) + "." + std::to_string(g_vm_store_counter++);
+    FILE* file = fopen(scratch.c_str(), "wb");
+    bool ok = file && fwrite(buffer, 1, size, file) == size;
+    ok = file && (fclose(file) == 0) && ok;
+#ifdef _WIN32
+    if (ok) remove(artifact);
+#else
+    if (ok) ok = chmod(scratch.c_str(), 0600) == 0;
+#endif
+    if (ok) ok = rename(scratch.c_str(), artifact) == 0;
+    if (!ok) remove(scratch.c_str());
+    
+    free(buffer);
+    free(artifact);
+    return ok;
+}
+
+static void vm_release(const void* data, size_t size) {
+#ifdef _WIN32
+    free((void*)data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+#ifdef _WIN32
+
+int kcl_cache_open(const char* cache_dir, const char* artifact) {
+    errno = ENOSYS;
+    return -1;
+}
+
+#else
+
+static bool vm_trusted(int fd, mode_t type) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && (st.st_mode & S_IFMT) == type &&
+           st.st_uid == geteuid() && !(st.st_mode & (S_IWGRP | S_IWOTH));
+}
+
+int kcl_cache_open(const char* cache_dir, const char* artifact) {
+    const char* name = artifact ? strrchr(artifact, '/') : NULL;
+    if (!cache_dir || !name) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    // With the directory checked no one else can swap the artifact after the
+    // checks, so the descriptor stays trustworthy for as long as it is used
+    int dir = open(cache_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0) return -1;
+    if (!vm_trusted(dir, S_IFDIR)) {
+        close(dir);
+        errno = EPERM;
+        return -1;
+    }
+    int fd = openat(dir, name + 1, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    int saved = errno;
+    close(dir);
+    if (fd < 0) {
+        errno = saved;
+        return -1;
+    }
+    if (!vm_trusted(fd, S_IFREG)) {
+        close(fd);
+        errno = EPERM;
+        return -1;
+    }
+    return fd;
+}
+
+#endif
+
+// Maps the artifact and reports when it was last written
+static const char* vm_map(const char* cache_dir, const char* path, size_t* size, uint64_t* written) {
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    struct _stat64 st;
+    if (_fstat64(_fileno(file), &st) != 0 || st.st_size < (long long)sizeof(VmArtifactHeader)) {
+        fclose(file);
+        return NULL;
+    }
+    
+    char* data = (char*)malloc((size_t)st.st_size);
+    if (data && fread(data, 1, (size_t)st.st_size, file) != (size_t)st.st_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    
+    *size = (size_t)st.st_size;
+    *written = (uint64_t)st.st_mtime * 1000000000ull;
+    return data;
+#else
+    int fd = kcl_cache_open(cache_dir, path);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(VmArtifactHeader)) {
+        close(fd);
+        return NULL;
+    }
+    
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    
+    *size = (size_t)st.st_size;
+    *written = vm_stat_mtime(&st);
+    return (const char*)data;
+#endif
+}
+
+static bool vm_section_fits(const VmArtifactHeader* header, uint64_t offset, uint64_t count, size_t element_size) {
+    if (offset % KCL_BYTECODE_ALIGN != 0 || offset > header->total_size) return false;
+    return count <= (header->total_size - offset) / element_size;
+}
+
+// Records the stack depth an instruction is reached with, which has to be
+// the same along every path that reaches it
+static bool vm_reach(std::vector<int64_t>& depths, std::vector<size_t>& pending, size_t pc, int64_t depth) {
+    if (depths[pc] < 0) {
+        depths[pc] = depth;
+        pending.push_back(pc);
+        return true;
+    }
+    return depths[pc] == depth;
+}
+
+// Follows every path through the code tracking the stack depth, so no
+// instruction can pop an empty stack, push past stack_depth or leave a jump
+// target reached at two different depths. Each loop is either a range or an
+// item loop, and every ITEMS of a loop leaves its items at the same base,
+// which is where ITEM_NEXT drops the stack back to when the loop ends.
+static bool vm_verify_stack(const KCLProgram* program) {
+    enum { LOOP_UNUSED, LOOP_RANGE, LOOP_ITEMS };
+    const uint32_t* code = program->code;
+    const int64_t limit = program->stack_depth;
+    std::vector<int64_t> depths(program->code_length, -1);
+    std::vector<int64_t> bases(program->loop_count, -1);
+    std::vector<uint8_t> kinds(program->loop_count, LOOP_UNUSED);
+    std::vector<size_t> pending;
+    vm_reach(depths, pending, 0, 0);
+    
+    while (!pending.empty()) {
+        size_t pc = pending.back();
+        pending.pop_back();
+        int64_t depth = depths[pc];
+        uint32_t op = code[pc] & 0xFF;
+        uint32_t a = code[pc] >> 8;
+        const uint32_t* operands = &code[pc + 1];
+    
+        int64_t pops = 0;
+        int64_t pushes = 0;
+        size_t next = pc + 1;
+        bool falls = true;
+        uint8_t kind = LOOP_UNUSED;
+        switch (op) {
+            case KCL_OP_HALT:
+                falls = false;
+                break;
+            case KCL_OP_PUSH:
+                pushes = 1;
+                break;
+            case KCL_OP_CONST:
+            case KCL_OP_LOAD:
+                pops = 1;
+                pushes = 1;
+                break;
+            case KCL_OP_STORE:
+            case KCL_OP_REDIRECT:
+            case KCL_OP_RUN:
+            case KCL_OP_PIPELINE:
+            case KCL_OP_ECHO:
+                pops = 1;
+                break;
+            case KCL_OP_JUMP:
+                if (!vm_reach(depths, pending, a, depth)) return false;
+                falls = false;
+                break;
+            case KCL_OP_TEST:
+                if (depth < 2 || !vm_reach(depths, pending, operands[0], depth - 2)) return false;
+                pops = 2;
+                next = pc + 2;
+                break;
+            case KCL_OP_RANGE:
+                pops = 2;
+                next = pc + 2;
+                kind = LOOP_RANGE;
+                break;
+            case KCL_OP_RANGE_NEXT:
+                if (!vm_reach(depths, pending, operands[1], depth)) return false;
+                next = pc + 3;
+                kind = LOOP_RANGE;
+                break;
+            case KCL_OP_ITEMS:
+                if (operands[0] > depth) return false;
+                if (bases[a] >= 0 && bases[a] != depth - operands[0]) return false;
+                bases[a] = depth - operands[0];
+                next = pc + 2;
+                kind = LOOP_ITEMS;
+                break;
+            case KCL_OP_ITEM_NEXT:
+                if (bases[a] < 0 || !vm_reach(depths, pending, operands[1], bases[a])) return false;
+                next = pc + 3;
+                kind = LOOP_ITEMS;
+                break;
+            default:
+                return false;
+        }
+        if (depth < pops || depth - pops + pushes > limit) return false;
+        if (kind != LOOP_UNUSED) {
+            if (kinds[a] != LOOP_UNUSED && kinds[a] != kind) return false;
+            kinds[a] = kind;
+        }
+        if (falls && !vm_reach(depths, pending, next, depth - pops + pushes)) return false;
+    }
+    return true;
+}
+
+// Every operand must stay inside the program, every jump must land on an
+// instruction and the stack must stay within bounds on every path, so a
+// damaged or foreign artifact is refused instead of run
+static bool vm_verify(const KCLProgram* program) {
+    if (program->code_length == 0 || program->pool[program->pool_length] != '\0') return false;
+    // Every loop needs instructions of its own, which bounds the loop table
+    if (program->loop_count > program->code_length) return false;
+    
+    for (size_t i = 0; i < program->constant_count; i++) {
+        const KCLConstant* constant = &program->constants[i];
+        if (constant->offset > program->pool_length || constant->length > program->pool_length - constant->offset) return false;
+        if (program->pool[constant->offset + constant->length] != '\0') return false;
+    }
+    for (size_t i = 0; i < program->variable_count; i++) {
+        if (program->variables[i] >= program->constant_count) return false;
+    }
+    for (size_t i = 0; i < program->import_count; i++) {
+        if (program->imports[i] >= program->variable_count) return false;
+    }
+    for (size_t i = 0; i < program->command_count; i++) {
+        if (program->commands[i] >= program->constant_count) return false;
+    }
+    
+    const uint32_t* code = program->code;
+    std::vector<bool> starts(program->code_length, false);
+    std::vector<uint32_t> targets;
+    uint32_t op = KCL_OP_HALT;
+    for (size_t pc = 0; pc < program->code_length; ) {
+        starts[pc] = true;
+        op = code[pc] & 0xFF;
+        uint32_t a = code[pc] >> 8;
+        size_t extra = op == KCL_OP_TEST || op == KCL_OP_RANGE || op == KCL_OP_ITEMS ? 1 :
+                       op == KCL_OP_RANGE_NEXT || op == KCL_OP_ITEM_NEXT ? 2 : 0;
+        if (extra >= program->code_length - pc) return false;
+        const uint32_t* operands = &code[pc + 1];
+    
+        bool valid;
+        switch (op) {
+            case KCL_OP_HALT:
+            case KCL_OP_PUSH:
+            case KCL_OP_PIPELINE:
+            case KCL_OP_ECHO:
+                valid = true;
+                break;
+            case KCL_OP_CONST:
+                valid = a < program->constant_count;
+                break;
+            case KCL_OP_LOAD:
+            case KCL_OP_STORE:
+                valid = a < program->variable_count;
+                break;
+            case KCL_OP_REDIRECT:
+                valid = a <= 1;
+                break;
+            case KCL_OP_RUN:
+                valid = a <= program->command_count;
+                break;
+            case KCL_OP_JUMP:
+                targets.push_back(a);
+                valid = true;
+                break;
+            case KCL_OP_TEST:
+                targets.push_back(operands[0]);
+                valid = a < sizeof(vm_compare_names) / sizeof(vm_compare_names[0]);
+                break;
+            case KCL_OP_RANGE:
+                valid = a < program->loop_count && operands[0] < program->variable_count;
+                break;
+            case KCL_OP_ITEMS:
+                valid = a < program->loop_count && operands[0] <= program->stack_depth;
+                break;
+            case KCL_OP_RANGE_NEXT:
+            case KCL_OP_ITEM_NEXT:
+                targets.push_back(operands[1]);
+                valid = a < program->loop_count && operands[0] < program->variable_count;
+                break;
+            default:
+                valid = false;
+                break;
+        }
+        if (!valid) return false;
+        pc += 1 + extra;
+    }
+    if (op != KCL_OP_HALT) return false;
+    
+    for (uint32_t target : targets) {
+        if (target >= program->code_length || !starts[target]) return false;
+    }
+    return vm_verify_stack(program);
+}
+
+// A program whose sections stay in the mapping, or NULL if the artifact is
+// not one this interpreter wrote
+static KCLProgram* vm_program_view(const char* data, size_t size) {
+    const VmArtifactHeader* header = (const VmArtifactHeader*)data;
+    if (memcmp(header->magic, KCL_BYTECODE_MAGIC, sizeof(KCL_BYTECODE_MAGIC)) != 0) return NULL;
+    if (header->format_version != KCL_BYTECODE_VERSION || header->total_size != size) return NULL;
+    if (!vm_section_fits(header, header->code_offset, header->code_length, sizeof(uint32_t)) ||
+        !vm_section_fits(header, header->constants_offset, header->constant_count, sizeof(KCLConstant)) ||
+        !vm_section_fits(header, header->variables_offset, header->variable_count, sizeof(uint32_t)) ||
+        !vm_section_fits(header, header->imports_offset, header->import_count, sizeof(uint32_t)) ||
+        !vm_section_fits(header, header->commands_offset, header->command_count, sizeof(uint32_t)) ||
+        !vm_section_fits(header, header->pool_offset, header->pool_length + 1, 1)) {
+        return NULL;
+    }
+    
+    KCLProgram* program = (KCLProgram*)calloc(1, sizeof(KCLProgram));
+    if (!program) return NULL;
+    program->code = (uint32_t*)(data + header->code_offset);
+    program->code_length = header->code_length;
+    program->constants = (KCLConstant*)(data + header->constants_offset);
+    program->constant_count = header->constant_count;
+    program->variables = (uint32_t*)(data + header->variables_offset);
+    program->variable_count = header->variable_count;
+    program->imports = (uint32_t*)(data + header->imports_offset);
+    program->import_count = header->import_count;
+    program->commands = (uint32_t*)(data + header->commands_offset);
+    program->command_count = header->command_count;
+    program->pool = (char*)(data + header->pool_offset);
+    program->pool_length = header->pool_length;
+    program->loop_count = header->loop_count;
+    program->stack_depth = header->stack_depth;
+    
+    if (!vm_verify(program)) {
+        free(program);
+        return NULL;
+    }
+    program->mapping = data;
+    program->mapping_size = size;
+    return program;
+}
+
+KCLProgram* kcl_bytecode_load(const char* cache_dir, const char* path, const KCLSourceStamp* stamp, const char* source_text) {
+    if (!cache_dir || !path || !stamp) return NULL;
+    
+    char* artifact = kcl_bytecode_cache_path(cache_dir, path);
+    if (!artifact) return NULL;
+    
+    size_t size = 0;
+    uint64_t written = 0;
+    const char* data = vm_map(cache_dir, artifact, &size, &written);
+    free(artifact);
+    if (!data) return NULL;
+    
+    KCLProgram* program = vm_program_view(data, size);
+    if (!program) {
+        vm_release(data, size);
+        return NULL;
+    }
+    
+    // A script changed within the same clock tick as its artifact was written
+    // could keep its stamp, so only a stamp older than the artifact is trusted
+    const VmArtifactHeader* header = (const VmArtifactHeader*)data;
+    if (header->source_size == stamp->size && header->source_mtime == stamp->mtime && stamp->mtime < written) {
+        return program;
+    }
+    
+    char* text = source_text ? NULL : kcl_read_script(path);
+    const char* content = source_text ? source_text : text;
+    if (content && header->source_hash == vm_source_hash(content)) {
+        // Touched but unchanged: restamp so the next run skips the hash
+        kcl_bytecode_store(cache_dir, path, stamp, content, program);
+    } else {
+        kcl_program_destroy(program);
+        program = NULL;
+    }
+    free(text);
+    return program;
+}
+
+typedef struct {
+    char* text;
+    size_t length;
+    uint64_t hash;
+    uint64_t last_used;
+    KCLProgram* program;
+} VmCachedProgram;
+
+struct KCLProgramCache {
+    VmCachedProgram* entries;
+    size_t count;
+    size_t capacity;
+    uint64_t clock;
+};
+
+KCLProgramCache* kcl_program_cache_create(size_t capacity) {
+    if (capacity == 0) return NULL;
+    
+    KCLProgramCache* cache = (KCLProgramCache*)calloc(1, sizeof(KCLProgramCache));
+    if (!cache) return NULL;
+    cache->entries = (VmCachedProgram*)calloc(capacity, sizeof(VmCachedProgram));
+    if (!cache->entries) {
+        free(cache);
+        return NULL;
+    }
+    cache->capacity = capacity;
+    return cache;
+}
+
+static void vm_cache_remove(KCLProgramCache* cache, size_t index) {
+    free(cache->entries[index].text);
+    cache->entries[index] = cache->entries[--cache->count];
+}
+
+void kcl_program_cache_destroy(KCLProgramCache* cache) {
+    if (!cache) return;
+    
+    for (size_t i = 0; i < cache->count; i++) {
+        kcl_program_destroy(cache->entries[i].program);
+        free(cache->entries[i].text);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+// Scripts are few enough that a scan over their hashes beats a hash table
+static size_t vm_cache_find(const KCLProgramCache* cache, const char* source_text, size_t length, uint64_t hash) {
+    for (size_t i = 0; i < cache->count; i++) {
+        const VmCachedProgram* entry = &cache->entries[i];
+        if (entry->hash == hash && entry->length == length && memcmp(entry->text, source_text, length) == 0) return i;
+    }
+    return cache->count;
+}
+
+KCLProgram* kcl_program_cache_take(KCLProgramCache* cache, const char* source_text) {
+    if (!cache || !source_text) return NULL;
+    
+    size_t length = strlen(source_text);
+    size_t index = vm_cache_find(cache, source_text, length, vm_hash(14695981039346656037ULL, source_text, length));
+    if (index == cache->count) return NULL;
+    
+    KCLProgram* program = cache->entries[index].program;
+    vm_cache_remove(cache, index);
+    return program;
+}
+
+void kcl_program_cache_put(KCLProgramCache* cache, const char* source_text, KCLProgram* program) {
+    if (!program) return;
+    
+    char* text = cache && source_text ? strdup(source_text) : NULL;
+    if (!text) {
+        kcl_program_destroy(program);
+        return;
+    }
+    
+    size_t length = strlen(text);
+    uint64_t hash = vm_hash(14695981039346656037ULL, text, length);
+    size_t index = vm_cache_find(cache, text, length, hash);
+    if (index < cache->count) {
+        // A nested run cached the same text meanwhile
+        kcl_program_destroy(cache->entries[index].program);
+        vm_cache_remove(cache, index);
+    } else if (cache->count == cache->capacity) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < cache->count; i++) {
+            if (cache->entries[i].last_used < cache->entries[oldest].last_used) oldest = i;
+        }
+        kcl_program_destroy(cache->entries[oldest].program);
+        vm_cache_remove(cache, oldest);
+    }
+    
+    VmCachedProgram* entry = &cache->entries[cache->count++];
+    entry->text = text;
+    entry->length = length;
+    entry->hash = hash;
+    entry->last_used = ++cache->clock;
+    entry->program = program;
+}
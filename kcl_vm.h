@@ -0,0 +1,142 @@
+#ifndef KCL_VM_H
+#define KCL_VM_H
+
+#include "kcl_interpreter.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Scripts run as bytecode on a stack machine whose values are strings. An
+ * instruction is one 32-bit word holding the opcode in its low byte and its
+ * first operand A in the upper 24 bits; operands shown in brackets follow it
+ * as whole words.
+ *   PUSH                        push an empty string
+ *   CONST A                     append constant A to the top string
+ *   LOAD A                      append variable A to the top string
+ *   STORE A                     pop into variable A; the status becomes 0
+ *   REDIRECT A                  pop the target for the next command, A = 1 to append
+ *   RUN A                       pop a command line and run it as command A - 1,
+ *                               or resolve its name on the spot when A is 0
+ *   PIPELINE                    pop a pipeline and run it
+ *   ECHO                        pop a line and write it out
+ *   JUMP A                      continue at word A
+ *   TEST A [target]             pop rhs and lhs and compare them with KCLCompare
+ *                               A, jumping to target unless the test holds
+ *   RANGE A [variable]          pop the to and from bounds of loop A
+ *   RANGE_NEXT A [variable] [target]
+ *                               store loop A's next number, or jump when done
+ *   ITEMS A [count]             loop A iterates over the top count strings
+ *   ITEM_NEXT A [variable] [target]
+ *                               store loop A's next item, or drop the items
+ *                               and jump when done
+ *   HALT
+ * Literal command names are collected in commands and looked up once per run
+ * in the pinned registry version, so a loop never resolves a name twice. */
+typedef enum {
+    KCL_OP_HALT,
+    KCL_OP_PUSH,
+    KCL_OP_CONST,
+    KCL_OP_LOAD,
+    KCL_OP_STORE,
+    KCL_OP_REDIRECT,
+    KCL_OP_RUN,
+    KCL_OP_PIPELINE,
+    KCL_OP_ECHO,
+    KCL_OP_JUMP,
+    KCL_OP_TEST,
+    KCL_OP_RANGE,
+    KCL_OP_RANGE_NEXT,
+    KCL_OP_ITEMS,
+    KCL_OP_ITEM_NEXT,
+    KCL_OP_COUNT
+} KCLOpcode;
+
+typedef enum {
+    KCL_COMPARE_EQUAL,
+    KCL_COMPARE_NOT_EQUAL,
+    KCL_COMPARE_EQ,
+    KCL_COMPARE_NE,
+    KCL_COMPARE_LT,
+    KCL_COMPARE_LE,
+    KCL_COMPARE_GT,
+    KCL_COMPARE_GE
+} KCLCompare;
+
+#define KCL_BYTECODE_VERSION 2
+#define KCL_PROGRAM_CACHE_ENTRIES 32
+#define KCL_OPERAND_MAX 0xFFFFFFu
+#define KCL_INSTRUCTION(op, a) ((uint32_t)(op) | ((uint32_t)(a) << 8))
+
+/* Constants are spans of pool, each followed by a NUL. Variables and commands
+ * are the constant indices of their names; imports are the variable slots
+ * the program reads but never assigns, which start out with the context's
+ * values. A program loaded from the bytecode cache points into its mapped
+ * artifact, which kcl_program_destroy unmaps. */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} KCLConstant;
+
+typedef struct KCLProgram {
+    uint32_t* code;
+    size_t code_length;
+    char* pool;
+    size_t pool_length;
+    KCLConstant* constants;
+    size_t constant_count;
+    uint32_t* variables;
+    size_t variable_count;
+    uint32_t* imports;
+    size_t import_count;
+    uint32_t* commands;
+    size_t command_count;
+    uint32_t loop_count;
+    uint32_t stack_depth;
+    const void* mapping;
+    size_t mapping_size;
+} KCLProgram;
+
+/* What a script file looked like when it was stamped: its size and its
+ * modification time in nanoseconds. */
+typedef struct {
+    uint64_t size;
+    uint64_t mtime;
+} KCLSourceStamp;
+
+/* NULL with *error set (when error is not NULL) if the script has errors or
+ * is too large for 24-bit operands. */
+KCLProgram* kcl_program_compile(const KCLScript* script, char** error);
+void kcl_program_destroy(KCLProgram* program);
+const char* kcl_program_constant(const KCLProgram* program, uint32_t index);
+
+/* Returns the exit status as kcl_execute_streaming does. */
+int kcl_program_run(const KCLProgram* program, KCLContext* ctx, OutputSink* sink);
+
+/* Programs are cached on disk as <cache_dir>/kcl-<hash>.kbc, one per script
+ * file, keyed by the file's resolved path. An artifact records the stamp and
+ * content hash of the source it was compiled from together with
+ * KCL_BYTECODE_VERSION. Stamp the file before reading it: kcl_bytecode_load
+ * maps the artifact and trusts it outright when the stamp still matches and
+ * predates the artifact, and otherwise hashes source_text (read from path
+ * when NULL), accepting an unchanged script and restamping its artifact. */
+bool kcl_source_stamp(const char* path, KCLSourceStamp* stamp);
+/* Opens an artifact in a KCL cache directory for reading, or returns -1 with
+ * errno set (EPERM when the cache is not trusted). The directory and the
+ * artifact must both be owned by the current user and not be group- or
+ * world-writable, and a symlinked artifact is refused, since anyone else who
+ * could write them could make scripts run code of their choosing. Cache
+ * directories are created 0700 and artifacts written owner-only. */
+int kcl_cache_open(const char* cache_dir, const char* artifact);
+char* kcl_bytecode_cache_path(const char* cache_dir, const char* path);
+KCLProgram* kcl_bytecode_load(const char* cache_dir, const char* path, const KCLSourceStamp* stamp, const char* source_text);
+bool kcl_bytecode_store(const char* cache_dir, const char* path, const KCLSourceStamp* stamp, const char* source_text, const KCLProgram* program);
+
+/* Programs for recently run script texts; the least recently used is evicted
+ * once capacity is reached. take removes the program while it runs and put
+ * hands it back (or frees it without a cache), so a nested run of the same
+ * text compiles its own copy and eviction never frees a running program. */
+KCLProgramCache* kcl_program_cache_create(size_t capacity);
+void kcl_program_cache_destroy(KCLProgramCache* cache);
+KCLProgram* kcl_program_cache_take(KCLProgramCache* cache, const char* source_text);
+void kcl_program_cache_put(KCLProgramCache* cache, const char* source_text, KCLProgram* program);
+
+#endif
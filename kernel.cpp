@@ -2,9 +2,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <atomic>
+#include <mutex>
+#ifdef _WIN32
+#include <io.h>
+#define kernel_read _read
+#else
+#include <unistd.h>
+#define kernel_read read
+#endif
 
 static KernelContext* g_kernel_ctx = NULL;
-static CommandRegistry* g_command_registry = NULL;
+static std::atomic<CommandRegistry*> g_command_registry{NULL};
+
+static KernelEnvironmentHandlers g_handlers[ENV_UNKNOWN] = {};
+static bool g_kernel_quiet = false;
+
+static void registry_release_all(void);
+
+void kernel_set_quiet(bool quiet) {
+    g_kernel_quiet = quiet;
+}
 
 KernelContext* kernel_init(void) {
     if (g_kernel_ctx != NULL) {
@@ -19,162 +39,1178 @@ KernelContext* kernel_init(void) {
     g_kernel_ctx->current_user = strdup("user");
     g_kernel_ctx->current_directory = strdup("/home/user");
     
-    g_command_registry = command_registry_create();
+    g_command_registry.store(command_registry_create());
     
-    printf("%s v%s initialized\n", KERNEL_NAME, KERNEL_VERSION);
+    if (!g_kernel_quiet) printf("%s v%s initialized\n", KERNEL_NAME, KERNEL_VERSION);
     return g_kernel_ctx;
 }
 
 void kernel_shutdown(KernelContext* ctx) {
+    // Jobs still queued resolve against the registry, so drain them first
+    kernel_stop_workers();
+    
     if (ctx) {
         free(ctx->current_user);
         free(ctx->current_directory);
         free(ctx);
     }
     
-    if (g_command_registry) {
-        command_registry_destroy(g_command_registry);
-        g_command_registry = NULL;
-    }
+    registry_release_all();
     
+    memset(g_handlers, 0, sizeof(g_handlers));
     g_kernel_ctx = NULL;
-    printf("Kernel shutdown complete\n");
+    if (!g_kernel_quiet) printf("Kernel shutdown complete\n");
+}
+
+KernelContext* kernel_context_clone(const KernelContext* ctx) {
+    if (!ctx) return NULL;
+    
+    KernelContext* clone = (KernelContext*)malloc(sizeof(KernelContext));
+    if (!clone) return NULL;
+    
+    clone->is_root = ctx->is_root;
+    clone->current_env = ctx->current_env;
+    clone->current_user = ctx->current_user ? strdup(ctx->current_user) : NULL;
+    clone->current_directory = ctx->current_directory ? strdup(ctx->current_directory) : NULL;
+    return clone;
+}
+
+void kernel_context_destroy(KernelContext* ctx) {
+    if (!ctx) return;
+    
+    free(ctx->current_user);
+    free(ctx->current_directory);
+    free(ctx);
+}
+
+CommandRegistry* kernel_get_registry(KernelContext* ctx) {
+    if (!ctx) return NULL;
+    return g_command_registry.load(std::memory_order_acquire);
+}
+
+// Readers announce the version they are using in a hazard record. Records are
+// never freed, only recycled, so a thread can always scan the list safely;
+// each thread first tries the record it used last
+struct RegistryHazard {
+    std::atomic<CommandRegistry*> registry;
+    std::atomic<bool> active;
+    RegistryHazard* next;
+};
+
+typedef struct RetiredRegistry {
+    CommandRegistry* registry;
+    struct RetiredRegistry* next;
+} RetiredRegistry;
+
+static std::atomic<RegistryHazard*> g_registry_hazards{NULL};
+static thread_local RegistryHazard* t_registry_hazard = NULL;
+static std::mutex g_registry_writer;
+static RetiredRegistry* g_retired_registries = NULL;
+
+static bool registry_hazard_claim(RegistryHazard* hazard) {
+    bool expected = false;
+    return hazard->active.compare_exchange_strong(expected, true, std::memory_order_acquire);
+}
+
+static RegistryHazard* registry_hazard_acquire(void) {
+    RegistryHazard* hazard = t_registry_hazard;
+    if (hazard && registry_hazard_claim(hazard)) return hazard;
+    
+    for (hazard = g_registry_hazards.load(std::memory_order_acquire); hazard; hazard = hazard->next) {
+        if (registry_hazard_claim(hazard)) break;
+    }
+    
+    if (!hazard) {
+        hazard = new RegistryHazard;
+        hazard->registry.store(NULL, std::memory_order_relaxed);
+        hazard->active.store(true, std::memory_order_relaxed);
+        hazard->next = g_registry_hazards.load(std::memory_order_relaxed);
+        while (!g_registry_hazards.compare_exchange_weak(hazard->next, hazard, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+    
+    t_registry_hazard = hazard;
+    return hazard;
+}
+
+CommandRegistry* kernel_registry_acquire(KernelRegistryGuard* guard) {
+    if (!guard) return NULL;
+    
+    RegistryHazard* hazard = registry_hazard_acquire();
+    
+    // The version is safe once the hazard is visible and the version is still
+    // the published one; a writer that swapped in between is retried
+    CommandRegistry* registry = g_command_registry.load();
+    for (;;) {
+        hazard->registry.store(registry);
+        CommandRegistry* current = g_command_registry.load();
+        if (current == registry) break;
+        registry = current;
+    }
+    
+    guard->registry = registry;
+    guard->hazard = hazard;
+    return registry;
+}
+
+void kernel_registry_release(KernelRegistryGuard* guard) {
+    if (!guard || !guard->hazard) return;
+    
+    guard->hazard->registry.store(NULL, std::memory_order_release);
+    guard->hazard->active.store(false, std::memory_order_release);
+    guard->hazard = NULL;
+    guard->registry = NULL;
+}
+
+static bool registry_is_pinned(const CommandRegistry* registry) {
+    for (RegistryHazard* hazard = g_registry_hazards.load(std::memory_order_acquire); hazard; hazard = hazard->next) {
+        if (hazard->registry.load() == registry) return true;
+    }
+    return false;
+}
+
+// Called with g_registry_writer held. Versions still pinned stay on the list
+// and are retried on the next publish
+static void registry_reclaim(void) {
+    RetiredRegistry** link = &g_retired_registries;
+    while (*link) {
+        RetiredRegistry* retired = *link;
+        if (registry_is_pinned(retired->registry)) {
+            link = &retired->next;
+            continue;
+        }
+    
+        *link = retired->next;
+        command_registry_destroy(retired->registry);
+        free(retired);
+    }
+}
+
+static void registry_publish(CommandRegistry* registry) {
+    CommandRegistry* previous = g_command_registry.exchange(registry);
+    if (previous && previous != registry) {
+        RetiredRegistry* retired = (RetiredRegistry*)malloc(sizeof(RetiredRegistry));
+        if (retired) {
+            retired->registry = previous;
+            retired->next = g_retired_registries;
+            g_retired_registries = retired;
+        }
+        // Without a list node the old version is leaked rather than freed
+        // under a reader
+    }
+    
+    registry_reclaim();
+}
+
+// Shutdown runs after the job pool has drained, so no version is pinned
+static void registry_release_all(void) {
+    std::lock_guard<std::mutex> lock(g_registry_writer);
+    
+    command_registry_destroy(g_command_registry.exchange(NULL));
+    while (g_retired_registries) {
+        RetiredRegistry* retired = g_retired_registries;
+        g_retired_registries = retired->next;
+        command_registry_destroy(retired->registry);
+        free(retired);
+    }
+}
+
+bool kernel_attach_registry(KernelContext* ctx, CommandRegistry* registry) {
+    if (!ctx || !registry) return false;
+    
+    std::lock_guard<std::mutex> lock(g_registry_writer);
+    registry_publish(registry);
+    return true;
+}
+
+// Writers are serialized, copy the current version and publish the copy with
+// one atomic swap; lookups in flight keep using the version they pinned
+bool kernel_update_registry(KernelRegistryUpdate update, void* userdata) {
+    if (!update) return false;
+    
+    std::lock_guard<std::mutex> lock(g_registry_writer);
+    CommandRegistry* current = g_command_registry.load(std::memory_order_acquire);
+    if (!current) return false;
+    
+    CommandRegistry* next = command_registry_clone(current);
+    if (!next) return false;
+    
+    if (!update(next, userdata)) {
+        command_registry_destroy(next);
+        return false;
+    }
+    
+    registry_publish(next);
+    return true;
+}
+
+bool kernel_register_executor(EnvironmentType env, KernelExecutor executor, void* userdata) {
+    if (env >= ENV_UNKNOWN) return false;
+    
+    g_handlers[env].executor = executor;
+    g_handlers[env].executor_userdata = userdata;
+    return true;
+}
+
+bool kernel_register_stage_launcher(EnvironmentType env, KernelStageLauncher launcher, void* userdata) {
+    if (env >= ENV_UNKNOWN) return false;
+    
+    g_handlers[env].launcher = launcher;
+    g_handlers[env].launcher_userdata = userdata;
+    return true;
+}
+
+const KernelEnvironmentHandlers* kernel_get_handlers(EnvironmentType env) {
+    if (env >= ENV_UNKNOWN) return NULL;
+    return &g_handlers[env];
+}
+
+#define ARENA_DEFAULT_CHUNK 16384
+#define REGISTRY_INITIAL_SLOTS 256
+#define REGISTRY_INITIAL_STRINGS 256
+
+struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t used;
+    size_t size;
+};
+
+void arena_init(Arena* arena, size_t chunk_size) {
+    if (!arena) return;
+    
+    arena->chunks = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : ARENA_DEFAULT_CHUNK;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+}
+
+static void* arena_bump(struct ArenaChunk* chunk, size_t size, size_t align) {
+    uintptr_t base = (uintptr_t)(chunk + 1);
+    uintptr_t start = (base + chunk->used + align - 1) & ~(uintptr_t)(align - 1);
+    if (start + size > base + chunk->size) return NULL;
+    
+    chunk->used = (size_t)(start + size - base);
+    return (void*)start;
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t align) {
+    if (!arena) return NULL;
+    if (align == 0) align = sizeof(void*);
+    
+    struct ArenaChunk* chunk = arena->chunks;
+    void* memory = chunk ? arena_bump(chunk, size, align) : NULL;
+    if (memory) {
+        arena->bytes_used += size;
+        return memory;
+    }
+    
+    // Oversized requests get a dedicated chunk behind the current one so the
+    // remaining space in the current chunk is not abandoned
+    size_t chunk_size = arena->chunk_size;
+    bool dedicated = size + align > chunk_size;
+    if (dedicated) chunk_size = size + align;
+    
+    struct ArenaChunk* fresh = (struct ArenaChunk*)malloc(sizeof(struct ArenaChunk) + chunk_size);
+    if (!fresh) return NULL;
+    fresh->size = chunk_size;
+    fresh->used = 0;
+    arena->bytes_reserved += sizeof(struct ArenaChunk) + chunk_size;
+    
+    if (dedicated && chunk) {
+        fresh->next = chunk->next;
+        chunk->next = fresh;
+    } else {
+        fresh->next = chunk;
+        arena->chunks = fresh;
+    }
+    
+    arena->bytes_used += size;
+    return arena_bump(fresh, size, align);
+}
+
+char* arena_strndup(Arena* arena, const char* str, size_t length) {
+    if (!str) return NULL;
+    
+    char* copy = (char*)arena_alloc(arena, length + 1, 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+void arena_release(Arena* arena) {
+    if (!arena) return;
+    
+    struct ArenaChunk* chunk = arena->chunks;
+    while (chunk) {
+        struct ArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    
+    arena->chunks = NULL;
+    arena->bytes_used = 0;
+    arena->bytes_reserved = 0;
+}
+
+static uint32_t command_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+CommandView command_group_view(const CommandGroup* group) {
+    CommandView view = { NULL, 0 };
+    if (!group || group->count == 0) return view;
+    
+    view.entries = (group->count == 1) ? &group->entry : group->entries;
+    view.count = group->count;
+    return view;
+}
+
+static const char* group_name(const CommandGroup* group) {
+    return (group->count == 1) ? group->entry->name : group->entries[0]->name;
+}
+
+static CommandGroup* registry_find_group(const CommandRegistry* registry, const char* name, uint32_t hash) {
+    size_t mask = registry->slot_count - 1;
+    for (size_t i = hash & mask; registry->slots[i] != 0; i = (i + 1) & mask) {
+        CommandGroup* group = &registry->groups[registry->slots[i] - 1];
+        if (group->hash == hash && strcmp(group_name(group), name) == 0) {
+            return group;
+        }
+    }
+    return NULL;
+}
+
+static void registry_index_groups(const CommandRegistry* registry, uint32_t* slots, size_t slot_count) {
+    size_t mask = slot_count - 1;
+    for (size_t g = 0; g < registry->group_count; g++) {
+        size_t i = registry->groups[g].hash & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = (uint32_t)(g + 1);
+    }
+}
+
+static void registry_replace_slots(CommandRegistry* registry, uint32_t* slots, size_t slot_count) {
+    if (!registry->slots_borrowed) free(registry->slots);
+    registry->slots = slots;
+    registry->slot_count = slot_count;
+    registry->slots_borrowed = false;
+}
+
+static bool registry_grow_slots(CommandRegistry* registry) {
+    size_t slot_count = registry->slot_count * 2;
+    uint32_t* slots = (uint32_t*)calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return false;
+    
+    registry_index_groups(registry, slots, slot_count);
+    registry_replace_slots(registry, slots, slot_count);
+    return true;
+}
+
+// A registry loaded from a snapshot probes the mapped index directly; the
+// first insert takes a private copy of it
+static bool registry_own_slots(CommandRegistry* registry) {
+    if (!registry->slots_borrowed) return true;
+    
+    uint32_t* slots = (uint32_t*)malloc(sizeof(uint32_t) * registry->slot_count);
+    if (!slots) return false;
+    memcpy(slots, registry->slots, sizeof(uint32_t) * registry->slot_count);
+    
+    registry->slots = slots;
+    registry->slots_borrowed = false;
+    return true;
+}
+
+static CommandGroup* registry_add_group(CommandRegistry* registry, CommandEntry* entry, uint32_t hash) {
+    // Keep the load factor at or below one half so probe chains stay short
+    if ((registry->group_count + 1) * 2 > registry->slot_count && !registry_grow_slots(registry)) {
+        return NULL;
+    }
+    if (!registry_own_slots(registry)) return NULL;
+    
+    if (registry->group_count >= registry->group_capacity) {
+        size_t capacity = registry->group_capacity * 2;
+        CommandGroup* groups = (CommandGroup*)realloc(registry->groups, sizeof(CommandGroup) * capacity);
+        if (!groups) return NULL;
+        registry->groups = groups;
+        registry->group_capacity = capacity;
+    }
+    
+    CommandGroup* group = &registry->groups[registry->group_count];
+    group->entry = entry;
+    group->hash = hash;
+    group->count = 1;
+    
+    size_t mask = registry->slot_count - 1;
+    size_t i = hash & mask;
+    while (registry->slots[i] != 0) i = (i + 1) & mask;
+    registry->slots[i] = (uint32_t)(++registry->group_count);
+    
+    return group;
+}
+
+static bool registry_grow_strings(CommandRegistry* registry) {
+    size_t slot_count = registry->string_slot_count * 2;
+    const char** strings = (const char**)calloc(slot_count, sizeof(const char*));
+    if (!strings) return false;
+    
+    size_t mask = slot_count - 1;
+    for (size_t s = 0; s < registry->string_slot_count; s++) {
+        const char* str = registry->strings[s];
+        if (!str) continue;
+        size_t i = command_hash(str) & mask;
+        while (strings[i]) i = (i + 1) & mask;
+        strings[i] = str;
+    }
+    
+    free(registry->strings);
+    registry->strings = strings;
+    registry->string_slot_count = slot_count;
+    return true;
+}
+
+// Sizes the group array and both hash indexes for `additional` more names so
+// a bulk load does not rehash repeatedly on the way up
+bool command_registry_reserve(CommandRegistry* registry, size_t additional) {
+    if (!registry) return false;
+    
+    size_t groups = registry->group_count + additional;
+    while (groups * 2 > registry->slot_count) {
+        if (!registry_grow_slots(registry)) return false;
+    }
+    
+    if (groups > registry->group_capacity) {
+        CommandGroup* grown = (CommandGroup*)realloc(registry->groups, sizeof(CommandGroup) * groups);
+        if (!grown) return false;
+        registry->groups = grown;
+        registry->group_capacity = groups;
+    }
+    
+    while ((registry->string_count + additional) * 4 > registry->string_slot_count * 3) {
+        if (!registry_grow_strings(registry)) return false;
+    }
+    
+    return true;
 }
 
 CommandRegistry* command_registry_create(void) {
     CommandRegistry* registry = (CommandRegistry*)malloc(sizeof(CommandRegistry));
     if (!registry) return NULL;
     
-    registry->capacity = 100;
+    arena_init(&registry->arena, ARENA_DEFAULT_CHUNK);
     registry->count = 0;
-    registry->entries = (CommandEntry*)malloc(sizeof(CommandEntry) * registry->capacity);
+    registry->group_capacity = REGISTRY_INITIAL_SLOTS / 2;
+    registry->group_count = 0;
+    registry->groups = (CommandGroup*)malloc(sizeof(CommandGroup) * registry->group_capacity);
+    registry->slot_count = REGISTRY_INITIAL_SLOTS;
+    registry->slots = (uint32_t*)calloc(registry->slot_count, sizeof(uint32_t));
+    registry->string_count = 0;
+    registry->string_slot_count = REGISTRY_INITIAL_STRINGS;
+    registry->strings = (const char**)calloc(registry->string_slot_count, sizeof(const char*));
+    registry->slots_borrowed = false;
+    registry->backing = NULL;
+    registry->backing_size = 0;
+    registry->release_backing = NULL;
+    
+    if (!registry->groups || !registry->slots || !registry->strings) {
+        free(registry->groups);
+        free(registry->slots);
+        free(registry->strings);
+        free(registry);
+        return NULL;
+    }
     
     return registry;
 }
 
+static void registry_insert(CommandRegistry* registry, const char* name, const char* path, EnvironmentType env, const char* description, bool is_template);
+
+// Re-inserts every entry in registration order, so the copy owns all of its
+// memory even when the source borrows a mapped snapshot
+CommandRegistry* command_registry_clone(const CommandRegistry* registry) {
+    if (!registry) return NULL;
+    
+    CommandRegistry* clone = command_registry_create();
+    if (!clone) return NULL;
+    
+    if (!command_registry_reserve(clone, registry->group_count + 1)) {
+        command_registry_destroy(clone);
+        return NULL;
+    }
+    
+    for (size_t g = 0; g < registry->group_count; g++) {
+        CommandView group = command_group_view(&registry->groups[g]);
+        for (size_t i = 0; i < group.count; i++) {
+            const CommandEntry* entry = group.entries[i];
+            registry_insert(clone, entry->name, entry->path, entry->env, entry->description, entry->description_is_template);
+        }
+    }
+    
+    if (clone->count != registry->count) {
+        command_registry_destroy(clone);
+        return NULL;
+    }
+    
+    return clone;
+}
+
 void command_registry_destroy(CommandRegistry* registry) {
     if (!registry) return;
     
-    for (size_t i = 0; i < registry->count; i++) {
-        free(registry->entries[i].name);
-        free(registry->entries[i].path);
-        free(registry->entries[i].description);
+    // Entries, strings and group member lists all live in the arena
+    arena_release(&registry->arena);
+    free(registry->groups);
+    if (!registry->slots_borrowed) free(registry->slots);
+    free(registry->strings);
+    if (registry->release_backing) {
+        registry->release_backing(registry->backing, registry->backing_size);
     }
-    
-    free(registry->entries);
     free(registry);
 }
 
-void command_registry_add(CommandRegistry* registry, const char* name, const char* path, EnvironmentType env, const char* description) {
-    if (!registry || !name || !path) return;
+static const char* registry_intern(CommandRegistry* registry, const char* str) {
     
-    if (registry->count >= registry->capacity) {
-        registry->capacity *= 2;
-        registry->entries = (CommandEntry*)realloc(registry->entries, sizeof(CommandEntry) * registry->capacity);
+    // Interned strings are only probed on insert, so a denser table is fine here
+    if ((registry->string_count + 1) * 4 > registry->string_slot_count * 3 && !registry_grow_strings(registry)) {
+        return NULL;
+    }
+    
+    size_t mask = registry->string_slot_count - 1;
+    size_t i = command_hash(str) & mask;
+    for (; registry->strings[i]; i = (i + 1) & mask) {
+        if (strcmp(registry->strings[i], str) == 0) {
+            return registry->strings[i];
+        }
     }
     
-    CommandEntry* entry = &registry->entries[registry->count++];
-    entry->name = strdup(name);
-    entry->path = strdup(path);
+    const char* copy = arena_strndup(&registry->arena, str, strlen(str));
+    if (!copy) return NULL;
+    
+    registry->strings[i] = copy;
+    registry->string_count++;
+    return copy;
+}
+
+static bool group_append(CommandRegistry* registry, CommandGroup* group, CommandEntry* entry) {
+    // Member arrays hold a power-of-two number of slots; when one fills up the
+    // old array is simply abandoned inside the arena
+    uint32_t count = group->count;
+    if (count == 1 || (count & (count - 1)) == 0) {
+        CommandEntry** entries = (CommandEntry**)arena_alloc(&registry->arena, sizeof(CommandEntry*) * count * 2, alignof(CommandEntry*));
+        if (!entries) return false;
+        if (count == 1) {
+            entries[0] = group->entry;
+        } else {
+            memcpy(entries, group->entries, sizeof(CommandEntry*) * count);
+        }
+        group->entries = entries;
+    }
+    
+    group->entries[group->count++] = entry;
+    return true;
+}
+
+static void registry_insert(CommandRegistry* registry, const char* name, const char* path, EnvironmentType env, const char* description, bool is_template) {
+    if (!registry || !name || !path) return;
+    
+    uint32_t hash = command_hash(name);
+    CommandGroup* group = registry_find_group(registry, name, hash);
+    
+    CommandEntry* entry = (CommandEntry*)arena_alloc(&registry->arena, sizeof(CommandEntry), alignof(CommandEntry));
+    if (!entry) return;
+    
+    // Names are deduplicated by the group index itself; paths and descriptions
+    // go through the intern table, and a path equal to the name shares it
+    entry->name = group ? group_name(group) : arena_strndup(&registry->arena, name, strlen(name));
+    if (!entry->name) return;
+    entry->path = (strcmp(path, name) == 0) ? entry->name : registry_intern(registry, path);
     entry->env = env;
-    entry->description = description ? strdup(description) : strdup("");
+    entry->description = registry_intern(registry, description ? description : "");
+    entry->description_is_template = is_template;
+    if (!entry->path || !entry->description) return;
+    
+    if (group) {
+        if (!group_append(registry, group, entry)) return;
+    } else if (!registry_add_group(registry, entry, hash)) {
+        return;
+    }
+    
+    registry->count++;
+}
+
+// Groups keep their order and the index is rebuilt once at the end. Member
+// arrays live in this registry's arena and are compacted in place, which
+// keeps the power-of-two capacity group_append relies on
+size_t command_registry_remove_if(CommandRegistry* registry, CommandEntryFilter match, void* userdata) {
+    if (!registry || !match) return 0;
+    
+    // Allocated up front so a failure leaves the registry untouched
+    uint32_t* slots = (uint32_t*)calloc(registry->slot_count, sizeof(uint32_t));
+    if (!slots) return 0;
+    
+    size_t removed = 0;
+    size_t kept_groups = 0;
+    for (size_t g = 0; g < registry->group_count; g++) {
+        CommandGroup group = registry->groups[g];
+        CommandView view = command_group_view(&group);
+        CommandEntry** members = (group.count == 1) ? &group.entry : group.entries;
+        
+        size_t kept = 0;
+        for (size_t i = 0; i < view.count; i++) {
+            if (match(view.entries[i], userdata)) continue;
+            members[kept++] = view.entries[i];
+        }
+        removed += view.count - kept;
+        if (kept == 0) continue;
+        
+        if (kept == 1 && group.count > 1) group.entry = members[0];
+        group.count = (uint32_t)kept;
+        registry->groups[kept_groups++] = group;
+    }
+    
+    if (removed == 0) {
+        free(slots);
+        return 0;
+    }
+    
+    registry->group_count = kept_groups;
+    registry->count -= removed;
+    registry_index_groups(registry, slots, registry->slot_count);
+    registry_replace_slots(registry, slots, registry->slot_count);
+    return removed;
+}
+
+void command_registry_add(CommandRegistry* registry, const char* name, const char* path, EnvironmentType env, const char* description) {
+    registry_insert(registry, name, path, env, description, false);
+}
+
+void command_registry_add_template(CommandRegistry* registry, const char* name, const char* path, EnvironmentType env, const char* description_template) {
+    registry_insert(registry, name, path, env, description_template, description_template != NULL);
+}
+
+size_t command_entry_format_description(const CommandEntry* entry, char* buffer, size_t size) {
+    if (!entry || !buffer || size == 0) return 0;
+    
+    const char* text = entry->description ? entry->description : "";
+    const char* placeholder = entry->description_is_template ? strstr(text, "%s") : NULL;
+    
+    size_t length;
+    if (placeholder) {
+        length = (size_t)snprintf(buffer, size, "%.*s%s%s", (int)(placeholder - text), text, entry->name, placeholder + 2);
+    } else {
+        length = (size_t)snprintf(buffer, size, "%s", text);
+    }
+    
+    return length;
+}
+
+void command_registry_memory_usage(const CommandRegistry* registry, CommandRegistryMemory* usage) {
+    if (!registry || !usage) return;
+    
+    size_t chunks = 0;
+    for (struct ArenaChunk* chunk = registry->arena.chunks; chunk; chunk = chunk->next) {
+        chunks++;
+    }
+    
+    usage->entry_count = registry->count;
+    usage->group_count = registry->group_count;
+    usage->string_count = registry->string_count;
+    usage->arena_used = registry->arena.bytes_used;
+    usage->arena_reserved = registry->arena.bytes_reserved;
+    usage->index_bytes = sizeof(CommandGroup) * registry->group_capacity +
+                         sizeof(uint32_t) * registry->slot_count +
+                         sizeof(const char*) * registry->string_slot_count;
+    usage->heap_blocks = chunks + 4;
+    usage->total_bytes = sizeof(CommandRegistry) + usage->index_bytes + usage->arena_reserved;
+}
+
+CommandView command_registry_lookup(const CommandRegistry* registry, const char* name) {
+    CommandView view = { NULL, 0 };
+    if (!registry || !name) return view;
+    
+    return command_group_view(registry_find_group(registry, name, command_hash(name)));
+}
+
+const CommandEntry* command_registry_resolve(const CommandRegistry* registry, const char* name, CommandView* matches) {
+    CommandView view = command_registry_lookup(registry, name);
+    if (matches) *matches = view;
+    return view.count == 1 ? view.entries[0] : NULL;
 }
 
 CommandEntry** command_registry_find(CommandRegistry* registry, const char* name, size_t* count) {
     if (!registry || !name || !count) return NULL;
     
-    *count = 0;
-    CommandEntry** matches = (CommandEntry**)malloc(sizeof(CommandEntry*) * registry->count);
+    CommandView view = command_registry_lookup(registry, name);
+    *count = view.count;
+    if (view.count == 0) return NULL;
     
-    for (size_t i = 0; i < registry->count; i++) {
-        if (strcmp(registry->entries[i].name, name) == 0) {
-            matches[(*count)++] = &registry->entries[i];
-        }
+    CommandEntry** matches = (CommandEntry**)malloc(sizeof(CommandEntry*) * view.count);
+    if (!matches) {
+        *count = 0;
+        return NULL;
     }
+    memcpy(matches, view.entries, sizeof(CommandEntry*) * view.count);
     
-    return (*count > 0) ? matches : NULL;
+    return matches;
 }
 
+static ExecutionResult* kernel_run_entry(KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink);
+
 ExecutionResult* kernel_execute_command(KernelContext* ctx, const char* command_line) {
-    if (!ctx || !command_line) return NULL;
-    
-    ExecutionResult* result = (ExecutionResult*)malloc(sizeof(ExecutionResult));
-    if (!result) return NULL;
+    OutputCapture capture;
+    output_capture_init(&capture);
     
+    ExecutionResult* result = kernel_execute_command_streaming(ctx, command_line, &capture.sink);
+    output_capture_finish(&capture, result);
+    return result;
+}
+
+static const char* kernel_env_name(EnvironmentType env) {
+    return (env == ENV_LINUX) ? "Linux" : (env == ENV_WINDOWS) ? "Windows" : "Kurono";
+}
+
+// Resolves and runs the line. Failures that never reach an executor are
+// written to result; otherwise *executed receives the executor's result, or
+// NULL when it could not be allocated
+static void kernel_dispatch(KernelContext* ctx, const char* command_line, OutputSink* sink,
+                            ExecutionResult* result, ExecutionResult** executed) {
+    *executed = NULL;
     result->result = CMD_NOT_FOUND;
-    result->output = NULL;
-    result->error = NULL;
     result->exit_code = -1;
     
-    char* command_copy = strdup(command_line);
-    char* command = strtok(command_copy, " ");
+    // The line is parsed once; the executor receives the same arguments
+    CommandArgs args;
+    if (!command_args_parse(&args, command_line)) {
+        execution_result_set_static_error(result, "Unterminated quote in command line");
+        return;
+    }
+    if (args.count == 0) {
+        execution_result_set_static_error(result, "Empty command");
+        return;
+    }
     
-    if (!command) {
-        result->error = strdup("Empty command");
-        free(command_copy);
-        return result;
+    char name_buffer[256];
+    char* command = name_buffer;
+    size_t name_length = command_args_copy(&args, 0, name_buffer, sizeof(name_buffer));
+    if (name_length >= sizeof(name_buffer)) {
+        command = (char*)malloc(name_length + 1);
+        if (!command) {
+            command_args_free(&args);
+            return;
+        }
+        command_args_copy(&args, 0, command, name_length + 1);
     }
     
-    size_t match_count = 0;
-    CommandEntry** matches = command_registry_find(g_command_registry, command, &match_count);
+    // The pinned version, and with it the entry, stays valid until the
+    // executor returns even if the registry is updated meanwhile
+    KernelRegistryGuard guard;
+    CommandView matches;
+    const CommandEntry* entry = command_registry_resolve(kernel_registry_acquire(&guard), command, &matches);
+    if (command != name_buffer) free(command);
+    
+    if (entry) {
+        *executed = kernel_run_entry(ctx, entry, command_line, &args, sink);
+    } else if (matches.count == 0) {
+        execution_result_set_static_error(result, "Command not found");
+    } else {
+        result->result = CMD_AMBIGUOUS;
+        execution_result_append_error(result, "[System Alert] Command exists in multiple environments:\n");
+        for (size_t i = 0; i < matches.count; i++) {
+            execution_result_append_error(result, "%zu) %s (%s)\n", i + 1, matches.entries[i]->path,
+                                          kernel_env_name(matches.entries[i]->env));
+        }
+    }
+    
+    kernel_registry_release(&guard);
+    command_args_free(&args);
+}
+
+ExecutionResult* kernel_execute_command_streaming(KernelContext* ctx, const char* command_line, OutputSink* sink) {
+    if (!ctx || !command_line || !sink) return NULL;
+    
+    ExecutionResult* result = execution_result_create();
+    if (!result) return NULL;
+    
+    ExecutionResult* executed;
+    kernel_dispatch(ctx, command_line, sink, result, &executed);
+    if (executed) {
+        execution_result_destroy(result);
+        return executed;
+    }
+    return result;
+}
+
+// Moves src into dst and recycles src. Neither side allocates: an error held
+// in src's message buffer is handed over by swapping the buffers
+static void execution_result_move(ExecutionResult* dst, ExecutionResult* src) {
+    execution_result_reset(dst);
+    dst->result = src->result;
+    dst->exit_code = src->exit_code;
+    dst->output = src->output;
+    dst->error = src->error;
+    dst->flags = src->flags;
+    if (src->error && src->error == src->message.data) {
+        OutputBuffer message = dst->message;
+        dst->message = src->message;
+        src->message = message;
+    }
+    src->output = NULL;
+    src->error = NULL;
+    src->flags = 0;
+    execution_result_destroy(src);
+}
+
+bool kernel_execute_command_into(KernelContext* ctx, const char* command_line, OutputSink* sink, ExecutionResult* result) {
+    if (!ctx || !command_line || !sink || !result) return false;
+    
+    execution_result_reset(result);
+    ExecutionResult* executed;
+    kernel_dispatch(ctx, command_line, sink, result, &executed);
+    if (executed) execution_result_move(result, executed);
+    return true;
+}
+
+ExecutionResult* kernel_execute_entry(KernelContext* ctx, const CommandEntry* entry, const char* command_line, OutputSink* sink) {
+    if (!ctx || !entry || !command_line || !sink) return NULL;
     
-    if (match_count == 0) {
-        result->error = strdup("Command not found");
-        free(command_copy);
+    CommandArgs args;
+    if (!command_args_parse(&args, command_line)) {
+        ExecutionResult* result = execution_result_create();
+        if (!result) return NULL;
+        execution_result_set_static_error(result, "Unterminated quote in command line");
         return result;
     }
     
-    if (match_count > 1) {
-        result->result = CMD_AMBIGUOUS;
-        char* error_msg = (char*)malloc(1024);
-        strcpy(error_msg, "[System Alert] Command exists in multiple environments:\n");
-        
-        for (size_t i = 0; i < match_count; i++) {
-            char line[256];
-            const char* env_name = (matches[i]->env == ENV_LINUX) ? "Linux" :
-                                 (matches[i]->env == ENV_WINDOWS) ? "Windows" : "Kurono";
-            snprintf(line, sizeof(line), "%zu) %s (%s)\n", i + 1, matches[i]->path, env_name);
-            strcat(error_msg, line);
-        }
-        
-        result->error = error_msg;
-        free(matches);
-        free(command_copy);
+    ExecutionResult* result = kernel_run_entry(ctx, entry, command_line, &args, sink);
+    command_args_free(&args);
+    return result;
+}
+
+static ExecutionResult* kernel_run_entry(KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    if (entry->env < ENV_UNKNOWN && g_handlers[entry->env].executor) {
+        KernelEnvironmentHandlers* handlers = &g_handlers[entry->env];
+        ExecutionResult* executed = handlers->executor(handlers->executor_userdata, ctx, entry, command_line, args, sink);
+        if (executed) return executed;
+    }
+    
+    ExecutionResult* result = execution_result_create();
+    if (!result) return NULL;
+    
+    if (entry->env < ENV_UNKNOWN && g_handlers[entry->env].executor) {
+        execution_result_set_static_error(result, "Command execution failed");
         return result;
     }
     
-    CommandEntry* entry = matches[0];
     result->result = CMD_SUCCESS;
-    result->output = strdup("Command executed successfully");
+    result->output = (char*)"Command executed successfully";
+    result->flags |= EXECUTION_RESULT_STATIC_OUTPUT;
     result->exit_code = 0;
+    return result;
+}
+
+void output_buffer_init(OutputBuffer* buffer) {
+    if (!buffer) return;
+    
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+bool output_buffer_reserve(OutputBuffer* buffer, size_t extra) {
+    if (!buffer) return false;
+    if (buffer->length + extra + 1 <= buffer->capacity) return true;
+    
+    size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+    while (capacity < buffer->length + extra + 1) capacity *= 2;
+    
+    char* data = (char*)realloc(buffer->data, capacity);
+    if (!data) return false;
     
-    free(matches);
-    free(command_copy);
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+bool output_buffer_append(OutputBuffer* buffer, const char* data, size_t length) {
+    if (!output_buffer_reserve(buffer, length)) return false;
+    
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return true;
+}
+
+// Reads straight into the buffer's spare capacity. Returns the byte count,
+// 0 at end of file, or -1 on error (EINTR/EAGAIN are reported as -1 with
+// errno left for the caller to inspect)
+long output_buffer_read_fd(OutputBuffer* buffer, int fd) {
+    if (!output_buffer_reserve(buffer, OUTPUT_BUFFER_READ_SIZE)) {
+        errno = ENOMEM;
+        return -1;
+    }
+    
+    size_t space = buffer->capacity - buffer->length - 1;
+    long n = (long)kernel_read(fd, buffer->data + buffer->length, (unsigned int)(space > OUTPUT_BUFFER_READ_SIZE ? OUTPUT_BUFFER_READ_SIZE : space));
+    if (n > 0) {
+        buffer->length += (size_t)n;
+        buffer->data[buffer->length] = '\0';
+    }
+    return n;
+}
+
+size_t output_buffer_read_file(OutputBuffer* buffer, FILE* file) {
+    if (!buffer || !file) return 0;
+    
+    size_t total = 0;
+    while (output_buffer_reserve(buffer, OUTPUT_BUFFER_READ_SIZE)) {
+        size_t n = fread(buffer->data + buffer->length, 1, OUTPUT_BUFFER_READ_SIZE, file);
+        buffer->length += n;
+        buffer->data[buffer->length] = '\0';
+        total += n;
+        if (n < OUTPUT_BUFFER_READ_SIZE) break;
+    }
+    return total;
+}
+
+// Transfers ownership of the collected bytes; an empty buffer yields NULL.
+// The buffer is left empty and may be reused
+char* output_buffer_take(OutputBuffer* buffer) {
+    if (!buffer) return NULL;
+    
+    char* data = buffer->length ? buffer->data : NULL;
+    if (!data) free(buffer->data);
+    output_buffer_init(buffer);
+    return data;
+}
+
+void output_buffer_free(OutputBuffer* buffer) {
+    if (!buffer) return;
+    
+    free(buffer->data);
+    output_buffer_init(buffer);
+}
+
+static bool output_sink_stdio_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    (void)sink;
+    FILE* file = (stream == OUTPUT_STREAM_STDERR) ? stderr : stdout;
+    if (fwrite(data, 1, length, file) != length) return false;
+    fflush(file);
+    return true;
+}
+
+void output_sink_init_stdio(OutputSink* sink) {
+    if (!sink) return;
+    
+    // Flush pending terminal output so spliced pipeline data stays in order
+    fflush(stdout);
+    sink->write = output_sink_stdio_write;
+    sink->userdata = NULL;
+    #ifdef _WIN32
+    sink->fd = _fileno(stdout);
+    #else
+    sink->fd = fileno(stdout);
+    #endif
+}
+
+static bool output_capture_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    OutputCapture* capture = (OutputCapture*)sink->userdata;
+    OutputBuffer* buffer = (stream == OUTPUT_STREAM_STDERR) ? &capture->error : &capture->output;
+    return output_buffer_append(buffer, data, length);
+}
+
+void output_capture_init(OutputCapture* capture) {
+    if (!capture) return;
+    
+    capture->sink.write = output_capture_write;
+    capture->sink.userdata = capture;
+    capture->sink.fd = -1;
+    output_buffer_init(&capture->output);
+    output_buffer_init(&capture->error);
+}
+
+// Moves the captured streams into the result. Diagnostics the executor put in
+// result->error are kept after whatever the command wrote to stderr
+void output_capture_finish(OutputCapture* capture, ExecutionResult* result) {
+    if (!capture) return;
+    
+    if (result) {
+        if (capture->output.length) {
+            if (!(result->flags & EXECUTION_RESULT_STATIC_OUTPUT)) free(result->output);
+            result->output = output_buffer_take(&capture->output);
+            result->flags &= ~EXECUTION_RESULT_STATIC_OUTPUT;
+        }
+        if (capture->error.length) {
+            if (result->error) {
+                if (capture->error.data[capture->error.length - 1] != '\n') {
+                    output_buffer_append(&capture->error, "\n", 1);
+                }
+                output_buffer_append(&capture->error, result->error, strlen(result->error));
+            }
+            execution_result_set_static_error(result, NULL);
+            result->error = output_buffer_take(&capture->error);
+        }
+    }
+    
+    output_buffer_free(&capture->output);
+    output_buffer_free(&capture->error);
+}
+
+// Results released on a thread are kept for its next commands. A message
+// buffer that grew past the limit is dropped rather than pinned in the pool
+#define EXECUTION_RESULT_POOL_SIZE 16
+#define EXECUTION_RESULT_MESSAGE_KEEP 65536
+
+struct ExecutionResultPool {
+    ExecutionResult* results[EXECUTION_RESULT_POOL_SIZE];
+    size_t count;
+    
+    ~ExecutionResultPool() {
+        while (count > 0) {
+            ExecutionResult* result = results[--count];
+            execution_result_release(result);
+            free(result);
+        }
+    }
+};
+
+static thread_local ExecutionResultPool t_result_pool;
+
+ExecutionResult* execution_result_create(void) {
+    ExecutionResultPool* pool = &t_result_pool;
+    ExecutionResult* result;
+    if (pool->count > 0) {
+        result = pool->results[--pool->count];
+    } else {
+        result = (ExecutionResult*)malloc(sizeof(ExecutionResult));
+        if (!result) return NULL;
+        execution_result_init(result);
+    }
+    
+    result->result = CMD_EXECUTION_FAILED;
+    result->exit_code = -1;
     return result;
 }
 
 void execution_result_destroy(ExecutionResult* result) {
     if (!result) return;
     
-    free(result->output);
-    free(result->error);
+    execution_result_reset(result);
+    if (result->message.capacity > EXECUTION_RESULT_MESSAGE_KEEP) output_buffer_free(&result->message);
+    
+    ExecutionResultPool* pool = &t_result_pool;
+    if (pool->count < EXECUTION_RESULT_POOL_SIZE) {
+        pool->results[pool->count++] = result;
+        return;
+    }
+    execution_result_release(result);
     free(result);
 }
 
-EnvironmentType kernel_detect_environment(const char* command) {
-    if (!command) return ENV_UNKNOWN;
+void execution_result_init(ExecutionResult* result) {
+    if (!result) return;
+    
+    result->result = CMD_EXECUTION_FAILED;
+    result->output = NULL;
+    result->error = NULL;
+    result->exit_code = -1;
+    result->flags = 0;
+    output_buffer_init(&result->message);
+}
+
+void execution_result_reset(ExecutionResult* result) {
+    if (!result) return;
+    
+    if (!(result->flags & EXECUTION_RESULT_STATIC_OUTPUT)) free(result->output);
+    if (!(result->flags & EXECUTION_RESULT_STATIC_ERROR)) free(result->error);
+    result->result = CMD_EXECUTION_FAILED;
+    result->output = NULL;
+    result->error = NULL;
+    result->exit_code = -1;
+    result->flags = 0;
+    result->message.length = 0;
+}
+
+void execution_result_release(ExecutionResult* result) {
+    if (!result) return;
+    
+    execution_result_reset(result);
+    output_buffer_free(&result->message);
+}
+
+void execution_result_set_static_error(ExecutionResult* result, const char* message) {
+    if (!result) return;
+    
+    if (!(result->flags & EXECUTION_RESULT_STATIC_ERROR)) free(result->error);
+    result->error = (char*)message;
+    if (message) result->flags |= EXECUTION_RESULT_STATIC_ERROR;
+    else result->flags &= ~EXECUTION_RESULT_STATIC_ERROR;
+}
+
+bool execution_result_append_error(ExecutionResult* result, const char* format, ...) {
+    if (!result || !format) return false;
     
-    size_t count = 0;
-    CommandEntry** matches = command_registry_find(g_command_registry, command, &count);
+    if (!result->error || result->error != result->message.data) {
+        execution_result_set_static_error(result, NULL);
+        result->message.length = 0;
+    }
+    
+    va_list ap;
+    va_start(ap, format);
+    char line[256];
+    int length = vsnprintf(line, sizeof(line), format, ap);
+    va_end(ap);
+    if (length < 0) return false;
     
-    if (count == 1) {
-        EnvironmentType env = matches[0]->env;
-        free(matches);
-        return env;
+    // Lines longer than the stack buffer are formatted again in place
+    bool ok;
+    if ((size_t)length < sizeof(line)) {
+        ok = output_buffer_append(&result->message, line, (size_t)length);
+    } else if ((ok = output_buffer_reserve(&result->message, (size_t)length))) {
+        va_start(ap, format);
+        vsnprintf(result->message.data + result->message.length, (size_t)length + 1, format, ap);
+        va_end(ap);
+        result->message.length += (size_t)length;
     }
+    if (result->message.data) execution_result_set_static_error(result, result->message.data);
+    return ok;
+}
+
+static char* execution_result_take(char** field, bool borrowed) {
+    char* value = *field;
+    *field = NULL;
+    return (borrowed && value) ? strdup(value) : value;
+}
+
+char* execution_result_take_output(ExecutionResult* result) {
+    if (!result) return NULL;
+    
+    char* output = execution_result_take(&result->output, result->flags & EXECUTION_RESULT_STATIC_OUTPUT);
+    result->flags &= ~EXECUTION_RESULT_STATIC_OUTPUT;
+    return output;
+}
+
+char* execution_result_take_error(ExecutionResult* result) {
+    if (!result) return NULL;
+    
+    char* error = execution_result_take(&result->error, result->flags & EXECUTION_RESULT_STATIC_ERROR);
+    result->flags &= ~EXECUTION_RESULT_STATIC_ERROR;
+    return error;
+}
+
+EnvironmentType kernel_detect_environment(const char* command) {
+    if (!command) return ENV_UNKNOWN;
+    
+    KernelRegistryGuard guard;
+    const CommandEntry* entry = command_registry_resolve(kernel_registry_acquire(&guard), command, NULL);
+    EnvironmentType env = entry ? entry->env : ENV_UNKNOWN;
+    kernel_registry_release(&guard);
     
-    free(matches);
-    return ENV_UNKNOWN;
+    return env;
 }
 
 bool kernel_switch_environment(KernelContext* ctx, EnvironmentType env) {
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 
 #define KERNEL_VERSION "1.0.0"
 #define KERNEL_NAME "Kurono OS Hybrid Kernel"
@@ -23,19 +24,79 @@ typedef enum {
     CMD_EXECUTION_FAILED
 } CommandResult;
 
+/* Bump allocator for data that lives exactly as long as its owner. Memory is
+ * handed out from large chunks and released all at once. */
+struct ArenaChunk;
+
+typedef struct {
+    struct ArenaChunk* chunks;
+    size_t chunk_size;
+    size_t bytes_used;
+    size_t bytes_reserved;
+} Arena;
+
+void arena_init(Arena* arena, size_t chunk_size);
+void* arena_alloc(Arena* arena, size_t size, size_t align);
+char* arena_strndup(Arena* arena, const char* str, size_t length);
+void arena_release(Arena* arena);
+
+/* Strings are owned by the registry. When description_is_template is set the
+ * description holds a "%s" placeholder for the command name; use
+ * command_entry_format_description to expand it. */
 typedef struct {
-    char* name;
-    char* path;
+    const char* name;
+    const char* path;
     EnvironmentType env;
-    char* description;
+    const char* description;
+    bool description_is_template;
 } CommandEntry;
 
+/* Every entry registered under one name. The common single-environment case
+ * stores its entry inline; larger groups keep a member array in the arena. */
 typedef struct {
-    CommandEntry* entries;
+    union {
+        CommandEntry* entry;
+        CommandEntry** entries;
+    };
+    uint32_t hash;
+    uint32_t count;
+} CommandGroup;
+
+/* Non-owning view of every entry registered under one name. Valid until the
+ * next command_registry_add on the same registry. */
+typedef struct {
+    CommandEntry* const* entries;
     size_t count;
-    size_t capacity;
+} CommandView;
+
+typedef struct {
+    Arena arena;
+    size_t count;
+    CommandGroup* groups;
+    size_t group_count;
+    size_t group_capacity;
+    uint32_t* slots;
+    size_t slot_count;
+    const char** strings;
+    size_t string_count;
+    size_t string_slot_count;
+    bool slots_borrowed;
+    const void* backing;
+    size_t backing_size;
+    void (*release_backing)(const void* backing, size_t size);
 } CommandRegistry;
 
+typedef struct {
+    size_t entry_count;
+    size_t group_count;
+    size_t string_count;
+    size_t arena_used;
+    size_t arena_reserved;
+    size_t index_bytes;
+    size_t heap_blocks;
+    size_t total_bytes;
+} CommandRegistryMemory;
+
 typedef struct {
     bool is_root;
     EnvironmentType current_env;
@@ -43,23 +104,255 @@ typedef struct {
     char* current_directory;
 } KernelContext;
 
+/* Growable byte buffer used to collect command output. Capacity doubles on
+ * growth and the data is always NUL-terminated once anything is stored, so
+ * appends are amortized O(1) and output_buffer_take can hand the bytes to an
+ * ExecutionResult without copying. */
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} OutputBuffer;
+
+#define OUTPUT_BUFFER_READ_SIZE 65536
+
+void output_buffer_init(OutputBuffer* buffer);
+bool output_buffer_reserve(OutputBuffer* buffer, size_t extra);
+bool output_buffer_append(OutputBuffer* buffer, const char* data, size_t length);
+long output_buffer_read_fd(OutputBuffer* buffer, int fd);
+size_t output_buffer_read_file(OutputBuffer* buffer, FILE* file);
+char* output_buffer_take(OutputBuffer* buffer);
+void output_buffer_free(OutputBuffer* buffer);
+
+/* output and error are heap strings owned by the result unless the matching
+ * STATIC flag is set, in which case they are borrowed (a string literal, or
+ * text formatted into the result's own message buffer) and never freed by
+ * the result. Use the execution_result_* helpers rather than freeing or
+ * stealing the strings directly. */
+#define EXECUTION_RESULT_STATIC_OUTPUT 0x1
+#define EXECUTION_RESULT_STATIC_ERROR 0x2
+
 typedef struct {
     CommandResult result;
     char* output;
     char* error;
     int exit_code;
+    uint32_t flags;
+    OutputBuffer message;
 } ExecutionResult;
 
+/* Streaming output interface. Producers call write for every chunk as it
+ * arrives and do not read further output until it returns, so a slow sink
+ * throttles the command through the pipe instead of growing a buffer.
+ * Returning false asks the producer to stop the command. Sinks backed by a
+ * file descriptor set fd so pipelines can splice into it directly; others
+ * leave it at -1. */
+typedef enum {
+    OUTPUT_STREAM_STDOUT,
+    OUTPUT_STREAM_STDERR
+} OutputStream;
+
+typedef struct OutputSink {
+    bool (*write)(struct OutputSink* sink, OutputStream stream, const char* data, size_t length);
+    void* userdata;
+    int fd;
+} OutputSink;
+
+/* Buffering adapter for callers that want the whole output at once. */
+typedef struct {
+    OutputSink sink;
+    OutputBuffer output;
+    OutputBuffer error;
+} OutputCapture;
+
+void output_sink_init_stdio(OutputSink* sink);
+void output_capture_init(OutputCapture* capture);
+void output_capture_finish(OutputCapture* capture, ExecutionResult* result);
+
 KernelContext* kernel_init(void);
 void kernel_shutdown(KernelContext* ctx);
+/* Suppresses the startup and shutdown messages, for batch runs whose stdout
+ * carries only command output. */
+void kernel_set_quiet(bool quiet);
+
+/* The kernel owns the single command registry shared by every subsystem and
+ * publishes it as a series of immutable versions. Readers pin the current
+ * version with kernel_registry_acquire and never block; writers build a new
+ * version with kernel_update_registry (or hand over a complete one with
+ * kernel_attach_registry) and the kernel frees a replaced version once no
+ * reader still pins it. kernel_get_registry returns the current version
+ * unpinned, which is only safe while no update can run concurrently. */
+typedef struct {
+    CommandRegistry* registry;
+    struct RegistryHazard* hazard;
+} KernelRegistryGuard;
+
+typedef bool (*CommandEntryFilter)(const CommandEntry* entry, void* userdata);
+typedef bool (*KernelRegistryUpdate)(CommandRegistry* registry, void* userdata);
+
+CommandRegistry* kernel_get_registry(KernelContext* ctx);
+bool kernel_attach_registry(KernelContext* ctx, CommandRegistry* registry);
+CommandRegistry* kernel_registry_acquire(KernelRegistryGuard* guard);
+void kernel_registry_release(KernelRegistryGuard* guard);
+bool kernel_update_registry(KernelRegistryUpdate update, void* userdata);
 
 CommandRegistry* command_registry_create(void);
+CommandRegistry* command_registry_clone(const CommandRegistry* registry);
 void command_registry_destroy(CommandRegistry* registry);
+bool command_registry_reserve(CommandRegistry* registry, size_t additional);
 void command_registry_add(CommandRegistry* registry, const char* name, const char* path, EnvironmentType env, const char* description);
 CommandEntry** command_registry_find(CommandRegistry* registry, const char* name, size_t* count);
+CommandView command_registry_lookup(const CommandRegistry* registry, const char* name);
+/* The one rule every path that runs a command by name follows: the name
+ * resolves only when a single environment provides it, whatever the
+ * context's current environment. Returns that entry, or NULL; matches, if
+ * given, receives every candidate so callers can tell a missing name from an
+ * ambiguous one. */
+const CommandEntry* command_registry_resolve(const CommandRegistry* registry, const char* name, CommandView* matches);
+CommandView command_group_view(const CommandGroup* group);
+/* Removes every entry match accepts and returns how many went. Only for a
+ * registry no reader can see yet: one being built before
+ * kernel_attach_registry, or the private copy inside kernel_update_registry. */
+size_t command_registry_remove_if(CommandRegistry* registry, CommandEntryFilter match, void* userdata);
+void command_registry_add_template(CommandRegistry* registry, const char* name, const char* path, EnvironmentType env, const char* description_template);
+void command_registry_memory_usage(const CommandRegistry* registry, CommandRegistryMemory* usage);
+size_t command_entry_format_description(const CommandEntry* entry, char* buffer, size_t size);
+
+/* A command line split into arguments without copying it. Each token is an
+ * (offset, length) span of line; arguments are separated by spaces and tabs,
+ * single quotes keep everything literal, double quotes keep everything but
+ * \" and \\, and a backslash outside quotes escapes the next character. The
+ * span of a quoted or escaped argument still holds its quotes, so
+ * command_args_copy produces the value a program should see. Up to
+ * COMMAND_ARGS_INLINE tokens are kept inside the struct, which must
+ * therefore not be copied; longer lines spill to the heap and need
+ * command_args_free. Parsing fails only on an unterminated quote or when the
+ * spill cannot be allocated. */
+#define COMMAND_ARGS_INLINE 16
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    bool quoted;
+} CommandToken;
+
+typedef struct {
+    const char* line;
+    CommandToken* tokens;
+    size_t count;
+    size_t capacity;
+    CommandToken inline_tokens[COMMAND_ARGS_INLINE];
+} CommandArgs;
+
+bool command_args_parse(CommandArgs* args, const char* line);
+void command_args_free(CommandArgs* args);
+/* Writes the unquoted argument, truncated and NUL-terminated like snprintf,
+ * and returns its full length. */
+size_t command_args_copy(const CommandArgs* args, size_t index, char* buffer, size_t size);
+/* Bytes needed to hold every unquoted argument with its terminator. */
+size_t command_args_storage_size(const CommandArgs* args);
+/* Unquotes every argument into storage and points argv at them, followed by
+ * a NULL. Returns the argument count, or -1 if argv or storage is too small. */
+int command_args_argv(const CommandArgs* args, char** argv, size_t max_argv, char* storage, size_t storage_size);
+
+/* Bridges register an executor per environment; kernel_execute_command hands
+ * an unambiguous match to it along with the full command line and the
+ * arguments the kernel already parsed from it. ctx is the context the
+ * command was issued from (a job's own clone, for pooled jobs), whose
+ * directory, user and environment the command runs with. Executors deliver
+ * the command's output through the sink and keep only status and their own
+ * diagnostics in the returned result. */
+typedef ExecutionResult* (*KernelExecutor)(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink);
+
+/* Environments that can run a command against raw descriptors also register
+ * a stage launcher, which lets pipelines connect them with OS pipes. A
+ * descriptor of -1 means inherit. Returns the child's process id, or -1 with
+ * *error set. */
+typedef long (*KernelStageLauncher)(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, int stdin_fd, int stdout_fd, int stderr_fd, char** error);
+
+typedef struct {
+    KernelExecutor executor;
+    void* executor_userdata;
+    KernelStageLauncher launcher;
+    void* launcher_userdata;
+} KernelEnvironmentHandlers;
+
+bool kernel_register_executor(EnvironmentType env, KernelExecutor executor, void* userdata);
+bool kernel_register_stage_launcher(EnvironmentType env, KernelStageLauncher launcher, void* userdata);
+const KernelEnvironmentHandlers* kernel_get_handlers(EnvironmentType env);
 
 ExecutionResult* kernel_execute_command(KernelContext* ctx, const char* command_line);
+ExecutionResult* kernel_execute_command_streaming(KernelContext* ctx, const char* command_line, OutputSink* sink);
+/* Fills a result the caller provides instead of allocating one. Commands that
+ * are not found or ambiguous, and empty or malformed lines, complete without
+ * any heap allocation once the result's message buffer has grown. */
+bool kernel_execute_command_into(KernelContext* ctx, const char* command_line, OutputSink* sink, ExecutionResult* result);
+/* Runs an entry the caller resolved itself; the caller keeps the registry
+ * version holding it pinned until this returns. */
+ExecutionResult* kernel_execute_entry(KernelContext* ctx, const CommandEntry* entry, const char* command_line, OutputSink* sink);
+
+/* Independent per-session or per-job copy of a context. */
+KernelContext* kernel_context_clone(const KernelContext* ctx);
+void kernel_context_destroy(KernelContext* ctx);
+
+/* Commands submitted to the kernel run on a fixed pool of worker threads,
+ * started on first use (or explicitly with kernel_start_workers). Each job
+ * executes against its own clone of the submitting context, so the caller
+ * may switch environment or user while jobs are in flight. A non-NULL sink
+ * receives output on the worker thread; otherwise the output is captured in
+ * the result. Every job must be collected with kernel_job_wait.
+ * kernel_submit_command returns NULL while kernel_stop_workers is draining
+ * the pool, so an accepted job always runs. */
+typedef struct KernelJob KernelJob;
+
+bool kernel_start_workers(size_t worker_count);
+void kernel_stop_workers(void);
+KernelJob* kernel_submit_command(KernelContext* ctx, const char* command_line, OutputSink* sink);
+bool kernel_job_done(KernelJob* job);
+ExecutionResult* kernel_job_wait(KernelJob* job);
+
+/* Results are recycled through a small per-thread free list, and each keeps
+ * its message buffer across reuse, so a warm thread creates, fills and
+ * destroys results without touching the heap. execution_result_create hands
+ * out a cleared result (CMD_EXECUTION_FAILED, exit code -1). Results the
+ * caller owns, for example on the stack, are set up with
+ * execution_result_init, emptied between uses with execution_result_reset and
+ * finally freed with execution_result_release. */
+ExecutionResult* execution_result_create(void);
 void execution_result_destroy(ExecutionResult* result);
+void execution_result_init(ExecutionResult* result);
+void execution_result_reset(ExecutionResult* result);
+void execution_result_release(ExecutionResult* result);
+/* Replaces the error with a borrowed string; NULL clears it. */
+void execution_result_set_static_error(ExecutionResult* result, const char* message);
+/* Appends formatted text to an error built up in the result's message
+ * buffer; an error set any other way is replaced. */
+bool execution_result_append_error(ExecutionResult* result, const char* format, ...);
+/* Hand the string to the caller as a heap copy it must free, copying only
+ * when the result did not own it. */
+char* execution_result_take_output(ExecutionResult* result);
+char* execution_result_take_error(ExecutionResult* result);
+
+/* cmd1 | cmd2 | ... where each stage may come from a different environment.
+ * All stages run concurrently; launcher-backed stages are joined by OS pipes
+ * and the last stage's output is forwarded to the sink. */
+typedef struct {
+    char* command;
+    EnvironmentType env;
+    CommandResult result;
+    int exit_code;
+    char* error;
+} PipelineStage;
+
+typedef struct {
+    CommandResult result;
+    PipelineStage* stages;
+    size_t stage_count;
+    char* error;
+} PipelineResult;
+
+PipelineResult* kernel_execute_pipeline(KernelContext* ctx, const char* pipeline, OutputSink* sink);
+void pipeline_result_destroy(PipelineResult* result);
 
 EnvironmentType kernel_detect_environment(const char* command);
 bool kernel_switch_environment(KernelContext* ctx, EnvironmentType env);
@@ -0,0 +1,149 @@
+#include "kernel.h"
+#include <stdlib.h>
+#include <string.h>
+
+static bool args_is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static bool args_push(CommandArgs* args, size_t offset, size_t length, bool quoted) {
+    if (offset > UINT32_MAX || length > UINT32_MAX) return false;
+    
+    if (args->count == args->capacity) {
+        size_t capacity = args->capacity * 2;
+        CommandToken* tokens;
+        if (args->tokens == args->inline_tokens) {
+            tokens = (CommandToken*)malloc(sizeof(CommandToken) * capacity);
+            if (tokens) memcpy(tokens, args->inline_tokens, sizeof(args->inline_tokens));
+        } else {
+            tokens = (CommandToken*)realloc(args->tokens, sizeof(CommandToken) * capacity);
+        }
+        if (!tokens) return false;
+        args->tokens = tokens;
+        args->capacity = capacity;
+    }
+    
+    CommandToken* token = &args->tokens[args->count++];
+    token->offset = (uint32_t)offset;
+    token->length = (uint32_t)length;
+    token->quoted = quoted;
+    return true;
+}
+
+bool command_args_parse(CommandArgs* args, const char* line) {
+    if (!args) return false;
+    
+    args->line = line;
+    args->tokens = args->inline_tokens;
+    args->count = 0;
+    args->capacity = COMMAND_ARGS_INLINE;
+    if (!line) return false;
+    
+    const char* p = line;
+    for (;;) {
+        while (args_is_space(*p)) p++;
+        if (!*p) return true;
+    
+        const char* start = p;
+        bool quoted = false;
+        while (*p && !args_is_space(*p)) {
+            if (*p == '\\') {
+                quoted = true;
+                p += p[1] ? 2 : 1;
+            } else if (*p == '\'' || *p == '"') {
+                char quote = *p++;
+                quoted = true;
+                while (*p && *p != quote) {
+                    if (quote == '"' && *p == '\\' && (p[1] == '"' || p[1] == '\\')) p++;
+                    p++;
+                }
+                if (!*p) {
+                    command_args_free(args);
+                    return false;
+                }
+                p++;
+            } else {
+                p++;
+            }
+        }
+    
+        if (!args_push(args, (size_t)(start - line), (size_t)(p - start), quoted)) {
+            command_args_free(args);
+            return false;
+        }
+    }
+}
+
+void command_args_free(CommandArgs* args) {
+    if (!args) return;
+    
+    if (args->tokens != args->inline_tokens) free(args->tokens);
+    args->tokens = args->inline_tokens;
+    args->count = 0;
+    args->capacity = COMMAND_ARGS_INLINE;
+}
+
+size_t command_args_copy(const CommandArgs* args, size_t index, char* buffer, size_t size) {
+    if (!args || index >= args->count) {
+        if (buffer && size) buffer[0] = '\0';
+        return 0;
+    }
+    
+    const CommandToken* token = &args->tokens[index];
+    const char* p = args->line + token->offset;
+    const char* end = p + token->length;
+    
+    size_t length = 0;
+    if (!token->quoted) {
+        length = token->length;
+        if (buffer && size) {
+            size_t n = length < size ? length : size - 1;
+            memcpy(buffer, p, n);
+            buffer[n] = '\0';
+        }
+        return length;
+    }
+    
+    // The parser already checked that every quote is closed
+    char quote = 0;
+    while (p < end) {
+        char c = *p++;
+        if (quote == 0 && (c == '\'' || c == '"')) {
+            quote = c;
+            continue;
+        }
+        if (quote != 0 && c == quote) {
+            quote = 0;
+            continue;
+        }
+        if (c == '\\' && p < end && (quote == 0 || (quote == '"' && (*p == '"' || *p == '\\')))) {
+            c = *p++;
+        }
+        if (buffer && length + 1 < size) buffer[length] = c;
+        length++;
+    }
+    if (buffer && size) buffer[length < size ? length : size - 1] = '\0';
+    return length;
+}
+
+size_t command_args_storage_size(const CommandArgs* args) {
+    if (!args) return 0;
+    
+    // Unquoting never makes an argument longer
+    size_t size = 0;
+    for (size_t i = 0; i < args->count; i++) size += args->tokens[i].length + 1;
+    return size;
+}
+
+int command_args_argv(const CommandArgs* args, char** argv, size_t max_argv, char* storage, size_t storage_size) {
+    if (!args || !argv || args->count + 1 > max_argv) return -1;
+    if (storage_size < command_args_storage_size(args)) return -1;
+    
+    char* cursor = storage;
+    for (size_t i = 0; i < args->count; i++) {
+        argv[i] = cursor;
+        cursor += command_args_copy(args, i, cursor, args->tokens[i].length + 1) + 1;
+    }
+    argv[args->count] = NULL;
+    return (int)args->count;
+}
@@ -0,0 +1,175 @@
+#include "kernel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define KERNEL_MIN_WORKERS 2
+#define KERNEL_MAX_WORKERS 16
+
+struct KernelJob {
+    KernelContext* ctx;
+    char* command_line;
+    OutputSink* sink;
+    ExecutionResult* result;
+    bool done;
+    KernelJob* next;
+};
+
+// Jobs form a FIFO list under g_pool_lock. Workers sleep on g_pool_work;
+// kernel_job_wait sleeps on g_pool_done, which is signalled on every completion
+static std::mutex g_pool_lock;
+static std::condition_variable g_pool_work;
+static std::condition_variable g_pool_done;
+static std::thread* g_workers = NULL;
+static size_t g_worker_count = 0;
+static KernelJob* g_queue_head = NULL;
+static KernelJob* g_queue_tail = NULL;
+static bool g_pool_stopping = false;
+
+static void kernel_worker_main(void) {
+    for (;;) {
+        KernelJob* job;
+        {
+            std::unique_lock<std::mutex> lock(g_pool_lock);
+            g_pool_work.wait(lock, [] { return g_queue_head != NULL || g_pool_stopping; });
+            if (!g_queue_head) return;
+    
+            job = g_queue_head;
+            g_queue_head = job->next;
+            if (!g_queue_head) g_queue_tail = NULL;
+        }
+    
+        ExecutionResult* result = job->sink
+            ? kernel_execute_command_streaming(job->ctx, job->command_line, job->sink)
+            : kernel_execute_command(job->ctx, job->command_line);
+    
+        {
+            std::lock_guard<std::mutex> lock(g_pool_lock);
+            job->result = result;
+            job->done = true;
+        }
+        g_pool_done.notify_all();
+    }
+}
+
+// Caller holds g_pool_lock. A pool that is still shutting down is not
+// restarted until kernel_stop_workers has joined every old worker
+static bool kernel_start_workers_locked(size_t worker_count) {
+    if (g_pool_stopping) return false;
+    if (g_workers) return true;
+    
+    if (worker_count == 0) {
+        worker_count = std::thread::hardware_concurrency();
+    }
+    if (worker_count < KERNEL_MIN_WORKERS) worker_count = KERNEL_MIN_WORKERS;
+    if (worker_count > KERNEL_MAX_WORKERS) worker_count = KERNEL_MAX_WORKERS;
+    
+    g_workers = new std::thread[worker_count];
+    for (size_t i = 0; i < worker_count; i++) {
+        g_workers[i] = std::thread(kernel_worker_main);
+    }
+    g_worker_count = worker_count;
+    return true;
+}
+
+bool kernel_start_workers(size_t worker_count) {
+    std::lock_guard<std::mutex> lock(g_pool_lock);
+    return kernel_start_workers_locked(worker_count);
+}
+
+// Workers finish everything already queued before they exit. The stopping
+// call takes the worker array, so a concurrent stop waits for it instead of
+// joining the same threads again
+void kernel_stop_workers(void) {
+    std::thread* workers;
+    size_t worker_count;
+    {
+        std::unique_lock<std::mutex> lock(g_pool_lock);
+        if (g_pool_stopping) {
+            g_pool_done.wait(lock, [] { return !g_pool_stopping; });
+            return;
+        }
+        if (!g_workers) return;
+    
+        workers = g_workers;
+        worker_count = g_worker_count;
+        g_workers = NULL;
+        g_worker_count = 0;
+        g_pool_stopping = true;
+    }
+    g_pool_work.notify_all();
+    
+    for (size_t i = 0; i < worker_count; i++) {
+        workers[i].join();
+    }
+    delete[] workers;
+    
+    {
+        std::lock_guard<std::mutex> lock(g_pool_lock);
+        g_pool_stopping = false;
+    }
+    g_pool_done.notify_all();
+}
+
+KernelJob* kernel_submit_command(KernelContext* ctx, const char* command_line, OutputSink* sink) {
+    if (!ctx || !command_line) return NULL;
+    
+    KernelJob* job = (KernelJob*)malloc(sizeof(KernelJob));
+    if (!job) return NULL;
+    
+    job->ctx = kernel_context_clone(ctx);
+    job->command_line = strdup(command_line);
+    job->sink = sink;
+    job->result = NULL;
+    job->done = false;
+    job->next = NULL;
+    if (!job->ctx || !job->command_line) {
+        kernel_context_destroy(job->ctx);
+        free(job->command_line);
+        free(job);
+        return NULL;
+    }
+    
+    // Starting the pool and queueing happen under one lock: a job is only
+    // queued while workers exist that will still drain the queue, and a
+    // submit racing kernel_stop_workers is refused
+    {
+        std::lock_guard<std::mutex> lock(g_pool_lock);
+        if (!kernel_start_workers_locked(0)) {
+            kernel_context_destroy(job->ctx);
+            free(job->command_line);
+            free(job);
+            return NULL;
+        }
+        if (g_queue_tail) g_queue_tail->next = job;
+        else g_queue_head = job;
+        g_queue_tail = job;
+    }
+    g_pool_work.notify_one();
+    return job;
+}
+
+bool kernel_job_done(KernelJob* job) {
+    if (!job) return true;
+    
+    std::lock_guard<std::mutex> lock(g_pool_lock);
+    return job->done;
+}
+
+// Blocks until the job has run, then releases it and hands back its result
+ExecutionResult* kernel_job_wait(KernelJob* job) {
+    if (!job) return NULL;
+    
+    {
+        std::unique_lock<std::mutex> lock(g_pool_lock);
+        g_pool_done.wait(lock, [job] { return job->done; });
+    }
+    
+    ExecutionResult* result = job->result;
+    kernel_context_destroy(job->ctx);
+    free(job->command_line);
+    free(job);
+    return result;
+}
@@ -0,0 +1,388 @@
+#include "kernel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#define PIPELINE_MAX_STAGES 16
+
+static char* pipeline_strndup(const char* start, const char* end) {
+    while (start < end && (*start == ' ' || *start == '\t')) start++;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    
+    size_t length = (size_t)(end - start);
+    char* copy = (char*)malloc(length + 1);
+    if (!copy) return NULL;
+    memcpy(copy, start, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// The next '|' that is not quoted or escaped, or the terminating NUL
+static const char* pipeline_find_separator(const char* p) {
+    char quote = 0;
+    for (; *p; p++) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+            else if (quote == '"' && *p == '\\' && p[1]) p++;
+        } else if (*p == '\'' || *p == '"') {
+            quote = *p;
+        } else if (*p == '\\' && p[1]) {
+            p++;
+        } else if (*p == '|') {
+            break;
+        }
+    }
+    return p;
+}
+
+static PipelineResult* pipeline_parse(const char* pipeline) {
+    PipelineResult* result = (PipelineResult*)malloc(sizeof(PipelineResult));
+    if (!result) return NULL;
+    
+    result->result = CMD_EXECUTION_FAILED;
+    result->stages = (PipelineStage*)calloc(PIPELINE_MAX_STAGES, sizeof(PipelineStage));
+    result->stage_count = 0;
+    result->error = NULL;
+    if (!result->stages) {
+        free(result);
+        return NULL;
+    }
+    
+    const char* start = pipeline;
+    for (;;) {
+        const char* end = pipeline_find_separator(start);
+    
+        if (result->stage_count == PIPELINE_MAX_STAGES) {
+            result->error = strdup("Too many pipeline stages");
+            return result;
+        }
+    
+        PipelineStage* stage = &result->stages[result->stage_count++];
+        stage->command = pipeline_strndup(start, end);
+        stage->env = ENV_UNKNOWN;
+        stage->result = CMD_NOT_FOUND;
+        stage->exit_code = -1;
+        stage->error = NULL;
+    
+        if (!stage->command || stage->command[0] == '\0') {
+            result->error = strdup("Empty pipeline stage");
+            return result;
+        }
+    
+        if (*end == '\0') break;
+        start = end + 1;
+    }
+    
+    return result;
+}
+
+// Stages resolve exactly like single commands, so a name that is ambiguous
+// on its own stays ambiguous inside a pipeline
+static const CommandEntry* pipeline_resolve(const CommandRegistry* registry, PipelineStage* stage, const CommandArgs* args) {
+    char name[256];
+    command_args_copy(args, 0, name, sizeof(name));
+    
+    CommandView matches;
+    const CommandEntry* entry = command_registry_resolve(registry, name, &matches);
+    if (!entry) {
+        char message[320];
+        stage->result = matches.count ? CMD_AMBIGUOUS : CMD_NOT_FOUND;
+        if (matches.count) {
+            snprintf(message, sizeof(message), "Command is ambiguous: %s", name);
+        } else {
+            snprintf(message, sizeof(message), "Command not found: %s", name);
+        }
+        stage->error = strdup(message);
+        return NULL;
+    }
+    
+    stage->env = entry->env;
+    return entry;
+}
+
+#ifndef _WIN32
+// Pipe ends are close-on-exec from the start, so a process spawned by another
+// thread never holds one open and stalls this pipeline's poll loop
+static bool pipeline_pipe(int fds[2]) {
+    return pipe2(fds, O_CLOEXEC) == 0;
+}
+
+static void pipeline_close(int* fd) {
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+static bool pipeline_write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// Sink handed to executor-backed stages: stdout goes to the next stage's pipe,
+// stderr to the pipeline's shared error pipe (passed through userdata)
+static bool pipeline_stage_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    int fd = (stream == OUTPUT_STREAM_STDERR) ? *(const int*)sink->userdata : sink->fd;
+    return pipeline_write_all(fd, data, length);
+}
+
+// Stages from environments without a stage launcher run their executor on a
+// worker thread. They do not consume stdin, so the read end is closed up
+// front and the upstream stage sees a broken pipe like it would in a shell.
+static void pipeline_run_executor(const KernelContext* ctx, const KernelEnvironmentHandlers* handlers, const CommandEntry* entry,
+                                  PipelineStage* stage, const CommandArgs* args, int stdin_fd, int stdout_fd, int stderr_fd) {
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &block, NULL);
+    
+    if (stdin_fd >= 0) close(stdin_fd);
+    
+    if (!handlers || !handlers->executor) {
+        stage->result = CMD_SUCCESS;
+        stage->exit_code = 0;
+        close(stdout_fd);
+        return;
+    }
+    
+    OutputSink sink = { pipeline_stage_write, &stderr_fd, stdout_fd };
+    ExecutionResult* executed = handlers->executor(handlers->executor_userdata, ctx, entry, stage->command, args, &sink);
+    close(stdout_fd);
+    
+    if (!executed) {
+        stage->result = CMD_EXECUTION_FAILED;
+        stage->error = strdup("Command execution failed");
+        return;
+    }
+    
+    stage->result = executed->result;
+    stage->exit_code = executed->exit_code;
+    stage->error = execution_result_take_error(executed);
+    execution_result_destroy(executed);
+}
+
+// Moves one chunk from a pipe to the sink. Stdout is spliced straight into
+// fd-backed sinks so the data never enters user space; *use_splice is
+// cleared the first time the target refuses splice. Returns false at EOF or
+// when the sink stops accepting data (*stopped is set in that case).
+static bool pipeline_forward(int fd, OutputStream stream, OutputSink* sink, OutputBuffer* chunk, bool* use_splice, bool* stopped) {
+    #ifdef __linux__
+    if (*use_splice && stream == OUTPUT_STREAM_STDOUT) {
+        ssize_t n = splice(fd, NULL, sink->fd, NULL, OUTPUT_BUFFER_READ_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n > 0) return true;
+        if (n == 0) return false;
+        if (errno == EINTR || errno == EAGAIN) return true;
+        if (errno != EINVAL && errno != ENOSYS) {
+            *stopped = true;
+            return false;
+        }
+        *use_splice = false;
+    }
+    #endif
+    
+    chunk->length = 0;
+    long n = output_buffer_read_fd(chunk, fd);
+    if (n > 0) {
+        if (!sink->write(sink, stream, chunk->data, chunk->length)) {
+            *stopped = true;
+            return false;
+        }
+        return true;
+    }
+    return n < 0 && (errno == EINTR || errno == EAGAIN);
+}
+
+static void pipeline_run(KernelContext* ctx, PipelineResult* result, const CommandEntry** entries, const CommandArgs* args, OutputSink* sink) {
+    size_t count = result->stage_count;
+    int pipes[PIPELINE_MAX_STAGES][2];
+    int err_pipe[2] = { -1, -1 };
+    long pids[PIPELINE_MAX_STAGES];
+    std::thread workers[PIPELINE_MAX_STAGES];
+    
+    for (size_t i = 0; i < count; i++) {
+        pipes[i][0] = pipes[i][1] = -1;
+        pids[i] = -1;
+    }
+    
+    // pipes[i] carries stage i's stdout; the last one feeds the sink
+    bool ready = pipeline_pipe(err_pipe);
+    for (size_t i = 0; ready && i < count; i++) {
+        ready = pipeline_pipe(pipes[i]);
+    }
+    if (!ready) {
+        for (size_t i = 0; i < count; i++) {
+            pipeline_close(&pipes[i][0]);
+            pipeline_close(&pipes[i][1]);
+        }
+        pipeline_close(&err_pipe[0]);
+        pipeline_close(&err_pipe[1]);
+        result->error = strdup("Failed to create pipeline pipes");
+        return;
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        PipelineStage* stage = &result->stages[i];
+        const KernelEnvironmentHandlers* handlers = kernel_get_handlers(entries[i]->env);
+        int stdin_fd = (i == 0) ? -1 : pipes[i - 1][0];
+        int stdout_fd = pipes[i][1];
+    
+        if (handlers && handlers->launcher) {
+            char* error = NULL;
+            pids[i] = handlers->launcher(handlers->launcher_userdata, ctx, entries[i], stage->command, &args[i],
+                                         stdin_fd, stdout_fd, err_pipe[1], &error);
+            if (pids[i] < 0) {
+                stage->result = CMD_EXECUTION_FAILED;
+                stage->exit_code = 127;
+                stage->error = error ? error : strdup("Failed to launch pipeline stage");
+            }
+            if (i > 0) pipeline_close(&pipes[i - 1][0]);
+            pipeline_close(&pipes[i][1]);
+        } else {
+            // The worker owns both ends from here on
+            int worker_err = fcntl(err_pipe[1], F_DUPFD_CLOEXEC, 0);
+            workers[i] = std::thread([ctx, handlers, entry = entries[i], stage, stage_args = &args[i], stdin_fd, stdout_fd, worker_err]() {
+                pipeline_run_executor(ctx, handlers, entry, stage, stage_args, stdin_fd, stdout_fd, worker_err);
+                close(worker_err);
+            });
+            if (i > 0) pipes[i - 1][0] = -1;
+            pipes[i][1] = -1;
+        }
+    }
+    pipeline_close(&err_pipe[1]);
+    
+    OutputBuffer chunk;
+    output_buffer_init(&chunk);
+    struct pollfd fds[2] = {
+        { pipes[count - 1][0], POLLIN, 0 },
+        { err_pipe[0], POLLIN, 0 }
+    };
+    const OutputStream streams[2] = { OUTPUT_STREAM_STDOUT, OUTPUT_STREAM_STDERR };
+    bool use_splice = sink->fd >= 0;
+    bool stopped = false;
+    int open_fds = 2;
+    
+    while (open_fds > 0 && !stopped) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+    
+        for (int i = 0; i < 2 && !stopped; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            if (!pipeline_forward(fds[i].fd, streams[i], sink, &chunk, &use_splice, &stopped)) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_fds--;
+            }
+        }
+    }
+    
+    output_buffer_free(&chunk);
+    for (int i = 0; i < 2; i++) {
+        if (fds[i].fd >= 0) close(fds[i].fd);
+    }
+    pipes[count - 1][0] = -1;
+    err_pipe[0] = -1;
+    
+    for (size_t i = 0; i < count; i++) {
+        if (stopped && pids[i] > 0) kill((pid_t)pids[i], SIGTERM);
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        if (workers[i].joinable()) {
+            workers[i].join();
+            continue;
+        }
+        if (pids[i] < 0) continue;
+    
+        int status = 0;
+        while (waitpid((pid_t)pids[i], &status, 0) < 0 && errno == EINTR) {
+        }
+    
+        PipelineStage* stage = &result->stages[i];
+        if (WIFEXITED(status)) {
+            stage->exit_code = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            stage->exit_code = 128 + WTERMSIG(status);
+        }
+        stage->result = (stage->exit_code == 0) ? CMD_SUCCESS : CMD_EXECUTION_FAILED;
+    }
+    
+    // Like a shell, the pipeline reports the status of its last stage
+    result->result = stopped ? CMD_EXECUTION_FAILED : result->stages[count - 1].result;
+    if (stopped) {
+        result->error = strdup("Pipeline stopped: output consumer rejected data");
+    }
+}
+#endif
+
+PipelineResult* kernel_execute_pipeline(KernelContext* ctx, const char* pipeline, OutputSink* sink) {
+    if (!ctx || !pipeline || !sink) return NULL;
+    
+    PipelineResult* result = pipeline_parse(pipeline);
+    if (!result || result->error) return result;
+    
+    // Every stage is parsed once, here, and its arguments are handed to the
+    // launcher or executor that runs it
+    CommandArgs args[PIPELINE_MAX_STAGES];
+    size_t parsed = 0;
+    for (; parsed < result->stage_count; parsed++) {
+        if (!command_args_parse(&args[parsed], result->stages[parsed].command)) {
+            result->error = strdup("Unterminated quote in pipeline stage");
+            break;
+        }
+    }
+    
+    // Every stage must resolve before anything is started. All stages resolve
+    // against one pinned registry version, which outlives the whole run
+    KernelRegistryGuard guard;
+    CommandRegistry* registry = kernel_registry_acquire(&guard);
+    const CommandEntry* entries[PIPELINE_MAX_STAGES];
+    for (size_t i = 0; !result->error && i < result->stage_count; i++) {
+        entries[i] = pipeline_resolve(registry, &result->stages[i], &args[i]);
+        if (!entries[i]) {
+            result->result = result->stages[i].result;
+            result->error = strdup(result->stages[i].error);
+        }
+    }
+    
+    if (!result->error) {
+        #ifdef _WIN32
+        result->error = strdup("Pipelines are not supported on this platform");
+        #else
+        pipeline_run(ctx, result, entries, args, sink);
+        #endif
+    }
+    kernel_registry_release(&guard);
+    for (size_t i = 0; i < parsed; i++) command_args_free(&args[i]);
+    return result;
+}
+
+void pipeline_result_destroy(PipelineResult* result) {
+    if (!result) return;
+    
+    for (size_t i = 0; i < result->stage_count; i++) {
+        free(result->stages[i].command);
+        free(result->stages[i].error);
+    }
+    free(result->stages);
+    free(result->error);
+    free(result);
+}
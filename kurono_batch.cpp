@@ -0,0 +1,164 @@
+#include "kurono_batch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+typedef struct {
+    BatchExecute execute;
+    void* userdata;
+    BatchSummary* summary;
+    bool stopped;
+} BatchRun;
+
+// Terminates the line in place and runs it
+static void batch_dispatch(BatchRun* run, char* line, size_t length) {
+    if (length > 0 && line[length - 1] == '\r') length--;
+    line[length] = '\0';
+    if (length == 0 || line[0] == '#') return;
+    
+    if (strcmp(line, "exit") == 0) {
+        run->stopped = true;
+        return;
+    }
+    
+    int status = run->execute(run->userdata, line);
+    run->summary->commands++;
+    if (status != 0) {
+        run->summary->failures++;
+        run->summary->status = status;
+    }
+}
+
+// Runs every complete line and returns the bytes consumed; a trailing line
+// without its newline is left for the caller
+static size_t batch_split(BatchRun* run, char* data, size_t length) {
+    size_t offset = 0;
+    while (offset < length && !run->stopped) {
+        char* newline = (char*)memchr(data + offset, '\n', length - offset);
+        if (!newline) break;
+    
+        size_t line_length = (size_t)(newline - (data + offset));
+        batch_dispatch(run, data + offset, line_length);
+        offset += line_length + 1;
+    }
+    return offset;
+}
+
+// The final line when the file does not end in a newline; buffer must have a
+// writable byte past the end
+static void batch_finish(BatchRun* run, char* data, size_t length) {
+    if (length > 0 && !run->stopped) batch_dispatch(run, data, length);
+}
+
+#ifndef _WIN32
+
+static bool batch_run_stream(BatchRun* run, int fd) {
+    OutputBuffer buffer;
+    output_buffer_init(&buffer);
+    
+    bool ok = true;
+    for (;;) {
+        long n = output_buffer_read_fd(&buffer, fd);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+    
+        // Lines are run as soon as they arrive; only a partial line is kept
+        size_t consumed = batch_split(run, buffer.data, buffer.length);
+        if (run->stopped) break;
+        memmove(buffer.data, buffer.data + consumed, buffer.length - consumed);
+        buffer.length -= consumed;
+        buffer.data[buffer.length] = '\0';
+    }
+    
+    if (ok && buffer.length) batch_finish(run, buffer.data, buffer.length);
+    output_buffer_free(&buffer);
+    return ok;
+}
+
+static bool batch_run_mapped(BatchRun* run, int fd, size_t size) {
+    // A private writable mapping lets lines be terminated in place; only the
+    // pages actually written are copied
+    char* data = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) return batch_run_stream(run, fd);
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+    
+    size_t consumed = batch_split(run, data, size);
+    size_t rest = size - consumed;
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (rest && size % page != 0) {
+        // The zero-filled tail of the last page has room for the terminator
+        batch_finish(run, data + consumed, rest);
+    } else if (rest && !run->stopped) {
+        char* line = (char*)malloc(rest + 1);
+        if (line) {
+            memcpy(line, data + consumed, rest);
+            batch_finish(run, line, rest);
+        }
+        free(line);
+    }
+    
+    munmap(data, size);
+    return true;
+}
+
+bool kurono_batch_run_file(const char* path, BatchExecute execute, void* userdata, BatchSummary* summary) {
+    if (!path || !execute || !summary) return false;
+    
+    summary->commands = 0;
+    summary->failures = 0;
+    summary->status = 0;
+    BatchRun run = { execute, userdata, summary, false };
+    
+    bool from_stdin = strcmp(path, KURONO_BATCH_STDIN) == 0;
+    int fd = from_stdin ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    
+    // stdin redirected from a file is mapped like any other file
+    struct stat st;
+    bool ok;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        ok = st.st_size == 0 || batch_run_mapped(&run, fd, (size_t)st.st_size);
+    } else {
+        ok = batch_run_stream(&run, fd);
+    }
+    
+    if (!from_stdin) close(fd);
+    return ok;
+}
+
+#else
+
+bool kurono_batch_run_file(const char* path, BatchExecute execute, void* userdata, BatchSummary* summary) {
+    if (!path || !execute || !summary) return false;
+    
+    summary->commands = 0;
+    summary->failures = 0;
+    summary->status = 0;
+    BatchRun run = { execute, userdata, summary, false };
+    
+    bool from_stdin = strcmp(path, KURONO_BATCH_STDIN) == 0;
+    FILE* file = from_stdin ? stdin : fopen(path, "rb");
+    if (!file) return false;
+    
+    OutputBuffer buffer;
+    output_buffer_init(&buffer);
+    output_buffer_read_file(&buffer, file);
+    if (!from_stdin) fclose(file);
+    
+    size_t consumed = buffer.length ? batch_split(&run, buffer.data, buffer.length) : 0;
+    if (buffer.length > consumed) batch_finish(&run, buffer.data + consumed, buffer.length - consumed);
+    output_buffer_free(&buffer);
+    return true;
+}
+
+#endif
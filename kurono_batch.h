@@ -0,0 +1,27 @@
+#ifndef KURONO_BATCH_H
+#define KURONO_BATCH_H
+
+#include "kernel.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define KURONO_BATCH_STDIN "-"
+
+/* Command files hold one command line per line. Blank lines and lines
+ * starting with '#' are skipped, a trailing '\r' is dropped, and a line
+ * reading exit ends the run. Regular files are mapped and split in place,
+ * so execute receives pointers into the mapping; pipes are read in chunks
+ * and split the same way. execute returns the command's exit status. */
+typedef int (*BatchExecute)(void* userdata, const char* command_line);
+
+/* status is 0 when every command succeeded, otherwise the status of the
+ * last command that failed. */
+typedef struct {
+    size_t commands;
+    size_t failures;
+    int status;
+} BatchSummary;
+
+bool kurono_batch_run_file(const char* path, BatchExecute execute, void* userdata, BatchSummary* summary);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef KURONO_BUILTINS_H
+#define KURONO_BUILTINS_H
+
+#include "perfect_hash.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Shell built-ins are declared as a constexpr table whose entries carry at
+ * least name, min_args and max_args, indexed with perfect_hash_build so that
+ * resolving the first word of a command line costs one hash, one probe and
+ * one comparison however many built-ins there are. The table itself keeps
+ * declaration order for help and completion. */
+
+#define KURONO_BUILTIN_ARGS_ANY 0xFF
+
+static inline bool kurono_builtin_is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+/* Resolves the built-in named by the first word of command_line. A built-in
+ * given the wrong number of arguments does not match, so the line falls
+ * through to the registry as any other command would. *args points past the
+ * name and the whitespace after it. */
+template <size_t SlotCount, typename Builtin, size_t Count>
+inline const Builtin* kurono_builtin_find(const PerfectHashIndex<SlotCount>& index, const Builtin (&table)[Count],
+                                          const char* command_line, const char** args) {
+    size_t length = 0;
+    while (command_line[length] && !kurono_builtin_is_space(command_line[length])) length++;
+    if (length == 0) return NULL;
+    
+    int slot = perfect_hash_find(index, table, command_line, length);
+    if (slot < 0) return NULL;
+    const Builtin* builtin = &table[slot];
+    
+    const char* rest = command_line + length;
+    while (kurono_builtin_is_space(*rest)) rest++;
+    
+    unsigned arg_count = 0;
+    for (const char* p = rest; *p; ) {
+        arg_count++;
+        while (*p && !kurono_builtin_is_space(*p)) p++;
+        while (kurono_builtin_is_space(*p)) p++;
+    }
+    if (arg_count < builtin->min_args) return NULL;
+    if (builtin->max_args != KURONO_BUILTIN_ARGS_ANY && arg_count > builtin->max_args) return NULL;
+    
+    if (args) *args = rest;
+    return builtin;
+}
+
+#endif
@@ -0,0 +1,273 @@
+#include "kurono_daemon.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#define DAEMON_POLL_INTERVAL_MS 200
+#define DAEMON_CHUNK_SIZE 65536
+
+static std::atomic<bool> g_daemon_stop{false};
+
+void kurono_daemon_stop(void) {
+    g_daemon_stop.store(true);
+}
+
+#ifndef _WIN32
+
+typedef struct DaemonConnection {
+    int fd;
+    std::mutex write_lock;
+    struct DaemonConnection* next;
+} DaemonConnection;
+
+// Live connections, so shutdown can wake sessions blocked reading a command
+static std::mutex g_connections_lock;
+static std::condition_variable g_connections_done;
+static DaemonConnection* g_connections = NULL;
+
+static bool daemon_read_full(int fd, void* buffer, size_t length) {
+    char* cursor = (char*)buffer;
+    while (length > 0) {
+        ssize_t n = read(fd, cursor, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        cursor += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+// MSG_NOSIGNAL keeps a client that hung up from killing the daemon
+static bool daemon_write_full(int fd, const void* buffer, size_t length) {
+    const char* cursor = (const char*)buffer;
+    while (length > 0) {
+        ssize_t n = send(fd, cursor, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        cursor += n;
+        length -= (size_t)n;
+    }
+    return true;
+}
+
+static bool daemon_write_frame(int fd, DaemonFrameType type, const void* data, size_t length) {
+    DaemonFrameHeader header = { (uint32_t)type, (uint32_t)length };
+    return daemon_write_full(fd, &header, sizeof(header)) && daemon_write_full(fd, data, length);
+}
+
+// Sinks may be written from pipeline threads, so frames are serialized
+static bool daemon_sink_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    DaemonConnection* connection = (DaemonConnection*)sink->userdata;
+    DaemonFrameType type = (stream == OUTPUT_STREAM_STDERR) ? DAEMON_FRAME_STDERR : DAEMON_FRAME_STDOUT;
+    
+    std::lock_guard<std::mutex> lock(connection->write_lock);
+    while (length > 0) {
+        size_t chunk = length < DAEMON_CHUNK_SIZE ? length : DAEMON_CHUNK_SIZE;
+        if (!daemon_write_frame(connection->fd, type, data, chunk)) return false;
+        data += chunk;
+        length -= chunk;
+    }
+    return true;
+}
+
+static void daemon_serve_connection(const DaemonHandlers* handlers, DaemonConnection* connection) {
+    OutputSink sink = { daemon_sink_write, connection, -1 };
+    void* session = handlers->open(handlers->userdata);
+    char* line = NULL;
+    
+    DaemonFrameHeader header;
+    while (session && daemon_read_full(connection->fd, &header, sizeof(header))) {
+        if (header.type != DAEMON_FRAME_COMMAND || header.length >= KURONO_DAEMON_MAX_LINE) break;
+    
+        char* grown = (char*)realloc(line, header.length + 1);
+        if (!grown) break;
+        line = grown;
+        if (!daemon_read_full(connection->fd, line, header.length)) break;
+        line[header.length] = '\0';
+    
+        int status = handlers->execute(handlers->userdata, session, line, &sink);
+        int32_t code = status < 0 ? 0 : status;
+    
+        std::lock_guard<std::mutex> lock(connection->write_lock);
+        if (!daemon_write_frame(connection->fd, DAEMON_FRAME_DONE, &code, sizeof(code)) || status < 0) break;
+    }
+    
+    free(line);
+    if (session) handlers->close(handlers->userdata, session);
+    
+    std::lock_guard<std::mutex> lock(g_connections_lock);
+    for (DaemonConnection** link = &g_connections; *link; link = &(*link)->next) {
+        if (*link == connection) {
+            *link = connection->next;
+            break;
+        }
+    }
+    close(connection->fd);
+    delete connection;
+    g_connections_done.notify_all();
+}
+
+// Sockets are close-on-exec from the start: a command spawned by another
+// session at the wrong moment would otherwise keep a client's connection, or
+// the listening socket, open after the daemon closes it
+static int daemon_socket(void) {
+    return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+}
+
+static bool daemon_address(const char* socket_path, struct sockaddr_un* address) {
+    if (!socket_path || strlen(socket_path) >= sizeof(address->sun_path)) return false;
+    
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, socket_path);
+    return true;
+}
+
+static int daemon_listen(const char* socket_path) {
+    struct sockaddr_un address;
+    if (!daemon_address(socket_path, &address)) return -1;
+    
+    // A socket file nobody accepts on is left over from a daemon that died
+    int probe = kurono_daemon_connect(socket_path);
+    if (probe >= 0) {
+        close(probe);
+        fprintf(stderr, "Kurono OS daemon already running on %s\n", socket_path);
+        return -1;
+    }
+    unlink(socket_path);
+    
+    int fd = daemon_socket();
+    if (fd < 0) return -1;
+    
+    // Sessions run with the daemon owner's rights, so only the owner may connect
+    mode_t mask = umask(077);
+    bool bound = bind(fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+    umask(mask);
+    
+    if (!bound || listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool kurono_daemon_serve(const char* socket_path, const DaemonHandlers* handlers) {
+    if (!handlers || !handlers->open || !handlers->execute || !handlers->close) return false;
+    
+    int listen_fd = daemon_listen(socket_path);
+    if (listen_fd < 0) return false;
+    
+    g_daemon_stop.store(false);
+    while (!g_daemon_stop.load()) {
+        struct pollfd pfd = { listen_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, DAEMON_POLL_INTERVAL_MS) <= 0) continue;
+    
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+    
+        DaemonConnection* connection = new DaemonConnection;
+        connection->fd = fd;
+        {
+            std::lock_guard<std::mutex> lock(g_connections_lock);
+            connection->next = g_connections;
+            g_connections = connection;
+        }
+        std::thread(daemon_serve_connection, handlers, connection).detach();
+    }
+    
+    close(listen_fd);
+    unlink(socket_path);
+    
+    // Shutting down the read side ends each session after its current command
+    std::unique_lock<std::mutex> lock(g_connections_lock);
+    for (DaemonConnection* connection = g_connections; connection; connection = connection->next) {
+        shutdown(connection->fd, SHUT_RD);
+    }
+    g_connections_done.wait(lock, [] { return g_connections == NULL; });
+    return true;
+}
+
+int kurono_daemon_connect(const char* socket_path) {
+    struct sockaddr_un address;
+    if (!daemon_address(socket_path, &address)) return -1;
+    
+    int fd = daemon_socket();
+    if (fd < 0) return -1;
+    
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int kurono_daemon_request(int fd, const char* command_line, OutputSink* sink) {
+    if (fd < 0 || !command_line || !sink) return -1;
+    
+    size_t length = strlen(command_line);
+    if (length >= KURONO_DAEMON_MAX_LINE) return -1;
+    if (!daemon_write_frame(fd, DAEMON_FRAME_COMMAND, command_line, length)) return -1;
+    
+    char* buffer = (char*)malloc(DAEMON_CHUNK_SIZE);
+    if (!buffer) return -1;
+    
+    int status = -1;
+    bool forwarding = true;
+    DaemonFrameHeader header;
+    while (daemon_read_full(fd, &header, sizeof(header))) {
+        if (header.type == DAEMON_FRAME_DONE) {
+            int32_t code;
+            if (header.length == sizeof(code) && daemon_read_full(fd, &code, sizeof(code))) {
+                status = code;
+            }
+            break;
+        }
+        if ((header.type != DAEMON_FRAME_STDOUT && header.type != DAEMON_FRAME_STDERR) || header.length > DAEMON_CHUNK_SIZE) break;
+        if (!daemon_read_full(fd, buffer, header.length)) break;
+    
+        // Output the sink refuses is drained so the connection stays usable
+        OutputStream stream = (header.type == DAEMON_FRAME_STDERR) ? OUTPUT_STREAM_STDERR : OUTPUT_STREAM_STDOUT;
+        if (forwarding && !sink->write(sink, stream, buffer, header.length)) {
+            forwarding = false;
+        }
+    }
+    
+    free(buffer);
+    return status;
+}
+
+void kurono_daemon_disconnect(int fd) {
+    if (fd >= 0) close(fd);
+}
+
+#else
+
+bool kurono_daemon_serve(const char* socket_path, const DaemonHandlers* handlers) {
+    fprintf(stderr, "Daemon mode is not supported on this platform\n");
+    return false;
+}
+
+int kurono_daemon_connect(const char* socket_path) {
+    return -1;
+}
+
+int kurono_daemon_request(int fd, const char* command_line, OutputSink* sink) {
+    return -1;
+}
+
+void kurono_daemon_disconnect(int fd) {
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef KURONO_DAEMON_H
+#define KURONO_DAEMON_H
+
+#include "kernel.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KURONO_DAEMON_SOCKET "/tmp/kurono-os.sock"
+#define KURONO_DAEMON_MAX_LINE 65536
+
+/* Clients talk to the daemon over a Unix-domain stream socket in frames: a
+ * DaemonFrameHeader followed by length payload bytes, in host byte order.
+ * The client sends one COMMAND frame per command line; the daemon answers
+ * with any number of STDOUT/STDERR frames and one DONE frame whose payload
+ * is the int32 exit code. A connection is one session and may send any
+ * number of commands. */
+typedef enum {
+    DAEMON_FRAME_COMMAND = 1,
+    DAEMON_FRAME_STDOUT,
+    DAEMON_FRAME_STDERR,
+    DAEMON_FRAME_DONE
+} DaemonFrameType;
+
+typedef struct {
+    uint32_t type;
+    uint32_t length;
+} DaemonFrameHeader;
+
+/* open creates the state for a new connection and close releases it. Each
+ * connection is served on its own thread, which calls execute for every
+ * command line with a sink that streams back to the client. execute returns
+ * the exit code, or a negative value to end the session. */
+typedef struct {
+    void* (*open)(void* userdata);
+    int (*execute)(void* userdata, void* session, const char* command_line, OutputSink* sink);
+    void (*close)(void* userdata, void* session);
+    void* userdata;
+} DaemonHandlers;
+
+/* Blocks until kurono_daemon_stop is called (it is async-signal-safe), then
+ * ends every open session and removes the socket. */
+bool kurono_daemon_serve(const char* socket_path, const DaemonHandlers* handlers);
+void kurono_daemon_stop(void);
+
+int kurono_daemon_connect(const char* socket_path);
+int kurono_daemon_request(int fd, const char* command_line, OutputSink* sink);
+void kurono_daemon_disconnect(int fd);
+
+#endif
@@ -2,13 +2,21 @@
 #include "linux_bridge.h"
 #include "windows_bridge.h"
 #include "kcl_interpreter.h"
+#include "kcl_aot.h"
 #include "conflict_resolver.h"
 #include "security_supr_engine.h"
 #include "package_manager.h"
 #include "linux_sync.h"
+#include "registry_snapshot.h"
+#include "kurono_daemon.h"
+#include "kurono_batch.h"
+#include "kurono_builtins.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <mutex>
 
 static KernelContext* g_kernel = NULL;
 static LinuxBridge* g_linux_bridge = NULL;
@@ -16,15 +24,105 @@ static WindowsBridge* g_windows_bridge = NULL;
 static KCLContext* g_kcl_ctx = NULL;
 static SecuritySuprEngine* g_security_engine = NULL;
 static PackageManager* g_package_manager = NULL;
-static CommandRegistry* g_command_registry = NULL;
+// The security engine and package database are shared by every session and
+// daemon sessions run on their own threads, so built-ins hold this lock for
+// every call into either
+static std::mutex g_shared_state_lock;
+// Batch runs keep stdout for command output only
+static bool g_quiet = false;
+
+/* One shell: the console REPL, a daemon connection or a batch run. Output
+ * goes through the session's sink so built-ins reach remote clients too. */
+typedef struct {
+    KernelContext* kernel;
+    KCLContext* kcl;
+    OutputSink* out;
+    bool interactive;
+} KuronoSession;
+
+#define REGISTRY_SNAPSHOT_PATH "/kurono/packages/registry.snap"
+#define KURONO_BATCH_BUFFER_SIZE (1 << 16)
 
 static int run_cmd(const char* cmd) {
     int rc = system(cmd);
     return rc;
 }
 
+static ExecutionResult* kurono_os_execute_linux(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    return linux_bridge_run_args((LinuxBridge*)userdata, ctx, args, entry->path, sink);
+}
+
+static long kurono_os_launch_linux(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, int stdin_fd, int stdout_fd, int stderr_fd, char** error) {
+    return linux_bridge_spawn_args((LinuxBridge*)userdata, ctx, args, entry->path, stdin_fd, stdout_fd, stderr_fd, error);
+}
+
+#ifdef _WIN32
+static ExecutionResult* kurono_os_execute_windows(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    return windows_bridge_run_powershell((WindowsBridge*)userdata, command_line, sink);
+}
+#endif
+
+// Scripts compiled with kcl-compile are looked up here by every session, and
+// the bytecode of every script run is kept alongside them
+static const char* kurono_os_kcl_cache_dir(void) {
+    const char* cache_dir = getenv("KCL_CACHE_DIR");
+    return (cache_dir && *cache_dir) ? cache_dir : KCL_AOT_DEFAULT_CACHE;
+}
+
+// Discovery walks the bridge directories, so it runs after boot; this is
+// everything a snapshot holds
+static void kurono_os_build_registry(CommandRegistry* registry, void* userdata) {
+    if (g_linux_bridge) {
+        linux_bridge_discover_commands(g_linux_bridge, registry);
+    }
+    if (g_windows_bridge) {
+        windows_bridge_register_commands(g_windows_bridge, registry);
+    }
+    if (g_kcl_ctx) {
+        kcl_register_commands(g_kcl_ctx, registry);
+    }
+}
+
+static bool kurono_os_is_linux_command(const CommandEntry* entry, void* userdata) {
+    return entry->env == ENV_LINUX;
+}
+
+// Default packages are not published under a name another environment
+// already provides, which discovery may only now have found
+static bool kurono_os_is_shadowed_package(const CommandEntry* entry, void* userdata) {
+    if (entry->env != ENV_KURONO || !package_manager_is_default_package(entry->name)) return false;
+    
+    CommandView found = command_registry_lookup((const CommandRegistry*)userdata, entry->name);
+    for (size_t i = 0; i < found.count; i++) {
+        if (found.entries[i]->env == ENV_LINUX) return true;
+    }
+    return false;
+}
+
+// Windows and KCL commands are built in, so only the Linux commands of the
+// boot registry can be out of date; packages and anything registered since
+// boot are kept
+static bool kurono_os_merge_registry(CommandRegistry* next, const CommandRegistry* rebuilt, void* userdata) {
+    command_registry_remove_if(next, kurono_os_is_linux_command, NULL);
+    command_registry_remove_if(next, kurono_os_is_shadowed_package, (void*)rebuilt);
+    
+    for (size_t g = 0; g < rebuilt->group_count; g++) {
+        CommandView group = command_group_view(&rebuilt->groups[g]);
+        for (size_t i = 0; i < group.count; i++) {
+            const CommandEntry* entry = group.entries[i];
+            if (entry->env != ENV_LINUX) continue;
+            if (entry->description_is_template) {
+                command_registry_add_template(next, entry->name, entry->path, entry->env, entry->description);
+            } else {
+                command_registry_add(next, entry->name, entry->path, entry->env, entry->description);
+            }
+        }
+    }
+    return true;
+}
+
 void kurono_os_init(void) {
-    printf("Initializing %s v%s...\n", KERNEL_NAME, KERNEL_VERSION);
+    if (!g_quiet) printf("Initializing %s v%s...\n", KERNEL_NAME, KERNEL_VERSION);
     
     // Initialize core kernel
     g_kernel = kernel_init();
@@ -33,13 +131,6 @@ void kurono_os_init(void) {
         exit(1);
     }
     
-    // Initialize command registry
-    g_command_registry = command_registry_create();
-    if (!g_command_registry) {
-        fprintf(stderr, "Failed to create command registry\n");
-        exit(1);
-    }
-    
     // Initialize Linux bridge
     #ifdef _WIN32
     g_linux_bridge = linux_bridge_create("D:\\OS\\Kurono OS\\LinuxRoot");
@@ -48,35 +139,84 @@ void kurono_os_init(void) {
     #endif
     if (g_linux_bridge) {
         linux_bridge_mount_filesystem(g_linux_bridge);
-        linux_bridge_register_commands(g_linux_bridge, g_command_registry);
+        kernel_register_executor(ENV_LINUX, kurono_os_execute_linux, g_linux_bridge);
+        kernel_register_stage_launcher(ENV_LINUX, kurono_os_launch_linux, g_linux_bridge);
     }
     
     // Initialize Windows bridge
     g_windows_bridge = windows_bridge_create("C:\\kurono\\windows");
+    #ifdef _WIN32
     if (g_windows_bridge) {
-        windows_bridge_register_commands(g_windows_bridge, g_command_registry);
+        kernel_register_executor(ENV_WINDOWS, kurono_os_execute_windows, g_windows_bridge);
     }
+    #endif
     
     // Initialize KCL interpreter
     g_kcl_ctx = kcl_context_create(g_kernel);
-    if (g_kcl_ctx) {
-        kcl_register_commands(g_kcl_ctx, g_command_registry);
-    }
+    kcl_context_set_native_cache(g_kcl_ctx, kurono_os_kcl_cache_dir());
+    kcl_context_set_bytecode_cache(g_kcl_ctx, kurono_os_kcl_cache_dir());
     
     // Initialize security engine
     g_security_engine = security_supr_engine_create();
     
     // Initialize package manager
     g_package_manager = package_manager_create("/kurono/packages/cache");
+    
+    // The registry snapshot is valid while the bridge command directories and
+    // the package database are unchanged
+    RegistrySnapshotSources sources;
+    registry_snapshot_sources_init(&sources);
+    if (g_linux_bridge) {
+        registry_snapshot_sources_add(&sources, g_linux_bridge->bin_path);
+        registry_snapshot_sources_add(&sources, g_linux_bridge->usr_bin_path);
+    }
+    if (g_windows_bridge) {
+        registry_snapshot_sources_add(&sources, g_windows_bridge->system32_path);
+    }
     if (g_package_manager) {
-        package_manager_register_kurono_packages(g_package_manager, g_command_registry);
+        registry_snapshot_sources_add(&sources, g_package_manager->cache_directory);
+    }
+    
+    // Every subsystem shares the kernel's registry. Boot never waits for
+    // discovery: it starts from the last snapshot even when that is stale, or
+    // from the built-in commands alone, and the rebuilt registry is published
+    // once discovery finishes
+    bool stale = false;
+    CommandRegistry* registry = registry_snapshot_load(REGISTRY_SNAPSHOT_PATH, &sources, &stale);
+    if (!registry) {
+        registry = command_registry_create();
+        if (!registry) {
+            fprintf(stderr, "Failed to create command registry\n");
+            exit(1);
+        }
+    
+        if (g_windows_bridge) {
+            windows_bridge_register_commands(g_windows_bridge, registry);
+        }
+        if (g_kcl_ctx) {
+            kcl_register_commands(g_kcl_ctx, registry);
+        }
+        stale = true;
+    }
+    
+    // Package commands are not part of the snapshot; they go into the private
+    // registry too, so boot publishes a single version
+    if (g_package_manager) {
+        package_manager_register_kurono_packages(g_package_manager, registry);
+    }
+    kernel_attach_registry(g_kernel, registry);
+    
+    if (stale) {
+        registry_snapshot_rebuild_async(REGISTRY_SNAPSHOT_PATH, &sources, kurono_os_build_registry, kurono_os_merge_registry, NULL);
     }
     
-    printf("Kurono OS initialized successfully\n");
+    if (!g_quiet) printf("Kurono OS initialized successfully\n");
 }
 
 void kurono_os_shutdown(void) {
-    printf("Shutting down Kurono OS...\n");
+    if (!g_quiet) printf("Shutting down Kurono OS...\n");
+    
+    registry_snapshot_wait();
     
     if (g_package_manager) {
         package_manager_destroy(g_package_manager);
@@ -104,17 +244,12 @@ void kurono_os_shutdown(void) {
         g_linux_bridge = NULL;
     }
     
-    if (g_command_registry) {
-        command_registry_destroy(g_command_registry);
-        g_command_registry = NULL;
-    }
-    
     if (g_kernel) {
         kernel_shutdown(g_kernel);
         g_kernel = NULL;
     }
     
-    printf("Kurono OS shutdown complete\n");
+    if (!g_quiet) printf("Kurono OS shutdown complete\n");
 }
 
 void kurono_os_print_banner(void) {
@@ -130,39 +265,29 @@ void kurono_os_print_banner(void) {
     printf("\n");
 }
 
-void kurono_os_print_help(void) {
-    printf("Kurono OS Commands:\n");
-    printf("  help              - Show this help message\n");
-    printf("  version           - Show version information\n");
-    printf("  env               - Show current environment\n");
-    printf("  switch <env>      - Switch to different environment (linux/windows/kurono)\n");
-    printf("  supr              - Enable root mode (requires admin password)\n");
-    printf("  exit              - Exit Kurono OS\n");
-    printf("  install <pkg>     - Install a package\n");
-    printf("  remove <pkg>      - Remove a package\n");
-    printf("  list              - List installed packages\n");
-    printf("  search <query>    - Search for packages\n");
-    printf("  kcl <script>      - Execute KCL script\n");
-    printf("  linux-start       - Start Kurono-controlled Linux VM\n");
-    printf("  linux-start-gui   - Start Kurono-controlled Linux VM with GUI\n");
-    printf("  linux-stop        - Stop Kurono-controlled Linux VM\n");
-    printf("  linux-sync-create-user <name> [admin] - Create Linux user\n");
-    printf("  linux-sync-delete-user <name>         - Delete Linux user\n");
-    printf("  linux-sync-dump   - Dump Linux users to shared file\n");
-    printf("  linux-sync-import - Import Linux users into Kurono\n");
-    printf("  linux-shim-setup  - Create MSYS2 command shims in LinuxRoot\n");
-    printf("  linux-de-install  - Install XFCE desktop in Linux VM\n");
-    printf("  linux-de-start    - Start XFCE desktop (requires GUI VM)\n");
-    printf("\n");
-    printf("Available environments:\n");
-    printf("  linux    - Linux subsystem with GNU utilities\n");
-    printf("  windows  - Windows subsystem with PE loader and PowerShell\n");
-    printf("  kurono   - Kurono native environment with KCL\n");
-    printf("\n");
+static void kurono_os_print(KuronoSession* session, OutputStream stream, const char* format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return;
+    
+    char* text = buffer;
+    if ((size_t)length >= sizeof(buffer)) {
+        text = (char*)malloc((size_t)length + 1);
+        if (!text) return;
+        va_start(args, format);
+        vsnprintf(text, (size_t)length + 1, format, args);
+        va_end(args);
+    }
+    
+    session->out->write(session->out, stream, text, (size_t)length);
+    if (text != buffer) free(text);
 }
 
-bool kurono_os_switch_environment(const char* env_name) {
-    if (!env_name || !g_kernel) return false;
+bool kurono_os_switch_environment(KuronoSession* session, const char* env_name) {
+    if (!session || !env_name) return false;
     
     EnvironmentType target_env;
     if (strcmp(env_name, "linux") == 0) {
@@ -172,21 +297,27 @@ bool kurono_os_switch_environment(const char* env_name) {
     } else if (strcmp(env_name, "kurono") == 0) {
         target_env = ENV_KURONO;
     } else {
-        printf("Unknown environment: %s\n", env_name);
+        kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Unknown environment: %s\n", env_name);
         return false;
     }
     
-    if (kernel_switch_environment(g_kernel, target_env)) {
-        printf("Switched to %s environment\n", env_name);
+    if (kernel_switch_environment(session->kernel, target_env)) {
+        kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Switched to %s environment\n", env_name);
         return true;
     }
     
     return false;
 }
 
-bool kurono_os_handle_supr(void) {
+bool kurono_os_handle_supr(KuronoSession* session) {
     if (!g_security_engine) return false;
     
+    // The security engine is shared, so SUPR is only granted to the console
+    if (!session->interactive) {
+        kurono_os_print(session, OUTPUT_STREAM_STDERR, "SUPR mode requires the interactive console\n");
+        return false;
+    }
+    
     char password[256];
     printf("Enter admin password: ");
     fflush(stdout);
@@ -196,7 +327,12 @@ bool kurono_os_handle_supr(void) {
         return false;
     }
     
-    if (security_supr_engine_enable_supr(g_security_engine, password)) {
+    bool enabled;
+    {
+        std::lock_guard<std::mutex> lock(g_shared_state_lock);
+        enabled = security_supr_engine_enable_supr(g_security_engine, password);
+    }
+    if (enabled) {
         printf("SUPR mode enabled. You now have root privileges.\n");
         printf("SUPR mode will expire in 15 minutes.\n");
         return true;
@@ -206,114 +342,467 @@ bool kurono_os_handle_supr(void) {
     }
 }
 
-void kurono_os_handle_command(const char* command_line) {
-    if (!command_line || !g_kernel || !g_command_registry) return;
+static int kurono_os_run_pipeline(KuronoSession* session, const char* command_line) {
+    PipelineResult* pipeline = kernel_execute_pipeline(session->kernel, command_line, session->out);
+    if (!pipeline) return 1;
     
-    // Handle built-in commands
-    if (strcmp(command_line, "help") == 0) {
-        kurono_os_print_help();
-        return;
-    } else if (strcmp(command_line, "version") == 0) {
-        printf("%s v%s\n", KERNEL_NAME, KERNEL_VERSION);
-        return;
-    } else if (strcmp(command_line, "env") == 0) {
-        const char* env_names[] = {"Linux", "Windows", "Kurono", "Unknown"};
-        printf("Current environment: %s\n", env_names[g_kernel->current_env]);
-        return;
-    } else if (strncmp(command_line, "switch ", 7) == 0) {
-        kurono_os_switch_environment(command_line + 7);
-        return;
-    } else if (strcmp(command_line, "supr") == 0) {
-        kurono_os_handle_supr();
-        return;
-    } else if (strcmp(command_line, "linux-start") == 0) {
-        run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\linux_vm_start.ps1\" -VmDir \"D:\\OS\\Kurono OS\\LinuxVM\"");
-        return;
-    } else if (strcmp(command_line, "linux-start-gui") == 0) {
-        run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\linux_vm_start_gui.ps1\" -VmDir \"D:\\OS\\Kurono OS\\LinuxVM\"");
-        return;
-    } else if (strcmp(command_line, "linux-stop") == 0) {
-        run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\linux_vm_stop.ps1\" ");
-        return;
-    } else if (strncmp(command_line, "linux-sync-create-user ", 24) == 0) {
-        const char* args = command_line + 24;
-        char name[128] = {0};
-        char admin[16] = {0};
-        sscanf(args, "%127s %15s", name, admin);
-        bool is_admin = (strcmp(admin, "admin") == 0 || strcmp(admin, "true") == 0);
-        if (linux_sync_create_user(name, is_admin)) printf("Linux user created: %s\n", name);
-        else printf("Failed to create Linux user: %s\n", name);
-        return;
-    } else if (strncmp(command_line, "linux-sync-delete-user ", 24) == 0) {
-        const char* args = command_line + 24;
-        char name[128] = {0};
-        sscanf(args, "%127s", name);
-        if (linux_sync_delete_user(name)) printf("Linux user deleted: %s\n", name);
-        else printf("Failed to delete Linux user: %s\n", name);
-        return;
-    } else if (strcmp(command_line, "linux-sync-dump") == 0) {
-        if (linux_sync_sync_from_linux()) printf("Dumped Linux users to D:\\OS\\Kurono OS\\Users\\linux_passwd.txt\n");
-        else printf("Failed to dump Linux users\n");
-        return;
-    } else if (strcmp(command_line, "linux-sync-import") == 0) {
-        if (security_supr_engine_import_linux_passwd(g_security_engine, "D:\\OS\\Kurono OS\\Users\\linux_passwd.txt")) printf("Imported Linux users into Kurono\n");
-        else printf("Failed to import Linux users\n");
-        return;
-    } else if (strcmp(command_line, "linux-shim-setup") == 0) {
-        run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\setup_kurono_linux_root.ps1\" -Root \"D:\\OS\\Kurono OS\\LinuxRoot\" ");
-        return;
-    } else if (strcmp(command_line, "linux-de-install") == 0) {
-        run_cmd("powershell -NoProfile -Command \"ssh -p 2222 root@localhost 'apk update && apk add xfce4 xfce4-terminal lightdm lightdm-gtk-greeter dbus dbus-x11 xorg-server mesa-dri-swrast && rc-update add lightdm && rc-update add dbus'\"");
-        printf("Desktop packages installed (XFCE + LightDM).\n");
-        return;
-    } else if (strcmp(command_line, "linux-de-start") == 0) {
-        run_cmd("powershell -NoProfile -Command \"ssh -p 2222 root@localhost 'service dbus start; service lightdm start || startxfce4'\"");
+    for (size_t i = 0; i < pipeline->stage_count; i++) {
+        const PipelineStage* stage = &pipeline->stages[i];
+        if (stage->exit_code > 0) {
+            kurono_os_print(session, OUTPUT_STREAM_STDERR, "Stage %zu (%s) exited with code %d\n", i + 1, stage->command, stage->exit_code);
+        }
+        if (stage->error && !pipeline->error) {
+            kurono_os_print(session, OUTPUT_STREAM_STDERR, "Error: %s\n", stage->error);
+        }
+    }
+    if (pipeline->error) {
+        kurono_os_print(session, OUTPUT_STREAM_STDERR, "Error: %s\n", pipeline->error);
+    }
+    
+    int status = 1;
+    if (!pipeline->error && pipeline->stage_count > 0) {
+        int last = pipeline->stages[pipeline->stage_count - 1].exit_code;
+        status = last >= 0 ? last : 1;
+    }
+    
+    pipeline_result_destroy(pipeline);
+    return status;
+}
+
+// Later kcl runs of the same script text load the cached shared object
+static bool kurono_os_compile_script(KuronoSession* session, const char* filename) {
+    char* script_text = kcl_read_script(filename);
+    if (!script_text) {
+        kurono_os_print(session, OUTPUT_STREAM_STDERR, "kcl-compile: cannot read %s\n", filename);
+        return false;
+    }
+    
+    char* error = NULL;
+    KCLNativeScript* native = kcl_aot_compile(script_text, kurono_os_kcl_cache_dir(), &error);
+    if (native) {
+        kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Compiled %s\n", filename);
+    } else {
+        kurono_os_print(session, OUTPUT_STREAM_STDERR, "kcl-compile: %s: %s\n", filename, error ? error : "compilation failed");
+    }
+    
+    kcl_aot_unload(native);
+    free(error);
+    free(script_text);
+    return native != NULL;
+}
+
+/* Built-ins take the rest of the line after their name as args. min_args and
+ * max_args count whitespace-separated words; a line outside that range is not
+ * the built-in and goes to the registry like any other command. */
+typedef struct {
+    const char* name;
+    const char* usage;
+    const char* summary;
+    uint8_t min_args;
+    uint8_t max_args;
+    int (*handler)(KuronoSession* session, const char* args);
+} KuronoBuiltin;
+
+void kurono_os_print_help(KuronoSession* session, const char* prefix);
+
+static int kurono_os_builtin_help(KuronoSession* session, const char* args) {
+    kurono_os_print_help(session, args[0] ? args : NULL);
+    return 0;
+}
+
+static int kurono_os_builtin_version(KuronoSession* session, const char* args) {
+    kurono_os_print(session, OUTPUT_STREAM_STDOUT, "%s v%s\n", KERNEL_NAME, KERNEL_VERSION);
+    return 0;
+}
+
+static int kurono_os_builtin_env(KuronoSession* session, const char* args) {
+    const char* env_names[] = {"Linux", "Windows", "Kurono", "Unknown"};
+    kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Current environment: %s\n", env_names[session->kernel->current_env]);
+    return 0;
+}
+
+static int kurono_os_builtin_switch(KuronoSession* session, const char* args) {
+    return kurono_os_switch_environment(session, args) ? 0 : 1;
+}
+
+static int kurono_os_builtin_supr(KuronoSession* session, const char* args) {
+    return kurono_os_handle_supr(session) ? 0 : 1;
+}
+
+static int kurono_os_builtin_kcl(KuronoSession* session, const char* args) {
+    int status = kcl_execute_file_streaming(session->kcl, args, session->out);
+    return status < 0 ? 1 : status;
+}
+
+static int kurono_os_builtin_kcl_compile(KuronoSession* session, const char* args) {
+    return kurono_os_compile_script(session, args) ? 0 : 1;
+}
+
+static int kurono_os_builtin_linux_start(KuronoSession* session, const char* args) {
+    run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\linux_vm_start.ps1\" -VmDir \"D:\\OS\\Kurono OS\\LinuxVM\"");
+    return 0;
+}
+
+static int kurono_os_builtin_linux_start_gui(KuronoSession* session, const char* args) {
+    run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\linux_vm_start_gui.ps1\" -VmDir \"D:\\OS\\Kurono OS\\LinuxVM\"");
+    return 0;
+}
+
+static int kurono_os_builtin_linux_stop(KuronoSession* session, const char* args) {
+    run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\linux_vm_stop.ps1\" ");
+    return 0;
+}
+
+static int kurono_os_builtin_linux_create_user(KuronoSession* session, const char* args) {
+    char name[128] = {0};
+    char admin[16] = {0};
+    sscanf(args, "%127s %15s", name, admin);
+    bool is_admin = (strcmp(admin, "admin") == 0 || strcmp(admin, "true") == 0);
+    bool created = linux_sync_create_user(name, is_admin);
+    if (created) kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Linux user created: %s\n", name);
+    else kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Failed to create Linux user: %s\n", name);
+    return created ? 0 : 1;
+}
+
+static int kurono_os_builtin_linux_delete_user(KuronoSession* session, const char* args) {
+    char name[128] = {0};
+    sscanf(args, "%127s", name);
+    bool deleted = linux_sync_delete_user(name);
+    if (deleted) kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Linux user deleted: %s\n", name);
+    else kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Failed to delete Linux user: %s\n", name);
+    return deleted ? 0 : 1;
+}
+
+static int kurono_os_builtin_linux_sync_dump(KuronoSession* session, const char* args) {
+    bool dumped = linux_sync_sync_from_linux();
+    if (dumped) kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Dumped Linux users to D:\\OS\\Kurono OS\\Users\\linux_passwd.txt\n");
+    else kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Failed to dump Linux users\n");
+    return dumped ? 0 : 1;
+}
+
+static int kurono_os_builtin_linux_sync_import(KuronoSession* session, const char* args) {
+    bool imported;
+    {
+        std::lock_guard<std::mutex> lock(g_shared_state_lock);
+        imported = g_security_engine && security_supr_engine_import_linux_passwd(g_security_engine, "D:\\OS\\Kurono OS\\Users\\linux_passwd.txt");
+    }
+    if (imported) kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Imported Linux users into Kurono\n");
+    else kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Failed to import Linux users\n");
+    return imported ? 0 : 1;
+}
+
+static int kurono_os_builtin_linux_shim_setup(KuronoSession* session, const char* args) {
+    run_cmd("powershell -ExecutionPolicy Bypass -File \"D:\\OS\\Kurono OS\\setup_kurono_linux_root.ps1\" -Root \"D:\\OS\\Kurono OS\\LinuxRoot\" ");
+    return 0;
+}
+
+static int kurono_os_builtin_linux_de_install(KuronoSession* session, const char* args) {
+    run_cmd("powershell -NoProfile -Command \"ssh -p 2222 root@localhost 'apk update && apk add xfce4 xfce4-terminal lightdm lightdm-gtk-greeter dbus dbus-x11 xorg-server mesa-dri-swrast && rc-update add lightdm && rc-update add dbus'\"");
+    kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Desktop packages installed (XFCE + LightDM).\n");
+    return 0;
+}
+
+static int kurono_os_builtin_linux_de_start(KuronoSession* session, const char* args) {
+    run_cmd("powershell -NoProfile -Command \"ssh -p 2222 root@localhost 'service dbus start; service lightdm start || startxfce4'\"");
+    return 0;
+}
+
+// New built-ins only need an entry here; help and completion read this table
+static constexpr KuronoBuiltin kurono_builtins[] = {
+    { "help", "help [prefix]", "Show this help message, or the built-ins starting with prefix", 0, 1, kurono_os_builtin_help },
+    { "version", "version", "Show version information", 0, 0, kurono_os_builtin_version },
+    { "env", "env", "Show current environment", 0, 0, kurono_os_builtin_env },
+    { "switch", "switch <env>", "Switch to different environment (linux/windows/kurono)", 1, 1, kurono_os_builtin_switch },
+    { "supr", "supr", "Enable root mode (requires admin password)", 0, 0, kurono_os_builtin_supr },
+    { "kcl", "kcl <script>", "Execute KCL script", 1, KURONO_BUILTIN_ARGS_ANY, kurono_os_builtin_kcl },
+    { "kcl-compile", "kcl-compile <script>", "Compile a KCL script to native code", 1, KURONO_BUILTIN_ARGS_ANY, kurono_os_builtin_kcl_compile },
+    { "linux-start", "linux-start", "Start Kurono-controlled Linux VM", 0, 0, kurono_os_builtin_linux_start },
+    { "linux-start-gui", "linux-start-gui", "Start Kurono-controlled Linux VM with GUI", 0, 0, kurono_os_builtin_linux_start_gui },
+    { "linux-stop", "linux-stop", "Stop Kurono-controlled Linux VM", 0, 0, kurono_os_builtin_linux_stop },
+    { "linux-sync-create-user", "linux-sync-create-user <name> [admin]", "Create Linux user", 1, 2, kurono_os_builtin_linux_create_user },
+    { "linux-sync-delete-user", "linux-sync-delete-user <name>", "Delete Linux user", 1, 1, kurono_os_builtin_linux_delete_user },
+    { "linux-sync-dump", "linux-sync-dump", "Dump Linux users to shared file", 0, 0, kurono_os_builtin_linux_sync_dump },
+    { "linux-sync-import", "linux-sync-import", "Import Linux users into Kurono", 0, 0, kurono_os_builtin_linux_sync_import },
+    { "linux-shim-setup", "linux-shim-setup", "Create MSYS2 command shims in LinuxRoot", 0, 0, kurono_os_builtin_linux_shim_setup },
+    { "linux-de-install", "linux-de-install", "Install XFCE desktop in Linux VM", 0, 0, kurono_os_builtin_linux_de_install },
+    { "linux-de-start", "linux-de-start", "Start XFCE desktop (requires GUI VM)", 0, 0, kurono_os_builtin_linux_de_start },
+};
+
+#define KURONO_BUILTIN_COUNT (sizeof(kurono_builtins) / sizeof(kurono_builtins[0]))
+
+static constexpr auto kurono_builtin_index = perfect_hash_build<PERFECT_HASH_SLOTS(kurono_builtins)>(kurono_builtins);
+static_assert(kurono_builtin_index.complete, "Built-in names must be unique");
+
+// With a prefix only the matching built-ins are listed, which is what a
+// completer needs
+void kurono_os_print_help(KuronoSession* session, const char* prefix) {
+    if (prefix) {
+        size_t prefix_length = strlen(prefix);
+        for (size_t i = 0; i < KURONO_BUILTIN_COUNT; i++) {
+            if (strncmp(kurono_builtins[i].name, prefix, prefix_length) != 0) continue;
+            kurono_os_print(session, OUTPUT_STREAM_STDOUT, "  %-17s - %s\n", kurono_builtins[i].usage, kurono_builtins[i].summary);
+        }
         return;
     }
     
-    // Check for command conflicts
-    char* command_copy = strdup(command_line);
-    char* command = strtok(command_copy, " ");
+    kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Kurono OS Commands:\n");
+    for (size_t i = 0; i < KURONO_BUILTIN_COUNT; i++) {
+        kurono_os_print(session, OUTPUT_STREAM_STDOUT, "  %-17s - %s\n", kurono_builtins[i].usage, kurono_builtins[i].summary);
+    }
+    kurono_os_print(session, OUTPUT_STREAM_STDOUT,
+        "  exit              - Exit Kurono OS\n"
+        "  install <pkg>     - Install a package\n"
+        "  remove <pkg>      - Remove a package\n"
+        "  list              - List installed packages\n"
+        "  search <query>    - Search for packages\n"
+        "\n"
+        "Available environments:\n"
+        "  linux    - Linux subsystem with GNU utilities\n"
+        "  windows  - Windows subsystem with PE loader and PowerShell\n"
+        "  kurono   - Kurono native environment with KCL\n"
+        "\n");
+}
+
+// Returns the exit status of the command line: the command's own exit code,
+// 127 when nothing by that name is registered, 0 or 1 for built-ins
+int kurono_os_handle_command(KuronoSession* session, const char* command_line) {
+    if (!session || !command_line || !g_kernel) return 1;
+    
+    const char* args = NULL;
+    const KuronoBuiltin* builtin = kurono_builtin_find(kurono_builtin_index, kurono_builtins, command_line, &args);
+    if (builtin) return builtin->handler(session, args);
+    
+    // The kernel resolves the command against the shared registry and streams
+    // its output straight to the session; the shell only steps in when the
+    // user has to pick an environment
+    if (strchr(command_line, '|')) {
+        return kurono_os_run_pipeline(session, command_line);
+    }
     
-    size_t conflict_count = 0;
-    CommandEntry** conflicts = command_registry_find(g_command_registry, command, &conflict_count);
+    ExecutionResult* result = kernel_execute_command_streaming(session->kernel, command_line, session->out);
+    if (!result) return 1;
     
-    if (conflict_count > 1) {
+    int command_len = (int)strcspn(command_line, " ");
+    int status = result->exit_code >= 0 ? result->exit_code : 1;
+    
+    if (result->result == CMD_AMBIGUOUS && !session->interactive) {
+        // Remote sessions cannot answer the prompt; they get the choices
+        kurono_os_print(session, OUTPUT_STREAM_STDERR, "%s", result->error);
+    } else if (result->result == CMD_AMBIGUOUS) {
+        char command[256];
+        snprintf(command, sizeof(command), "%.*s", command_len, command_line);
+    
+        // The resolver keeps entry pointers while the user chooses, so the
+        // registry version stays pinned until it is destroyed
+        KernelRegistryGuard guard = { NULL, NULL };
         ConflictResolver* resolver = conflict_resolver_create(command);
-        if (resolver && conflict_resolver_detect_conflicts(resolver, g_command_registry)) {
+        if (resolver && conflict_resolver_detect_conflicts(resolver, kernel_registry_acquire(&guard))) {
             int choice = conflict_resolver_prompt_user(resolver);
             if (choice >= 0) {
-                CommandEntry* selected = conflicts[choice];
+                CommandEntry* selected = conflict_resolver_get_resolution(resolver);
                 printf("Selected: %s from %s environment\n", selected->path, 
                        selected->env == ENV_LINUX ? "Linux" : 
                        selected->env == ENV_WINDOWS ? "Windows" : "Kurono");
             }
         }
         conflict_resolver_destroy(resolver);
-    } else if (conflict_count == 1) {
-        // Execute the command
-        ExecutionResult* result = kernel_execute_command(g_kernel, command_line);
-        if (result) {
-            if (result->output) {
-                printf("%s\n", result->output);
-            }
-            if (result->error) {
-                fprintf(stderr, "Error: %s\n", result->error);
-            }
-            execution_result_destroy(result);
+        kernel_registry_release(&guard);
+    } else if (result->result == CMD_NOT_FOUND) {
+        kurono_os_print(session, OUTPUT_STREAM_STDOUT, "Command not found: %.*s\n", command_len, command_line);
+        status = 127;
+    } else {
+        if (result->output) {
+            kurono_os_print(session, OUTPUT_STREAM_STDOUT, "%s\n", result->output);
+        }
+        if (result->error) {
+            kurono_os_print(session, OUTPUT_STREAM_STDERR, "Error: %s\n", result->error);
+        }
+    }
+    
+    execution_result_destroy(result);
+    return status;
+}
+
+// Daemon sessions get their own kernel context and KCL context; the registry,
+// security engine and package database stay shared with every other session
+static void* kurono_os_session_open(void* userdata) {
+    KuronoSession* session = (KuronoSession*)malloc(sizeof(KuronoSession));
+    if (!session) return NULL;
+    
+    session->kernel = kernel_context_clone(g_kernel);
+    session->kcl = session->kernel ? kcl_context_create(session->kernel) : NULL;
+    session->out = NULL;
+    session->interactive = false;
+    if (!session->kcl || !kcl_context_set_native_cache(session->kcl, kurono_os_kcl_cache_dir()) ||
+        !kcl_context_set_bytecode_cache(session->kcl, kurono_os_kcl_cache_dir())) {
+        kcl_context_destroy(session->kcl);
+        kernel_context_destroy(session->kernel);
+        free(session);
+        return NULL;
+    }
+    return session;
+}
+
+static int kurono_os_session_execute(void* userdata, void* handle, const char* command_line, OutputSink* sink) {
+    KuronoSession* session = (KuronoSession*)handle;
+    if (strcmp(command_line, "exit") == 0) return -1;
+    
+    session->out = sink;
+    return kurono_os_handle_command(session, command_line);
+}
+
+static void kurono_os_session_close(void* userdata, void* handle) {
+    KuronoSession* session = (KuronoSession*)handle;
+    kcl_context_destroy(session->kcl);
+    kernel_context_destroy(session->kernel);
+    free(session);
+}
+
+static void kurono_os_handle_signal(int signal_number) {
+    kurono_daemon_stop();
+}
+
+static int kurono_os_run_daemon(const char* socket_path) {
+    kurono_os_init();
+    
+    #ifndef _WIN32
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = kurono_os_handle_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    #endif
+    
+    DaemonHandlers handlers = { kurono_os_session_open, kurono_os_session_execute, kurono_os_session_close, NULL };
+    printf("Kurono OS daemon listening on %s\n", socket_path);
+    fflush(stdout);
+    bool served = kurono_daemon_serve(socket_path, &handlers);
+    
+    kurono_os_shutdown();
+    return served ? 0 : 1;
+}
+
+// Thin client: forwards command lines to the daemon and streams the output
+// back. With no command on the command line it sends one per stdin line over
+// a single session and exits with the status of the last one
+static int kurono_os_run_client(const char* socket_path, int argc, char* argv[]) {
+    int fd = kurono_daemon_connect(socket_path);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot connect to Kurono OS daemon at %s\n", socket_path);
+        return 1;
+    }
+    
+    OutputSink terminal;
+    output_sink_init_stdio(&terminal);
+    int status = 0;
+    
+    if (argc > 0) {
+        char command_line[KURONO_DAEMON_MAX_LINE];
+        size_t length = 0;
+        command_line[0] = '\0';
+        for (int i = 0; i < argc; i++) {
+            int written = snprintf(command_line + length, sizeof(command_line) - length, "%s%s", i ? " " : "", argv[i]);
+            if (written < 0 || (size_t)written >= sizeof(command_line) - length) break;
+            length += (size_t)written;
+        }
+        status = kurono_daemon_request(fd, command_line, &terminal);
+    } else {
+        char command_line[1024];
+        while (fgets(command_line, sizeof(command_line), stdin)) {
+            command_line[strcspn(command_line, "\n")] = 0;
+            if (command_line[0] == '\0') continue;
+            
+            status = kurono_daemon_request(fd, command_line, &terminal);
+            if (status < 0) break;
         }
+    }
+    
+    kurono_daemon_disconnect(fd);
+    if (status < 0) {
+        fprintf(stderr, "Lost connection to Kurono OS daemon\n");
+        return 1;
+    }
+    return status;
+}
+
+// stdout is fully buffered in batch mode and only flushed when full, before
+// anything goes to stderr, and at exit
+static bool kurono_os_batch_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    if (stream == OUTPUT_STREAM_STDERR) {
+        fflush(stdout);
+        return fwrite(data, 1, length, stderr) == length;
+    }
+    return fwrite(data, 1, length, stdout) == length;
+}
+
+static int kurono_os_batch_execute(void* userdata, const char* command_line) {
+    return kurono_os_handle_command((KuronoSession*)userdata, command_line);
+}
+
+static int kurono_os_run_batch(const char* path) {
+    // Must precede any output on stdout
+    setvbuf(stdout, NULL, _IOFBF, KURONO_BATCH_BUFFER_SIZE);
+    g_quiet = true;
+    kernel_set_quiet(true);
+    kurono_os_init();
+    
+    // No sink fd: pipelines must not splice past the buffered output
+    OutputSink writer = { kurono_os_batch_write, NULL, -1 };
+    KuronoSession batch = { g_kernel, g_kcl_ctx, &writer, false };
+    BatchSummary summary;
+    bool read = g_kernel && kurono_batch_run_file(path, kurono_os_batch_execute, &batch, &summary);
+    
+    fflush(stdout);
+    int status;
+    if (!g_kernel) {
+        status = 1;
+    } else if (!read) {
+        fprintf(stderr, "Cannot read batch input %s\n", path);
+        status = 1;
     } else {
-        printf("Command not found: %s\n", command);
+        if (summary.failures) {
+            fprintf(stderr, "%zu of %zu commands failed\n", summary.failures, summary.commands);
+        }
+        status = summary.status;
     }
     
-    free(conflicts);
-    free(command_copy);
+    kurono_os_shutdown();
+    fflush(stdout);
+    return status;
 }
 
 int main(int argc, char* argv[]) {
+    const char* socket_path = getenv("KURONO_SOCKET");
+    if (!socket_path) socket_path = KURONO_DAEMON_SOCKET;
+    
+    if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+        return kurono_os_run_client(socket_path, argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0) {
+        return kurono_os_run_daemon(socket_path);
+    }
+    if (argc > 2 && strcmp(argv[1], "--batch") == 0) {
+        return kurono_os_run_batch(argv[2]);
+    }
+    if (argc > 2 && strcmp(argv[1], "--kcl-compile") == 0) {
+        OutputSink terminal;
+        output_sink_init_stdio(&terminal);
+        KuronoSession offline = { NULL, NULL, &terminal, false };
+        int status = 0;
+        for (int i = 2; i < argc; i++) {
+            if (!kurono_os_compile_script(&offline, argv[i])) status = 1;
+        }
+        return status;
+    }
+    
     kurono_os_init();
     kurono_os_print_banner();
-    kurono_os_print_help();
+    
+    OutputSink terminal;
+    output_sink_init_stdio(&terminal);
+    KuronoSession console = { g_kernel, g_kcl_ctx, &terminal, true };
+    kurono_os_print_help(&console, NULL);
     
     char command_line[1024];
     
@@ -337,7 +826,7 @@ int main(int argc, char* argv[]) {
         }
         
         // Handle the command
-        kurono_os_handle_command(command_line);
+        kurono_os_handle_command(&console, command_line);
         
         printf("Kurono OS> ");
         fflush(stdout);
@@ -1,13 +1,43 @@
 #include "linux_bridge.h"
+#include "perfect_hash.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #ifdef _WIN32
 #include <direct.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/inotify.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #endif
 
-static const char* common_linux_commands[] = {
+#define LINUX_MAX_ARGS 64
+#define LINUX_ARGV_INLINE_STORAGE 1024
+#define LINUX_SESSION_VARS 3
+#define LINUX_SESSION_VAR_SIZE 256
+#define LINUX_MAX_ENV 1024
+
+static struct LinuxPathCache* linux_path_cache_create(void);
+static void linux_path_cache_destroy(struct LinuxPathCache* cache);
+
+static constexpr const char* common_linux_commands[] = {
     "ls", "dir", "cat", "grep", "find", "chmod", "chown", "mkdir", "rm", "cp", "mv",
     "ps", "kill", "top", "df", "du", "tar", "gzip", "wget", "curl", "ssh", "scp",
     "apt", "yum", "dnf", "pacman", "systemctl", "service", "ifconfig", "ip", "netstat",
@@ -15,9 +45,13 @@ static const char* common_linux_commands[] = {
     "vim", "nano", "emacs", "less", "more", "head", "tail", "sort", "uniq", "wc",
     "diff", "patch", "make", "gcc", "g++", "python", "python3", "perl", "ruby", "php",
     "git", "svn", "mercurial", "docker", "podman", "kubectl", "ansible", "terraform",
-    NULL
 };
 
+#define LINUX_COMMON_COMMAND_COUNT (sizeof(common_linux_commands) / sizeof(common_linux_commands[0]))
+
+static constexpr auto common_linux_index = perfect_hash_build<PERFECT_HASH_SLOTS(common_linux_commands)>(common_linux_commands);
+static_assert(common_linux_index.complete, "Common Linux commands must be unique");
+
 LinuxBridge* linux_bridge_create(const char* linux_root) {
     if (!linux_root) return NULL;
     
@@ -35,12 +69,16 @@ LinuxBridge* linux_bridge_create(const char* linux_root) {
     sprintf(bridge->lib_path, "%s/lib", linux_root);
     sprintf(bridge->etc_path, "%s/etc", linux_root);
     
+    bridge->path_cache = linux_path_cache_create();
+    bridge->zygote = NULL;
     return bridge;
 }
 
 void linux_bridge_destroy(LinuxBridge* bridge) {
     if (!bridge) return;
     
+    linux_bridge_stop_zygote(bridge);
+    linux_path_cache_destroy(bridge->path_cache);
     free(bridge->root_path);
     free(bridge->bin_path);
     free(bridge->usr_bin_path);
@@ -49,15 +87,22 @@ void linux_bridge_destroy(LinuxBridge* bridge) {
     free(bridge);
 }
 
+const char* const* linux_bridge_common_commands(size_t* count) {
+    if (count) *count = LINUX_COMMON_COMMAND_COUNT;
+    return common_linux_commands;
+}
+
+bool linux_bridge_is_known_command(const char* name) {
+    return perfect_hash_contains(common_linux_index, common_linux_commands, name);
+}
+
 bool linux_bridge_register_commands(LinuxBridge* bridge, CommandRegistry* registry) {
     if (!bridge || !registry) return false;
     
-    for (int i = 0; common_linux_commands[i] != NULL; i++) {
+    for (size_t i = 0; i < LINUX_COMMON_COMMAND_COUNT; i++) {
         char* full_path = linux_bridge_resolve_path(bridge, common_linux_commands[i]);
         if (full_path) {
-            char description[256];
-            snprintf(description, sizeof(description), "Linux command: %s", common_linux_commands[i]);
-            command_registry_add(registry, common_linux_commands[i], full_path, ENV_LINUX, description);
+            command_registry_add_template(registry, common_linux_commands[i], full_path, ENV_LINUX, "Linux command: %s");
             free(full_path);
         }
     }
@@ -65,61 +110,1061 @@ bool linux_bridge_register_commands(LinuxBridge* bridge, CommandRegistry* regist
     return true;
 }
 
-bool linux_bridge_execute_command(LinuxBridge* bridge, const char* command_line, char** output, char** error) {
-    if (!bridge || !command_line) return false;
+#ifdef __linux__
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* Names found in one directory, stored back to back with NUL separators. */
+typedef struct {
+    const char* dir_path;
+    OutputBuffer names;
+    size_t count;
+} LinuxDirScan;
+
+// Enumerates a directory through one fd with large getdents64 batches. Only
+// entries whose type the kernel did not report (or symlinks, which need their
+// target checked) cost an fstatat relative to that fd.
+static void* linux_scan_directory(void* arg) {
+    LinuxDirScan* scan = (LinuxDirScan*)arg;
+    int dir_fd = open(scan->dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0) return NULL;
+    
+    char buffer[65536] __attribute__((aligned(8)));
+    for (;;) {
+        long n = syscall(SYS_getdents64, dir_fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        
+        for (long offset = 0; offset < n;) {
+            const struct linux_dirent64* entry = (const struct linux_dirent64*)(buffer + offset);
+            offset += entry->d_reclen;
+            if (entry->d_name[0] == '.') continue;
+            
+            bool command = entry->d_type == DT_REG;
+            if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+                struct stat st;
+                command = fstatat(dir_fd, entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode);
+            }
+            
+            if (command && output_buffer_append(&scan->names, entry->d_name, strlen(entry->d_name) + 1)) {
+                scan->count++;
+            }
+        }
+    }
+    
+    close(dir_fd);
+    return NULL;
+}
+
+static bool linux_has_entry(CommandRegistry* registry, const char* name) {
+    CommandView view = command_registry_lookup(registry, name);
+    for (size_t i = 0; i < view.count; i++) {
+        if (view.entries[i]->env == ENV_LINUX) return true;
+    }
+    return false;
+}
+#endif
+
+bool linux_bridge_discover_commands(LinuxBridge* bridge, CommandRegistry* registry) {
+    if (!bridge || !registry) return false;
+    
+    #ifdef __linux__
+    LinuxDirScan scans[2] = {
+        { bridge->bin_path, { NULL, 0, 0 }, 0 },
+        { bridge->usr_bin_path, { NULL, 0, 0 }, 0 }
+    };
+    
+    // usr/bin is usually the large one; scan it on a second thread
+    pthread_t worker;
+    bool threaded = pthread_create(&worker, NULL, linux_scan_directory, &scans[1]) == 0;
+    linux_scan_directory(&scans[0]);
+    if (threaded) {
+        pthread_join(worker, NULL);
+    } else {
+        linux_scan_directory(&scans[1]);
+    }
+    
+    command_registry_reserve(registry, scans[0].count + scans[1].count);
+    
+    // bin is listed first so it wins over usr/bin, matching path resolution
+    char path[1024];
+    for (int d = 0; d < 2; d++) {
+        const char* name = scans[d].names.data;
+        for (size_t i = 0; i < scans[d].count; i++) {
+            size_t length = strlen(name);
+            if (!linux_has_entry(registry, name)) {
+                snprintf(path, sizeof(path), "%s/%s", scans[d].dir_path, name);
+                command_registry_add_template(registry, name, path, ENV_LINUX, "Linux command: %s");
+            }
+            name += length + 1;
+        }
+        output_buffer_free(&scans[d].names);
+    }
+    
+    return true;
+    #else
+    return linux_bridge_register_commands(bridge, registry);
+    #endif
+}
+
+#ifndef _WIN32
+// argv for posix_spawn, unquoted from the kernel's tokens into a stack buffer
+// unless the line is unusually long
+typedef struct {
+    char* argv[LINUX_MAX_ARGS];
+    char* storage;
+    char inline_storage[LINUX_ARGV_INLINE_STORAGE];
+} LinuxArgv;
+
+static const char* linux_argv_build(LinuxArgv* out, const CommandArgs* args) {
+    out->storage = out->inline_storage;
+    if (args->count == 0) return "Empty command";
+    if (args->count >= LINUX_MAX_ARGS) return "Too many arguments";
+    
+    size_t size = command_args_storage_size(args);
+    if (size > sizeof(out->inline_storage)) {
+        out->storage = (char*)malloc(size);
+        if (!out->storage) return "Out of memory";
+    }
+    command_args_argv(args, out->argv, LINUX_MAX_ARGS, out->storage, size);
+    return NULL;
+}
+
+static void linux_argv_free(LinuxArgv* out) {
+    if (out->storage != out->inline_storage) free(out->storage);
+}
+
+// What a command takes from the session that runs it: the working directory,
+// mapped under the bridge root, and the session's user and environment as
+// USER, LOGNAME and KURONO_ENV. Empty fields keep the caller's own; so does a
+// directory the bridge root does not have
+typedef struct {
+    char cwd[1024];
+    char vars[LINUX_SESSION_VARS][LINUX_SESSION_VAR_SIZE];
+} LinuxSession;
+
+static void linux_session_init(LinuxSession* session, const LinuxBridge* bridge, const KernelContext* ctx) {
+    session->cwd[0] = '\0';
+    for (int i = 0; i < LINUX_SESSION_VARS; i++) session->vars[i][0] = '\0';
+    if (!ctx) return;
+    
+    const char* dir = ctx->current_directory;
+    if (dir && *dir) {
+        snprintf(session->cwd, sizeof(session->cwd), "%s%s%s", bridge->root_path, dir[0] == '/' ? "" : "/", dir);
+        struct stat st;
+        if (stat(session->cwd, &st) != 0 || !S_ISDIR(st.st_mode)) session->cwd[0] = '\0';
+    }
+    if (ctx->current_user) {
+        snprintf(session->vars[0], LINUX_SESSION_VAR_SIZE, "USER=%s", ctx->current_user);
+        snprintf(session->vars[1], LINUX_SESSION_VAR_SIZE, "LOGNAME=%s", ctx->current_user);
+    }
+    const char* env = (ctx->current_env == ENV_LINUX) ? "linux" : (ctx->current_env == ENV_WINDOWS) ? "windows" : "kurono";
+    snprintf(session->vars[2], LINUX_SESSION_VAR_SIZE, "KURONO_ENV=%s", env);
+}
+
+// The caller's environment with the session variables replacing their own.
+// Only pointers are stored, so the zygote can build it without allocating
+static char* const* linux_session_envp(const char* const* vars, char** envp, size_t max) {
+    bool any = false;
+    for (int v = 0; v < LINUX_SESSION_VARS; v++) any = any || vars[v][0];
+    if (!any) return environ;
+    
+    size_t n = 0;
+    for (char** e = environ; *e && n + LINUX_SESSION_VARS + 1 < max; e++) {
+        bool replaced = false;
+        for (int v = 0; v < LINUX_SESSION_VARS && !replaced; v++) {
+            const char* eq = strchr(vars[v], '=');
+            replaced = eq && strncmp(*e, vars[v], (size_t)(eq - vars[v]) + 1) == 0;
+        }
+        if (!replaced) envp[n++] = *e;
+    }
+    for (int v = 0; v < LINUX_SESSION_VARS; v++) {
+        if (vars[v][0]) envp[n++] = (char*)vars[v];
+    }
+    envp[n] = NULL;
+    return envp;
+}
+
+// Starts the binary directly (no intermediate /bin/sh) with the given
+// descriptors as its stdin/stdout/stderr; -1 leaves the stream inherited.
+// Callers mark their own pipe ends close-on-exec so the child only keeps the
+// duplicated copies
+static int linux_start(const LinuxSession* session, const char* path, char* const* argv, int stdin_fd, int stdout_fd, int stderr_fd, pid_t* pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (stdin_fd >= 0) posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+    if (stdout_fd >= 0) posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+    if (stderr_fd >= 0) posix_spawn_file_actions_adddup2(&actions, stderr_fd, STDERR_FILENO);
+    #if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+    if (session->cwd[0]) posix_spawn_file_actions_addchdir_np(&actions, session->cwd);
+    #endif
+    
+    const char* vars[LINUX_SESSION_VARS];
+    for (int i = 0; i < LINUX_SESSION_VARS; i++) vars[i] = session->vars[i];
+    char* envp_storage[LINUX_MAX_ENV];
+    char* const* envp = linux_session_envp(vars, envp_storage, LINUX_MAX_ENV);
+    
+    // Children start with default signal handling even when the caller's
+    // thread has SIGPIPE blocked
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    #ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+    #endif
+    posix_spawnattr_setflags(&attr, flags);
+    
+    int rc = (strchr(path, '/') != NULL)
+        ? posix_spawn(pid, path, &actions, &attr, argv, envp)
+        : posix_spawnp(pid, path, &actions, &attr, argv, envp);
+    
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return rc;
+}
+
+#ifdef __linux__
+#define ZYGOTE_MAX_REQUEST 8192
+#define ZYGOTE_SPAWNED 1
+#define ZYGOTE_EXITED 2
+
+typedef struct {
+    int32_t type;
+    int32_t pid;
+    int32_t value;
+} LinuxZygoteMessage;
+
+/* Helper process forked once by linux_bridge_start_zygote. It launches
+ * commands on request over a SOCK_SEQPACKET socketpair: each request carries
+ * the session's directory and variables, the path and argv, plus the
+ * caller's stdin via SCM_RIGHTS, and the reply
+ * passes back the read ends of the child's stdout/stderr pipes. The helper
+ * reaps its children and reports their wait status, since the caller is not
+ * their parent.
+ *
+ * request_lock keeps one request in flight, so a reply always belongs to
+ * launching; it is held only for the exchange, and children run and are
+ * waited for concurrently. One thread at a time reads the socket, whichever
+ * needs a message first, and hands each message to the launch or waiter it
+ * belongs to under lock. */
+typedef struct LinuxZygoteWaiter {
+    pid_t pid;
+    int status;
+    int error;
+    int fds[3];
+    int fd_count;
+    bool spawned;
+    bool exited;
+    struct LinuxZygoteWaiter* next;
+} LinuxZygoteWaiter;
+
+struct LinuxZygote {
+    int socket_fd;
+    pid_t pid;
+    pthread_mutex_t request_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool reading;
+    bool broken;
+    LinuxZygoteWaiter* launching;
+    LinuxZygoteWaiter* waiters;
+};
+
+static bool zygote_send(int socket_fd, const void* data, size_t length, const int* fds, int fd_count) {
+    struct iovec iov = { (void*)data, length };
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    
+    if (fd_count > 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fd_count);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fd_count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fd_count);
+    }
+    
+    ssize_t n;
+    while ((n = sendmsg(socket_fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {
+    }
+    return n == (ssize_t)length;
+}
+
+// Returns the payload size (0 when the peer has gone away, -1 on error)
+static ssize_t zygote_receive(int socket_fd, void* data, size_t length, int* fds, int* fd_count) {
+    struct iovec iov = { data, length };
+    char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    
+    ssize_t n;
+    while ((n = recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {
+    }
+    
+    *fd_count = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            *fd_count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            if (*fd_count > 3) *fd_count = 3;
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * *fd_count);
+        }
+    }
+    return n;
+}
+
+// Runs in the helper. Nothing here allocates: the helper is forked from a
+// process that may have other threads, so the inherited heap is off limits.
+static void zygote_handle_request(int socket_fd, char* request, ssize_t length, const int* fds, int fd_count) {
+    // cwd, the session variables and path lead the request, then argv
+    const char* header[LINUX_SESSION_VARS + 2] = { NULL };
+    int header_count = 0;
+    char* p = request;
+    for (; p < request + length && header_count < LINUX_SESSION_VARS + 2; p += strlen(p) + 1) {
+        header[header_count++] = p;
+    }
+    
+    char* argv[LINUX_MAX_ARGS];
+    int argc = 0;
+    for (; p < request + length && argc < LINUX_MAX_ARGS - 1; p += strlen(p) + 1) {
+        argv[argc++] = p;
+    }
+    argv[argc] = NULL;
+    if (header_count < LINUX_SESSION_VARS + 2) argc = 0;
+    
+    const char* cwd = header[0];
+    const char* path = header[LINUX_SESSION_VARS + 1];
+    char* envp_storage[LINUX_MAX_ENV];
+    char* const* envp = argc ? linux_session_envp(header + 1, envp_storage, LINUX_MAX_ENV) : NULL;
+    
+    LinuxZygoteMessage reply = { ZYGOTE_SPAWNED, -1, 0 };
+    int out_pipe[2] = { -1, -1 };
+    int err_pipe[2] = { -1, -1 };
+    if (argc == 0 || fd_count != 1 || pipe2(out_pipe, O_CLOEXEC) != 0 || pipe2(err_pipe, O_CLOEXEC) != 0) {
+        reply.value = (argc == 0 || fd_count != 1) ? EINVAL : errno;
+        if (out_pipe[0] >= 0) {
+            close(out_pipe[0]);
+            close(out_pipe[1]);
+        }
+        zygote_send(socket_fd, &reply, sizeof(reply), NULL, 0);
+    } else {
+        volatile int exec_error = 0;
+        pid_t pid = vfork();
+        if (pid == 0) {
+            sigset_t none;
+            sigemptyset(&none);
+            sigprocmask(SIG_SETMASK, &none, NULL);
+            signal(SIGINT, SIG_DFL);
+            dup2(fds[0], STDIN_FILENO);
+            dup2(out_pipe[1], STDOUT_FILENO);
+            dup2(err_pipe[1], STDERR_FILENO);
+            if (cwd[0] && chdir(cwd) != 0) {
+                exec_error = errno;
+                _exit(127);
+            }
+            if (strchr(path, '/')) execve(path, argv, envp);
+            else execvpe(path, argv, envp);
+            exec_error = errno;
+            _exit(127);
+        }
+        
+        reply.pid = pid;
+        reply.value = pid < 0 ? errno : exec_error;
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        int reply_fds[2] = { out_pipe[0], err_pipe[0] };
+        zygote_send(socket_fd, &reply, sizeof(reply), reply_fds, pid < 0 ? 0 : 2);
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+    }
+    
+    for (int i = 0; i < fd_count; i++) close(fds[i]);
+}
+
+static void zygote_main(int socket_fd) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    signal(SIGINT, SIG_IGN);
+    
+    // Keep only the control socket and stdio
+    for (int fd = 3; fd < 1024; fd++) {
+        if (fd != socket_fd) close(fd);
+    }
+    
+    sigset_t child_mask;
+    sigemptyset(&child_mask);
+    sigaddset(&child_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &child_mask, NULL);
+    int signal_fd = signalfd(-1, &child_mask, SFD_CLOEXEC);
+    
+    char request[ZYGOTE_MAX_REQUEST];
+    struct pollfd fds[2] = {
+        { socket_fd, POLLIN, 0 },
+        { signal_fd, POLLIN, 0 }
+    };
+    
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) < 0 && errno == EINTR) {
+            }
+            
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                LinuxZygoteMessage exited = { ZYGOTE_EXITED, pid, status };
+                zygote_send(socket_fd, &exited, sizeof(exited), NULL, 0);
+            }
+        }
+        
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            int received[3];
+            int received_count = 0;
+            ssize_t n = zygote_receive(socket_fd, request, sizeof(request) - 1, received, &received_count);
+            if (n <= 0) break;
+            request[n] = '\0';
+            zygote_handle_request(socket_fd, request, n, received, received_count);
+        }
+    }
+    
+    _exit(0);
+}
+
+bool linux_bridge_start_zygote(LinuxBridge* bridge) {
+    if (!bridge) return false;
+    if (bridge->zygote) return true;
+    
+    struct LinuxZygote* zygote = (struct LinuxZygote*)malloc(sizeof(struct LinuxZygote));
+    if (!zygote) return false;
+    
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        free(zygote);
+        return false;
+    }
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sockets[0]);
+        zygote_main(sockets[1]);
+    }
+    close(sockets[1]);
+    
+    if (pid < 0) {
+        close(sockets[0]);
+        free(zygote);
+        return false;
+    }
+    
+    zygote->socket_fd = sockets[0];
+    zygote->pid = pid;
+    pthread_mutex_init(&zygote->request_lock, NULL);
+    pthread_mutex_init(&zygote->lock, NULL);
+    pthread_cond_init(&zygote->changed, NULL);
+    zygote->reading = false;
+    zygote->broken = false;
+    zygote->launching = NULL;
+    zygote->waiters = NULL;
+    bridge->zygote = zygote;
+    return true;
+}
+
+void linux_bridge_stop_zygote(LinuxBridge* bridge) {
+    if (!bridge || !bridge->zygote) return;
+    
+    struct LinuxZygote* zygote = bridge->zygote;
+    close(zygote->socket_fd);
+    while (waitpid(zygote->pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    pthread_cond_destroy(&zygote->changed);
+    pthread_mutex_destroy(&zygote->lock);
+    pthread_mutex_destroy(&zygote->request_lock);
+    free(zygote);
+    bridge->zygote = NULL;
+}
+
+static void zygote_unlink(struct LinuxZygote* zygote, LinuxZygoteWaiter* waiter) {
+    for (LinuxZygoteWaiter** link = &zygote->waiters; *link; link = &(*link)->next) {
+        if (*link == waiter) {
+            *link = waiter->next;
+            return;
+        }
+    }
+}
+
+// Receives one message and delivers it. Called with lock held; the lock is
+// dropped while blocked on the socket so others can register and wait.
+static void zygote_pump(struct LinuxZygote* zygote) {
+    zygote->reading = true;
+    pthread_mutex_unlock(&zygote->lock);
+    
+    LinuxZygoteMessage message;
+    int fds[3];
+    int fd_count = 0;
+    ssize_t n = zygote_receive(zygote->socket_fd, &message, sizeof(message), fds, &fd_count);
+    
+    pthread_mutex_lock(&zygote->lock);
+    zygote->reading = false;
+    LinuxZygoteWaiter* launching = zygote->launching;
+    if (n != (ssize_t)sizeof(message)) {
+        zygote->broken = true;
+    } else if (message.type == ZYGOTE_SPAWNED && launching) {
+        // The child cannot be reported as exited before this reply, so its
+        // waiter is registered before any message for it can arrive
+        launching->pid = message.pid;
+        launching->error = message.value;
+        launching->fd_count = fd_count;
+        memcpy(launching->fds, fds, sizeof(int) * fd_count);
+        launching->spawned = true;
+        fd_count = 0;
+        if (message.pid > 0) {
+            launching->next = zygote->waiters;
+            zygote->waiters = launching;
+        }
+        zygote->launching = NULL;
+    } else if (message.type == ZYGOTE_EXITED) {
+        for (LinuxZygoteWaiter* waiter = zygote->waiters; waiter; waiter = waiter->next) {
+            if (waiter->pid != message.pid) continue;
+            waiter->status = message.value;
+            waiter->exited = true;
+            zygote_unlink(zygote, waiter);
+            break;
+        }
+    }
+    for (int i = 0; i < fd_count; i++) close(fds[i]);
+    pthread_cond_broadcast(&zygote->changed);
+}
+
+// Waits with lock held until *done, reading the socket whenever no one else is
+static void zygote_await(struct LinuxZygote* zygote, const bool* done) {
+    while (!*done && !zygote->broken) {
+        if (zygote->reading) pthread_cond_wait(&zygote->changed, &zygote->lock);
+        else zygote_pump(zygote);
+    }
+}
+
+// Asks the helper to start the command. On success with a pid, waiter stays
+// registered until zygote_wait collects the child's status.
+static int zygote_launch(struct LinuxZygote* zygote, LinuxZygoteWaiter* waiter, const LinuxSession* session, const char* path, char* const* argv, int* out_fd, int* err_fd, pid_t* pid) {
+    char request[ZYGOTE_MAX_REQUEST];
+    size_t length = 0;
+    const char* parts[LINUX_SESSION_VARS + LINUX_MAX_ARGS + 2];
+    int part_count = 0;
+    parts[part_count++] = session->cwd;
+    for (int i = 0; i < LINUX_SESSION_VARS; i++) parts[part_count++] = session->vars[i];
+    parts[part_count++] = path;
+    for (int i = 0; argv[i] && i < LINUX_MAX_ARGS; i++) parts[part_count++] = argv[i];
+    
+    for (int i = 0; i < part_count; i++) {
+        size_t part_length = strlen(parts[i]) + 1;
+        if (length + part_length > sizeof(request)) return E2BIG;
+        memcpy(request + length, parts[i], part_length);
+        length += part_length;
+    }
+    
+    memset(waiter, 0, sizeof(*waiter));
+    waiter->pid = -1;
+    pthread_mutex_lock(&zygote->request_lock);
+    pthread_mutex_lock(&zygote->lock);
+    zygote->launching = waiter;
+    pthread_mutex_unlock(&zygote->lock);
+    
+    int stdin_fd = STDIN_FILENO;
+    int rc = 0;
+    if (!zygote_send(zygote->socket_fd, request, length, &stdin_fd, 1)) rc = errno ? errno : EPIPE;
+    
+    pthread_mutex_lock(&zygote->lock);
+    if (rc == 0) zygote_await(zygote, &waiter->spawned);
+    if (!waiter->spawned) {
+        zygote->launching = NULL;
+        if (rc == 0) rc = EPROTO;
+    }
+    pthread_mutex_unlock(&zygote->lock);
+    pthread_mutex_unlock(&zygote->request_lock);
+    if (rc != 0) return rc;
+    
+    *pid = waiter->pid;
+    *out_fd = waiter->fd_count > 0 ? waiter->fds[0] : -1;
+    *err_fd = waiter->fd_count > 1 ? waiter->fds[1] : -1;
+    for (int i = 2; i < waiter->fd_count; i++) close(waiter->fds[i]);
+    return waiter->error;
+}
+
+static int zygote_wait(struct LinuxZygote* zygote, LinuxZygoteWaiter* waiter) {
+    pthread_mutex_lock(&zygote->lock);
+    zygote_await(zygote, &waiter->exited);
+    if (!waiter->exited) zygote_unlink(zygote, waiter);
+    pthread_mutex_unlock(&zygote->lock);
+    return waiter->exited ? waiter->status : -1;
+}
+#else
+bool linux_bridge_start_zygote(LinuxBridge* bridge) {
+    return false;
+}
+
+void linux_bridge_stop_zygote(LinuxBridge* bridge) {
+}
+#endif
+
+// Forwards both pipes to the sink until EOF. Output is only read while the
+// sink keeps up, so a slow consumer stalls the child on its pipe rather than
+// buffering. Returns false if the sink asked to stop.
+static bool linux_forward_output(int out_fd, int err_fd, OutputSink* sink) {
+    OutputBuffer chunk;
+    output_buffer_init(&chunk);
+    struct pollfd fds[2] = {
+        { out_fd, POLLIN, 0 },
+        { err_fd, POLLIN, 0 }
+    };
+    const OutputStream streams[2] = { OUTPUT_STREAM_STDOUT, OUTPUT_STREAM_STDERR };
+    int open_fds = 2;
+    bool stopped = false;
+    
+    while (open_fds > 0 && !stopped) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        for (int i = 0; i < 2 && !stopped; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            
+            chunk.length = 0;
+            long n = output_buffer_read_fd(&chunk, fds[i].fd);
+            if (n > 0) {
+                stopped = !sink->write(sink, streams[i], chunk.data, chunk.length);
+            } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_fds--;
+            }
+        }
+    }
+    
+    output_buffer_free(&chunk);
+    for (int i = 0; i < 2; i++) {
+        if (fds[i].fd >= 0) close(fds[i].fd);
+    }
+    return !stopped;
+}
+
+// Runs the binary directly (no intermediate /bin/sh), through the zygote
+// when one is running, and streams its output to the sink
+static ExecutionResult* linux_spawn(LinuxBridge* bridge, const LinuxSession* session, const char* path, char* const* argv, OutputSink* sink) {
+    ExecutionResult* result = execution_result_create();
+    if (!result) return NULL;
+    
+    int out_fd = -1;
+    int err_fd = -1;
+    pid_t pid = -1;
+    int rc;
+    
+    #ifdef __linux__
+    struct LinuxZygote* zygote = bridge->zygote;
+    LinuxZygoteWaiter waiter;
+    if (zygote) {
+        rc = zygote_launch(zygote, &waiter, session, path, argv, &out_fd, &err_fd, &pid);
+    } else
+    #endif
+    {
+        int out_pipe[2] = { -1, -1 };
+        int err_pipe[2] = { -1, -1 };
+        // Created close-on-exec: a child spawned on another thread must not
+        // inherit the write ends, or this command never sees EOF
+        if (pipe2(out_pipe, O_CLOEXEC) != 0 || pipe2(err_pipe, O_CLOEXEC) != 0) {
+            if (out_pipe[0] >= 0) { close(out_pipe[0]); close(out_pipe[1]); }
+            execution_result_set_static_error(result, "Failed to create output pipes");
+            return result;
+        }
+        
+        rc = linux_start(session, path, argv, -1, out_pipe[1], err_pipe[1], &pid);
+        close(out_pipe[1]);
+        close(err_pipe[1]);
+        out_fd = out_pipe[0];
+        err_fd = err_pipe[0];
+        if (rc != 0) pid = -1;
+    }
+    
+    bool stopped = false;
+    if (rc == 0 && out_fd >= 0 && err_fd >= 0) {
+        stopped = !linux_forward_output(out_fd, err_fd, sink);
+        if (stopped) kill(pid, SIGTERM);
+    } else {
+        if (out_fd >= 0) close(out_fd);
+        if (err_fd >= 0) close(err_fd);
+        if (rc == 0) rc = EPROTO;
+    }
+    
+    int status = -1;
+    #ifdef __linux__
+    if (zygote) {
+        if (pid > 0) status = zygote_wait(zygote, &waiter);
+    } else
+    #endif
+    if (pid > 0) {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+    }
+    
+    if (rc != 0) {
+        execution_result_append_error(result, "Failed to launch %s: %s", path, strerror(rc));
+        result->exit_code = 127;
+        return result;
+    }
+    
+    if (status != -1 && WIFEXITED(status)) {
+        result->exit_code = WEXITSTATUS(status);
+    } else if (status != -1 && WIFSIGNALED(status)) {
+        result->exit_code = 128 + WTERMSIG(status);
+    }
+    
+    result->result = (result->exit_code == 0 && !stopped) ? CMD_SUCCESS : CMD_EXECUTION_FAILED;
+    if (stopped) {
+        execution_result_set_static_error(result, "Command stopped: output consumer rejected data");
+    }
+    return result;
+}
+#endif
+
+ExecutionResult* linux_bridge_run(LinuxBridge* bridge, const char* command_line, const char* resolved_path) {
+    OutputCapture capture;
+    output_capture_init(&capture);
+    
+    ExecutionResult* result = linux_bridge_run_streaming(bridge, command_line, resolved_path, &capture.sink);
+    output_capture_finish(&capture, result);
+    return result;
+}
+
+ExecutionResult* linux_bridge_run_streaming(LinuxBridge* bridge, const char* command_line, const char* resolved_path, OutputSink* sink) {
+    if (!bridge || !command_line || !sink) return NULL;
+    
+    CommandArgs args;
+    if (!command_args_parse(&args, command_line)) {
+        ExecutionResult* result = execution_result_create();
+        if (result) execution_result_set_static_error(result, "Unterminated quote in command line");
+        return result;
+    }
+    
+    ExecutionResult* result = linux_bridge_run_args(bridge, NULL, &args, resolved_path, sink);
+    command_args_free(&args);
+    return result;
+}
+
+ExecutionResult* linux_bridge_run_args(LinuxBridge* bridge, const KernelContext* ctx, const CommandArgs* args, const char* resolved_path, OutputSink* sink) {
+    if (!bridge || !args || !sink) return NULL;
     
     #ifdef _WIN32
+    ExecutionResult* result = execution_result_create();
+    if (!result) return NULL;
+    
     char cmd[1024];
-    snprintf(cmd, sizeof(cmd), "wsl -d KuronoLinux %s", command_line);
+    snprintf(cmd, sizeof(cmd), "wsl -d KuronoLinux %s", args->line);
     FILE* pipe = _popen(cmd, "r");
     if (!pipe) {
-        if (error) *error = strdup("Failed to execute WSL command");
-        return false;
+        execution_result_set_static_error(result, "Failed to execute WSL command");
+        return result;
     }
-    char buffer[1024];
-    char* result = (char*)malloc(1);
-    result[0] = '\0';
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL) {
-        result = (char*)realloc(result, strlen(result) + strlen(buffer) + 1);
-        strcat(result, buffer);
+    OutputBuffer chunk;
+    output_buffer_init(&chunk);
+    bool stopped = false;
+    while (!stopped && output_buffer_reserve(&chunk, OUTPUT_BUFFER_READ_SIZE)) {
+        size_t n = fread(chunk.data, 1, OUTPUT_BUFFER_READ_SIZE, pipe);
+        if (n == 0) break;
+        stopped = !sink->write(sink, OUTPUT_STREAM_STDOUT, chunk.data, n);
     }
-    _pclose(pipe);
-    if (output) *output = result; else free(result);
-    return true;
+    output_buffer_free(&chunk);
+    result->exit_code = _pclose(pipe);
+    result->result = (result->exit_code == 0 && !stopped) ? CMD_SUCCESS : CMD_EXECUTION_FAILED;
+    return result;
     #else
-    int rc = system(command_line);
-    if (rc != 0) {
+    LinuxArgv argv;
+    const char* invalid = linux_argv_build(&argv, args);
+    if (invalid) {
+        linux_argv_free(&argv);
+        ExecutionResult* result = execution_result_create();
+        if (result) execution_result_set_static_error(result, invalid);
+        return result;
+    }
+    
+    // Prefer the bridge's own root; names it does not provide fall back to a
+    // PATH search, as the old system() call did
+    char* bridge_path = resolved_path ? NULL : linux_bridge_resolve_path(bridge, argv.argv[0]);
+    const char* path = resolved_path ? resolved_path : bridge_path ? bridge_path : argv.argv[0];
+    
+    LinuxSession session;
+    linux_session_init(&session, bridge, ctx);
+    ExecutionResult* result = linux_spawn(bridge, &session, path, argv.argv, sink);
+    
+    free(bridge_path);
+    linux_argv_free(&argv);
+    return result;
+    #endif
+}
+
+long linux_bridge_spawn(LinuxBridge* bridge, const char* command_line, const char* resolved_path, int stdin_fd, int stdout_fd, int stderr_fd, char** error) {
+    if (!bridge || !command_line) return -1;
+    
+    CommandArgs args;
+    if (!command_args_parse(&args, command_line)) {
+        if (error) *error = strdup("Unterminated quote in command line");
+        return -1;
+    }
+    
+    long pid = linux_bridge_spawn_args(bridge, NULL, &args, resolved_path, stdin_fd, stdout_fd, stderr_fd, error);
+    command_args_free(&args);
+    return pid;
+}
+
+long linux_bridge_spawn_args(LinuxBridge* bridge, const KernelContext* ctx, const CommandArgs* args, const char* resolved_path, int stdin_fd, int stdout_fd, int stderr_fd, char** error) {
+    if (!bridge || !args) return -1;
+    
+    #ifdef _WIN32
+    if (error) *error = strdup("Descriptor-level launch is not supported on this platform");
+    return -1;
+    #else
+    LinuxArgv argv;
+    const char* invalid = linux_argv_build(&argv, args);
+    if (invalid) {
+        linux_argv_free(&argv);
+        if (error) *error = strdup(invalid);
+        return -1;
+    }
+    
+    char* bridge_path = resolved_path ? NULL : linux_bridge_resolve_path(bridge, argv.argv[0]);
+    const char* path = resolved_path ? resolved_path : bridge_path ? bridge_path : argv.argv[0];
+    
+    LinuxSession session;
+    linux_session_init(&session, bridge, ctx);
+    pid_t pid;
+    int rc = linux_start(&session, path, argv.argv, stdin_fd, stdout_fd, stderr_fd, &pid);
+    if (rc != 0 && error) {
+        char message[256];
+        snprintf(message, sizeof(message), "Failed to launch %s: %s", path, strerror(rc));
+        *error = strdup(message);
+    }
+    
+    free(bridge_path);
+    linux_argv_free(&argv);
+    return rc == 0 ? (long)pid : -1;
+    #endif
+}
+
+bool linux_bridge_execute_command(LinuxBridge* bridge, const char* command_line, char** output, char** error) {
+    if (!bridge || !command_line) return false;
+    
+    ExecutionResult* result = linux_bridge_run(bridge, command_line, NULL);
+    if (!result) {
         if (error) *error = strdup("Linux command failed");
         return false;
     }
-    if (output) *output = strdup("Linux command executed successfully");
+    
+    bool success = result->result == CMD_SUCCESS;
+    if (output) *output = execution_result_take_output(result);
+    if (error) {
+        *error = execution_result_take_error(result);
+        if (!*error && !success) *error = strdup("Linux command failed");
+    }
+    
+    execution_result_destroy(result);
+    return success;
+}
+
+#ifdef __linux__
+#define PATH_CACHE_INITIAL_SLOTS 128
+#define PATH_CACHE_MAX_ENTRIES 4096
+
+typedef struct {
+    char* name;
+    char* path;
+    uint32_t hash;
+    bool executable;
+} LinuxPathCacheEntry;
+
+/* Open-addressing table guarded by lock. The watcher thread clears it and
+ * bumps generation whenever anything changes in a watched directory, so a
+ * lookup that resolved against an older generation is not cached. */
+struct LinuxPathCache {
+    LinuxPathCacheEntry* slots;
+    size_t slot_count;
+    size_t count;
+    uint64_t generation;
+    bool watching;
+    bool watcher_started;
+    int inotify_fd;
+    int wake_pipe[2];
+    pthread_t watcher;
+    pthread_mutex_t lock;
+};
+
+static uint32_t linux_path_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void linux_path_cache_clear(struct LinuxPathCache* cache) {
+    for (size_t i = 0; i < cache->slot_count; i++) {
+        free(cache->slots[i].name);
+        free(cache->slots[i].path);
+    }
+    memset(cache->slots, 0, sizeof(LinuxPathCacheEntry) * cache->slot_count);
+    cache->count = 0;
+}
+
+static LinuxPathCacheEntry* linux_path_cache_slot(LinuxPathCacheEntry* slots, size_t slot_count, const char* name, uint32_t hash) {
+    size_t mask = slot_count - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        if (!slots[i].name || (slots[i].hash == hash && strcmp(slots[i].name, name) == 0)) {
+            return &slots[i];
+        }
+    }
+}
+
+static bool linux_path_cache_grow(struct LinuxPathCache* cache) {
+    size_t slot_count = cache->slot_count * 2;
+    LinuxPathCacheEntry* slots = (LinuxPathCacheEntry*)calloc(slot_count, sizeof(LinuxPathCacheEntry));
+    if (!slots) return false;
+    
+    for (size_t i = 0; i < cache->slot_count; i++) {
+        if (cache->slots[i].name) {
+            *linux_path_cache_slot(slots, slot_count, cache->slots[i].name, cache->slots[i].hash) = cache->slots[i];
+        }
+    }
+    
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slot_count = slot_count;
     return true;
-    #endif
 }
 
-bool linux_bridge_is_command_available(LinuxBridge* bridge, const char* command) {
-    if (!bridge || !command) return false;
+static void* linux_path_cache_watch(void* arg) {
+    struct LinuxPathCache* cache = (struct LinuxPathCache*)arg;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd fds[2] = {
+        { cache->inotify_fd, POLLIN, 0 },
+        { cache->wake_pipe[0], POLLIN, 0 }
+    };
     
-    char* path = linux_bridge_resolve_path(bridge, command);
-    if (!path) return false;
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents) break;
+        
+        bool watch_lost = false;
+        ssize_t n;
+        while ((n = read(cache->inotify_fd, events, sizeof(events))) > 0) {
+            for (char* p = events; p < events + n;) {
+                const struct inotify_event* event = (const struct inotify_event*)p;
+                if (event->mask & IN_IGNORED) watch_lost = true;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        
+        pthread_mutex_lock(&cache->lock);
+        linux_path_cache_clear(cache);
+        cache->generation++;
+        if (watch_lost) cache->watching = false;
+        pthread_mutex_unlock(&cache->lock);
+    }
     
-    struct stat st;
-    bool exists = false;
-    if (stat(path, &st) == 0) {
-        #ifdef _WIN32
-        exists = true;
-        #else
-        exists = (st.st_mode & S_IXUSR);
-        #endif
+    return NULL;
+}
+
+static struct LinuxPathCache* linux_path_cache_create(void) {
+    struct LinuxPathCache* cache = (struct LinuxPathCache*)calloc(1, sizeof(struct LinuxPathCache));
+    if (!cache) return NULL;
+    
+    cache->slots = (LinuxPathCacheEntry*)calloc(PATH_CACHE_INITIAL_SLOTS, sizeof(LinuxPathCacheEntry));
+    cache->slot_count = PATH_CACHE_INITIAL_SLOTS;
+    cache->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    cache->wake_pipe[0] = cache->wake_pipe[1] = -1;
+    
+    if (!cache->slots || cache->inotify_fd < 0 || pipe2(cache->wake_pipe, O_CLOEXEC) != 0) {
+        if (cache->inotify_fd >= 0) close(cache->inotify_fd);
+        free(cache->slots);
+        free(cache);
+        return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static void linux_path_cache_destroy(struct LinuxPathCache* cache) {
+    if (!cache) return;
+    
+    if (cache->watcher_started) {
+        char wake = 1;
+        ssize_t written = write(cache->wake_pipe[1], &wake, 1);
+        (void)written;
+        pthread_join(cache->watcher, NULL);
     }
-    free(path);
     
-    return exists;
+    close(cache->inotify_fd);
+    close(cache->wake_pipe[0]);
+    close(cache->wake_pipe[1]);
+    linux_path_cache_clear(cache);
+    free(cache->slots);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
 }
 
-char* linux_bridge_resolve_path(LinuxBridge* bridge, const char* command) {
-    if (!bridge || !command) return NULL;
+// Caching is only safe while both bin directories are watched; until they
+// exist (e.g. before the filesystem is mounted) every lookup hits the disk.
+// Called with the lock held.
+static bool linux_path_cache_arm(LinuxBridge* bridge) {
+    struct LinuxPathCache* cache = bridge->path_cache;
+    if (cache->watching) return true;
     
+    const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |
+                          IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF;
+    if (inotify_add_watch(cache->inotify_fd, bridge->bin_path, mask) < 0 ||
+        inotify_add_watch(cache->inotify_fd, bridge->usr_bin_path, mask) < 0) {
+        return false;
+    }
+    
+    if (!cache->watcher_started) {
+        if (pthread_create(&cache->watcher, NULL, linux_path_cache_watch, cache) != 0) return false;
+        cache->watcher_started = true;
+    }
+    
+    cache->watching = true;
+    return true;
+}
+#else
+static struct LinuxPathCache* linux_path_cache_create(void) {
+    return NULL;
+}
+
+static void linux_path_cache_destroy(struct LinuxPathCache* cache) {
+}
+#endif
+
+// Looks the name up on disk: bin first, then usr/bin
+static char* linux_resolve_uncached(LinuxBridge* bridge, const char* command, bool* executable) {
     char* paths[] = { bridge->bin_path, bridge->usr_bin_path };
     
     for (int i = 0; i < 2; i++) {
@@ -128,14 +1173,94 @@ char* linux_bridge_resolve_path(LinuxBridge* bridge, const char* command) {
         
         struct stat st;
         if (stat(full_path, &st) == 0) {
+            #ifdef _WIN32
+            *executable = true;
+            #else
+            *executable = (st.st_mode & S_IXUSR) != 0;
+            #endif
             return full_path;
         }
         free(full_path);
     }
     
+    *executable = false;
     return NULL;
 }
 
+// Resolves through the cache. *path receives a copy the caller frees (pass
+// NULL when only availability matters). Returns whether the name exists.
+static bool linux_resolve(LinuxBridge* bridge, const char* command, char** path, bool* executable) {
+    #ifdef __linux__
+    struct LinuxPathCache* cache = bridge->path_cache;
+    if (cache) {
+        uint32_t hash = linux_path_hash(command);
+        
+        pthread_mutex_lock(&cache->lock);
+        bool armed = linux_path_cache_arm(bridge);
+        if (armed) {
+            LinuxPathCacheEntry* entry = linux_path_cache_slot(cache->slots, cache->slot_count, command, hash);
+            if (entry->name) {
+                bool found = entry->path != NULL;
+                if (path) *path = found ? strdup(entry->path) : NULL;
+                *executable = entry->executable;
+                pthread_mutex_unlock(&cache->lock);
+                return found;
+            }
+        }
+        uint64_t generation = cache->generation;
+        pthread_mutex_unlock(&cache->lock);
+        
+        char* resolved = linux_resolve_uncached(bridge, command, executable);
+        
+        // Only publish the answer if no directory changed while resolving it
+        pthread_mutex_lock(&cache->lock);
+        if (armed && cache->watching && cache->generation == generation) {
+            if (cache->count >= PATH_CACHE_MAX_ENTRIES) {
+                linux_path_cache_clear(cache);
+            }
+            if ((cache->count + 1) * 2 <= cache->slot_count || linux_path_cache_grow(cache)) {
+                LinuxPathCacheEntry* entry = linux_path_cache_slot(cache->slots, cache->slot_count, command, hash);
+                if (!entry->name) {
+                    entry->name = strdup(command);
+                    entry->path = resolved ? strdup(resolved) : NULL;
+                    entry->hash = hash;
+                    entry->executable = *executable;
+                    cache->count++;
+                }
+            }
+        }
+        pthread_mutex_unlock(&cache->lock);
+        
+        bool found = resolved != NULL;
+        if (path) *path = resolved;
+        else free(resolved);
+        return found;
+    }
+    #endif
+    
+    char* resolved = linux_resolve_uncached(bridge, command, executable);
+    bool found = resolved != NULL;
+    if (path) *path = resolved;
+    else free(resolved);
+    return found;
+}
+
+bool linux_bridge_is_command_available(LinuxBridge* bridge, const char* command) {
+    if (!bridge || !command) return false;
+    
+    bool executable = false;
+    return linux_resolve(bridge, command, NULL, &executable) && executable;
+}
+
+char* linux_bridge_resolve_path(LinuxBridge* bridge, const char* command) {
+    if (!bridge || !command) return NULL;
+    
+    char* path = NULL;
+    bool executable = false;
+    linux_resolve(bridge, command, &path, &executable);
+    return path;
+}
+
 bool linux_bridge_mount_filesystem(LinuxBridge* bridge) {
     if (!bridge) return false;
     
@@ -152,9 +1277,11 @@ bool linux_bridge_mount_filesystem(LinuxBridge* bridge) {
         #endif
     }
     
-    char* dirs[] = { bridge->bin_path, bridge->usr_bin_path, bridge->lib_path, bridge->etc_path };
+    char usr_path[1024];
+    snprintf(usr_path, sizeof(usr_path), "%s/usr", bridge->root_path);
+    char* dirs[] = { bridge->bin_path, usr_path, bridge->usr_bin_path, bridge->lib_path, bridge->etc_path };
     
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < 5; i++) {
         if (stat(dirs[i], &st) != 0) {
             #ifdef _WIN32
             if (_mkdir(dirs[i]) != 0) {
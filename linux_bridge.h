@@ -4,23 +4,64 @@
 #include "kernel.h"
 #include <stdbool.h>
 
+/* Name -> resolved path cache, kept valid by an inotify watch on the bin
+ * directories (Linux only; elsewhere every lookup goes to the filesystem). */
+struct LinuxPathCache;
+struct LinuxZygote;
+
 typedef struct {
     char* root_path;
     char* bin_path;
     char* usr_bin_path;
     char* lib_path;
     char* etc_path;
+    struct LinuxPathCache* path_cache;
+    struct LinuxZygote* zygote;
 } LinuxBridge;
 
 LinuxBridge* linux_bridge_create(const char* linux_root);
 void linux_bridge_destroy(LinuxBridge* bridge);
 
+/* The built-in list of common commands, and a compile-time perfect hash
+ * membership test against it. */
+const char* const* linux_bridge_common_commands(size_t* count);
+bool linux_bridge_is_known_command(const char* name);
 bool linux_bridge_register_commands(LinuxBridge* bridge, CommandRegistry* registry);
+
+/* Registers every binary in bin and usr/bin rather than only the common
+ * command list. Falls back to linux_bridge_register_commands on platforms
+ * without getdents64. */
+bool linux_bridge_discover_commands(LinuxBridge* bridge, CommandRegistry* registry);
 bool linux_bridge_execute_command(LinuxBridge* bridge, const char* command_line, char** output, char** error);
 
+/* Runs a command and reports its captured stdout, stderr and exit status.
+ * resolved_path may be NULL, in which case the name is resolved under the
+ * bridge root before falling back to PATH. The streaming variant forwards
+ * output to the sink as it is produced instead of collecting it. */
+ExecutionResult* linux_bridge_run(LinuxBridge* bridge, const char* command_line, const char* resolved_path);
+ExecutionResult* linux_bridge_run_streaming(LinuxBridge* bridge, const char* command_line, const char* resolved_path, OutputSink* sink);
+/* Same, for arguments the kernel already parsed; nothing re-tokenizes the
+ * line and posix_spawn gets argv unquoted straight from the tokens. The
+ * command runs in ctx's directory under the bridge root when that exists,
+ * with USER, LOGNAME and KURONO_ENV taken from ctx; a NULL ctx inherits the
+ * caller's. */
+ExecutionResult* linux_bridge_run_args(LinuxBridge* bridge, const KernelContext* ctx, const CommandArgs* args, const char* resolved_path, OutputSink* sink);
+
+/* Starts a command on caller-supplied descriptors (-1 inherits) without
+ * waiting for it; used as the Linux pipeline stage launcher. Returns the
+ * process id, or -1 with *error set. */
+long linux_bridge_spawn(LinuxBridge* bridge, const char* command_line, const char* resolved_path, int stdin_fd, int stdout_fd, int stderr_fd, char** error);
+long linux_bridge_spawn_args(LinuxBridge* bridge, const KernelContext* ctx, const CommandArgs* args, const char* resolved_path, int stdin_fd, int stdout_fd, int stderr_fd, char** error);
+
 bool linux_bridge_is_command_available(LinuxBridge* bridge, const char* command);
 char* linux_bridge_resolve_path(LinuxBridge* bridge, const char* command);
 
+/* Optional launch helper for tight loops of short commands. Start it early,
+ * before the process grows or spawns threads: it is forked from the caller
+ * and then serves every linux_bridge_run until stopped (Linux only). */
+bool linux_bridge_start_zygote(LinuxBridge* bridge);
+void linux_bridge_stop_zygote(LinuxBridge* bridge);
+
 bool linux_bridge_mount_filesystem(LinuxBridge* bridge);
 bool linux_bridge_unmount_filesystem(LinuxBridge* bridge);
 
@@ -1,4 +1,5 @@
 #include "package_manager.h"
+#include "perfect_hash.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -8,14 +9,18 @@
 #endif
 #include <time.h>
 
-static const char* default_packages[] = {
+static constexpr const char* default_packages[] = {
     "coreutils", "bash", "vim", "nano", "git", "curl", "wget", "python3",
     "nodejs", "npm", "docker", "kubernetes", "ansible", "terraform",
     "kcl-core", "kcl-utils", "kcl-dev", "kcl-admin", "kcl-security",
     "powershell-core", "windows-utils", "pe-loader", "registry-tools",
-    NULL
 };
 
+#define DEFAULT_PACKAGE_COUNT (sizeof(default_packages) / sizeof(default_packages[0]))
+
+static constexpr auto default_package_index = perfect_hash_build<PERFECT_HASH_SLOTS(default_packages)>(default_packages);
+static_assert(default_package_index.complete, "Default package names must be unique");
+
 PackageManager* package_manager_create(const char* cache_dir) {
     if (!cache_dir) return NULL;
     
@@ -64,17 +69,32 @@ void package_manager_destroy(PackageManager* pm) {
     free(pm);
 }
 
-bool package_manager_install(PackageManager* pm, const char* package_name) {
-    if (!pm || !package_name) return false;
-    
-    Package* existing = package_manager_get_package(pm, package_name);
-    if (existing && existing->status == PKG_STATUS_INSTALLED) {
-        return true; // Already installed
-    }
-    
+// Runs on a private copy of the registry; returning false leaves the
+// published version untouched. Packages named after a command another
+// environment already provides (vim, git, ...) must not make it ambiguous
+static bool package_manager_publish_command(CommandRegistry* registry, void* userdata) {
+    const char* name = (const char*)userdata;
+    if (command_registry_lookup(registry, name).count > 0) return false;
+    
+    command_registry_add_template(registry, name, name, ENV_KURONO, "Kurono package: %s");
+    return true;
+}
+
+static bool package_manager_is_package_command(const CommandEntry* entry, void* userdata) {
+    return entry->env == ENV_KURONO && strcmp(entry->name, (const char*)userdata) == 0;
+}
+
+// Rejects the update when the package never published a command, so removing
+// one that was shadowed by another environment does not copy the registry
+static bool package_manager_unpublish_command(CommandRegistry* registry, void* userdata) {
+    return command_registry_remove_if(registry, package_manager_is_package_command, userdata) > 0;
+}
+
+// Records the package without touching any registry
+static Package* package_manager_add_package(PackageManager* pm, const char* package_name) {
     // Simulate package installation
     Package* pkg = (Package*)malloc(sizeof(Package));
-    if (!pkg) return false;
+    if (!pkg) return NULL;
     
     pkg->name = strdup(package_name);
     pkg->version = strdup("1.0.0");
@@ -98,6 +118,24 @@ bool package_manager_install(PackageManager* pm, const char* package_name) {
     }
     
     pm->packages[pm->package_count++] = pkg;
+    return pkg;
+}
+
+bool package_manager_install(PackageManager* pm, const char* package_name) {
+    if (!pm || !package_name) return false;
+    
+    Package* existing = package_manager_get_package(pm, package_name);
+    if (existing && existing->status == PKG_STATUS_INSTALLED) {
+        return true; // Already installed
+    }
+    
+    Package* pkg = package_manager_add_package(pm, package_name);
+    if (!pkg) return false;
+    
+    // Installed packages run by name. The kernel publishes a new registry
+    // version, so lookups already in flight are never stalled; without a
+    // running kernel there is no registry to update
+    kernel_update_registry(package_manager_publish_command, pkg->name);
     
     return true;
 }
@@ -117,6 +155,10 @@ bool package_manager_remove(PackageManager* pm, const char* package_name) {
             }
             pm->package_count--;
             
+            // Readers still holding the old version keep seeing the command
+            // until they release it
+            kernel_update_registry(package_manager_unpublish_command, pkg->name);
+            
             // Clean up package data
             free(pkg->name);
             free(pkg->version);
@@ -234,16 +276,28 @@ bool package_manager_remove_repository(PackageManager* pm, const char* repo_url)
     return false;
 }
 
+bool package_manager_is_default_package(const char* package_name) {
+    return perfect_hash_contains(default_package_index, default_packages, package_name);
+}
+
 bool package_manager_register_kurono_packages(PackageManager* pm, CommandRegistry* registry) {
     if (!pm || !registry) return false;
     
-    for (int i = 0; default_packages[i] != NULL; i++) {
-        if (!package_manager_get_package(pm, default_packages[i])) {
-            package_manager_install(pm, default_packages[i]);
+    // Called on the boot registry before it is attached, so the whole default
+    // set lands in one version instead of one published copy per package
+    bool success = true;
+    for (size_t i = 0; i < DEFAULT_PACKAGE_COUNT; i++) {
+        if (package_manager_get_package(pm, default_packages[i])) continue;
+    
+        Package* pkg = package_manager_add_package(pm, default_packages[i]);
+        if (!pkg) {
+            success = false;
+            continue;
         }
+        package_manager_publish_command(registry, pkg->name);
     }
     
-    return true;
+    return success;
 }
 
 char* package_manager_get_cache_path(PackageManager* pm, const char* package_name) {
@@ -60,6 +60,11 @@ bool package_manager_refresh_repositories(PackageManager* pm);
 bool package_manager_add_repository(PackageManager* pm, const char* repo_url);
 bool package_manager_remove_repository(PackageManager* pm, const char* repo_url);
 
+/* Whether the package is one of those installed by default, checked against
+ * a compile-time perfect hash of the default list. */
+bool package_manager_is_default_package(const char* package_name);
+/* Installs the default packages and adds their commands to registry, which
+ * must not be published yet; install and remove publish through the kernel. */
 bool package_manager_register_kurono_packages(PackageManager* pm, CommandRegistry* registry);
 
 char* package_manager_get_cache_path(PackageManager* pm, const char* package_name);
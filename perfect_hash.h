@@ -0,0 +1,105 @@
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Perfect hashing for fixed name tables known at compile time. The table is
+ * a constexpr array of names, or of structs with a name member;
+ * perfect_hash_build searches during compilation for a seed under which every
+ * name gets its own slot, so a lookup is one hash, one probe and one string
+ * comparison with nothing to set up at run time. A table with a duplicate
+ * name can never be placed and leaves the index incomplete, which callers
+ * static_assert on. */
+
+#define PERFECT_HASH_EMPTY_SLOT 0xFF
+#define PERFECT_HASH_SEED_LIMIT 65536
+
+template <size_t SlotCount>
+struct PerfectHashIndex {
+    uint32_t seed;
+    bool complete;
+    uint8_t slots[SlotCount];
+};
+
+/* Four slots per name keeps the seed search short for tables of up to a few
+ * dozen names. */
+constexpr size_t perfect_hash_slot_count(size_t count) {
+    size_t slots = 1;
+    while (slots < count * 4) slots <<= 1;
+    return slots;
+}
+
+#define PERFECT_HASH_SLOTS(table) perfect_hash_slot_count(sizeof(table) / sizeof((table)[0]))
+
+constexpr size_t perfect_hash_slot(const char* name, size_t length, uint32_t seed, size_t slot_count) {
+    // FNV-1a with the seed folded into the offset basis
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 15;
+    return hash & (slot_count - 1);
+}
+
+constexpr size_t perfect_hash_length(const char* name) {
+    size_t length = 0;
+    while (name[length]) length++;
+    return length;
+}
+
+constexpr const char* perfect_hash_name(const char* entry) {
+    return entry;
+}
+
+template <typename Entry>
+constexpr const char* perfect_hash_name(const Entry& entry) {
+    return entry.name;
+}
+
+template <size_t SlotCount, typename Entry, size_t Count>
+constexpr PerfectHashIndex<SlotCount> perfect_hash_build(const Entry (&table)[Count]) {
+    static_assert(Count < PERFECT_HASH_EMPTY_SLOT, "Too many names for 8-bit slots");
+    static_assert(SlotCount >= Count && (SlotCount & (SlotCount - 1)) == 0, "Slot count must be a power of two covering the table");
+    
+    PerfectHashIndex<SlotCount> index = {};
+    for (uint32_t seed = 0; seed < PERFECT_HASH_SEED_LIMIT; seed++) {
+        for (size_t s = 0; s < SlotCount; s++) index.slots[s] = PERFECT_HASH_EMPTY_SLOT;
+    
+        bool collided = false;
+        for (size_t i = 0; i < Count && !collided; i++) {
+            const char* name = perfect_hash_name(table[i]);
+            size_t slot = perfect_hash_slot(name, perfect_hash_length(name), seed, SlotCount);
+            if (index.slots[slot] != PERFECT_HASH_EMPTY_SLOT) collided = true;
+            else index.slots[slot] = (uint8_t)i;
+        }
+        if (!collided) {
+            index.seed = seed;
+            index.complete = true;
+            return index;
+        }
+    }
+    return index;
+}
+
+/* Position of the first length bytes of name in the table, or -1. name need
+ * not be NUL-terminated. */
+template <size_t SlotCount, typename Entry, size_t Count>
+inline int perfect_hash_find(const PerfectHashIndex<SlotCount>& index, const Entry (&table)[Count], const char* name, size_t length) {
+    uint8_t slot = index.slots[perfect_hash_slot(name, length, index.seed, SlotCount)];
+    if (slot == PERFECT_HASH_EMPTY_SLOT) return -1;
+    
+    const char* candidate = perfect_hash_name(table[slot]);
+    if (strncmp(candidate, name, length) != 0 || candidate[length] != '\0') return -1;
+    return slot;
+}
+
+template <size_t SlotCount, typename Entry, size_t Count>
+inline bool perfect_hash_contains(const PerfectHashIndex<SlotCount>& index, const Entry (&table)[Count], const char* name) {
+    return name && perfect_hash_find(index, table, name, strlen(name)) >= 0;
+}
+
+#endif
@@ -0,0 +1,559 @@
+#include "registry_snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define SNAPSHOT_MAGIC "KRNSNAP"
+#define SNAPSHOT_ALIGN 8
+
+// On-disk layout, native endianness:
+//   header | sources | entries | groups | slots | strings
+// Every section starts on an 8-byte boundary and string references are
+// offsets into the trailing blob of NUL-terminated strings.
+typedef struct {
+    char magic[8];
+    uint32_t format_version;
+    uint32_t source_count;
+    char kernel_version[16];
+    uint64_t total_size;
+    uint32_t entry_count;
+    uint32_t group_count;
+    uint32_t slot_count;
+    uint32_t reserved;
+    uint64_t sources_offset;
+    uint64_t entries_offset;
+    uint64_t groups_offset;
+    uint64_t slots_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} SnapshotHeader;
+
+typedef struct {
+    uint64_t mtime;
+    uint32_t path;
+    uint32_t reserved;
+} SnapshotSource;
+
+typedef struct {
+    uint32_t name;
+    uint32_t path;
+    uint32_t description;
+    uint8_t env;
+    uint8_t is_template;
+    uint16_t reserved;
+} SnapshotEntry;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t first;
+    uint32_t count;
+} SnapshotGroup;
+
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+    uint32_t* slots;
+    size_t slot_count;
+    size_t count;
+} SnapshotStrings;
+
+static std::thread g_snapshot_writer;
+
+void registry_snapshot_sources_init(RegistrySnapshotSources* sources) {
+    if (!sources) return;
+    memset(sources, 0, sizeof(*sources));
+}
+
+bool registry_snapshot_sources_add(RegistrySnapshotSources* sources, const char* path) {
+    if (!sources || !path || sources->count >= REGISTRY_SNAPSHOT_MAX_SOURCES) return false;
+    
+    sources->paths[sources->count++] = path;
+    return true;
+}
+
+static uint64_t snapshot_source_mtime(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    
+#if defined(__linux__)
+    return (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    return (uint64_t)st.st_mtimespec.tv_sec * 1000000000ull + (uint64_t)st.st_mtimespec.tv_nsec;
+#else
+    return (uint64_t)st.st_mtime * 1000000000ull;
+#endif
+}
+
+static uint32_t snapshot_hash(const char* str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t snapshot_align(size_t offset) {
+    return (offset + SNAPSHOT_ALIGN - 1) & ~(size_t)(SNAPSHOT_ALIGN - 1);
+}
+
+static bool snapshot_strings_init(SnapshotStrings* strings) {
+    strings->capacity = 4096;
+    strings->size = 0;
+    strings->data = (char*)malloc(strings->capacity);
+    strings->slot_count = 512;
+    strings->count = 0;
+    strings->slots = (uint32_t*)calloc(strings->slot_count, sizeof(uint32_t));
+    return strings->data && strings->slots;
+}
+
+static void snapshot_strings_free(SnapshotStrings* strings) {
+    free(strings->data);
+    free(strings->slots);
+}
+
+static bool snapshot_strings_rehash(SnapshotStrings* strings) {
+    size_t slot_count = strings->slot_count * 2;
+    uint32_t* slots = (uint32_t*)calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return false;
+    
+    size_t mask = slot_count - 1;
+    for (size_t s = 0; s < strings->slot_count; s++) {
+        if (strings->slots[s] == 0) continue;
+        size_t i = snapshot_hash(strings->data + strings->slots[s] - 1) & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = strings->slots[s];
+    }
+    
+    free(strings->slots);
+    strings->slots = slots;
+    strings->slot_count = slot_count;
+    return true;
+}
+
+// Returns the blob offset of str, adding it once per distinct value
+static bool snapshot_strings_add(SnapshotStrings* strings, const char* str, uint32_t* offset) {
+    if ((strings->count + 1) * 2 > strings->slot_count && !snapshot_strings_rehash(strings)) {
+        return false;
+    }
+    
+    size_t mask = strings->slot_count - 1;
+    size_t i = snapshot_hash(str) & mask;
+    for (; strings->slots[i] != 0; i = (i + 1) & mask) {
+        if (strcmp(strings->data + strings->slots[i] - 1, str) == 0) {
+            *offset = strings->slots[i] - 1;
+            return true;
+        }
+    }
+    
+    size_t length = strlen(str) + 1;
+    if (strings->size + length >= UINT32_MAX) return false;
+    if (strings->size + length > strings->capacity) {
+        size_t capacity = strings->capacity * 2;
+        while (capacity < strings->size + length) capacity *= 2;
+        char* data = (char*)realloc(strings->data, capacity);
+        if (!data) return false;
+        strings->data = data;
+        strings->capacity = capacity;
+    }
+    
+    memcpy(strings->data + strings->size, str, length);
+    *offset = (uint32_t)strings->size;
+    strings->slots[i] = (uint32_t)strings->size + 1;
+    strings->size += length;
+    strings->count++;
+    return true;
+}
+
+static char* snapshot_serialize(const CommandRegistry* registry, const RegistrySnapshotSources* sources, size_t* out_size) {
+    SnapshotStrings strings;
+    if (!snapshot_strings_init(&strings)) {
+        snapshot_strings_free(&strings);
+        return NULL;
+    }
+    
+    size_t source_count = sources ? sources->count : 0;
+    SnapshotSource* snap_sources = (SnapshotSource*)calloc(source_count ? source_count : 1, sizeof(SnapshotSource));
+    SnapshotEntry* snap_entries = (SnapshotEntry*)calloc(registry->count ? registry->count : 1, sizeof(SnapshotEntry));
+    SnapshotGroup* snap_groups = (SnapshotGroup*)calloc(registry->group_count ? registry->group_count : 1, sizeof(SnapshotGroup));
+    char* buffer = NULL;
+    bool ok = snap_sources && snap_entries && snap_groups;
+    
+    for (size_t i = 0; ok && i < source_count; i++) {
+        snap_sources[i].mtime = snapshot_source_mtime(sources->paths[i]);
+        ok = snapshot_strings_add(&strings, sources->paths[i], &snap_sources[i].path);
+    }
+    
+    // Entries are written group by group so each group is a contiguous range
+    uint32_t entry_index = 0;
+    for (size_t g = 0; ok && g < registry->group_count; g++) {
+        CommandView view = command_group_view(&registry->groups[g]);
+        snap_groups[g].hash = registry->groups[g].hash;
+        snap_groups[g].first = entry_index;
+        snap_groups[g].count = (uint32_t)view.count;
+    
+        for (size_t i = 0; ok && i < view.count; i++) {
+            const CommandEntry* entry = view.entries[i];
+            SnapshotEntry* snap = &snap_entries[entry_index++];
+            snap->env = (uint8_t)entry->env;
+            snap->is_template = entry->description_is_template ? 1 : 0;
+            ok = snapshot_strings_add(&strings, entry->name, &snap->name) &&
+                 snapshot_strings_add(&strings, entry->path, &snap->path) &&
+                 snapshot_strings_add(&strings, entry->description, &snap->description);
+        }
+    }
+    
+    if (ok) {
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.format_version = REGISTRY_SNAPSHOT_VERSION;
+        header.source_count = (uint32_t)source_count;
+        snprintf(header.kernel_version, sizeof(header.kernel_version), "%s", KERNEL_VERSION);
+        header.entry_count = entry_index;
+        header.group_count = (uint32_t)registry->group_count;
+        header.slot_count = (uint32_t)registry->slot_count;
+        header.sources_offset = snapshot_align(sizeof(SnapshotHeader));
+        header.entries_offset = snapshot_align(header.sources_offset + sizeof(SnapshotSource) * source_count);
+        header.groups_offset = snapshot_align(header.entries_offset + sizeof(SnapshotEntry) * header.entry_count);
+        header.slots_offset = snapshot_align(header.groups_offset + sizeof(SnapshotGroup) * header.group_count);
+        header.strings_offset = snapshot_align(header.slots_offset + sizeof(uint32_t) * header.slot_count);
+        header.strings_size = strings.size;
+        header.total_size = header.strings_offset + strings.size;
+    
+        buffer = (char*)calloc(1, header.total_size);
+        if (buffer) {
+            memcpy(buffer, &header, sizeof(header));
+            memcpy(buffer + header.sources_offset, snap_sources, sizeof(SnapshotSource) * source_count);
+            memcpy(buffer + header.entries_offset, snap_entries, sizeof(SnapshotEntry) * header.entry_count);
+            memcpy(buffer + header.groups_offset, snap_groups, sizeof(SnapshotGroup) * header.group_count);
+            memcpy(buffer + header.slots_offset, registry->slots, sizeof(uint32_t) * header.slot_count);
+            memcpy(buffer + header.strings_offset, strings.data, strings.size);
+            *out_size = header.total_size;
+        }
+    }
+    
+    free(snap_sources);
+    free(snap_entries);
+    free(snap_groups);
+    snapshot_strings_free(&strings);
+    return buffer;
+}
+
+static bool snapshot_write_file(const char* path, const char* buffer, size_t size) {
+    size_t tmp_len = strlen(path) + 5;
+    char* tmp_path = (char*)malloc(tmp_len);
+    if (!tmp_path) return false;
+    snprintf(tmp_path, tmp_len, "%s.tmp", path);
+    
+    FILE* file = fopen(tmp_path, "wb");
+    if (!file) {
+        free(tmp_path);
+        return false;
+    }
+    
+    bool ok = fwrite(buffer, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+    
+    // Readers only ever see a complete snapshot: the new file replaces the
+    // old one in a single rename
+#ifdef _WIN32
+    if (ok) remove(path);
+#endif
+    if (ok) ok = rename(tmp_path, path) == 0;
+    if (!ok) remove(tmp_path);
+    
+    free(tmp_path);
+    return ok;
+}
+
+bool registry_snapshot_save(const CommandRegistry* registry, const char* path, const RegistrySnapshotSources* sources) {
+    if (!registry || !path) return false;
+    
+    size_t size = 0;
+    char* buffer = snapshot_serialize(registry, sources, &size);
+    if (!buffer) return false;
+    
+    bool ok = snapshot_write_file(path, buffer, size);
+    free(buffer);
+    return ok;
+}
+
+bool registry_snapshot_save_async(const CommandRegistry* registry, const char* path, const RegistrySnapshotSources* sources) {
+    if (!registry || !path) return false;
+    
+    // Serializing is a memory copy; only the file I/O moves off the caller's
+    // thread, so later registry updates cannot race the writer
+    size_t size = 0;
+    char* buffer = snapshot_serialize(registry, sources, &size);
+    if (!buffer) return false;
+    
+    char* target = strdup(path);
+    if (!target) {
+        free(buffer);
+        return false;
+    }
+    
+    registry_snapshot_wait();
+    g_snapshot_writer = std::thread([buffer, size, target]() {
+        snapshot_write_file(target, buffer, size);
+        free(buffer);
+        free(target);
+    });
+    
+    return true;
+}
+
+typedef struct {
+    CommandRegistry* rebuilt;
+    RegistrySnapshotMerge merge;
+    void* userdata;
+} SnapshotMergeContext;
+
+static bool snapshot_merge(CommandRegistry* next, void* userdata) {
+    SnapshotMergeContext* context = (SnapshotMergeContext*)userdata;
+    return context->merge(next, context->rebuilt, context->userdata);
+}
+
+bool registry_snapshot_rebuild_async(const char* path, const RegistrySnapshotSources* sources, RegistrySnapshotBuild build, RegistrySnapshotMerge merge, void* userdata) {
+    if (!path || !build || !merge) return false;
+    
+    char* target = strdup(path);
+    if (!target) return false;
+    
+    RegistrySnapshotSources watched;
+    registry_snapshot_sources_init(&watched);
+    if (sources) watched = *sources;
+    
+    // The rebuild shares the writer slot, so shutdown joins it the same way
+    registry_snapshot_wait();
+    g_snapshot_writer = std::thread([target, watched, build, merge, userdata]() {
+        CommandRegistry* rebuilt = command_registry_create();
+        if (rebuilt) {
+            build(rebuilt, userdata);
+            registry_snapshot_save(rebuilt, target, &watched);
+    
+            SnapshotMergeContext context = { rebuilt, merge, userdata };
+            kernel_update_registry(snapshot_merge, &context);
+            command_registry_destroy(rebuilt);
+        }
+        free(target);
+    });
+    
+    return true;
+}
+
+void registry_snapshot_wait(void) {
+    if (g_snapshot_writer.joinable()) {
+        g_snapshot_writer.join();
+    }
+}
+
+static void snapshot_release(const void* data, size_t size) {
+#ifdef _WIN32
+    free((void*)data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+static const char* snapshot_map(const char* path, size_t* size) {
+#ifdef _WIN32
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    struct _stat64 st;
+    if (_fstat64(_fileno(file), &st) != 0 || st.st_size < (long long)sizeof(SnapshotHeader)) {
+        fclose(file);
+        return NULL;
+    }
+    
+    char* data = (char*)malloc((size_t)st.st_size);
+    if (data && fread(data, 1, (size_t)st.st_size, file) != (size_t)st.st_size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    
+    *size = (size_t)st.st_size;
+    return data;
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        close(fd);
+        return NULL;
+    }
+    
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    
+    *size = (size_t)st.st_size;
+    return (const char*)data;
+#endif
+}
+
+static bool snapshot_section_fits(const SnapshotHeader* header, uint64_t offset, uint64_t count, size_t element_size) {
+    if (offset % SNAPSHOT_ALIGN != 0 || offset > header->total_size) return false;
+    return count <= (header->total_size - offset) / element_size;
+}
+
+static bool snapshot_validate(const char* data, size_t size, const RegistrySnapshotSources* sources, bool* stale) {
+    const SnapshotHeader* header = (const SnapshotHeader*)data;
+    
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) return false;
+    if (header->format_version != REGISTRY_SNAPSHOT_VERSION) return false;
+    if (strncmp(header->kernel_version, KERNEL_VERSION, sizeof(header->kernel_version)) != 0) return false;
+    if (header->total_size != size) return false;
+    
+    if (!snapshot_section_fits(header, header->sources_offset, header->source_count, sizeof(SnapshotSource)) ||
+        !snapshot_section_fits(header, header->entries_offset, header->entry_count, sizeof(SnapshotEntry)) ||
+        !snapshot_section_fits(header, header->groups_offset, header->group_count, sizeof(SnapshotGroup)) ||
+        !snapshot_section_fits(header, header->slots_offset, header->slot_count, sizeof(uint32_t)) ||
+        !snapshot_section_fits(header, header->strings_offset, header->strings_size, 1)) {
+        return false;
+    }
+    
+    const char* blob = data + header->strings_offset;
+    if (header->strings_size == 0 || blob[header->strings_size - 1] != '\0') return false;
+    
+    const SnapshotSource* snap_sources = (const SnapshotSource*)(data + header->sources_offset);
+    for (uint32_t i = 0; i < header->source_count; i++) {
+        if (snap_sources[i].path >= header->strings_size) return false;
+    }
+    
+    // Stale when the set of sources or any of their mtimes changed
+    size_t source_count = sources ? sources->count : 0;
+    bool fresh = header->source_count == source_count;
+    for (size_t i = 0; fresh && i < source_count; i++) {
+        fresh = strcmp(blob + snap_sources[i].path, sources->paths[i]) == 0 &&
+                snap_sources[i].mtime == snapshot_source_mtime(sources->paths[i]);
+    }
+    if (!fresh && !stale) return false;
+    
+    uint32_t slot_count = header->slot_count;
+    if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0) return false;
+    if ((uint64_t)header->group_count * 2 > slot_count) return false;
+    
+    const SnapshotEntry* entries = (const SnapshotEntry*)(data + header->entries_offset);
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        if (entries[i].name >= header->strings_size || entries[i].path >= header->strings_size ||
+            entries[i].description >= header->strings_size || entries[i].env > ENV_UNKNOWN) {
+            return false;
+        }
+    }
+    
+    const SnapshotGroup* groups = (const SnapshotGroup*)(data + header->groups_offset);
+    for (uint32_t g = 0; g < header->group_count; g++) {
+        if (groups[g].count == 0 || groups[g].first > header->entry_count ||
+            groups[g].count > header->entry_count - groups[g].first) {
+            return false;
+        }
+    }
+    
+    const uint32_t* slots = (const uint32_t*)(data + header->slots_offset);
+    for (uint32_t i = 0; i < slot_count; i++) {
+        if (slots[i] > header->group_count) return false;
+    }
+    
+    if (stale) *stale = !fresh;
+    return true;
+}
+
+CommandRegistry* registry_snapshot_load(const char* path, const RegistrySnapshotSources* sources, bool* stale) {
+    if (!path) return NULL;
+    
+    size_t size = 0;
+    const char* data = snapshot_map(path, &size);
+    if (!data) return NULL;
+    
+    if (!snapshot_validate(data, size, sources, stale)) {
+        snapshot_release(data, size);
+        return NULL;
+    }
+    
+    const SnapshotHeader* header = (const SnapshotHeader*)data;
+    const SnapshotEntry* snap_entries = (const SnapshotEntry*)(data + header->entries_offset);
+    const SnapshotGroup* snap_groups = (const SnapshotGroup*)(data + header->groups_offset);
+    const char* blob = data + header->strings_offset;
+    
+    CommandRegistry* registry = command_registry_create();
+    if (!registry) {
+        snapshot_release(data, size);
+        return NULL;
+    }
+    
+    // Strings and the slot index stay in the mapping; only the entry records
+    // and group table are materialized, in one pass and a handful of blocks
+    size_t group_capacity = header->group_count > 64 ? header->group_count : 64;
+    CommandGroup* groups = (CommandGroup*)malloc(sizeof(CommandGroup) * group_capacity);
+    CommandEntry* entries = (CommandEntry*)arena_alloc(&registry->arena, sizeof(CommandEntry) * (header->entry_count ? header->entry_count : 1), alignof(CommandEntry));
+    if (!groups || !entries) {
+        free(groups);
+        command_registry_destroy(registry);
+        snapshot_release(data, size);
+        return NULL;
+    }
+    
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        entries[i].name = blob + snap_entries[i].name;
+        entries[i].path = blob + snap_entries[i].path;
+        entries[i].env = (EnvironmentType)snap_entries[i].env;
+        entries[i].description = blob + snap_entries[i].description;
+        entries[i].description_is_template = snap_entries[i].is_template != 0;
+    }
+    
+    for (uint32_t g = 0; g < header->group_count; g++) {
+        CommandGroup* group = &groups[g];
+        group->hash = snap_groups[g].hash;
+        group->count = snap_groups[g].count;
+    
+        if (group->count == 1) {
+            group->entry = &entries[snap_groups[g].first];
+            continue;
+        }
+    
+        // Member arrays keep the power-of-two capacity the registry expects
+        uint32_t capacity = 2;
+        while (capacity < group->count) capacity *= 2;
+        group->entries = (CommandEntry**)arena_alloc(&registry->arena, sizeof(CommandEntry*) * capacity, alignof(CommandEntry*));
+        if (!group->entries) {
+            free(groups);
+            registry->group_count = 0;
+            command_registry_destroy(registry);
+            snapshot_release(data, size);
+            return NULL;
+        }
+        for (uint32_t i = 0; i < group->count; i++) {
+            group->entries[i] = &entries[snap_groups[g].first + i];
+        }
+    }
+    
+    free(registry->groups);
+    free(registry->slots);
+    registry->groups = groups;
+    registry->group_count = header->group_count;
+    registry->group_capacity = group_capacity;
+    registry->slots = (uint32_t*)(data + header->slots_offset);
+    registry->slot_count = header->slot_count;
+    registry->slots_borrowed = true;
+    registry->count = header->entry_count;
+    registry->backing = data;
+    registry->backing_size = size;
+    registry->release_backing = snapshot_release;
+    
+    return registry;
+}
@@ -0,0 +1,36 @@
+#ifndef REGISTRY_SNAPSHOT_H
+#define REGISTRY_SNAPSHOT_H
+
+#include "kernel.h"
+#include <stdbool.h>
+
+#define REGISTRY_SNAPSHOT_VERSION 1
+#define REGISTRY_SNAPSHOT_MAX_SOURCES 8
+
+/* Paths whose modification times decide whether a snapshot is still valid:
+ * the bridge command directories and the package database. */
+typedef struct {
+    const char* paths[REGISTRY_SNAPSHOT_MAX_SOURCES];
+    size_t count;
+} RegistrySnapshotSources;
+
+void registry_snapshot_sources_init(RegistrySnapshotSources* sources);
+bool registry_snapshot_sources_add(RegistrySnapshotSources* sources, const char* path);
+
+bool registry_snapshot_save(const CommandRegistry* registry, const char* path, const RegistrySnapshotSources* sources);
+bool registry_snapshot_save_async(const CommandRegistry* registry, const char* path, const RegistrySnapshotSources* sources);
+void registry_snapshot_wait(void);
+
+/* A snapshot whose sources changed is rejected, unless stale is given: then
+ * it is loaded anyway and *stale tells the caller to rebuild it. */
+CommandRegistry* registry_snapshot_load(const char* path, const RegistrySnapshotSources* sources, bool* stale);
+
+/* Rebuilds the snapshot off the caller's thread: build fills an empty
+ * registry, which is saved to path and then folded into the published
+ * version with merge inside kernel_update_registry. The source paths must
+ * outlive the rebuild; registry_snapshot_wait joins it. */
+typedef void (*RegistrySnapshotBuild)(CommandRegistry* registry, void* userdata);
+typedef bool (*RegistrySnapshotMerge)(CommandRegistry* next, const CommandRegistry* rebuilt, void* userdata);
+bool registry_snapshot_rebuild_async(const char* path, const RegistrySnapshotSources* sources, RegistrySnapshotBuild build, RegistrySnapshotMerge merge, void* userdata);
+
+#endif
@@ -2,13 +2,63 @@
 #include "linux_bridge.h"
 #include "windows_bridge.h"
 #include "kcl_interpreter.h"
+#include "kcl_aot.h"
+#include "kcl_vm.h"
 #include "conflict_resolver.h"
 #include "security_supr_engine.h"
 #include "package_manager.h"
+#include "registry_snapshot.h"
+#include "kurono_daemon.h"
+#include "kurono_batch.h"
+#include "kurono_builtins.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/stat.h>
+#include <time.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <unistd.h>
+#include <utime.h>
+#include <pthread.h>
+#endif
+
+// Counts heap allocations while enabled, for tests that check a path never
+// allocates. The sanitizers replace the allocator, so counting is left off
+// under them
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define TEST_COUNT_ALLOCATIONS
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+static bool g_count_allocations = false;
+static size_t g_allocation_count = 0;
+
+static void test_count_allocation(void) {
+    if (__atomic_load_n(&g_count_allocations, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&g_allocation_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+extern "C" void* malloc(size_t size) noexcept {
+    test_count_allocation();
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept {
+    test_count_allocation();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) noexcept {
+    test_count_allocation();
+    return __libc_realloc(ptr, size);
+}
+#endif
 
 static int tests_passed = 0;
 static int tests_failed = 0;
@@ -35,40 +85,1091 @@ void test_kernel_core(void) {
     TEST_ASSERT(count == 1, "Should find exactly one test command");
     TEST_ASSERT(entries != NULL, "Should return valid entries array");
     
-    free(entries);
-    command_registry_destroy(registry);
-    kernel_shutdown(ctx);
+    // Grow well past the initial index size and check every name still resolves
+    char name[32];
+    for (int i = 0; i < 2000; i++) {
+        snprintf(name, sizeof(name), "cmd%d", i);
+        command_registry_add(registry, name, name, ENV_LINUX, NULL);
+    }
+    command_registry_add(registry, "test", "test.exe", ENV_WINDOWS, "Windows test");
+    
+    CommandView view = command_registry_lookup(registry, "test");
+    TEST_ASSERT(view.count == 2, "Lookup should group entries across environments");
+    TEST_ASSERT(view.entries[0] == entries[0], "Entries should not move as the registry grows");
+    TEST_ASSERT(view.entries[1]->env == ENV_WINDOWS, "Group should keep registration order");
+    
+    snprintf(name, sizeof(name), "cmd%d", 1999);
+    view = command_registry_lookup(registry, name);
+    TEST_ASSERT(view.count == 1 && strcmp(view.entries[0]->path, name) == 0, "Should resolve late additions");
+    TEST_ASSERT(command_registry_lookup(registry, "missing").count == 0, "Unknown names should yield an empty view");
+    TEST_ASSERT(registry->count == 2002, "Registry should count every entry");
+    
+    command_registry_add_template(registry, "grep", "/bin/grep", ENV_LINUX, "Linux command: %s");
+    command_registry_add_template(registry, "sed", "/bin/sed", ENV_LINUX, "Linux command: %s");
+    command_registry_add_template(registry, "kcl-run", "kcl-run", ENV_KURONO, "KCL command: %s");
+    CommandEntry* grep = command_registry_lookup(registry, "grep").entries[0];
+    CommandEntry* sed = command_registry_lookup(registry, "sed").entries[0];
+    CommandEntry* kcl_run = command_registry_lookup(registry, "kcl-run").entries[0];
+    TEST_ASSERT(grep->description == sed->description, "Description templates should be interned once");
+    TEST_ASSERT(kcl_run->path == kcl_run->name, "A path equal to the name should share its storage");
+    
+    char description[64];
+    command_entry_format_description(sed, description, sizeof(description));
+    TEST_ASSERT(strcmp(description, "Linux command: sed") == 0, "Templates should expand to the command name");
+    free(entries);
+    
+    // Once attached, the kernel owns the registry and resolves against it
+    TEST_ASSERT(kernel_attach_registry(ctx, registry), "Kernel should accept a shared registry");
+    TEST_ASSERT(kernel_get_registry(ctx) == registry, "Kernel should hand out the attached registry");
+    TEST_ASSERT(kernel_detect_environment("grep") == ENV_LINUX, "Environment detection should use the shared registry");
+    
+    ExecutionResult* result = kernel_execute_command(ctx, "test --flag");
+    TEST_ASSERT(result && result->result == CMD_AMBIGUOUS, "Kernel should see every environment's entry");
+    execution_result_destroy(result);
+    
+    result = kernel_execute_command(ctx, "missing");
+    TEST_ASSERT(result && result->result == CMD_NOT_FOUND, "Unknown commands should not resolve");
+    execution_result_destroy(result);
+    
+    // Output buffers grow geometrically and hand their storage over as-is
+    OutputBuffer buffer;
+    output_buffer_init(&buffer);
+    for (int i = 0; i < 100000; i++) {
+        TEST_ASSERT(output_buffer_append(&buffer, "0123456789", 10), "Output buffer append should succeed");
+    }
+    TEST_ASSERT(buffer.length == 1000000, "Output buffer should track its length");
+    TEST_ASSERT(buffer.capacity < 2 * buffer.length + 4096, "Output buffer should grow geometrically");
+    
+    FILE* file = tmpfile();
+    TEST_ASSERT(file != NULL, "Should create temporary file");
+    fwrite(buffer.data, 1, buffer.length, file);
+    rewind(file);
+    
+    const char* storage = buffer.data;
+    char* taken = output_buffer_take(&buffer);
+    TEST_ASSERT(taken == storage && buffer.data == NULL, "Taking the output should not copy it");
+    
+    TEST_ASSERT(output_buffer_read_file(&buffer, file) == 1000000, "Should read the whole stream");
+    TEST_ASSERT(memcmp(buffer.data, taken, 1000000) == 0 && buffer.data[buffer.length] == '\0', "Stream contents should round-trip");
+    fclose(file);
+    free(taken);
+    output_buffer_free(&buffer);
+    TEST_ASSERT(output_buffer_take(&buffer) == NULL, "Empty buffer should yield no output");
+    
+    kernel_shutdown(ctx);
+    
+    TEST_PASS();
+}
+
+void test_linux_bridge(void) {
+#ifndef KURONO_DISABLE_LINUX
+    TEST_START("Linux Bridge");
+    
+    LinuxBridge* bridge = linux_bridge_create("/tmp/test_linux");
+    TEST_ASSERT(bridge != NULL, "Linux bridge should not be NULL");
+    
+    bool mounted = linux_bridge_mount_filesystem(bridge);
+    TEST_ASSERT(mounted, "Linux filesystem should mount successfully");
+    
+    CommandRegistry* registry = command_registry_create();
+    bool registered = linux_bridge_register_commands(bridge, registry);
+    TEST_ASSERT(registered, "Linux commands should register successfully");
+    
+    size_t count = 0;
+    CommandEntry** entries = command_registry_find(registry, "ls", &count);
+    TEST_ASSERT(count > 0, "Should find Linux 'ls' command");
+    
+    free(entries);
+    command_registry_destroy(registry);
+    linux_bridge_destroy(bridge);
+    
+    TEST_PASS();
+#else
+    TEST_START("Linux Bridge (disabled)");
+    TEST_PASS();
+#endif
+}
+
+#ifndef _WIN32
+static ExecutionResult* test_linux_executor(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    return linux_bridge_run_args((LinuxBridge*)userdata, ctx, args, entry->path, sink);
+}
+
+typedef struct {
+    size_t chunks;
+    size_t bytes;
+    size_t limit;
+} TestCountingSink;
+
+static bool test_counting_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    TestCountingSink* counter = (TestCountingSink*)sink->userdata;
+    counter->chunks++;
+    counter->bytes += length;
+    return counter->limit == 0 || counter->bytes < counter->limit;
+}
+
+#ifdef __linux__
+typedef struct {
+    LinuxBridge* bridge;
+    const char* command;
+    size_t expected;
+    int runs;
+    bool ok;
+} TestZygoteRunner;
+
+// Runs the command repeatedly; ok only if every run exits 0 with exactly the
+// expected amount of output, so replies and exits reached the right caller
+static void* test_zygote_run(void* arg) {
+    TestZygoteRunner* runner = (TestZygoteRunner*)arg;
+    runner->ok = true;
+    for (int i = 0; i < runner->runs; i++) {
+        ExecutionResult* result = linux_bridge_run(runner->bridge, runner->command, NULL);
+        size_t length = result && result->output ? strlen(result->output) : 0;
+        if (!result || result->exit_code != 0 || length != runner->expected) runner->ok = false;
+        execution_result_destroy(result);
+    }
+    return NULL;
+}
+#endif
+#endif
+
+void test_linux_execution(void) {
+#ifndef _WIN32
+    TEST_START("Linux Execution");
+    
+    const char* root = "/tmp/test_linux_exec";
+    LinuxBridge* bridge = linux_bridge_create(root);
+    TEST_ASSERT(bridge != NULL, "Linux bridge should not be NULL");
+    TEST_ASSERT(linux_bridge_mount_filesystem(bridge), "Linux filesystem should mount successfully");
+    
+    // Link a few host binaries into the bridge root so resolution goes
+    // through the bridge rather than PATH
+    const char* tools[] = { "ls", "cat", "head", "pwd", "printenv", "sleep" };
+    char link_path[256];
+    char target[256];
+    for (int i = 0; i < 6; i++) {
+        snprintf(link_path, sizeof(link_path), "%s/bin/%s", root, tools[i]);
+        snprintf(target, sizeof(target), "/bin/%s", tools[i]);
+        unlink(link_path);
+        TEST_ASSERT(symlink(target, link_path) == 0, "Should link host tool into bridge root");
+    }
+    
+    char data_path[256];
+    snprintf(data_path, sizeof(data_path), "%s/etc/motd", root);
+    FILE* data = fopen(data_path, "w");
+    TEST_ASSERT(data != NULL, "Should create data file");
+    for (int i = 0; i < 2000; i++) {
+        fprintf(data, "line %d of the message of the day\n", i);
+    }
+    fclose(data);
+    
+    char command[512];
+    snprintf(command, sizeof(command), "ls %s/bin", root);
+    ExecutionResult* result = linux_bridge_run(bridge, command, NULL);
+    TEST_ASSERT(result != NULL, "Execution result should not be NULL");
+    TEST_ASSERT(result->result == CMD_SUCCESS && result->exit_code == 0, "ls should succeed");
+    TEST_ASSERT(result->output && strstr(result->output, "cat") != NULL, "ls output should be captured");
+    execution_result_destroy(result);
+    
+    result = linux_bridge_run(bridge, "ls /nonexistent/kurono/path", NULL);
+    TEST_ASSERT(result != NULL, "Execution result should not be NULL");
+    TEST_ASSERT(result->result == CMD_EXECUTION_FAILED && result->exit_code != 0, "Failing command should report its exit code");
+    TEST_ASSERT(result->error != NULL && result->error[0] != '\0', "stderr should be captured");
+    execution_result_destroy(result);
+    
+    result = linux_bridge_run(bridge, "kurono-no-such-binary", NULL);
+    TEST_ASSERT(result != NULL && result->exit_code == 127, "Missing binary should exit with 127");
+    execution_result_destroy(result);
+    
+    // Output larger than a pipe buffer must be drained without deadlocking,
+    // and the kernel should hand registered Linux commands to the bridge
+    KernelContext* kernel = kernel_init();
+    TEST_ASSERT(linux_bridge_register_commands(bridge, kernel_get_registry(kernel)), "Linux commands should register");
+    TEST_ASSERT(kernel_register_executor(ENV_LINUX, test_linux_executor, bridge), "Executor should register");
+    
+    snprintf(command, sizeof(command), "cat %s", data_path);
+    result = kernel_execute_command(kernel, command);
+    TEST_ASSERT(result != NULL && result->result == CMD_SUCCESS, "Kernel should execute Linux command");
+    TEST_ASSERT(result->output && strstr(result->output, "line 1999 of") != NULL, "Large output should be captured in full");
+    size_t total = strlen(result->output);
+    execution_result_destroy(result);
+    
+    // Streaming delivers the same bytes through the sink, and a sink that
+    // refuses more data stops the command
+    TestCountingSink counter = { 0, 0, 0 };
+    OutputSink sink = { test_counting_write, &counter, -1 };
+    result = kernel_execute_command_streaming(kernel, command, &sink);
+    TEST_ASSERT(result != NULL && result->result == CMD_SUCCESS, "Streaming execution should succeed");
+    TEST_ASSERT(result->output == NULL && counter.bytes == total, "Streamed output should reach the sink, not the result");
+    execution_result_destroy(result);
+    
+    counter.chunks = 0;
+    counter.bytes = 0;
+    counter.limit = 1;
+    result = kernel_execute_command_streaming(kernel, command, &sink);
+    TEST_ASSERT(result != NULL && result->result == CMD_EXECUTION_FAILED, "Rejected output should stop the command");
+    TEST_ASSERT(counter.chunks == 1, "Producer should stop writing once the sink refuses");
+    execution_result_destroy(result);
+    
+    // Commands run in the issuing context's directory, under the bridge
+    // root, and see its user and environment
+    char home[256];
+    snprintf(home, sizeof(home), "%s/home", root);
+    mkdir(home, 0755);
+    snprintf(home, sizeof(home), "%s/home/user", root);
+    mkdir(home, 0755);
+    snprintf(link_path, sizeof(link_path), "%s/bin/pwd", root);
+    command_registry_add(kernel_get_registry(kernel), "pwd", link_path, ENV_LINUX, "Linux command");
+    snprintf(link_path, sizeof(link_path), "%s/bin/printenv", root);
+    command_registry_add(kernel_get_registry(kernel), "printenv", link_path, ENV_LINUX, "Linux command");
+    
+    KernelContext* session = kernel_context_clone(kernel);
+    free(session->current_user);
+    session->current_user = strdup("session-user");
+    session->current_env = ENV_LINUX;
+    result = kernel_execute_command(session, "pwd");
+    TEST_ASSERT(result && result->output && strncmp(result->output, home, strlen(home)) == 0, "Command should run in the context's directory");
+    execution_result_destroy(result);
+    result = kernel_execute_command(session, "printenv USER KURONO_ENV");
+    TEST_ASSERT(result && result->output && strcmp(result->output, "session-user\nlinux\n") == 0, "Command should see the context's user and environment");
+    execution_result_destroy(result);
+    
+    kernel_shutdown(kernel);
+    
+#ifdef __linux__
+    // The zygote helper must be indistinguishable from direct spawning
+    TEST_ASSERT(linux_bridge_start_zygote(bridge), "Zygote should start");
+    for (int i = 0; i < 3; i++) {
+        result = linux_bridge_run(bridge, command, NULL);
+        TEST_ASSERT(result && result->result == CMD_SUCCESS && result->output && strlen(result->output) == total, "Zygote launch should capture full output");
+        execution_result_destroy(result);
+    }
+    
+    result = linux_bridge_run(bridge, "ls /nonexistent/kurono/path", NULL);
+    TEST_ASSERT(result && result->exit_code != 0 && result->error, "Zygote launch should report exit code and stderr");
+    execution_result_destroy(result);
+    
+    result = linux_bridge_run(bridge, "kurono-no-such-binary", NULL);
+    TEST_ASSERT(result && result->exit_code == 127, "Zygote launch of a missing binary should exit with 127");
+    execution_result_destroy(result);
+    
+    counter.chunks = 0;
+    counter.bytes = 0;
+    counter.limit = 1;
+    result = linux_bridge_run_streaming(bridge, command, NULL, &sink);
+    TEST_ASSERT(result && result->result == CMD_EXECUTION_FAILED && counter.chunks == 1, "Zygote launch should honour a stopping sink");
+    execution_result_destroy(result);
+    
+    result = linux_bridge_run(bridge, "ls", NULL);
+    TEST_ASSERT(result && result->result == CMD_SUCCESS, "Zygote should keep serving after a stopped command");
+    execution_result_destroy(result);
+    
+    CommandArgs args;
+    OutputCapture capture;
+    TEST_ASSERT(command_args_parse(&args, "pwd"), "Arguments should parse");
+    output_capture_init(&capture);
+    result = linux_bridge_run_args(bridge, session, &args, NULL, &capture.sink);
+    output_capture_finish(&capture, result);
+    TEST_ASSERT(result && result->output && strncmp(result->output, home, strlen(home)) == 0, "Zygote launch should use the context's directory");
+    execution_result_destroy(result);
+    command_args_free(&args);
+    
+    TEST_ASSERT(command_args_parse(&args, "printenv USER"), "Arguments should parse");
+    output_capture_init(&capture);
+    result = linux_bridge_run_args(bridge, session, &args, NULL, &capture.sink);
+    output_capture_finish(&capture, result);
+    TEST_ASSERT(result && result->output && strcmp(result->output, "session-user\n") == 0, "Zygote launch should use the context's user");
+    execution_result_destroy(result);
+    command_args_free(&args);
+    
+    // A long-running child does not hold up other launches, and concurrent
+    // launches each get their own output and exit status
+    TestZygoteRunner sleeper = { bridge, "sleep 2", 0, 1, false };
+    TestZygoteRunner runners[4];
+    pthread_t sleeper_thread;
+    pthread_t runner_threads[4];
+    TEST_ASSERT(pthread_create(&sleeper_thread, NULL, test_zygote_run, &sleeper) == 0, "Sleeper thread should start");
+    usleep(100000);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < 4; i++) {
+        runners[i] = (TestZygoteRunner){ bridge, command, total, 5, false };
+        TEST_ASSERT(pthread_create(&runner_threads[i], NULL, test_zygote_run, &runners[i]) == 0, "Runner thread should start");
+    }
+    for (int i = 0; i < 4; i++) pthread_join(runner_threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    pthread_join(sleeper_thread, NULL);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT(runners[i].ok, "Concurrent zygote launches should get their own output");
+    }
+    TEST_ASSERT(sleeper.ok, "The long-running command should still complete");
+    TEST_ASSERT(elapsed < 1.5, "Commands should not wait for an unrelated long-running one");
+    linux_bridge_stop_zygote(bridge);
+#endif
+    
+    kernel_context_destroy(session);
+    linux_bridge_destroy(bridge);
+    
+    TEST_PASS();
+#else
+    TEST_START("Linux Execution (disabled)");
+    TEST_PASS();
+#endif
+}
+
+void test_linux_discovery(void) {
+#ifdef __linux__
+    TEST_START("Linux Command Discovery");
+    
+    const char* root = "/tmp/test_discovery";
+    LinuxBridge* bridge = linux_bridge_create(root);
+    TEST_ASSERT(bridge != NULL, "Linux bridge should not be NULL");
+    TEST_ASSERT(linux_bridge_mount_filesystem(bridge), "Linux filesystem should mount successfully");
+    
+    char path[512];
+    for (int i = 0; i < 500; i++) {
+        snprintf(path, sizeof(path), "%s/tool-%03d", bridge->usr_bin_path, i);
+        FILE* file = fopen(path, "w");
+        TEST_ASSERT(file != NULL, "Should create tool");
+        fclose(file);
+    }
+    
+    // bin shadows usr/bin; symlinks count only when they lead to a file, and
+    // directories and dot files are skipped
+    snprintf(path, sizeof(path), "%s/tool-000", bridge->bin_path);
+    FILE* file = fopen(path, "w");
+    TEST_ASSERT(file != NULL, "Should create shadowing tool");
+    fclose(file);
+    
+    char target[512];
+    snprintf(target, sizeof(target), "%s/tool-001", bridge->usr_bin_path);
+    snprintf(path, sizeof(path), "%s/linked-tool", bridge->bin_path);
+    unlink(path);
+    TEST_ASSERT(symlink(target, path) == 0, "Should link tool");
+    snprintf(path, sizeof(path), "%s/linked-dir", bridge->bin_path);
+    unlink(path);
+    TEST_ASSERT(symlink(bridge->etc_path, path) == 0, "Should link directory");
+    snprintf(path, sizeof(path), "%s/subdir", bridge->usr_bin_path);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/.hidden", bridge->usr_bin_path);
+    file = fopen(path, "w");
+    TEST_ASSERT(file != NULL, "Should create hidden file");
+    fclose(file);
+    
+    CommandRegistry* registry = command_registry_create();
+    TEST_ASSERT(linux_bridge_discover_commands(bridge, registry), "Discovery should succeed");
+    TEST_ASSERT(registry->count == 501, "Discovery should register every command once");
+    
+    CommandView view = command_registry_lookup(registry, "tool-000");
+    snprintf(path, sizeof(path), "%s/tool-000", bridge->bin_path);
+    TEST_ASSERT(view.count == 1 && strcmp(view.entries[0]->path, path) == 0, "bin should shadow usr/bin");
+    TEST_ASSERT(command_registry_lookup(registry, "tool-499").count == 1, "usr/bin tools should be registered");
+    TEST_ASSERT(command_registry_lookup(registry, "linked-tool").count == 1, "Symlinked tools should be registered");
+    TEST_ASSERT(command_registry_lookup(registry, "linked-dir").count == 0, "Symlinked directories should be skipped");
+    TEST_ASSERT(command_registry_lookup(registry, "subdir").count == 0, "Directories should be skipped");
+    TEST_ASSERT(command_registry_lookup(registry, ".hidden").count == 0, "Dot files should be skipped");
+    
+    // Discovering again must not duplicate entries
+    TEST_ASSERT(linux_bridge_discover_commands(bridge, registry), "Repeated discovery should succeed");
+    TEST_ASSERT(registry->count == 501, "Repeated discovery should not add duplicates");
+    
+    command_registry_destroy(registry);
+    linux_bridge_destroy(bridge);
+    
+    TEST_PASS();
+#else
+    TEST_START("Linux Command Discovery (disabled)");
+    TEST_PASS();
+#endif
+}
+
+void test_linux_path_cache(void) {
+#ifdef __linux__
+    TEST_START("Linux Path Cache");
+    
+    LinuxBridge* bridge = linux_bridge_create("/tmp/test_path_cache");
+    TEST_ASSERT(bridge != NULL, "Linux bridge should not be NULL");
+    TEST_ASSERT(linux_bridge_mount_filesystem(bridge), "Linux filesystem should mount successfully");
+    
+    char tool_path[256];
+    snprintf(tool_path, sizeof(tool_path), "%s/kurono-cache-tool", bridge->usr_bin_path);
+    unlink(tool_path);
+    
+    // The miss is cached as a negative entry and must not hide a new binary
+    TEST_ASSERT(linux_bridge_resolve_path(bridge, "kurono-cache-tool") == NULL, "Unknown tool should not resolve");
+    TEST_ASSERT(!linux_bridge_is_command_available(bridge, "kurono-cache-tool"), "Unknown tool should not be available");
+    
+    FILE* tool = fopen(tool_path, "w");
+    TEST_ASSERT(tool != NULL, "Should create tool");
+    fclose(tool);
+    chmod(tool_path, 0755);
+    
+    bool available = false;
+    for (int i = 0; i < 2000 && !available; i++) {
+        available = linux_bridge_is_command_available(bridge, "kurono-cache-tool");
+        if (!available) usleep(1000);
+    }
+    TEST_ASSERT(available, "Newly installed tool should become available");
+    
+    char* resolved = linux_bridge_resolve_path(bridge, "kurono-cache-tool");
+    TEST_ASSERT(resolved && strcmp(resolved, tool_path) == 0, "Cached path should match the install location");
+    free(resolved);
+    
+    // Permission changes and removal invalidate positive entries too
+    chmod(tool_path, 0644);
+    for (int i = 0; i < 2000 && available; i++) {
+        available = linux_bridge_is_command_available(bridge, "kurono-cache-tool");
+        if (available) usleep(1000);
+    }
+    TEST_ASSERT(!available, "Tool without execute bit should not be available");
+    
+    unlink(tool_path);
+    bool resolves = true;
+    for (int i = 0; i < 2000 && resolves; i++) {
+        resolved = linux_bridge_resolve_path(bridge, "kurono-cache-tool");
+        resolves = resolved != NULL;
+        free(resolved);
+        if (resolves) usleep(1000);
+    }
+    TEST_ASSERT(!resolves, "Removed tool should stop resolving");
+    
+    linux_bridge_destroy(bridge);
+    
+    TEST_PASS();
+#else
+    TEST_START("Linux Path Cache (disabled)");
+    TEST_PASS();
+#endif
+}
+
+#ifndef _WIN32
+static long test_linux_launcher(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, int stdin_fd, int stdout_fd, int stderr_fd, char** error) {
+    return linux_bridge_spawn_args((LinuxBridge*)userdata, ctx, args, entry->path, stdin_fd, stdout_fd, stderr_fd, error);
+}
+
+static ExecutionResult* test_kurono_executor(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    ExecutionResult* result = execution_result_create();
+    const char* lines = "alpha\nbeta\ngamma\n";
+    sink->write(sink, OUTPUT_STREAM_STDOUT, lines, strlen(lines));
+    result->result = CMD_SUCCESS;
+    result->exit_code = 0;
+    return result;
+}
+
+static bool test_fd_write(OutputSink* sink, OutputStream stream, const char* data, size_t length) {
+    return write(sink->fd, data, length) == (ssize_t)length;
+}
+#endif
+
+void test_pipeline(void) {
+#ifndef _WIN32
+    TEST_START("Pipeline");
+    
+    const char* root = "/tmp/test_pipeline";
+    LinuxBridge* bridge = linux_bridge_create(root);
+    TEST_ASSERT(bridge != NULL, "Linux bridge should not be NULL");
+    TEST_ASSERT(linux_bridge_mount_filesystem(bridge), "Linux filesystem should mount successfully");
+    
+    const char* tools[] = { "cat", "grep", "sort", "head", "wc", "printenv" };
+    char link_path[256];
+    char target[256];
+    for (int i = 0; i < 6; i++) {
+        snprintf(link_path, sizeof(link_path), "%s/bin/%s", root, tools[i]);
+        snprintf(target, sizeof(target), "/usr/bin/%s", tools[i]);
+        unlink(link_path);
+        TEST_ASSERT(symlink(target, link_path) == 0, "Should link host tool into bridge root");
+    }
+    
+    char data_path[256];
+    snprintf(data_path, sizeof(data_path), "%s/etc/numbers", root);
+    FILE* data = fopen(data_path, "w");
+    TEST_ASSERT(data != NULL, "Should create data file");
+    for (int i = 0; i < 50000; i++) {
+        fprintf(data, "%d\n", i);
+    }
+    fclose(data);
+    
+    KernelContext* kernel = kernel_init();
+    CommandRegistry* registry = kernel_get_registry(kernel);
+    linux_bridge_register_commands(bridge, registry);
+    command_registry_add(registry, "kgen", "kgen", ENV_KURONO, "Test generator");
+    kernel_register_executor(ENV_LINUX, test_linux_executor, bridge);
+    kernel_register_stage_launcher(ENV_LINUX, test_linux_launcher, bridge);
+    kernel_register_executor(ENV_KURONO, test_kurono_executor, NULL);
+    
+    // Three process stages joined by kernel pipes: 9999, 19999, ... 49999
+    char command[512];
+    snprintf(command, sizeof(command), "cat %s | grep 9999 | wc -l", data_path);
+    OutputCapture capture;
+    output_capture_init(&capture);
+    PipelineResult* pipeline = kernel_execute_pipeline(kernel, command, &capture.sink);
+    TEST_ASSERT(pipeline != NULL && pipeline->result == CMD_SUCCESS, "Pipeline should succeed");
+    TEST_ASSERT(pipeline->stage_count == 3, "Pipeline should have three stages");
+    TEST_ASSERT(capture.output.data && atoi(capture.output.data) == 5, "Pipeline output should reach the sink");
+    for (size_t i = 0; i < pipeline->stage_count; i++) {
+        TEST_ASSERT(pipeline->stages[i].exit_code == 0, "Every stage should report exit code 0");
+    }
+    pipeline_result_destroy(pipeline);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // Launched stages run as the context the pipeline was issued from
+    KernelContext* session = kernel_context_clone(kernel);
+    free(session->current_user);
+    session->current_user = strdup("pipeline-user");
+    command_registry_add(registry, "printenv", link_path, ENV_LINUX, "Linux command");
+    output_capture_init(&capture);
+    pipeline = kernel_execute_pipeline(session, "printenv LOGNAME | cat", &capture.sink);
+    TEST_ASSERT(pipeline != NULL && pipeline->result == CMD_SUCCESS, "Pipeline with a session context should succeed");
+    TEST_ASSERT(capture.output.data && strcmp(capture.output.data, "pipeline-user\n") == 0, "Pipeline stages should see the context's user");
+    pipeline_result_destroy(pipeline);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    kernel_context_destroy(session);
+    
+    // An executor-backed stage from another environment feeds a process
+    output_capture_init(&capture);
+    pipeline = kernel_execute_pipeline(kernel, "kgen | grep beta", &capture.sink);
+    TEST_ASSERT(pipeline != NULL && pipeline->result == CMD_SUCCESS, "Cross-environment pipeline should succeed");
+    TEST_ASSERT(pipeline->stages[0].env == ENV_KURONO && pipeline->stages[1].env == ENV_LINUX, "Stages should keep their environments");
+    TEST_ASSERT(capture.output.data && strcmp(capture.output.data, "beta\n") == 0, "Executor output should flow into the next stage");
+    pipeline_result_destroy(pipeline);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // Per-stage exit codes survive even when the last stage succeeds
+    output_capture_init(&capture);
+    pipeline = kernel_execute_pipeline(kernel, "cat /nonexistent/kurono | wc -l", &capture.sink);
+    TEST_ASSERT(pipeline != NULL && pipeline->result == CMD_SUCCESS, "Pipeline status should follow the last stage");
+    TEST_ASSERT(pipeline->stages[0].exit_code != 0 && pipeline->stages[1].exit_code == 0, "Failing stage should keep its exit code");
+    TEST_ASSERT(capture.error.length > 0, "Stage stderr should reach the sink");
+    pipeline_result_destroy(pipeline);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // Unknown stages are rejected before anything starts
+    output_capture_init(&capture);
+    pipeline = kernel_execute_pipeline(kernel, "kgen | no-such-tool", &capture.sink);
+    TEST_ASSERT(pipeline != NULL && pipeline->result == CMD_NOT_FOUND, "Unknown stage should fail the pipeline");
+    TEST_ASSERT(capture.output.length == 0, "Nothing should run when a stage is unknown");
+    pipeline_result_destroy(pipeline);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // Names ambiguous on their own stay ambiguous inside a pipeline, even
+    // when one of the candidates is in the current environment
+    command_registry_add(registry, "kgen", "/usr/bin/kgen", ENV_LINUX, "Linux command");
+    output_capture_init(&capture);
+    ExecutionResult* single = kernel_execute_command_streaming(kernel, "kgen", &capture.sink);
+    TEST_ASSERT(single && single->result == CMD_AMBIGUOUS, "Ambiguous command should not run on its own");
+    execution_result_destroy(single);
+    pipeline = kernel_execute_pipeline(kernel, "kgen | cat", &capture.sink);
+    TEST_ASSERT(pipeline != NULL && pipeline->result == CMD_AMBIGUOUS, "Ambiguous stage should fail the pipeline");
+    TEST_ASSERT(capture.output.length == 0, "Nothing should run when a stage is ambiguous");
+    pipeline_result_destroy(pipeline);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // Descriptor-backed sinks receive the final stage through splice
+    FILE* file = tmpfile();
+    TEST_ASSERT(file != NULL, "Should create temporary file");
+    OutputSink fd_sink = { test_fd_write, NULL, fileno(file) };
+    snprintf(command, sizeof(command), "cat %s | sort -n -r | head -n 3", data_path);
+    pipeline = kernel_execute_pipeline(kernel, command, &fd_sink);
+    TEST_ASSERT(pipeline != NULL && pipeline->result == CMD_SUCCESS, "Spliced pipeline should succeed");
+    pipeline_result_destroy(pipeline);
+    
+    char spliced[64] = {0};
+    rewind(file);
+    size_t read_bytes = fread(spliced, 1, sizeof(spliced) - 1, file);
+    fclose(file);
+    TEST_ASSERT(read_bytes > 0 && strcmp(spliced, "49999\n49998\n49997\n") == 0, "Spliced output should match");
+    
+    kernel_shutdown(kernel);
+    linux_bridge_destroy(bridge);
+    
+    TEST_PASS();
+#else
+    TEST_START("Pipeline (disabled)");
+    TEST_PASS();
+#endif
+}
+
+#define TEST_POOL_RACE_JOBS 256
+
+typedef struct {
+    KernelContext* kernel;
+    KernelJob* jobs[TEST_POOL_RACE_JOBS];
+    int accepted;
+} TestPoolRace;
+
+static void* test_pool_submit(void* arg) {
+    TestPoolRace* race = (TestPoolRace*)arg;
+    for (int i = 0; i < TEST_POOL_RACE_JOBS; i++) {
+        race->jobs[i] = kernel_submit_command(race->kernel, "echo raced", NULL);
+    }
+    return NULL;
+}
+
+static void* test_pool_stop(void* arg) {
+    kernel_stop_workers();
+    return NULL;
+}
+
+void test_kernel_jobs(void) {
+#ifndef _WIN32
+    TEST_START("Kernel Jobs");
+    
+    const char* root = "/tmp/test_kernel_jobs";
+    LinuxBridge* bridge = linux_bridge_create(root);
+    TEST_ASSERT(bridge != NULL, "Linux bridge should not be NULL");
+    TEST_ASSERT(linux_bridge_mount_filesystem(bridge), "Linux filesystem should mount successfully");
+    
+    const char* tools[] = { "sleep", "echo" };
+    char link_path[256];
+    char target[256];
+    for (int i = 0; i < 2; i++) {
+        snprintf(link_path, sizeof(link_path), "%s/bin/%s", root, tools[i]);
+        snprintf(target, sizeof(target), "/bin/%s", tools[i]);
+        unlink(link_path);
+        TEST_ASSERT(symlink(target, link_path) == 0, "Should link host tool into bridge root");
+    }
+    
+    KernelContext* kernel = kernel_init();
+    TEST_ASSERT(linux_bridge_discover_commands(bridge, kernel_get_registry(kernel)), "Commands should be discovered");
+    kernel_register_executor(ENV_LINUX, test_linux_executor, bridge);
+    TEST_ASSERT(kernel_start_workers(4), "Worker pool should start");
+    
+    // Eight 200ms sleeps on four workers take about two rounds, not eight
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    KernelJob* jobs[8];
+    for (int i = 0; i < 8; i++) {
+        jobs[i] = kernel_submit_command(kernel, "sleep 0.2", NULL);
+        TEST_ASSERT(jobs[i] != NULL, "Job should be submitted");
+    }
+    for (int i = 0; i < 8; i++) {
+        ExecutionResult* result = kernel_job_wait(jobs[i]);
+        TEST_ASSERT(result && result->result == CMD_SUCCESS && result->exit_code == 0, "Sleep job should succeed");
+        execution_result_destroy(result);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    TEST_ASSERT(elapsed < 1.2, "Jobs should run concurrently");
+    
+    // Jobs keep the context they were submitted with
+    KernelJob* linux_job = kernel_submit_command(kernel, "echo job-output", NULL);
+    kernel_switch_environment(kernel, ENV_WINDOWS);
+    KernelJob* missing_job = kernel_submit_command(kernel, "no-such-command", NULL);
+    ExecutionResult* result = kernel_job_wait(linux_job);
+    TEST_ASSERT(result && result->output && strcmp(result->output, "job-output\n") == 0, "Captured job output should match");
+    execution_result_destroy(result);
+    result = kernel_job_wait(missing_job);
+    TEST_ASSERT(result && result->result == CMD_NOT_FOUND, "Unknown command should fail in its job");
+    execution_result_destroy(result);
+    
+    // Streaming jobs deliver into the caller's sink from the worker thread
+    OutputCapture capture;
+    output_capture_init(&capture);
+    KernelJob* streamed = kernel_submit_command(kernel, "echo streamed", &capture.sink);
+    result = kernel_job_wait(streamed);
+    TEST_ASSERT(kernel_job_done(NULL), "Missing job should count as done");
+    TEST_ASSERT(result && result->exit_code == 0, "Streaming job should succeed");
+    TEST_ASSERT(capture.output.data && strcmp(capture.output.data, "streamed\n") == 0, "Streamed output should reach the sink");
+    execution_result_destroy(result);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // Shutdown drains anything still queued
+    KernelJob* pending = kernel_submit_command(kernel, "sleep 0.1", NULL);
+    kernel_stop_workers();
+    TEST_ASSERT(kernel_job_done(pending), "Stopping the pool should finish queued jobs");
+    execution_result_destroy(kernel_job_wait(pending));
+    
+    // Stops race each other and late submits; every accepted job still runs
+    TEST_ASSERT(kernel_start_workers(4), "Worker pool should restart");
+    TestPoolRace race = { kernel, { NULL }, 0 };
+    pthread_t stoppers[2];
+    pthread_t submitter;
+    TEST_ASSERT(pthread_create(&submitter, NULL, test_pool_submit, &race) == 0, "Submit thread should start");
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT(pthread_create(&stoppers[i], NULL, test_pool_stop, NULL) == 0, "Stop thread should start");
+    }
+    for (int i = 0; i < 2; i++) pthread_join(stoppers[i], NULL);
+    pthread_join(submitter, NULL);
+    for (int i = 0; i < TEST_POOL_RACE_JOBS; i++) {
+        if (!race.jobs[i]) continue;
+        race.accepted++;
+        result = kernel_job_wait(race.jobs[i]);
+        TEST_ASSERT(result && result->result == CMD_SUCCESS, "Accepted jobs should run");
+        execution_result_destroy(result);
+    }
+    TEST_ASSERT(race.accepted > 0, "Jobs submitted before the stop should be accepted");
+    kernel_stop_workers();
+    
+    kernel_shutdown(kernel);
+    linux_bridge_destroy(bridge);
+    
+    TEST_PASS();
+#else
+    TEST_START("Kernel Jobs (disabled)");
+    TEST_PASS();
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+    int commands;
+} TestDaemonSession;
+
+static void* test_daemon_open(void* userdata) {
+    return calloc(1, sizeof(TestDaemonSession));
+}
+
+// Echoes each line with a per-session counter so sessions can be told apart
+static int test_daemon_execute(void* userdata, void* handle, const char* command_line, OutputSink* sink) {
+    TestDaemonSession* session = (TestDaemonSession*)handle;
+    if (strcmp(command_line, "exit") == 0) return -1;
+    if (strcmp(command_line, "fail") == 0) {
+        sink->write(sink, OUTPUT_STREAM_STDERR, "failed\n", 7);
+        return 3;
+    }
+    if (strcmp(command_line, "big") == 0) {
+        char* data = (char*)malloc(200000);
+        memset(data, 'x', 200000);
+        sink->write(sink, OUTPUT_STREAM_STDOUT, data, 200000);
+        free(data);
+        return 0;
+    }
+    
+    char line[256];
+    int length = snprintf(line, sizeof(line), "%d:%s\n", ++session->commands, command_line);
+    sink->write(sink, OUTPUT_STREAM_STDOUT, line, (size_t)length);
+    return 0;
+}
+
+static void test_daemon_close(void* userdata, void* handle) {
+    free(handle);
+}
+
+static void* test_daemon_serve(void* path) {
+    DaemonHandlers handlers = { test_daemon_open, test_daemon_execute, test_daemon_close, NULL };
+    return kurono_daemon_serve((const char*)path, &handlers) ? path : NULL;
+}
+#endif
+
+void test_daemon(void) {
+#ifndef _WIN32
+    TEST_START("Daemon Sessions");
+    
+    const char* path = "/tmp/test_kurono_daemon.sock";
+    pthread_t server;
+    TEST_ASSERT(pthread_create(&server, NULL, test_daemon_serve, (void*)path) == 0, "Daemon thread should start");
+    
+    int first = -1;
+    for (int attempt = 0; attempt < 200 && first < 0; attempt++) {
+        first = kurono_daemon_connect(path);
+        if (first < 0) usleep(10000);
+    }
+    TEST_ASSERT(first >= 0, "Client should connect to the daemon");
+    int second = kurono_daemon_connect(path);
+    TEST_ASSERT(second >= 0, "Second client should connect concurrently");
+    
+    // Each connection keeps its own session state
+    OutputCapture capture;
+    output_capture_init(&capture);
+    TEST_ASSERT(kurono_daemon_request(first, "one", &capture.sink) == 0, "Request should succeed");
+    TEST_ASSERT(kurono_daemon_request(second, "first", &capture.sink) == 0, "Request on second session should succeed");
+    TEST_ASSERT(kurono_daemon_request(first, "two", &capture.sink) == 0, "Session should accept more commands");
+    TEST_ASSERT(capture.output.data && strcmp(capture.output.data, "1:one\n1:first\n2:two\n") == 0, "Sessions should be independent");
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // Exit codes, stderr and large outputs stream back intact
+    output_capture_init(&capture);
+    TEST_ASSERT(kurono_daemon_request(second, "fail", &capture.sink) == 3, "Exit code should reach the client");
+    TEST_ASSERT(capture.error.data && strcmp(capture.error.data, "failed\n") == 0, "Stderr should reach the client");
+    TEST_ASSERT(kurono_daemon_request(second, "big", &capture.sink) == 0, "Large output should succeed");
+    TEST_ASSERT(capture.output.length == 200000, "Large output should arrive in full");
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    
+    // exit ends only that session
+    output_capture_init(&capture);
+    TEST_ASSERT(kurono_daemon_request(first, "exit", &capture.sink) == 0, "Exit should be acknowledged");
+    TEST_ASSERT(kurono_daemon_request(first, "three", &capture.sink) < 0, "Ended session should be closed");
+    TEST_ASSERT(kurono_daemon_request(second, "second", &capture.sink) == 0, "Other sessions should keep running");
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    kurono_daemon_disconnect(first);
+    
+    // Stopping closes remaining sessions and removes the socket
+    void* served = NULL;
+    kurono_daemon_stop();
+    pthread_join(server, &served);
+    TEST_ASSERT(served != NULL, "Daemon should serve until stopped");
+    TEST_ASSERT(access(path, F_OK) != 0, "Socket should be removed on stop");
+    output_capture_init(&capture);
+    TEST_ASSERT(kurono_daemon_request(second, "late", &capture.sink) < 0, "Sessions should end with the daemon");
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    kurono_daemon_disconnect(second);
+    
+    TEST_PASS();
+#else
+    TEST_START("Daemon Sessions (disabled)");
+    TEST_PASS();
+#endif
+}
+
+// Records each command line, one per output line; "fail" exits with 2
+static int test_batch_execute(void* userdata, const char* command_line) {
+    OutputBuffer* seen = (OutputBuffer*)userdata;
+    output_buffer_append(seen, command_line, strlen(command_line));
+    output_buffer_append(seen, "\n", 1);
+    return strcmp(command_line, "fail") == 0 ? 2 : 0;
+}
+
+static bool test_batch_file(const char* path, const char* contents, size_t length) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    bool written = fwrite(contents, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+}
+
+void test_batch(void) {
+    TEST_START("Batch Mode");
+    
+    const char* path = "/tmp/test_kurono_batch.txt";
+    const char* script = "first\r\n\n# comment\nfail\n  spaced arg\nlast";
+    TEST_ASSERT(test_batch_file(path, script, strlen(script)), "Should create batch file");
+    
+    OutputBuffer seen;
+    output_buffer_init(&seen);
+    BatchSummary summary;
+    TEST_ASSERT(kurono_batch_run_file(path, test_batch_execute, &seen, &summary), "Batch file should run");
+    TEST_ASSERT(seen.data && strcmp(seen.data, "first\nfail\n  spaced arg\nlast\n") == 0, "Lines should be split, trimmed of CR and filtered");
+    TEST_ASSERT(summary.commands == 4 && summary.failures == 1 && summary.status == 2, "Summary should aggregate statuses");
+    
+    // exit ends the run like it ends the console
+    seen.length = 0;
+    TEST_ASSERT(test_batch_file(path, "one\nexit\ntwo\n", 13), "Should rewrite batch file");
+    TEST_ASSERT(kurono_batch_run_file(path, test_batch_execute, &seen, &summary), "Batch file should run");
+    TEST_ASSERT(summary.commands == 1 && summary.status == 0 && strcmp(seen.data, "one\n") == 0, "exit should stop the batch");
+    
+    // An unterminated last line filling its page exactly needs its own copy
+    char* page = (char*)malloc(8192);
+    TEST_ASSERT(page != NULL, "Should allocate page");
+    memset(page, 'x', 8192);
+    page[4095] = '\n';
+    TEST_ASSERT(test_batch_file(path, page, 8192), "Should write page-sized batch file");
+    seen.length = 0;
+    TEST_ASSERT(kurono_batch_run_file(path, test_batch_execute, &seen, &summary), "Page-sized batch should run");
+    TEST_ASSERT(summary.commands == 2 && seen.length == 8193 && seen.data[8192] == '\n', "Last line should run without overrunning the mapping");
+    free(page);
+    
+    TEST_ASSERT(!kurono_batch_run_file("/tmp/test_kurono_batch_missing.txt", test_batch_execute, &seen, &summary), "Missing input should fail");
+    remove(path);
+    
+#ifndef _WIN32
+    // Piped stdin is read in chunks, with lines running as they arrive
+    int fds[2];
+    TEST_ASSERT(pipe(fds) == 0, "Should create pipe");
+    TEST_ASSERT(write(fds[1], "alpha\nbeta\ngamma", 16) == 16, "Should fill pipe");
+    close(fds[1]);
+    int saved_stdin = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    seen.length = 0;
+    bool piped = kurono_batch_run_file(KURONO_BATCH_STDIN, test_batch_execute, &seen, &summary);
+    dup2(saved_stdin, STDIN_FILENO);
+    close(saved_stdin);
+    TEST_ASSERT(piped && summary.commands == 3 && strcmp(seen.data, "alpha\nbeta\ngamma\n") == 0, "Piped input should run every line");
+#endif
+    
+    output_buffer_free(&seen);
+    TEST_PASS();
+}
+
+void test_command_sets(void) {
+    TEST_START("Static Command Sets");
+    
+    size_t count = 0;
+    const char* const* commands = linux_bridge_common_commands(&count);
+    TEST_ASSERT(commands != NULL && count > 0, "Common Linux commands should be listed");
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT(linux_bridge_is_known_command(commands[i]), "Every listed Linux command should be known");
+    }
+    TEST_ASSERT(!linux_bridge_is_known_command("l") && !linux_bridge_is_known_command("lsx"), "Prefixes and extensions should not be known");
+    TEST_ASSERT(!linux_bridge_is_known_command("") && !linux_bridge_is_known_command(NULL), "Empty names should not be known");
+    
+    TEST_ASSERT(windows_bridge_is_known_command("ipconfig") && windows_bridge_is_known_command("Get-ChildItem"), "cmd and PowerShell commands should be known");
+    TEST_ASSERT(windows_bridge_is_powershell_command("Where-Object") && !windows_bridge_is_powershell_command("ipconfig"), "PowerShell membership should be separate");
+    TEST_ASSERT(!windows_bridge_is_known_command("get-childitem"), "Membership should be case-sensitive");
+    
+    TEST_ASSERT(kcl_is_known_command("kcl-run") && kcl_is_known_command("kurono"), "KCL commands should be known");
+    TEST_ASSERT(!kcl_is_known_command("kcl-end"), "Script keywords are not registered commands");
+    TEST_ASSERT(!kcl_is_known_command("kcl-function"), "Commands the grammar lacks should not be registered");
+    TEST_ASSERT(package_manager_is_default_package("kcl-core") && !package_manager_is_default_package("kcl"), "Default packages should be known by exact name");
+    
+    TEST_PASS();
+}
+
+// Prints the arguments it was handed, one per line in brackets
+static ExecutionResult* test_argv_executor(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    ExecutionResult* result = execution_result_create();
+    result->result = CMD_SUCCESS;
+    result->exit_code = 0;
+    
+    for (size_t i = 0; i < args->count; i++) {
+        char value[256];
+        size_t length = command_args_copy(args, i, value, sizeof(value));
+        sink->write(sink, OUTPUT_STREAM_STDOUT, "[", 1);
+        sink->write(sink, OUTPUT_STREAM_STDOUT, value, length);
+        sink->write(sink, OUTPUT_STREAM_STDOUT, "]", 1);
+    }
+    return result;
+}
+
+static bool test_add_argv_command(CommandRegistry* registry, void* userdata) {
+    command_registry_add(registry, "kargv", "kargv", ENV_KURONO, "Argument printer");
+    return true;
+}
+
+void test_command_args(void) {
+    TEST_START("Command Arguments");
+    
+    CommandArgs args;
+    const char* line = "  grep -n 'a b'  \"say \\\"hi\\\"\" x\\ y \"c:\\dir\" 'it'\\''s'";
+    TEST_ASSERT(command_args_parse(&args, line), "Quoted line should parse");
+    TEST_ASSERT(args.count == 7 && args.tokens == args.inline_tokens, "Short lines should stay inline");
+    TEST_ASSERT(args.tokens[0].offset == 2 && args.tokens[0].length == 4 && !args.tokens[0].quoted, "Tokens should be views into the line");
+    
+    const char* expected[] = { "grep", "-n", "a b", "say \"hi\"", "x y", "c:\\dir", "it's" };
+    char value[64];
+    for (size_t i = 0; i < 7; i++) {
+        size_t length = command_args_copy(&args, i, value, sizeof(value));
+        TEST_ASSERT(strcmp(value, expected[i]) == 0 && length == strlen(expected[i]), "Arguments should unquote like a shell");
+    }
+    TEST_ASSERT(command_args_copy(&args, 3, value, 4) == 8 && strcmp(value, "say") == 0, "Copies should truncate like snprintf");
+    
+    char* argv[8];
+    char storage[128];
+    TEST_ASSERT(command_args_argv(&args, argv, 8, storage, sizeof(storage)) == 7, "argv should hold every argument");
+    TEST_ASSERT(strcmp(argv[2], "a b") == 0 && strcmp(argv[6], "it's") == 0 && argv[7] == NULL, "argv should be unquoted and terminated");
+    TEST_ASSERT(command_args_argv(&args, argv, 7, storage, sizeof(storage)) == -1, "argv without room for NULL should be rejected");
+    command_args_free(&args);
+    
+    TEST_ASSERT(command_args_parse(&args, " \t ") && args.count == 0, "Blank lines have no arguments");
+    TEST_ASSERT(!command_args_parse(&args, "echo 'open") && !command_args_parse(&args, "echo \"open\\\""), "Unterminated quotes should fail");
+    
+    // Long lines spill to the heap
+    char long_line[512] = "";
+    for (int i = 0; i < 40; i++) strcat(long_line, "arg ");
+    TEST_ASSERT(command_args_parse(&args, long_line) && args.count == 40 && args.tokens != args.inline_tokens, "Long lines should spill");
+    command_args_free(&args);
+    
+    // The kernel parses once and hands the arguments to the executor
+    KernelContext* kernel = kernel_init();
+    TEST_ASSERT(kernel_update_registry(test_add_argv_command, NULL), "Test command should register");
+    KernelEnvironmentHandlers previous = *kernel_get_handlers(ENV_KURONO);
+    kernel_register_executor(ENV_KURONO, test_argv_executor, NULL);
+    
+    ExecutionResult* result = kernel_execute_command(kernel, "  'kargv' \"two words\" x\\|y");
+    TEST_ASSERT(result && result->result == CMD_SUCCESS, "Quoted command names should resolve");
+    TEST_ASSERT(result->output && strcmp(result->output, "[kargv][two words][x|y]") == 0, "Executor should receive parsed arguments");
+    execution_result_destroy(result);
+    
+    result = kernel_execute_command(kernel, "kargv 'unterminated");
+    TEST_ASSERT(result && result->result == CMD_NOT_FOUND && result->error && strstr(result->error, "quote"), "Unterminated quotes should be reported");
+    execution_result_destroy(result);
+    
+#ifndef _WIN32
+    // Quoted and escaped bars do not split a pipeline
+    OutputCapture capture;
+    output_capture_init(&capture);
+    PipelineResult* pipeline = kernel_execute_pipeline(kernel, "kargv a | kargv 'b|c' d\\|e", &capture.sink);
+    TEST_ASSERT(pipeline && pipeline->stage_count == 2 && pipeline->error == NULL, "Pipeline should have two stages");
+    TEST_ASSERT(capture.output.data && strcmp(capture.output.data, "[kargv][b|c][d|e]") == 0, "Last stage should get its own arguments");
+    pipeline_result_destroy(pipeline);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+#endif
+    
+    kernel_register_executor(ENV_KURONO, previous.executor, previous.executor_userdata);
+    kernel_shutdown(kernel);
     
     TEST_PASS();
 }
 
-void test_linux_bridge(void) {
-#ifndef KURONO_DISABLE_LINUX
-    TEST_START("Linux Bridge");
+static bool test_add_result_commands(CommandRegistry* registry, void* userdata) {
+    command_registry_add(registry, "kargv", "kargv", ENV_KURONO, "Argument printer");
+    command_registry_add(registry, "kdup", "/usr/bin/kdup", ENV_LINUX, "Duplicate command");
+    command_registry_add(registry, "kdup", "kdup", ENV_KURONO, "Duplicate command");
+    return true;
+}
+
+void test_result_pool(void) {
+    TEST_START("Execution Result Pool");
     
-    LinuxBridge* bridge = linux_bridge_create("/tmp/test_linux");
-    TEST_ASSERT(bridge != NULL, "Linux bridge should not be NULL");
+    KernelContext* kernel = kernel_init();
+    TEST_ASSERT(kernel_update_registry(test_add_result_commands, NULL), "Test commands should register");
+    KernelEnvironmentHandlers previous = *kernel_get_handlers(ENV_KURONO);
+    kernel_register_executor(ENV_KURONO, test_argv_executor, NULL);
+    OutputCapture capture;
+    output_capture_init(&capture);
     
-    bool mounted = linux_bridge_mount_filesystem(bridge);
-    TEST_ASSERT(mounted, "Linux filesystem should mount successfully");
+    // Fixed messages are borrowed; taking one hands out a copy
+    ExecutionResult* result = kernel_execute_command_streaming(kernel, "knothere", &capture.sink);
+    TEST_ASSERT(result && result->result == CMD_NOT_FOUND, "Unknown commands should not be found");
+    TEST_ASSERT((result->flags & EXECUTION_RESULT_STATIC_ERROR) && strcmp(result->error, "Command not found") == 0, "Not-found error should be static");
+    char* error = execution_result_take_error(result);
+    TEST_ASSERT(error && strcmp(error, "Command not found") == 0 && result->error == NULL && result->flags == 0, "Taking a static error should copy it");
+    free(error);
     
-    CommandRegistry* registry = command_registry_create();
-    bool registered = linux_bridge_register_commands(bridge, registry);
-    TEST_ASSERT(registered, "Linux commands should register successfully");
+    execution_result_destroy(result);
+    ExecutionResult* reused = execution_result_create();
+    TEST_ASSERT(reused == result && reused->error == NULL && reused->flags == 0 && reused->exit_code == -1, "Destroyed results should be recycled clean");
+    execution_result_destroy(reused);
     
-    size_t count = 0;
-    CommandEntry** entries = command_registry_find(registry, "ls", &count);
-    TEST_ASSERT(count > 0, "Should find Linux 'ls' command");
+    result = kernel_execute_command_streaming(kernel, "kdup", &capture.sink);
+    TEST_ASSERT(result && result->result == CMD_AMBIGUOUS && result->error == result->message.data, "Ambiguous error should be built in the message buffer");
+    execution_result_destroy(result);
     
-    free(entries);
-    command_registry_destroy(registry);
-    linux_bridge_destroy(bridge);
+    // Caller-provided results
+    ExecutionResult local;
+    execution_result_init(&local);
+    TEST_ASSERT(kernel_execute_command_into(kernel, "kdup -x", &capture.sink, &local), "Ambiguous command should run into the result");
+    TEST_ASSERT(local.result == CMD_AMBIGUOUS && local.error && strstr(local.error, "1) /usr/bin/kdup (Linux)") && strstr(local.error, "2) kdup (Kurono)"), "Ambiguous error should list every match");
+    TEST_ASSERT(kernel_execute_command_into(kernel, "kargv one", &capture.sink, &local), "Resolved command should run into the result");
+    TEST_ASSERT(local.result == CMD_SUCCESS && local.error == NULL && capture.output.data && strcmp(capture.output.data, "[kargv][one]") == 0, "Executor result should move into the caller's result");
+    TEST_ASSERT(kernel_execute_command_into(kernel, "   ", &capture.sink, &local) && local.error && strcmp(local.error, "Empty command") == 0, "Empty lines should be reported");
     
-    TEST_PASS();
-#else
-    TEST_START("Linux Bridge (disabled)");
-    TEST_PASS();
+#ifdef TEST_COUNT_ALLOCATIONS
+    // Everything above warmed the pool and the message buffers
+    __atomic_store_n(&g_count_allocations, true, __ATOMIC_RELAXED);
+    for (int i = 0; i < 100; i++) {
+        execution_result_destroy(kernel_execute_command_streaming(kernel, "knothere", &capture.sink));
+        execution_result_destroy(kernel_execute_command_streaming(kernel, "kdup", &capture.sink));
+        execution_result_destroy(kernel_execute_command(kernel, "knothere now"));
+        kernel_execute_command_into(kernel, "knothere", &capture.sink, &local);
+        kernel_execute_command_into(kernel, "kdup a b", &capture.sink, &local);
+        kernel_execute_command_into(kernel, "echo 'open", &capture.sink, &local);
+    }
+    __atomic_store_n(&g_count_allocations, false, __ATOMIC_RELAXED);
+    size_t allocations = __atomic_load_n(&g_allocation_count, __ATOMIC_RELAXED);
+    TEST_ASSERT(allocations == 0, "Not-found and ambiguous commands should not allocate");
+    TEST_ASSERT(local.result == CMD_NOT_FOUND && strcmp(local.error, "Unterminated quote in command line") == 0, "Last result should be the quote error");
 #endif
+    
+    execution_result_release(&local);
+    output_buffer_free(&capture.output);
+    output_buffer_free(&capture.error);
+    kernel_register_executor(ENV_KURONO, previous.executor, previous.executor_userdata);
+    kernel_shutdown(kernel);
+    
+    TEST_PASS();
 }
 
 void test_windows_bridge(void) {
@@ -115,6 +1216,679 @@ void test_kcl_interpreter(void) {
     TEST_PASS();
 }
 
+// Kurono commands for the KCL tests: kargs prints its command line, kexit N
+// exits with status N, and with a KCL context as userdata kvar NAME prints a
+// variable and kset NAME VALUE sets one
+static ExecutionResult* test_kcl_executor(void* userdata, const KernelContext* ctx, const CommandEntry* entry, const char* command_line, const CommandArgs* args, OutputSink* sink) {
+    ExecutionResult* result = execution_result_create();
+    result->result = CMD_SUCCESS;
+    result->exit_code = 0;
+    
+    if (strcmp(entry->name, "kargs") == 0) {
+        sink->write(sink, OUTPUT_STREAM_STDOUT, command_line, strlen(command_line));
+        sink->write(sink, OUTPUT_STREAM_STDOUT, "\n", 1);
+    } else if (strcmp(entry->name, "kexit") == 0) {
+        result->exit_code = atoi(command_line + 5);
+        if (result->exit_code != 0) result->result = CMD_EXECUTION_FAILED;
+    } else if (strcmp(entry->name, "kvar") == 0 && userdata) {
+        const char* value = kcl_get_variable((KCLContext*)userdata, command_line + 5);
+        if (!value) value = "(unset)";
+        sink->write(sink, OUTPUT_STREAM_STDOUT, value, strlen(value));
+        sink->write(sink, OUTPUT_STREAM_STDOUT, "\n", 1);
+    } else if (strcmp(entry->name, "kset") == 0 && userdata) {
+        char name[64], value[64];
+        if (sscanf(command_line + 5, "%63s %63s", name, value) != 2 || !kcl_set_variable((KCLContext*)userdata, name, value)) {
+            result->exit_code = 1;
+            result->result = CMD_EXECUTION_FAILED;
+        }
+    }
+    return result;
+}
+
+static bool test_add_kcl_commands(CommandRegistry* registry, void* userdata) {
+    kcl_register_commands((KCLContext*)userdata, registry);
+    command_registry_add(registry, "kargs", "kargs", ENV_KURONO, "KCL test command");
+    command_registry_add(registry, "kexit", "kexit", ENV_KURONO, "KCL test command");
+    command_registry_add(registry, "kvar", "kvar", ENV_KURONO, "KCL test command");
+    command_registry_add(registry, "kset", "kset", ENV_KURONO, "KCL test command");
+    return true;
+}
+
+typedef struct {
+    const char* script;
+    const char* output;
+    int status;
+} TestKCLCase;
+
+static const TestKCLCase test_kcl_cases[] = {
+    { "kcl-set name world\necho \"hello $name\" 'and $name' \\$name\n", "hello world and $name $name\n", 0 },
+    { "kcl-for i from 1 to 5\n    kcl-if $i -gt 3\n        echo big $i\n    kcl-else\n        echo small $i\n    kcl-end\nkcl-end\n",
+      "small 1\nsmall 2\nsmall 3\nbig 4\nbig 5\n", 0 },
+    { "kcl-set s a\nkcl-while $s != done\n    echo $s\n    kcl-set s done\nkcl-end\n", "a\n", 0 },
+    { "kcl-for word in one \"two three\" $missing four; echo [$word]; kcl-end", "[one]\n[two three]\n[]\n[four]\n", 0 },
+    { "kcl-set n 3; kcl-set m $n; kargs $m${n}x # comment\nkcl-if $m == 3; echo eq; kcl-end", "kargs 33x\neq\n", 0 },
+    { "kcl-for i from 1 to 3; kcl-set last $i; kcl-end; kcl-if $last -eq 3; kexit 3; kcl-end", "", 3 },
+    { "kexit 0; kcl-no-such-command a b", "", 127 },
+    { "kcl-set x abc; kcl-if $x -lt 4; echo unreachable; kcl-end; echo after", "", 1 },
+    { "kcl-for i from 3 to 1; echo never; kcl-end; kcl-set x", "", 0 },
+};
+
+static ExecutionResult* test_kcl_run(KCLContext* ctx, const char* script) {
+    ExecutionResult* result = kcl_execute_string(ctx, script);
+    if (result && !result->output) result->output = strdup("");
+    return result;
+}
+
+void test_kcl_scripts(void) {
+    TEST_START("KCL Scripts");
+    
+    // Statements are split on newlines and ';', and the first word of each
+    // statement or pipeline stage is its command
+    KCLLexer* lexer = kcl_lexer_create("ls -l $dir | grep 'a b' >> out\n\necho 42");
+    TEST_ASSERT(lexer != NULL, "Lexer should tokenize");
+    KCLTokenType expected[] = {
+        KCL_TOKEN_COMMAND, KCL_TOKEN_ARGUMENT, KCL_TOKEN_VARIABLE, KCL_TOKEN_PIPE, KCL_TOKEN_COMMAND,
+        KCL_TOKEN_STRING, KCL_TOKEN_REDIRECT, KCL_TOKEN_ARGUMENT, KCL_TOKEN_OPERATOR, KCL_TOKEN_COMMAND,
+        KCL_TOKEN_NUMBER, KCL_TOKEN_EOF
+    };
+    for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+        KCLToken token = kcl_lexer_next_token(lexer);
+        TEST_ASSERT(token.type == expected[i], "Tokens should be classified");
+        if (i == 5) TEST_ASSERT(token.length == 5 && memcmp(kcl_token_text(lexer, &token), "'a b'", 5) == 0, "Tokens should be views of the source");
+        if (i == 4) TEST_ASSERT(token.line == 1 && token.column == 14, "Tokens should carry their column");
+        if (i == 9) TEST_ASSERT(token.line == 3 && token.column == 1, "Tokens should carry their position");
+    }
+    kcl_lexer_destroy(lexer);
+    
+    // Quoted newlines belong to the word but still advance the line
+    lexer = kcl_lexer_create("echo \"a\nb\" ${x} -7 $x-y\n  kcl-end");
+    TEST_ASSERT(lexer != NULL && lexer->count == 7, "Lexer should tokenize multi-line words");
+    TEST_ASSERT(lexer->tokens[1].type == KCL_TOKEN_STRING && lexer->tokens[1].line == 1, "Quoted words start on their first line");
+    TEST_ASSERT(lexer->tokens[2].type == KCL_TOKEN_VARIABLE && lexer->tokens[2].line == 2 && lexer->tokens[2].column == 4, "Words after a quoted newline move down a line");
+    TEST_ASSERT(lexer->tokens[3].type == KCL_TOKEN_NUMBER && lexer->tokens[4].type == KCL_TOKEN_ARGUMENT, "Numbers and words should be told apart");
+    TEST_ASSERT(lexer->tokens[6].type == KCL_TOKEN_COMMAND && lexer->tokens[6].line == 3 && lexer->tokens[6].column == 3, "Indented commands should keep their column");
+    kcl_lexer_destroy(lexer);
+    
+    KCLScript* script = kcl_parse("echo ok\nkcl-if a == b\n    echo x\n");
+    TEST_ASSERT(script && script->has_error && strstr(script->error_message, "line 2") != NULL, "Unclosed blocks should be reported with their line");
+    kcl_script_destroy(script);
+    script = kcl_parse("echo 'open");
+    TEST_ASSERT(script && script->has_error, "Unterminated quotes should not parse");
+    kcl_script_destroy(script);
+    
+    KernelContext* kernel = kernel_init();
+    KCLContext* ctx = kcl_context_create(kernel);
+    TEST_ASSERT(ctx != NULL, "KCL context should not be NULL");
+    TEST_ASSERT(kernel_update_registry(test_add_kcl_commands, ctx), "Test commands should register");
+    KernelEnvironmentHandlers previous = *kernel_get_handlers(ENV_KURONO);
+    kernel_register_executor(ENV_KURONO, test_kcl_executor, NULL);
+    
+    for (size_t i = 0; i < sizeof(test_kcl_cases) / sizeof(test_kcl_cases[0]); i++) {
+        ExecutionResult* result = test_kcl_run(ctx, test_kcl_cases[i].script);
+        TEST_ASSERT(result != NULL, "Scripts should return a result");
+        TEST_ASSERT(strcmp(result->output, test_kcl_cases[i].output) == 0, "Script output should match");
+        TEST_ASSERT(result->exit_code == test_kcl_cases[i].status, "Script status should be its last command's");
+        if (test_kcl_cases[i].status == 127) {
+            TEST_ASSERT(result->error && strstr(result->error, "command not found: kcl-no-such-command"), "Missing commands should be reported");
+        }
+        execution_result_destroy(result);
+    }
+    
+    // Redirection writes stdout to the file and keeps stderr with the caller
+    char path[256];
+    snprintf(path, sizeof(path), "/tmp/kurono_kcl_redirect_%d.txt", (int)getpid());
+    char text[1024];
+    snprintf(text, sizeof(text), "kcl-set f %s\necho first > $f\nkargs second >> $f\nkcl-for i from 1 to 2; echo $i >> \"$f\"; kcl-end", path);
+    ExecutionResult* result = test_kcl_run(ctx, text);
+    TEST_ASSERT(result && result->exit_code == 0 && result->output[0] == '\0', "Redirected output should not reach the sink");
+    execution_result_destroy(result);
+    
+    char* contents = kcl_read_script(path);
+    TEST_ASSERT(contents && strcmp(contents, "first\nkargs second\n1\n2\n") == 0, "Redirection should create and append");
+    free(contents);
+    remove(path);
+    
+    kernel_register_executor(ENV_KURONO, previous.executor, previous.executor_userdata);
+    kcl_context_destroy(ctx);
+    kernel_shutdown(kernel);
+    
+    TEST_PASS();
+}
+
+// Heap calls made parsing and freeing `copies` repetitions of a statement
+static size_t test_kcl_parse_allocations(const char* statement, size_t copies) {
+    OutputBuffer text;
+    output_buffer_init(&text);
+    for (size_t i = 0; i < copies; i++) output_buffer_append(&text, statement, strlen(statement));
+    
+    size_t allocations = 0;
+#ifdef TEST_COUNT_ALLOCATIONS
+    size_t before = __atomic_load_n(&g_allocation_count, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_count_allocations, true, __ATOMIC_RELAXED);
+    kcl_script_destroy(kcl_parse(text.data));
+    __atomic_store_n(&g_count_allocations, false, __ATOMIC_RELAXED);
+    allocations = __atomic_load_n(&g_allocation_count, __ATOMIC_RELAXED) - before;
+#endif
+    
+    output_buffer_free(&text);
+    return allocations;
+}
+
+void test_kcl_ast(void) {
+    TEST_START("KCL Syntax Tree");
+    
+    KCLScript* script = kcl_parse("kcl-for i in a b c\n    echo $i x${i}y >> out\nkcl-end\n");
+    TEST_ASSERT(script && !script->has_error && script->root->child_count == 1, "Script should parse");
+    TEST_ASSERT(script->arena.bytes_used > 0, "Nodes should come from the script's arena");
+    
+    const KCLNode* loop = script->root->children[0];
+    TEST_ASSERT(loop->type == KCL_NODE_FOR && strcmp(loop->value, "i") == 0 && loop->child_count == 4, "Loop should hold its items and body");
+    const KCLNode* body = loop->children[3];
+    TEST_ASSERT(body->type == KCL_NODE_BLOCK && body->child_count == 1, "Loop body should be a block");
+    
+    const KCLNode* command = body->children[0];
+    TEST_ASSERT(command->type == KCL_NODE_COMMAND && command->child_count == 4, "Command should hold its words and redirection");
+    TEST_ASSERT(command->children[1]->type == KCL_NODE_VARIABLE && strcmp(command->children[1]->value, "i") == 0, "Lone variables should not be wrapped");
+    const KCLNode* word = command->children[2];
+    TEST_ASSERT(word->type == KCL_NODE_WORD && word->child_count == 3 && word->children[1]->type == KCL_NODE_VARIABLE, "Mixed words should be split");
+    const KCLNode* redirect = command->children[3];
+    TEST_ASSERT(redirect->type == KCL_NODE_REDIRECTION && strcmp(redirect->value, ">>") == 0 && redirect->child_count == 1, "Redirection should keep its target");
+    kcl_script_destroy(script);
+    
+    // A failed parse gives back its partial tree with the arena
+    script = kcl_parse("kcl-if a == b\n    echo 'open\nkcl-end");
+    TEST_ASSERT(script && script->has_error && script->root == NULL, "Broken scripts should not parse");
+    kcl_script_destroy(script);
+    
+#ifdef TEST_COUNT_ALLOCATIONS
+    // The number of heap calls must not grow with the number of nodes
+    const char* statement = "kcl-if $n -lt 3; deploy --host \"node-$n\" | tee -a log > out; kcl-end\n";
+    size_t small = test_kcl_parse_allocations(statement, 10);
+    size_t large = test_kcl_parse_allocations(statement, 10000);
+    TEST_ASSERT(small > 0 && large <= small + 16, "Parsing should not allocate per node");
+#endif
+    
+    TEST_PASS();
+}
+
+static bool test_add_late_command(CommandRegistry* registry, void* userdata) {
+    command_registry_add(registry, "klate", "klate", ENV_KURONO, "KCL test command");
+    return true;
+}
+
+// Runs a compiled program and returns its status with the program freed
+static int test_kcl_run_program(KCLContext* ctx, KCLProgram* program, OutputCapture* capture) {
+    output_capture_init(capture);
+    int status = kcl_program_run(program, ctx, &capture->sink);
+    kcl_program_destroy(program);
+    return status;
+}
+
+static KCLProgram* test_kcl_compile(const char* text) {
+    KCLScript* script = kcl_parse(text);
+    KCLProgram* program = kcl_program_compile(script, NULL);
+    kcl_script_destroy(script);
+    return program;
+}
+
+// Heap calls made running a loop of `iterations` commands and assignments
+static size_t test_kcl_run_allocations(KCLContext* ctx, size_t iterations) {
+    char text[128];
+    snprintf(text, sizeof(text), "kcl-for i from 1 to %zu; kexit 0; kcl-set last x$i; kcl-end", iterations);
+    KCLProgram* program = test_kcl_compile(text);
+    
+    OutputCapture capture;
+    output_capture_init(&capture);
+    size_t allocations = 0;
+#ifdef TEST_COUNT_ALLOCATIONS
+    size_t before = __atomic_load_n(&g_allocation_count, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_count_allocations, true, __ATOMIC_RELAXED);
+    kcl_program_run(program, ctx, &capture.sink);
+    __atomic_store_n(&g_count_allocations, false, __ATOMIC_RELAXED);
+    allocations = __atomic_load_n(&g_allocation_count, __ATOMIC_RELAXED) - before;
+#endif
+    
+    output_capture_finish(&capture, NULL);
+    kcl_program_destroy(program);
+    return allocations;
+}
+
+void test_kcl_vm(void) {
+    TEST_START("KCL Bytecode");
+    
+    KCLProgram* program = test_kcl_compile("kcl-for i in a b; kargs $i; kargs -v $i > out; $i x; echo $i; kcl-end\nkargs | kargs");
+    TEST_ASSERT(program != NULL && program->code_length > 0, "Script should compile");
+    TEST_ASSERT(program->code[program->code_length - 1] == KCL_INSTRUCTION(KCL_OP_HALT, 0), "Programs should end with HALT");
+    TEST_ASSERT(program->command_count == 1 && strcmp(kcl_program_constant(program, program->commands[0]), "kargs") == 0, "Each literal command name should be resolved once");
+    TEST_ASSERT(program->variable_count == 1 && program->loop_count == 1, "Variables and loops should get slots");
+    TEST_ASSERT(program->stack_depth == 4, "Stack depth should be known up front");
+    kcl_program_destroy(program);
+    
+    char* error = NULL;
+    KCLScript* script = kcl_parse("kcl-if a ==");
+    TEST_ASSERT(kcl_program_compile(script, &error) == NULL && error != NULL, "Broken scripts should not compile");
+    free(error);
+    kcl_script_destroy(script);
+    
+    KernelContext* kernel = kernel_init();
+    KCLContext* ctx = kcl_context_create(kernel);
+    TEST_ASSERT(ctx != NULL, "KCL context should not be NULL");
+    TEST_ASSERT(kernel_update_registry(test_add_kcl_commands, ctx), "Test commands should register");
+    KernelEnvironmentHandlers previous = *kernel_get_handlers(ENV_KURONO);
+    kernel_register_executor(ENV_KURONO, test_kcl_executor, NULL);
+    
+    // Names only known at run time are resolved by the kernel as before
+    OutputCapture capture;
+    int status = test_kcl_run_program(ctx, test_kcl_compile("kcl-set c kargs; $c dynamic; 'kargs' quoted; kargs static"), &capture);
+    TEST_ASSERT(status == 0 && capture.output.data && strcmp(capture.output.data, "kargs dynamic\nkargs quoted\nkargs static\n") == 0, "Static and dynamic command names should both run");
+    output_capture_finish(&capture, NULL);
+    
+    // Programs are not tied to the registry version they were compiled under
+    program = test_kcl_compile("klate");
+    TEST_ASSERT(program != NULL && program->command_count == 1, "Late command should compile");
+    TEST_ASSERT(kernel_update_registry(test_add_late_command, NULL), "Late command should register");
+    TEST_ASSERT(test_kcl_run_program(ctx, program, &capture) == 0, "Commands added after compiling should resolve when the program runs");
+    output_capture_finish(&capture, NULL);
+    
+#ifdef TEST_COUNT_ALLOCATIONS
+    // Once the run's buffers have grown, iterations reuse them
+    test_kcl_run_allocations(ctx, 10);
+    size_t small = test_kcl_run_allocations(ctx, 10);
+    size_t large = test_kcl_run_allocations(ctx, 10000);
+    TEST_ASSERT(small > 0 && large == small, "Loop iterations should not allocate");
+#endif
+    
+    kernel_register_executor(ENV_KURONO, previous.executor, previous.executor_userdata);
+    kcl_context_destroy(ctx);
+    kernel_shutdown(kernel);
+    
+    TEST_PASS();
+}
+
+void test_kcl_variables(void) {
+    TEST_START("KCL Variables");
+    
+    KCLVariableStore store;
+    kcl_variables_init(&store);
+    TEST_ASSERT(kcl_variables_find(&store, "x", 1) == NULL, "An empty store should find nothing");
+    TEST_ASSERT(kcl_variables_set(&store, "x", 1, "short", 5), "Variables should be set");
+    const KCLVariable* x = kcl_variables_find(&store, "x", 1);
+    TEST_ASSERT(x && x->value.capacity == 0 && strcmp(kcl_value_data(&x->value), "short") == 0, "Short values should be stored inline");
+    const char* name = x->name;
+    
+    char long_value[128];
+    memset(long_value, 'v', sizeof(long_value) - 1);
+    long_value[sizeof(long_value) - 1] = '\0';
+    TEST_ASSERT(kcl_variables_set(&store, "x", 1, long_value, strlen(long_value)), "Long values should be set");
+    x = kcl_variables_find(&store, "x", 1);
+    TEST_ASSERT(x && x->value.capacity > 0 && strcmp(kcl_value_data(&x->value), long_value) == 0, "Long values should move to the heap");
+    TEST_ASSERT(kcl_variables_set(&store, "x", 1, "back", 4), "Values should shrink again");
+    x = kcl_variables_find(&store, "x", 1);
+    TEST_ASSERT(x && x->value.capacity == 0 && strcmp(kcl_value_data(&x->value), "back") == 0, "Shrunk values should return inline");
+    
+    // Growing the table rehashes entries but keeps their interned names
+    char key[32];
+    for (int i = 0; i < 500; i++) {
+        snprintf(key, sizeof(key), "name%d", i);
+        kcl_variables_set(&store, key, strlen(key), key, strlen(key));
+    }
+    bool all_found = true;
+    for (int i = 0; i < 500; i++) {
+        snprintf(key, sizeof(key), "name%d", i);
+        const KCLVariable* variable = kcl_variables_find(&store, key, strlen(key));
+        all_found = all_found && variable && strcmp(kcl_value_data(&variable->value), key) == 0;
+    }
+    TEST_ASSERT(all_found && store.count == 501, "Every variable should survive growth");
+    TEST_ASSERT(store.count * 4 <= store.capacity * 3, "The table should stay at most three quarters full");
+    x = kcl_variables_find(&store, "x", 1);
+    TEST_ASSERT(x && x->name == name, "Names should be interned once");
+    
+    TEST_ASSERT(kcl_variables_set(&store, "x", 1, NULL, 0) && kcl_variables_find(&store, "x", 1) == NULL, "Unset variables should not be found");
+    TEST_ASSERT(kcl_variables_set(&store, "x", 1, "again", 5) && kcl_variables_find(&store, "x", 1) != NULL, "Unset variables can be set again");
+    kcl_variables_free(&store);
+    
+    KernelContext* kernel = kernel_init();
+    KCLContext* ctx = kcl_context_create(kernel);
+    TEST_ASSERT(ctx != NULL, "KCL context should not be NULL");
+    TEST_ASSERT(kernel_update_registry(test_add_kcl_commands, ctx), "Test commands should register");
+    KernelEnvironmentHandlers previous = *kernel_get_handlers(ENV_KURONO);
+    kernel_register_executor(ENV_KURONO, test_kcl_executor, ctx);
+    
+    TEST_ASSERT(kcl_get_variable(ctx, "host") == NULL, "Unknown variables should be unset");
+    TEST_ASSERT(kcl_set_variable(ctx, "host", "kurono") && strcmp(kcl_get_variable(ctx, "host"), "kurono") == 0, "Context variables should be stored");
+    TEST_ASSERT(kcl_set_variable(ctx, "name", "outer"), "Context variables should be stored");
+    
+    // Names a script only reads come from the context; its own variables
+    // start empty and stay in the run's frame
+    ExecutionResult* result = test_kcl_run(ctx, "echo [$name] $host; kcl-set name inner; echo $name; kvar name; kvar host");
+    TEST_ASSERT(result && result->exit_code == 0 && strcmp(result->output, "[] kurono\ninner\ninner\nkurono\n") == 0, "Scripts should read context variables and their own");
+    execution_result_destroy(result);
+    TEST_ASSERT(strcmp(kcl_get_variable(ctx, "name"), "outer") == 0, "Script variables should not leak into the context");
+    
+    // Commands reach the running script's variables by name
+    result = test_kcl_run(ctx, "kcl-for i from 1 to 2; kvar i; kcl-end; kcl-set n 1; kset n 2; echo $n; kvar n");
+    TEST_ASSERT(result && result->exit_code == 0 && strcmp(result->output, "1\n2\n2\n2\n") == 0, "Commands should see and set the script's variables");
+    execution_result_destroy(result);
+    TEST_ASSERT(kcl_get_variable(ctx, "i") == NULL && kcl_get_variable(ctx, "n") == NULL, "Frames should be gone after the run");
+    
+    // A variable the script only reads is copied once, when it starts
+    result = test_kcl_run(ctx, "kset host other; echo $host");
+    TEST_ASSERT(result && result->exit_code == 0 && strcmp(result->output, "kurono\n") == 0, "Read-only names should keep their starting value");
+    execution_result_destroy(result);
+    TEST_ASSERT(strcmp(kcl_get_variable(ctx, "host"), "other") == 0, "Names a script does not own should be set in the context");
+    
+    TEST_ASSERT(kcl_set_variable(ctx, "host", NULL) && kcl_get_variable(ctx, "host") == NULL, "Setting NULL should unset");
+    result = test_kcl_run(ctx, "echo [$host]");
+    TEST_ASSERT(result && strcmp(result->output, "[]\n") == 0, "Unset variables should expand to nothing");
+    execution_result_destroy(result);
+    
+    KCLProgram* program = test_kcl_compile("echo $a $b; kcl-set b x; kcl-for c in $a; kcl-end");
+    TEST_ASSERT(program && program->import_count == 1 && strcmp(kcl_program_constant(program, program->variables[program->imports[0]]), "a") == 0, "Only unassigned names should be imported");
+    kcl_program_destroy(program);
+    
+    kernel_register_executor(ENV_KURONO, previous.executor, previous.executor_userdata);
+    kcl_context_destroy(ctx);
+    kernel_shutdown(kernel);
+    
+    TEST_PASS();
+}
+
+static void test_write_file(const char* path, const char* text, time_t mtime) {
+    FILE* file = fopen(path, "wb");
+    if (file) {
+        fputs(text, file);
+        fclose(file);
+    }
+    struct utimbuf times = { mtime, mtime };
+    utime(path, &times);
+}
+
+// Output of kcl_execute_file, or NULL when the script failed
+static char* test_kcl_file_output(KCLContext* ctx, const char* path) {
+    ExecutionResult* result = kcl_execute_file(ctx, path);
+    char* output = result && result->exit_code == 0 ? strdup(result->output ? result->output : "") : NULL;
+    execution_result_destroy(result);
+    return output;
+}
+
+static bool test_kcl_cache_accepts(const char* cache_dir, const char* path) {
+    KCLSourceStamp stamp;
+    if (!kcl_source_stamp(path, &stamp)) return false;
+    KCLProgram* program = kcl_bytecode_load(cache_dir, path, &stamp, NULL);
+    bool mapped = program && program->mapping != NULL;
+    kcl_program_destroy(program);
+    return mapped;
+}
+
+void test_kcl_cache(void) {
+    TEST_START("KCL Bytecode Cache");
+    
+    char cache_dir[256], script_path[256];
+    snprintf(cache_dir, sizeof(cache_dir), "/tmp/kurono_kcl_bytecode_%d/nested", (int)getpid());
+    snprintf(script_path, sizeof(script_path), "/tmp/kurono_kcl_cached_%d.kcl", (int)getpid());
+    
+    KernelContext* kernel = kernel_init();
+    KCLContext* ctx = kcl_context_create(kernel);
+    TEST_ASSERT(ctx != NULL && kcl_context_set_bytecode_cache(ctx, cache_dir), "Bytecode cache should be configurable");
+    
+    // The first run compiles and stores; the script's stamp predates the
+    // artifact, so later runs trust it without reading the script
+    test_write_file(script_path, "kcl-for i from 1 to 2; echo v1 $i; kcl-end\n", 1000000);
+    char* output = test_kcl_file_output(ctx, script_path);
+    TEST_ASSERT(output && strcmp(output, "v1 1\nv1 2\n") == 0, "Scripts should run through the cache");
+    free(output);
+    char* artifact = kcl_bytecode_cache_path(cache_dir, script_path);
+    struct stat st;
+    TEST_ASSERT(artifact && stat(artifact, &st) == 0, "Runs should leave an artifact");
+    TEST_ASSERT(test_kcl_cache_accepts(cache_dir, script_path), "Artifacts should map while the stamp matches");
+    
+    // Artifacts anyone else could have written are never mapped
+    TEST_ASSERT((st.st_mode & 0777) == 0600, "Artifacts should be written owner-only");
+    chmod(artifact, 0620);
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Group-writable artifacts should be refused");
+    chmod(artifact, 0600);
+    chmod(cache_dir, 0777);
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Artifacts in world-writable directories should be refused");
+    chmod(cache_dir, 0700);
+    char moved[320];
+    snprintf(moved, sizeof(moved), "%s.moved", artifact);
+    TEST_ASSERT(rename(artifact, moved) == 0 && symlink(moved, artifact) == 0, "Artifact should be replaced by a link");
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Symlinked artifacts should be refused");
+    TEST_ASSERT(remove(artifact) == 0 && rename(moved, artifact) == 0, "Artifact should be restored");
+    TEST_ASSERT(test_kcl_cache_accepts(cache_dir, script_path), "Restored artifacts should map again");
+    
+    // Same size and mtime: the stamp alone decides, as it does for make
+    test_write_file(script_path, "kcl-for i from 1 to 2; echo v2 $i; kcl-end\n", 1000000);
+    output = test_kcl_file_output(ctx, script_path);
+    TEST_ASSERT(output && strcmp(output, "v1 1\nv1 2\n") == 0, "Matching stamps should skip reading the script");
+    free(output);
+    
+    // A new stamp falls back to the content hash
+    test_write_file(script_path, "kcl-for i from 1 to 2; echo v2 $i; kcl-end\n", 2000000);
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Edited scripts should miss the cache");
+    output = test_kcl_file_output(ctx, script_path);
+    TEST_ASSERT(output && strcmp(output, "v2 1\nv2 2\n") == 0, "Edited scripts should be compiled again");
+    free(output);
+    test_write_file(script_path, "kcl-for i from 1 to 2; echo v2 $i; kcl-end\n", 3000000);
+    TEST_ASSERT(test_kcl_cache_accepts(cache_dir, script_path), "Touched scripts should keep their artifact");
+    TEST_ASSERT(test_kcl_cache_accepts(cache_dir, script_path), "Touched scripts should be restamped");
+    
+    // Damaged artifacts are refused and replaced
+    KCLSourceStamp stamp;
+    kcl_source_stamp(script_path, &stamp);
+    KCLProgram* program = kcl_bytecode_load(cache_dir, script_path, &stamp, NULL);
+    TEST_ASSERT(program != NULL, "Artifact should load");
+    long code_offset = (long)((const char*)program->code - (const char*)program->mapping);
+    kcl_program_destroy(program);
+    FILE* file = fopen(artifact, "r+b");
+    TEST_ASSERT(file != NULL, "Artifact should open");
+    fseek(file, code_offset, SEEK_SET);
+    fputc(0xEE, file);
+    fclose(file);
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Artifacts with invalid bytecode should be refused");
+    uint32_t underflow = KCL_INSTRUCTION(KCL_OP_CONST, 0);
+    file = fopen(artifact, "r+b");
+    TEST_ASSERT(file != NULL, "Artifact should open");
+    fseek(file, code_offset, SEEK_SET);
+    fwrite(&underflow, sizeof(underflow), 1, file);
+    fclose(file);
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Artifacts that use an empty stack should be refused");
+    OutputBuffer bytes;
+    output_buffer_init(&bytes);
+    file = fopen(artifact, "rb");
+    TEST_ASSERT(file != NULL, "Artifact should open");
+    output_buffer_read_file(&bytes, file);
+    fclose(file);
+    file = fopen(artifact, "wb");
+    TEST_ASSERT(file != NULL && bytes.length > 4, "Artifact should be rewritten");
+    fwrite(bytes.data, 1, bytes.length - 4, file);
+    fclose(file);
+    output_buffer_free(&bytes);
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Truncated artifacts should be refused");
+    test_write_file(artifact, "not bytecode at all, but long enough to hold a header ........................................................................................", 0);
+    TEST_ASSERT(!test_kcl_cache_accepts(cache_dir, script_path), "Foreign files should be refused");
+    output = test_kcl_file_output(ctx, script_path);
+    TEST_ASSERT(output && strcmp(output, "v2 1\nv2 2\n") == 0, "Scripts with bad artifacts should still run");
+    free(output);
+    TEST_ASSERT(test_kcl_cache_accepts(cache_dir, script_path), "Bad artifacts should be rewritten");
+    
+    // Whatever the compiler emits passes the verifier, nested item loops included
+    kcl_source_stamp(script_path, &stamp);
+    for (size_t i = 0; i <= sizeof(test_kcl_cases) / sizeof(test_kcl_cases[0]); i++) {
+        const char* text = i ? test_kcl_cases[i - 1].script : "kcl-for a in x y; kcl-for b in 1 $a 3; kcl-if $b == x; echo $a; kcl-end; kcl-end; kcl-end";
+        program = test_kcl_compile(text);
+        TEST_ASSERT(program && kcl_bytecode_store(cache_dir, script_path, &stamp, text, program), "Compiled programs should be stored");
+        kcl_program_destroy(program);
+        TEST_ASSERT(test_kcl_cache_accepts(cache_dir, script_path), "Compiled programs should pass verification");
+    }
+    
+    // Strings run again come from the in-memory cache
+    ExecutionResult* result = kcl_execute_string(ctx, "echo again");
+    execution_result_destroy(result);
+    program = kcl_program_cache_take(ctx->programs, "echo again");
+    TEST_ASSERT(program != NULL && kcl_program_cache_take(ctx->programs, "echo again") == NULL, "Strings should be cached once run");
+    kcl_program_cache_put(ctx->programs, "echo again", program);
+    result = kcl_execute_string(ctx, "echo again");
+    TEST_ASSERT(result && result->output && strcmp(result->output, "again\n") == 0, "Cached strings should run");
+    execution_result_destroy(result);
+    
+    KCLProgramCache* cache = kcl_program_cache_create(2);
+    kcl_program_cache_put(cache, "a", test_kcl_compile("echo a"));
+    kcl_program_cache_put(cache, "b", test_kcl_compile("echo b"));
+    kcl_program_cache_put(cache, "a", kcl_program_cache_take(cache, "a"));
+    kcl_program_cache_put(cache, "c", test_kcl_compile("echo c"));
+    TEST_ASSERT(kcl_program_cache_take(cache, "b") == NULL, "The least recently used program should be evicted");
+    program = kcl_program_cache_take(cache, "a");
+    TEST_ASSERT(program != NULL, "Recently used programs should stay cached");
+    kcl_program_destroy(program);
+    kcl_program_cache_destroy(cache);
+    
+    remove(artifact);
+    free(artifact);
+    remove(script_path);
+    rmdir(cache_dir);
+    *strrchr(cache_dir, '/') = '\0';
+    rmdir(cache_dir);
+    kcl_context_destroy(ctx);
+    kernel_shutdown(kernel);
+    
+    TEST_PASS();
+}
+
+// Compiled scripts must behave exactly like interpreted ones
+void test_kcl_aot(void) {
+    TEST_START("KCL Native Compilation");
+    
+    // Each literal command name is resolved once per run, and a variable that
+    // only ever holds integers becomes a long
+    KCLScript* script = kcl_parse("kcl-set label run; kcl-for i from 1 to 3; kargs $label $i; kargs x; kcl-end");
+    char* generated = kcl_aot_generate(script);
+    kcl_script_destroy(script);
+    TEST_ASSERT(generated && strstr(generated, "kcl_native_main") != NULL, "Parsed scripts should generate code");
+    const char* resolve = strstr(generated, "api->resolve(");
+    bool resolved_once = resolve && !strstr(resolve + 1, "api->resolve(");
+    bool typed = strstr(generated, "long v1") && strstr(generated, "std::string v0");
+    free(generated);
+    TEST_ASSERT(resolved_once, "Each command name should be resolved once");
+    TEST_ASSERT(typed, "Loop counters should be integers and other variables strings");
+    
+    char cache_dir[256];
+    snprintf(cache_dir, sizeof(cache_dir), "/tmp/kurono_kcl_cache_%d/nested", (int)getpid());
+    
+    char* error = NULL;
+    KCLNativeScript* probe = kcl_aot_compile("echo probe", cache_dir, &error);
+    if (!probe) {
+        // Hosts without a C++ compiler keep interpreting every script
+        printf("(skipped: %s) ", error ? error : "no compiler");
+        free(error);
+        TEST_PASS();
+        return;
+    }
+    kcl_aot_unload(probe);
+    
+    KernelContext* kernel = kernel_init();
+    KCLContext* ctx = kcl_context_create(kernel);
+    TEST_ASSERT(ctx != NULL, "KCL context should not be NULL");
+    TEST_ASSERT(kernel_update_registry(test_add_kcl_commands, ctx), "Test commands should register");
+    KernelEnvironmentHandlers previous = *kernel_get_handlers(ENV_KURONO);
+    kernel_register_executor(ENV_KURONO, test_kcl_executor, NULL);
+    
+    char* source = kcl_aot_generate(NULL);
+    TEST_ASSERT(source == NULL, "Nothing should be generated without a script");
+    
+    for (size_t i = 0; i < sizeof(test_kcl_cases) / sizeof(test_kcl_cases[0]); i++) {
+        const char* text = test_kcl_cases[i].script;
+        KCLNativeScript* native = kcl_aot_compile(text, cache_dir, &error);
+        TEST_ASSERT(native != NULL, error ? error : "Script should compile");
+    
+        OutputCapture capture;
+        output_capture_init(&capture);
+        int status = kcl_aot_run(native, ctx, &capture.sink);
+        bool matches = status == test_kcl_cases[i].status &&
+                       strcmp(capture.output.data ? capture.output.data : "", test_kcl_cases[i].output) == 0;
+        ExecutionResult* interpreted = test_kcl_run(ctx, text);
+        bool same_errors = interpreted && strcmp(capture.error.data ? capture.error.data : "", interpreted->error ? interpreted->error : "") == 0;
+        output_capture_finish(&capture, NULL);
+        execution_result_destroy(interpreted);
+        kcl_aot_unload(native);
+    
+        TEST_ASSERT(matches, "Compiled output and status should match the interpreter");
+        TEST_ASSERT(same_errors, "Compiled scripts should report errors like the interpreter");
+    }
+    
+    // Names a compiled script only reads come from the context as well
+    const char* imports = "echo [$kcl_host]; kcl-for i from 1 to 2; echo $kcl_host$i; kcl-end";
+    TEST_ASSERT(kcl_set_variable(ctx, "kcl_host", "kurono"), "Context variables should be stored");
+    KCLNativeScript* importing = kcl_aot_compile(imports, cache_dir, &error);
+    TEST_ASSERT(importing != NULL, error ? error : "Script should compile");
+    OutputCapture imported;
+    output_capture_init(&imported);
+    TEST_ASSERT(kcl_aot_run(importing, ctx, &imported.sink) == 0, "Compiled script should run");
+    ExecutionResult* interpreted = test_kcl_run(ctx, imports);
+    TEST_ASSERT(imported.output.data && interpreted && strcmp(imported.output.data, "[kurono]\nkurono1\nkurono2\n") == 0 &&
+                strcmp(imported.output.data, interpreted->output) == 0, "Compiled scripts should read context variables like the interpreter");
+    output_capture_finish(&imported, NULL);
+    execution_result_destroy(interpreted);
+    kcl_aot_unload(importing);
+    char* imports_artifact = kcl_aot_cache_path(imports, cache_dir);
+    remove(imports_artifact);
+    free(imports_artifact);
+    
+    // kcl_execute_file picks up the cached artifact for the same text only
+    char script_path[256];
+    snprintf(script_path, sizeof(script_path), "/tmp/kurono_kcl_script_%d.kcl", (int)getpid());
+    FILE* file = fopen(script_path, "w");
+    TEST_ASSERT(file != NULL, "Should create script file");
+    fputs(test_kcl_cases[1].script, file);
+    fclose(file);
+    
+    TEST_ASSERT(kcl_context_set_native_cache(ctx, cache_dir), "Native cache should be configurable");
+    KCLNativeScript* cached = kcl_aot_load(test_kcl_cases[1].script, cache_dir);
+    TEST_ASSERT(cached != NULL, "Compiled scripts should load from the cache");
+    kcl_aot_unload(cached);
+    TEST_ASSERT(kcl_aot_load("echo edited", cache_dir) == NULL, "Edited scripts should miss the cache");
+    
+    char* artifact_path = kcl_aot_cache_path(test_kcl_cases[1].script, cache_dir);
+    chmod(artifact_path, 0720);
+    TEST_ASSERT(kcl_aot_load(test_kcl_cases[1].script, cache_dir) == NULL, "Group-writable artifacts should not load");
+    chmod(artifact_path, 0700);
+    chmod(cache_dir, 0777);
+    TEST_ASSERT(kcl_aot_load(test_kcl_cases[1].script, cache_dir) == NULL, "Artifacts in world-writable directories should not load");
+    char* refused = NULL;
+    TEST_ASSERT(kcl_aot_compile(test_kcl_cases[1].script, cache_dir, &refused) == NULL, "Untrusted caches should not load fresh builds");
+    TEST_ASSERT(refused && strstr(refused, "writable by other users"), "Refused artifacts should say why");
+    free(refused);
+    chmod(cache_dir, 0700);
+    cached = kcl_aot_load(test_kcl_cases[1].script, cache_dir);
+    TEST_ASSERT(cached != NULL, "Restored permissions should load again");
+    kcl_aot_unload(cached);
+    free(artifact_path);
+    
+    ExecutionResult* result = kcl_execute_file(ctx, script_path);
+    TEST_ASSERT(result && result->exit_code == 0 && result->output && strcmp(result->output, test_kcl_cases[1].output) == 0, "Cached scripts should run from files");
+    execution_result_destroy(result);
+    
+    char* bad = NULL;
+    TEST_ASSERT(kcl_aot_compile("kcl-if a ==", cache_dir, &bad) == NULL && bad != NULL, "Invalid scripts should not compile");
+    free(bad);
+    
+    remove(script_path);
+    for (size_t i = 0; i <= sizeof(test_kcl_cases) / sizeof(test_kcl_cases[0]); i++) {
+        char* artifact = kcl_aot_cache_path(i ? test_kcl_cases[i - 1].script : "echo probe", cache_dir);
+        remove(artifact);
+        free(artifact);
+    }
+    rmdir(cache_dir);
+    *strrchr(cache_dir, '/') = '\0';
+    rmdir(cache_dir);
+    
+    kernel_register_executor(ENV_KURONO, previous.executor, previous.executor_userdata);
+    kcl_context_destroy(ctx);
+    kernel_shutdown(kernel);
+    
+    TEST_PASS();
+}
+
 void test_conflict_resolver(void) {
     TEST_START("Conflict Resolver");
     
@@ -173,11 +1947,13 @@ void test_security_engine(void) {
 void test_package_manager(void) {
     TEST_START("Package Manager");
     
+    KernelContext* kernel = kernel_init();
     PackageManager* pm = package_manager_create("/tmp/test_packages");
     TEST_ASSERT(pm != NULL, "Package manager should not be NULL");
     
     bool installed = package_manager_install(pm, "test-package");
     TEST_ASSERT(installed, "Should install package successfully");
+    TEST_ASSERT(kernel_detect_environment("test-package") == ENV_KURONO, "Install should publish the package command");
     
     Package* pkg = package_manager_get_package(pm, "test-package");
     TEST_ASSERT(pkg != NULL, "Should retrieve installed package");
@@ -194,8 +1970,164 @@ void test_package_manager(void) {
     
     pkg = package_manager_get_package(pm, "test-package");
     TEST_ASSERT(pkg == NULL, "Package should no longer exist");
+    TEST_ASSERT(kernel_detect_environment("test-package") == ENV_UNKNOWN, "Remove should unpublish the package command");
+    
+    // Only the package's own entry goes; other names and environments stay
+    CommandRegistry* registry = command_registry_create();
+    command_registry_add(registry, "shared", "/usr/bin/shared", ENV_LINUX, "Linux command");
+    command_registry_add(registry, "shared", "shared", ENV_KURONO, "Kurono command");
+    command_registry_add(registry, "other", "other", ENV_KURONO, "Kurono command");
+    TEST_ASSERT(kernel_attach_registry(kernel, registry), "Registry should attach");
+    TEST_ASSERT(package_manager_install(pm, "shared") && package_manager_remove(pm, "shared"), "Shadowed package should install and remove");
+    CommandView shared = command_registry_lookup(kernel_get_registry(kernel), "shared");
+    TEST_ASSERT(shared.count == 1 && shared.entries[0]->env == ENV_LINUX, "Remove should keep other environments' entries");
+    TEST_ASSERT(kernel_detect_environment("other") == ENV_KURONO, "Remove should keep other commands");
+    TEST_ASSERT(kernel_get_registry(kernel)->count == 2, "Remove should drop exactly one entry");
     
     package_manager_destroy(pm);
+    kernel_shutdown(kernel);
+    
+    TEST_PASS();
+}
+
+static bool test_add_versioned(CommandRegistry* registry, void* userdata) {
+    command_registry_add(registry, (const char*)userdata, (const char*)userdata, ENV_KURONO, "Versioned command");
+    return true;
+}
+
+static void test_build_snapshot(CommandRegistry* registry, void* userdata) {
+    command_registry_add(registry, "rebuilt", "/bin/rebuilt", ENV_LINUX, "Found by discovery");
+}
+
+static bool test_merge_snapshot(CommandRegistry* next, const CommandRegistry* rebuilt, void* userdata) {
+    command_registry_add(next, "rebuilt", "/bin/rebuilt", ENV_LINUX, "Found by discovery");
+    return command_registry_lookup(rebuilt, "rebuilt").count == 1;
+}
+
+void test_registry_snapshot(void) {
+    TEST_START("Registry Snapshot");
+    
+    const char* source_dir = "/tmp/test_snapshot_src";
+    const char* snapshot_path = "/tmp/test_registry.snap";
+#ifdef _WIN32
+    _mkdir(source_dir);
+#else
+    mkdir(source_dir, 0755);
+#endif
+    
+    struct utimbuf times = { 1000000, 1000000 };
+    utime(source_dir, &times);
+    
+    RegistrySnapshotSources sources;
+    registry_snapshot_sources_init(&sources);
+    registry_snapshot_sources_add(&sources, source_dir);
+    
+    CommandRegistry* registry = command_registry_create();
+    command_registry_add(registry, "test", "/bin/test", ENV_LINUX, "Linux test");
+    command_registry_add(registry, "test", "test.exe", ENV_WINDOWS, "Windows test");
+    command_registry_add(registry, "test", "test.kc", ENV_KURONO, "Kurono test");
+    command_registry_add_template(registry, "grep", "/bin/grep", ENV_LINUX, "Linux command: %s");
+    
+    bool saved = registry_snapshot_save(registry, snapshot_path, &sources);
+    TEST_ASSERT(saved, "Snapshot should be written");
+    command_registry_destroy(registry);
+    
+    CommandRegistry* loaded = registry_snapshot_load(snapshot_path, &sources, NULL);
+    TEST_ASSERT(loaded != NULL, "Fresh snapshot should load");
+    TEST_ASSERT(loaded->count == 4, "Snapshot should restore every entry");
+    
+    CommandView view = command_registry_lookup(loaded, "test");
+    TEST_ASSERT(view.count == 3, "Snapshot should restore conflict groups");
+    TEST_ASSERT(view.entries[1]->env == ENV_WINDOWS && strcmp(view.entries[1]->path, "test.exe") == 0, "Group order should survive");
+    
+    char description[64];
+    command_entry_format_description(command_registry_lookup(loaded, "grep").entries[0], description, sizeof(description));
+    TEST_ASSERT(strcmp(description, "Linux command: grep") == 0, "Templates should survive");
+    
+    command_registry_add(loaded, "test", "/usr/bin/test", ENV_LINUX, "Another test");
+    command_registry_add(loaded, "fresh", "/bin/fresh", ENV_LINUX, "Added after load");
+    TEST_ASSERT(command_registry_lookup(loaded, "test").count == 4, "Loaded groups should accept new entries");
+    TEST_ASSERT(command_registry_lookup(loaded, "fresh").count == 1, "Loaded index should accept new names");
+    TEST_ASSERT(command_registry_lookup(loaded, "grep").count == 1, "Existing names should still resolve");
+    command_registry_destroy(loaded);
+    
+    // Any change to a source's mtime makes the snapshot stale
+    times.modtime = 2000000;
+    utime(source_dir, &times);
+    TEST_ASSERT(registry_snapshot_load(snapshot_path, &sources, NULL) == NULL, "Stale snapshot should be rejected");
+    
+    // Callers that rebuild in the background may start from it anyway
+    bool stale = false;
+    loaded = registry_snapshot_load(snapshot_path, &sources, &stale);
+    TEST_ASSERT(loaded != NULL && stale, "Stale snapshot should load when asked for");
+    TEST_ASSERT(loaded && loaded->count == 4, "Stale snapshot should restore every entry");
+    command_registry_destroy(loaded);
+    
+    // A rebuild is saved fresh and merged into the published version
+    KernelContext* kernel = kernel_init();
+    TEST_ASSERT(kernel_update_registry(test_add_versioned, (void*)"packaged"), "Boot registry should publish");
+    TEST_ASSERT(registry_snapshot_rebuild_async(snapshot_path, &sources, test_build_snapshot, test_merge_snapshot, NULL), "Rebuild should start");
+    registry_snapshot_wait();
+    TEST_ASSERT(kernel_detect_environment("rebuilt") == ENV_LINUX, "Rebuilt commands should be published");
+    TEST_ASSERT(kernel_detect_environment("packaged") == ENV_KURONO, "Merge should keep the published commands");
+    stale = true;
+    loaded = registry_snapshot_load(snapshot_path, &sources, &stale);
+    TEST_ASSERT(loaded != NULL && !stale && loaded->count == 1, "Rebuild should save a fresh snapshot");
+    command_registry_destroy(loaded);
+    kernel_shutdown(kernel);
+    
+    remove(snapshot_path);
+    
+    TEST_PASS();
+}
+
+static bool test_reject_update(CommandRegistry* registry, void* userdata) {
+    command_registry_add(registry, "rejected", "rejected", ENV_KURONO, "Never published");
+    return false;
+}
+
+void test_registry_versions(void) {
+    TEST_START("Registry Versions");
+    
+    KernelContext* kernel = kernel_init();
+    TEST_ASSERT(kernel_update_registry(test_add_versioned, (void*)"alpha"), "Update should publish a new version");
+    
+    // A pinned version survives later updates unchanged
+    KernelRegistryGuard pinned;
+    CommandRegistry* old_version = kernel_registry_acquire(&pinned);
+    TEST_ASSERT(command_registry_lookup(old_version, "alpha").count == 1, "Pinned version should see earlier updates");
+    TEST_ASSERT(kernel_update_registry(test_add_versioned, (void*)"beta"), "Update should not wait for readers");
+    TEST_ASSERT(kernel_get_registry(kernel) != old_version, "Update should publish a different version");
+    TEST_ASSERT(command_registry_lookup(old_version, "beta").count == 0, "Pinned version should not change");
+    TEST_ASSERT(strcmp(command_registry_lookup(old_version, "alpha").entries[0]->name, "alpha") == 0, "Pinned entries should stay readable");
+    TEST_ASSERT(kernel_update_registry(test_add_versioned, (void*)"gamma"), "Further updates should publish");
+    kernel_registry_release(&pinned);
+    
+    KernelRegistryGuard current;
+    CommandRegistry* latest = kernel_registry_acquire(&current);
+    TEST_ASSERT(command_registry_lookup(latest, "beta").count == 1 && command_registry_lookup(latest, "gamma").count == 1, "New readers should see the latest version");
+    kernel_registry_release(&current);
+    
+    TEST_ASSERT(!kernel_update_registry(test_reject_update, NULL), "Rejected update should report failure");
+    TEST_ASSERT(kernel_detect_environment("rejected") == ENV_UNKNOWN, "Rejected update should not be published");
+    TEST_ASSERT(kernel_detect_environment("gamma") == ENV_KURONO, "Environment detection should read the latest version");
+    
+    // Lookups from the job pool run while the registry keeps changing
+    KernelJob* jobs[64];
+    char names[64][32];
+    for (int i = 0; i < 64; i++) {
+        jobs[i] = kernel_submit_command(kernel, "alpha", NULL);
+        snprintf(names[i], sizeof(names[i]), "pkg-%d", i);
+        TEST_ASSERT(kernel_update_registry(test_add_versioned, names[i]), "Concurrent update should publish");
+    }
+    for (int i = 0; i < 64; i++) {
+        ExecutionResult* result = kernel_job_wait(jobs[i]);
+        TEST_ASSERT(result && result->result == CMD_SUCCESS, "Lookups should succeed during updates");
+        execution_result_destroy(result);
+    }
+    TEST_ASSERT(kernel_get_registry(kernel)->count == 67, "Every update should be kept");
+    
+    kernel_shutdown(kernel);
     
     TEST_PASS();
 }
@@ -230,6 +2162,7 @@ void test_integration(void) {
     PackageManager* pm = package_manager_create("/tmp/test_integration");
     TEST_ASSERT(pm != NULL, "Package manager should create");
     package_manager_register_kurono_packages(pm, registry);
+    TEST_ASSERT(command_registry_lookup(registry, "kcl-core").count == 1, "Default packages should be added to the given registry");
     
     // Test cross-environment command execution
     size_t count = 0;
@@ -263,6 +2196,53 @@ void test_integration(void) {
     TEST_PASS();
 }
 
+typedef struct {
+    const char* name;
+    uint8_t min_args;
+    uint8_t max_args;
+} TestBuiltin;
+
+static constexpr TestBuiltin test_builtins[] = {
+    { "help", 0, 1 },
+    { "env", 0, 0 },
+    { "switch", 1, 1 },
+    { "kcl", 1, KURONO_BUILTIN_ARGS_ANY },
+    { "kcl-compile", 1, KURONO_BUILTIN_ARGS_ANY },
+    { "linux-sync-create-user", 1, 2 },
+    { "linux-sync-delete-user", 1, 1 },
+};
+
+static constexpr auto test_builtin_index = perfect_hash_build<PERFECT_HASH_SLOTS(test_builtins)>(test_builtins);
+static_assert(test_builtin_index.complete, "Test built-ins should hash perfectly");
+
+void test_builtin_dispatch(void) {
+    TEST_START("Built-in Dispatch");
+    
+    const char* args = NULL;
+    for (size_t i = 0; i < sizeof(test_builtins) / sizeof(test_builtins[0]); i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "%s%s", test_builtins[i].name, test_builtins[i].min_args ? " arg" : "");
+        TEST_ASSERT(kurono_builtin_find(test_builtin_index, test_builtins, line, &args) == &test_builtins[i], "Every built-in should resolve to its own entry");
+    }
+    
+    TEST_ASSERT(kurono_builtin_find(test_builtin_index, test_builtins, "linux-sync-create-user alice admin", &args) == &test_builtins[5], "Names should match on the whole first word");
+    TEST_ASSERT(strcmp(args, "alice admin") == 0, "Args should start after the name");
+    TEST_ASSERT(kurono_builtin_find(test_builtin_index, test_builtins, "switch \t linux", &args) && strcmp(args, "linux") == 0, "Whitespace before args should be skipped");
+    TEST_ASSERT(kurono_builtin_find(test_builtin_index, test_builtins, "kcl my script.kcl", &args) && strcmp(args, "my script.kcl") == 0, "Variadic built-ins should take the rest of the line");
+    
+    // Prefixes, extensions and wrong arities fall through to the registry
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, "kcl-", &args), "Prefixes of a built-in should not match");
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, "envx", &args), "Extended names should not match");
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, "env FOO=1 ls", &args), "Too many args should not match");
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, "switch", &args), "Missing args should not match");
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, "linux-sync-delete-user bob extra", &args), "Arity should be checked");
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, "", &args), "Empty lines should not match");
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, " env", &args), "The name should start the line");
+    TEST_ASSERT(!kurono_builtin_find(test_builtin_index, test_builtins, "ls -la", &args), "Other commands should not match");
+    
+    TEST_PASS();
+}
+
 void run_all_tests(void) {
     printf("\n");
     printf("╔══════════════════════════════════════════════════════════════════════════════╗\n");
@@ -272,11 +2252,30 @@ void run_all_tests(void) {
     
     test_kernel_core();
     test_linux_bridge();
+    test_linux_execution();
+    test_linux_path_cache();
+    test_linux_discovery();
+    test_pipeline();
+    test_kernel_jobs();
+    test_daemon();
+    test_batch();
+    test_builtin_dispatch();
+    test_command_sets();
+    test_command_args();
+    test_result_pool();
     test_windows_bridge();
     test_kcl_interpreter();
+    test_kcl_scripts();
+    test_kcl_ast();
+    test_kcl_vm();
+    test_kcl_variables();
+    test_kcl_cache();
+    test_kcl_aot();
     test_conflict_resolver();
     test_security_engine();
     test_package_manager();
+    test_registry_snapshot();
+    test_registry_versions();
     test_integration();
     
     printf("\n");
@@ -302,16 +2301,54 @@ int main(int argc, char* argv[]) {
             test_kernel_core();
         } else if (strcmp(argv[1], "--test-linux") == 0) {
             test_linux_bridge();
+        } else if (strcmp(argv[1], "--test-linux-exec") == 0) {
+            test_linux_execution();
+        } else if (strcmp(argv[1], "--test-path-cache") == 0) {
+            test_linux_path_cache();
+        } else if (strcmp(argv[1], "--test-discovery") == 0) {
+            test_linux_discovery();
+        } else if (strcmp(argv[1], "--test-pipeline") == 0) {
+            test_pipeline();
+        } else if (strcmp(argv[1], "--test-jobs") == 0) {
+            test_kernel_jobs();
+        } else if (strcmp(argv[1], "--test-daemon") == 0) {
+            test_daemon();
+        } else if (strcmp(argv[1], "--test-batch") == 0) {
+            test_batch();
+        } else if (strcmp(argv[1], "--test-builtins") == 0) {
+            test_builtin_dispatch();
+        } else if (strcmp(argv[1], "--test-command-sets") == 0) {
+            test_command_sets();
+        } else if (strcmp(argv[1], "--test-command-args") == 0) {
+            test_command_args();
+        } else if (strcmp(argv[1], "--test-result-pool") == 0) {
+            test_result_pool();
         } else if (strcmp(argv[1], "--test-windows") == 0) {
             test_windows_bridge();
         } else if (strcmp(argv[1], "--test-kcl") == 0) {
             test_kcl_interpreter();
+        } else if (strcmp(argv[1], "--test-kcl-scripts") == 0) {
+            test_kcl_scripts();
+        } else if (strcmp(argv[1], "--test-kcl-ast") == 0) {
+            test_kcl_ast();
+        } else if (strcmp(argv[1], "--test-kcl-vm") == 0) {
+            test_kcl_vm();
+        } else if (strcmp(argv[1], "--test-kcl-variables") == 0) {
+            test_kcl_variables();
+        } else if (strcmp(argv[1], "--test-kcl-cache") == 0) {
+            test_kcl_cache();
+        } else if (strcmp(argv[1], "--test-kcl-aot") == 0) {
+            test_kcl_aot();
         } else if (strcmp(argv[1], "--test-conflicts") == 0) {
             test_conflict_resolver();
         } else if (strcmp(argv[1], "--test-security") == 0) {
             test_security_engine();
         } else if (strcmp(argv[1], "--test-packages") == 0) {
             test_package_manager();
+        } else if (strcmp(argv[1], "--test-snapshot") == 0) {
+            test_registry_snapshot();
+        } else if (strcmp(argv[1], "--test-registry-rcu") == 0) {
+            test_registry_versions();
         } else if (strcmp(argv[1], "--test-integration") == 0) {
             test_integration();
         } else {
@@ -327,11 +2364,30 @@ int main(int argc, char* argv[]) {
     printf("  --test              Run all tests\n");
     printf("  --test-kernel       Test kernel core\n");
     printf("  --test-linux        Test Linux bridge\n");
+    printf("  --test-linux-exec   Test Linux command execution\n");
+    printf("  --test-path-cache   Test Linux path resolution cache\n");
+    printf("  --test-discovery    Test Linux command discovery\n");
+    printf("  --test-pipeline     Test cross-environment pipelines\n");
+    printf("  --test-jobs         Test concurrent kernel jobs\n");
+    printf("  --test-daemon       Test daemon sessions over a Unix socket\n");
+    printf("  --test-batch        Test batch command files\n");
+    printf("  --test-builtins     Test shell built-in dispatch\n");
+    printf("  --test-command-sets Test static command list membership\n");
+    printf("  --test-command-args Test command-line tokenizer\n");
+    printf("  --test-result-pool  Test pooled, allocation-free results\n");
     printf("  --test-windows      Test Windows bridge\n");
     printf("  --test-kcl          Test KCL interpreter\n");
+    printf("  --test-kcl-scripts  Test KCL language semantics\n");
+    printf("  --test-kcl-ast      Test KCL syntax tree layout and allocation\n");
+    printf("  --test-kcl-vm       Test KCL bytecode compilation and execution\n");
+    printf("  --test-kcl-variables Test the KCL variable store and script frames\n");
+    printf("  --test-kcl-cache    Test the KCL bytecode caches\n");
+    printf("  --test-kcl-aot      Test KCL native compilation\n");
     printf("  --test-conflicts    Test conflict resolver\n");
     printf("  --test-security     Test security engine\n");
     printf("  --test-packages     Test package manager\n");
+    printf("  --test-snapshot     Test registry snapshot\n");
+    printf("  --test-registry-rcu Test published registry versions\n");
     printf("  --test-integration  Test full integration\n");
     
     return 0;
@@ -1,11 +1,12 @@
 #include "windows_bridge.h"
+#include "perfect_hash.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <windows.h>
 
-static const char* common_windows_commands[] = {
+static constexpr const char* common_windows_commands[] = {
     "dir", "copy", "move", "del", "type", "cd", "md", "rd", "cls", "echo",
     "set", "path", "ver", "date", "time", "tasklist", "taskkill", "net",
     "ipconfig", "ping", "tracert", "netstat", "nslookup", "systeminfo",
@@ -13,10 +14,9 @@ static const char* common_windows_commands[] = {
     "diskpart", "sfc", "chkdsk", "defrag", "format", "label", "vol",
     "assoc", "ftype", "attrib", "comp", "fc", "find", "findstr",
     "more", "sort", "tree", "xcopy", "robocopy", "takeown", "icacls",
-    NULL
 };
 
-static const char* common_powershell_commands[] = {
+static constexpr const char* common_powershell_commands[] = {
     "Get-ChildItem", "Get-Content", "Set-Content", "Copy-Item", "Move-Item",
     "Remove-Item", "New-Item", "Get-Process", "Stop-Process", "Start-Process",
     "Get-Service", "Start-Service", "Stop-Service", "Restart-Service",
@@ -24,9 +24,16 @@ static const char* common_powershell_commands[] = {
     "Get-Command", "Get-Help", "Get-Member", "Where-Object", "Select-Object",
     "Sort-Object", "Group-Object", "Measure-Object", "ForEach-Object",
     "If", "Else", "For", "While", "Switch", "Function", "Filter",
-    NULL
 };
 
+#define WINDOWS_COMMON_COMMAND_COUNT (sizeof(common_windows_commands) / sizeof(common_windows_commands[0]))
+#define POWERSHELL_COMMON_COMMAND_COUNT (sizeof(common_powershell_commands) / sizeof(common_powershell_commands[0]))
+
+static constexpr auto common_windows_index = perfect_hash_build<PERFECT_HASH_SLOTS(common_windows_commands)>(common_windows_commands);
+static constexpr auto common_powershell_index = perfect_hash_build<PERFECT_HASH_SLOTS(common_powershell_commands)>(common_powershell_commands);
+static_assert(common_windows_index.complete, "Common Windows commands must be unique");
+static_assert(common_powershell_index.complete, "Common PowerShell commands must be unique");
+
 WindowsBridge* windows_bridge_create(const char* windows_root) {
     if (!windows_root) return NULL;
     
@@ -35,7 +42,7 @@ WindowsBridge* windows_bridge_create(const char* windows_root) {
     
     bridge->system_root = strdup(windows_root);
     bridge->system32_path = (char*)malloc(strlen(windows_root) + 12);
-    bridge->powershell_path = (char*)malloc(strlen(windows_root) + 24);
+    bridge->powershell_path = (char*)malloc(strlen(windows_root) + 34);
     bridge->registry_path = (char*)malloc(strlen(windows_root) + 10);
     
     sprintf(bridge->system32_path, "%s\\System32", windows_root);
@@ -55,25 +62,27 @@ void windows_bridge_destroy(WindowsBridge* bridge) {
     free(bridge);
 }
 
+bool windows_bridge_is_known_command(const char* name) {
+    return perfect_hash_contains(common_windows_index, common_windows_commands, name) ||
+           windows_bridge_is_powershell_command(name);
+}
+
+bool windows_bridge_is_powershell_command(const char* name) {
+    return perfect_hash_contains(common_powershell_index, common_powershell_commands, name);
+}
+
 bool windows_bridge_register_commands(WindowsBridge* bridge, CommandRegistry* registry) {
     if (!bridge || !registry) return false;
     
-    for (int i = 0; common_windows_commands[i] != NULL; i++) {
-        char* full_path = (char*)malloc(strlen(bridge->system32_path) + strlen(common_windows_commands[i]) + 2);
-        sprintf(full_path, "%s\\%s.exe", bridge->system32_path, common_windows_commands[i]);
-        
-        char description[256];
-        snprintf(description, sizeof(description), "Windows command: %s", common_windows_commands[i]);
-        command_registry_add(registry, common_windows_commands[i], full_path, ENV_WINDOWS, description);
-        free(full_path);
+    for (size_t i = 0; i < WINDOWS_COMMON_COMMAND_COUNT; i++) {
+        char full_path[1024];
+        snprintf(full_path, sizeof(full_path), "%s\\%s.exe", bridge->system32_path, common_windows_commands[i]);
+        command_registry_add_template(registry, common_windows_commands[i], full_path, ENV_WINDOWS, "Windows command: %s");
     }
     
-    for (int i = 0; common_powershell_commands[i] != NULL; i++) {
-        char* full_path = strdup(common_powershell_commands[i]);
-        char description[256];
-        snprintf(description, sizeof(description), "PowerShell command: %s", common_powershell_commands[i]);
-        command_registry_add(registry, common_powershell_commands[i], full_path, ENV_WINDOWS, description);
-        free(full_path);
+    // PowerShell cmdlets resolve by name, so the path is the interned name itself
+    for (size_t i = 0; i < POWERSHELL_COMMON_COMMAND_COUNT; i++) {
+        command_registry_add_template(registry, common_powershell_commands[i], common_powershell_commands[i], ENV_WINDOWS, "PowerShell command: %s");
     }
     
     return true;
@@ -82,7 +91,10 @@ bool windows_bridge_register_commands(WindowsBridge* bridge, CommandRegistry* re
 bool windows_bridge_execute_command(WindowsBridge* bridge, const char* command, char** output, char** error) {
     if (!bridge || !command) return false;
     
-    if (strncmp(command, "Get-", 4) == 0 || strncmp(command, "Set-", 4) == 0 || 
+    // Known cmdlets and keywords go to PowerShell as well as the verb prefixes
+    size_t name_length = strcspn(command, " ");
+    bool known_cmdlet = perfect_hash_find(common_powershell_index, common_powershell_commands, command, name_length) >= 0;
+    if (known_cmdlet || strncmp(command, "Get-", 4) == 0 || strncmp(command, "Set-", 4) == 0 || 
         strncmp(command, "New-", 4) == 0 || strncmp(command, "Remove-", 7) == 0 ||
         strncmp(command, "If ", 3) == 0 || strncmp(command, "For ", 4) == 0 ||
         strncmp(command, "While ", 6) == 0 || strncmp(command, "Function ", 9) == 0) {
@@ -146,35 +158,57 @@ bool windows_bridge_execute_pe(WindowsBridge* bridge, const char* pe_path, char*
     return true;
 }
 
-bool windows_bridge_execute_powershell(WindowsBridge* bridge, const char* script, char** output, char** error) {
-    if (!bridge || !script) return false;
+ExecutionResult* windows_bridge_run_powershell(WindowsBridge* bridge, const char* script, OutputSink* sink) {
+    if (!bridge || !script || !sink) return NULL;
+    
+    ExecutionResult* result = execution_result_create();
+    if (!result) return NULL;
     
     char* ps_cmd = (char*)malloc(strlen(script) + 50);
     sprintf(ps_cmd, "powershell -Command \"%s\"", script);
     
     FILE* pipe = _popen(ps_cmd, "r");
+    free(ps_cmd);
     if (!pipe) {
-        if (error) *error = strdup("Failed to execute PowerShell");
-        free(ps_cmd);
-        return false;
+        execution_result_set_static_error(result, "Failed to execute PowerShell");
+        return result;
     }
     
-    char buffer[1024];
-    char* result = (char*)malloc(1);
-    result[0] = '\0';
-    
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL) {
-        result = (char*)realloc(result, strlen(result) + strlen(buffer) + 1);
-        strcat(result, buffer);
+    OutputBuffer chunk;
+    output_buffer_init(&chunk);
+    bool stopped = false;
+    while (!stopped && output_buffer_reserve(&chunk, OUTPUT_BUFFER_READ_SIZE)) {
+        size_t n = fread(chunk.data, 1, OUTPUT_BUFFER_READ_SIZE, pipe);
+        if (n == 0) break;
+        stopped = !sink->write(sink, OUTPUT_STREAM_STDOUT, chunk.data, n);
     }
+    output_buffer_free(&chunk);
     
-    _pclose(pipe);
-    free(ps_cmd);
+    result->exit_code = _pclose(pipe);
+    result->result = (result->exit_code == 0 && !stopped) ? CMD_SUCCESS : CMD_EXECUTION_FAILED;
+    return result;
+}
+
+bool windows_bridge_execute_powershell(WindowsBridge* bridge, const char* script, char** output, char** error) {
+    if (!bridge || !script) return false;
     
-    if (output) *output = result;
-    else free(result);
+    OutputCapture capture;
+    output_capture_init(&capture);
     
-    return true;
+    ExecutionResult* result = windows_bridge_run_powershell(bridge, script, &capture.sink);
+    output_capture_finish(&capture, result);
+    if (!result) return false;
+    
+    bool launched = result->exit_code != -1;
+    if (!launched) {
+        if (error) *error = result->error ? strdup(result->error) : NULL;
+    } else if (output) {
+        *output = execution_result_take_output(result);
+        if (!*output) *output = strdup("");
+    }
+    
+    execution_result_destroy(result);
+    return launched;
 }
 
 bool windows_bridge_is_pe_file(const char* file_path) {
@@ -240,17 +274,13 @@ char* windows_bridge_registry_get(WindowsBridge* bridge, const char* key) {
     
     if (!pipe) return NULL;
     
-    char buffer[1024];
-    char* result = (char*)malloc(1);
-    result[0] = '\0';
-    
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL) {
-        result = (char*)realloc(result, strlen(result) + strlen(buffer) + 1);
-        strcat(result, buffer);
-    }
+    OutputBuffer result;
+    output_buffer_init(&result);
+    output_buffer_read_file(&result, pipe);
     
     _pclose(pipe);
-    return result;
+    char* value = output_buffer_take(&result);
+    return value ? value : strdup("");
 }
 
 bool windows_bridge_registry_delete(WindowsBridge* bridge, const char* key) {
@@ -20,11 +20,16 @@ typedef struct {
 WindowsBridge* windows_bridge_create(const char* windows_root);
 void windows_bridge_destroy(WindowsBridge* bridge);
 
+/* Compile-time perfect hash membership tests against the built-in cmd and
+ * PowerShell command lists. */
+bool windows_bridge_is_known_command(const char* name);
+bool windows_bridge_is_powershell_command(const char* name);
 bool windows_bridge_register_commands(WindowsBridge* bridge, CommandRegistry* registry);
 bool windows_bridge_execute_command(WindowsBridge* bridge, const char* command, char** output, char** error);
 
 bool windows_bridge_execute_pe(WindowsBridge* bridge, const char* pe_path, char** output, char** error);
 bool windows_bridge_execute_powershell(WindowsBridge* bridge, const char* script, char** output, char** error);
+ExecutionResult* windows_bridge_run_powershell(WindowsBridge* bridge, const char* script, OutputSink* sink);
 
 bool windows_bridge_is_pe_file(const char* file_path);
 bool windows_bridge_load_pe(WindowsBridge* bridge, const char* pe_path);